@@ -1,15 +1,78 @@
 #include "adc.h"
-#include <array>
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <linux/i2c-dev.h>
+#include "hal.h"
+#include "timing.h"
+#include "trace.h"
+#include "recorder.h"
+
+//-----------------------------------------------------------------------------
+
+// configuration register bits
+static const uint16_t CFG_COMP_QUE_AFTER1  = 0x00;     // Fire after 1 conversion
+static const uint16_t CFG_COMP_QUE_AFTER2  = 0x01;     // Fire after 2 conversions
+static const uint16_t CFG_COMP_QUE_AFTER4  = 0x02;     // Fire after 4 conversions
+static const uint16_t CFG_COMP_QUE_DISABLE = 0x03;     // Disable comparator
+static const uint16_t CFG_COMP_LAT_ENABLE  = (1<<2);   // Latching comparator
+static const uint16_t CFG_COMP_POL_HIGH    = (1<<3);   // Comparator active high
+static const uint16_t CFG_COMP_MODE_WINDOW = (1<<4);   // Comparator window mode
+static const uint16_t CFG_DATA_RATE_128    = (0<<5);   // 128 samples/s
+static const uint16_t CFG_DATA_RATE_250    = (1<<5);   // 250 samples/s
+static const uint16_t CFG_DATA_RATE_490    = (2<<5);   // 490 samples/s
+static const uint16_t CFG_DATA_RATE_920    = (3<<5);   // 920 samples/s
+static const uint16_t CFG_DATA_RATE_1600   = (4<<5);   // 1600 samples/s (default)
+static const uint16_t CFG_DATA_RATE_2400   = (5<<5);   // 2400 samples/s
+static const uint16_t CFG_DATA_RATE_3300   = (4<<5);   // 3300 samples/s
+static const uint16_t CFG_DATA_RATE_MAX    = (5<<5);   // Also 3300 samples/s
+static const uint16_t CFG_MODE_CONTINUOUS  = (0<<8);   // Continuous conversion
+static const uint16_t CFG_MODE_SINGLE_SHOT = (1<<8);   // Single-shot (default)
+static const uint16_t CFG_PGA_FS_6_144     = (0<<9);   // +/-6.144V
+static const uint16_t CFG_PGA_FS_4_096     = (1<<9);   // +/-4.096V
+static const uint16_t CFG_PGA_FS_2_048     = (2<<9);   // +/-2.048V (default)
+static const uint16_t CFG_PGA_FS_1_024     = (3<<9);   // +/-1.024V
+static const uint16_t CFG_PGA_FS_0_512     = (4<<9);   // +/-0.512V
+static const uint16_t CFG_PGA_FS_0_256     = (5<<9);   // +/-0.256V
+static const uint16_t CFG_OS_BEGIN_CONV    = (1<<15);  // Begin conversion
+static const uint16_t CFG_MUX_A0           = (4<<12);  // A0 single input
+static const uint16_t CFG_MUX_A1           = (5<<12);  // A1 single input
+static const uint16_t CFG_MUX_A2           = (6<<12);  // A2 single input
+static const uint16_t CFG_MUX_A3           = (7<<12);  // A3 single input
+
+// converts integer channel number to bit mask
+static const std::array<uint16_t,ADC::CHANNELS> channelMap{
+    CFG_MUX_A0, CFG_MUX_A1, CFG_MUX_A2, CFG_MUX_A3
+};
+
+// time for the first conversion after selecting an input in continuous
+// mode: a conversion may be in progress when the input changes, so allow
+// two conversion periods (CFG_DATA_RATE_MAX is 2400 samples/s on the
+// ADS1015)
+static const double SETTLE_TIME = 2.0 / 2400.0;
+
+// longest sleep of the sampler, so that a new schedule takes effect promptly
+static const double MAX_WAIT = 0.01;
+
+//-----------------------------------------------------------------------------
+
+/// Convert the conversion register to a voltage (4.096V full scale)
+static double toVoltage( uint16_t result )
+{
+    return static_cast<double>(result) * 4.096 / 32752.0;
+}
 
 //-----------------------------------------------------------------------------
 
 ADC::ADC() :
-    m_file( -1 )
+    m_file( -1 ),
+    m_selected( -1 ),
+    m_sampled( 0 ),
+    m_run( false )
 {
+    for (size_t i=0; i<m_channels.size(); ++i) {
+        m_channels[i].rate = 0.0;
+        m_channels[i].priority = 0;
+        m_channels[i].due = 0.0;
+        m_channels[i].next = 0;
+        m_channels[i].count = 0;
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -26,66 +89,175 @@ bool ADC::open( const std::string & device, unsigned address )
     // close if already open
     close();
 
-    // attempt to open
-    m_file = ::open( device.c_str(), O_RDWR );
+    // attempt to open the device and select the I2C slave address
+    m_file = HAL::i2cOpen( device, address );
+    return ( m_file >= 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+double ADC::getVoltage( unsigned channel )
+{
+    if ( channel >= CHANNELS ) return 0.0;
+
+    // the latest sample, if the channel is sampled in the background
+    Sample latest;
+    if ( getSample( channel, latest ) ) return latest.voltage;
+
+    // lock the mutex (the time spent waiting shows contention in the trace)
+    double waitStart = Trace::now();
+    std::lock_guard<std::mutex> lock( m_mutex );
+    Trace::complete( "adc.wait", waitStart );
+    return convert( channel );
+}
+
+//-----------------------------------------------------------------------------
+
+double ADC::getMeanVoltage( unsigned channel, unsigned count )
+{
+    if ( (channel >= CHANNELS) || (count == 0) ) return 0.0;
+
+    double sum = 0.0;
+    if ( isSampled( channel ) ) {
+        std::lock_guard<std::mutex> lock( m_valueMutex );
+        const Channel & c = m_channels[channel];
+        if ( count > c.count ) count = c.count;
+        for (unsigned i=1; i<=count; ++i)
+            sum += c.samples[(c.next + HISTORY - i) % HISTORY].voltage;
+    } else {
+        for (unsigned i=0; i<count; ++i)
+            sum += getVoltage( channel );
+    }
+    return (count > 0) ? sum / static_cast<double>(count) : 0.0;
+}
+
+//-----------------------------------------------------------------------------
+
+bool ADC::getSample( unsigned channel, Sample & sample ) const
+{
+    if ( !isSampled( channel ) ) return false;
+
+    std::lock_guard<std::mutex> lock( m_valueMutex );
+    const Channel & c = m_channels[channel];
+    if ( c.count == 0 ) return false;
+    sample = c.samples[(c.next + HISTORY - 1) % HISTORY];
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void ADC::setSchedule( unsigned channel, double rate, unsigned priority )
+{
+    if ( channel >= CHANNELS ) return;
+    {
+        std::lock_guard<std::mutex> lock( m_valueMutex );
+        m_channels[channel].priority = priority;
+    }
+    setRate( channel, rate );
+}
+
+//-----------------------------------------------------------------------------
+
+void ADC::setRate( unsigned channel, double rate )
+{
+    if ( channel >= CHANNELS ) return;
+
+    std::lock_guard<std::mutex> lock( m_valueMutex );
+    Channel & c = m_channels[channel];
+    c.rate = (rate > 0.0) ? rate : 0.0;
+
+    // sample straight away at the new rate (the latest sample stays valid
+    // until then), or forget the samples if no longer sampled
+    c.due = getClock();
+    if ( c.rate == 0.0 ) {
+        m_sampled &= ~(1u << channel);
+        c.next = 0;
+        c.count = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool ADC::startSampling()
+{
+    stopSampling();
     if ( m_file < 0 ) return false;
 
-    // select the I2C slave address
-    if ( ioctl( m_file, I2C_SLAVE, address ) < 0 ) {
-        close();
-        return false;
+    // take the first samples here, so that there is always a latest value
+    bool scheduled = false;
+    for (unsigned channel=0; channel<CHANNELS; ++channel) {
+        {
+            std::lock_guard<std::mutex> lock( m_valueMutex );
+            if ( m_channels[channel].rate == 0.0 ) continue;
+        }
+        scheduled = true;
+
+        // on a failure, forget the channels already sampled, so that the
+        // callers fall back to single conversions
+        Sample first;
+        if ( !sample( channel, first.voltage ) ) {
+            stopSampling();
+            return false;
+        }
+        first.time = getClock();
+
+        std::lock_guard<std::mutex> lock( m_valueMutex );
+        store( channel, first );
     }
+    if ( !scheduled ) return false;
 
+    m_run = true;
+    m_thread = startThread( &ADC::sampler, this );
     return true;
 }
 
 //-----------------------------------------------------------------------------
 
-double ADC::getVoltage( unsigned channel )
+void ADC::stopSampling()
+{
+    m_run = false;
+    joinThread( m_thread );
+
+    std::lock_guard<std::mutex> lock( m_valueMutex );
+    m_sampled = 0;
+    for (size_t i=0; i<m_channels.size(); ++i) {
+        m_channels[i].next = 0;
+        m_channels[i].count = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool ADC::isSampled( unsigned channel ) const
+{
+    return (m_sampled & (1u << channel)) != 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void ADC::close()
 {
-    // lock the mutex
+    stopSampling();
+
     std::lock_guard<std::mutex> lock( m_mutex );
+    if ( m_file >= 0 ) {
+        HAL::i2cClose( m_file );
+        m_file = -1;
+    }
+    m_selected = -1;
+}
 
-    // check that the device is open
-    if ( m_file < 0 ) return false;
+//-----------------------------------------------------------------------------
 
-    const uint16_t CFG_COMP_QUE_AFTER1  = 0x00;     // Fire after 1 conversion
-    const uint16_t CFG_COMP_QUE_AFTER2  = 0x01;     // Fire after 2 conversions
-    const uint16_t CFG_COMP_QUE_AFTER4  = 0x02;     // Fire after 4 conversions
-    const uint16_t CFG_COMP_QUE_DISABLE = 0x03;     // Disable comparator
-    const uint16_t CFG_COMP_LAT_ENABLE  = (1<<2);   // Latching comparator
-    const uint16_t CFG_COMP_POL_HIGH    = (1<<3);   // Comparator active high
-    const uint16_t CFG_COMP_MODE_WINDOW = (1<<4);   // Comparator window mode
-    const uint16_t CFG_DATA_RATE_128    = (0<<5);   // 128 samples/s
-    const uint16_t CFG_DATA_RATE_250    = (1<<5);   // 250 samples/s
-    const uint16_t CFG_DATA_RATE_490    = (2<<5);   // 490 samples/s
-    const uint16_t CFG_DATA_RATE_920    = (3<<5);   // 920 samples/s
-    const uint16_t CFG_DATA_RATE_1600   = (4<<5);   // 1600 samples/s (default)
-    const uint16_t CFG_DATA_RATE_2400   = (5<<5);   // 2400 samples/s
-    const uint16_t CFG_DATA_RATE_3300   = (4<<5);   // 3300 samples/s
-    const uint16_t CFG_DATA_RATE_MAX    = (5<<5);   // Also 3300 samples/s
-    const uint16_t CFG_MODE_CONTINUOUS  = (0<<8);   // Continuous conversion
-    const uint16_t CFG_MODE_SINGLE_SHOT = (1<<8);   // Single-shot (default)
-    const uint16_t CFG_PGA_FS_6_144     = (0<<9);   // +/-6.144V
-    const uint16_t CFG_PGA_FS_4_096     = (1<<9);   // +/-4.096V
-    const uint16_t CFG_PGA_FS_2_048     = (2<<9);   // +/-2.048V (default)
-    const uint16_t CFG_PGA_FS_1_024     = (3<<9);   // +/-1.024V
-    const uint16_t CFG_PGA_FS_0_512     = (4<<9);   // +/-0.512V
-    const uint16_t CFG_PGA_FS_0_256     = (5<<9);   // +/-0.256V
-    const uint16_t CFG_OS_BEGIN_CONV    = (1<<15);  // Begin conversion
-    const uint16_t CFG_MUX_A0           = (4<<12);  // A0 single input
-    const uint16_t CFG_MUX_A1           = (5<<12);  // A1 single input
-    const uint16_t CFG_MUX_A2           = (6<<12);  // A2 single input
-    const uint16_t CFG_MUX_A3           = (7<<12);  // A3 single input
-
-    // converts integer channel number to bit mask
-    const std::array<uint16_t,4> channelMap{
-        CFG_MUX_A0, CFG_MUX_A1, CFG_MUX_A2, CFG_MUX_A3
-    };
+double ADC::convert( unsigned channel )
+{
+    Trace::Span span( "adc.convert" );
 
-    if ( channel > channelMap.size() ) return 0.0;
+    // check that the device is open
+    if ( m_file < 0 ) return 0.0;
 
     // initialise config register and start conversion of A0
+    m_selected = -1;
     if ( !writeRegister(
           REG_CONFIG,
           CFG_COMP_QUE_DISABLE  // Disable comparator
@@ -116,21 +288,123 @@ double ADC::getVoltage( unsigned channel )
     }
 
     // convert to voltage
-    return static_cast<double>(result) * 4.096 / 32752.0;
+    double voltage = toVoltage( result );
+    Recorder::record( Recorder::Voltage, channel, voltage );
+    return voltage;
 }
 
 //-----------------------------------------------------------------------------
 
-void ADC::close()
+bool ADC::sample( unsigned channel, double & voltage )
 {
-    if ( m_file > 0 ) {
-        ::close( m_file );
-        m_file = -1;
+    Trace::Span span( "adc.sample" );
+
+    // switch the input, and sleep (rather than poll the bus) until the
+    // first conversion of the new input is ready
+    bool settle = false;
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( m_file < 0 ) return false;
+        if ( m_selected != static_cast<int>( channel ) ) {
+            m_selected = -1;
+            if ( !writeRegister(
+                  REG_CONFIG,
+                  CFG_COMP_QUE_DISABLE  // Disable comparator
+                | CFG_MODE_CONTINUOUS   // Continuous conversion mode
+                | CFG_DATA_RATE_MAX     // Set data rate
+                | CFG_PGA_FS_4_096      // 4.096V full scale
+                | channelMap[channel]   // Select single ended input A0..A3
+            ) ) return false;
+            m_selected = static_cast<int>( channel );
+            settle = true;
+        }
+    }
+    if ( settle ) getClockSource().sleep( SETTLE_TIME );
+
+    // read the conversion register, unless a single-shot conversion has
+    // changed the input meanwhile
+    uint16_t result = 0;
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( m_selected != static_cast<int>( channel ) ) return false;
+        if ( !readRegister( REG_CONVERSION, result ) ) return false;
+    }
+
+    voltage = toVoltage( result );
+    Recorder::record( Recorder::Voltage, channel, voltage );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void ADC::sampler()
+{
+    Trace::setThreadName( "adc" );
+
+    while ( m_run ) {
+        // choose the channel to read: the highest priority of those which
+        // are due, and the one due first of those with the same priority
+        double now = getClock();
+        double wake = now + MAX_WAIT;
+        int channel = -1;
+        {
+            std::lock_guard<std::mutex> lock( m_valueMutex );
+            for (unsigned i=0; i<CHANNELS; ++i) {
+                const Channel & c = m_channels[i];
+                if ( c.rate == 0.0 ) continue;
+                if ( c.due > now ) {
+                    if ( c.due < wake ) wake = c.due;
+                    continue;
+                }
+                if ( channel < 0 ) {
+                    channel = static_cast<int>( i );
+                    continue;
+                }
+                const Channel & best = m_channels[channel];
+                if ( (c.priority > best.priority) ||
+                    ((c.priority == best.priority) && (c.due < best.due)) )
+                    channel = static_cast<int>( i );
+            }
+
+            // schedule the next sample (without catching up if behind)
+            if ( channel >= 0 ) {
+                Channel & c = m_channels[channel];
+                c.due += 1.0 / c.rate;
+                if ( c.due < now ) c.due = now + 1.0 / c.rate;
+            }
+        }
+
+        // sleep until a channel is due
+        if ( channel < 0 ) {
+            getClockSource().sleep( wake - now );
+            continue;
+        }
+
+        Sample latest;
+        if ( !sample( static_cast<unsigned>( channel ), latest.voltage ) )
+            continue;
+        latest.time = getClock();
+
+        std::lock_guard<std::mutex> lock( m_valueMutex );
+        store( static_cast<unsigned>( channel ), latest );
     }
 }
 
 //-----------------------------------------------------------------------------
 
+void ADC::store( unsigned channel, const Sample & sample )
+{
+    Channel & c = m_channels[channel];
+    if ( c.rate == 0.0 ) return;
+
+    c.samples[c.next] = sample;
+    c.next = (c.next + 1) % HISTORY;
+    if ( c.count < HISTORY ) ++c.count;
+    m_sampled |= 1u << channel;
+}
+
+//-----------------------------------------------------------------------------
+
 bool ADC::writeRegister( Register address, uint16_t value )
 {
     // build the command buffer
@@ -141,7 +415,7 @@ bool ADC::writeRegister( Register address, uint16_t value )
     };
 
     // send the command
-    return ( write( m_file, buffer, sizeof(buffer) ) == sizeof(buffer) );
+    return HAL::i2cWrite( m_file, buffer, sizeof(buffer) );
 }
 
 //-----------------------------------------------------------------------------
@@ -153,12 +427,12 @@ bool ADC::readRegister( Register address, uint16_t & value )
 
     // set the pointer register to specify the register address
     uint8_t pointer = static_cast<uint8_t>(address);
-    if ( write( m_file, &pointer, 1 ) != 1 )
+    if ( !HAL::i2cWrite( m_file, &pointer, 1 ) )
         return false;
 
     // read the register (2 bytes)
     uint8_t result[2] = {};
-    if ( read( m_file, result, sizeof(result) ) != sizeof(result) )
+    if ( !HAL::i2cRead( m_file, result, sizeof(result) ) )
         return false;
 
     // return the result
@@ -4,16 +4,38 @@
 //-----------------------------------------------------------------------------
 
 #include <string>
+#include <array>
 #include <mutex>
+#include <thread>
+#include <atomic>
 #include <inttypes.h>
 
 //-----------------------------------------------------------------------------
 
 /**
- * Represents the ADC interface
+ * Represents the ADC interface. Voltages are either converted on demand
+ * (single-shot conversions, waiting for each to complete) or, once sampling
+ * has been started, by a background thread which owns the I2C bus and reads
+ * each scheduled channel at its own rate in continuous conversion mode, so
+ * that readers get the latest timestamped sample straight away without
+ * touching the bus. When several channels are due at once the one with the
+ * highest priority is read first, so a busy low priority channel (such as
+ * the buttons) doesn't delay a high priority one (such as the pressure).
  */
 class ADC {
 public:
+    /// Number of input channels
+    static const unsigned CHANNELS = 4;
+
+    /// Number of recent samples kept for each sampled channel
+    static const unsigned HISTORY = 8;
+
+    /// A sampled voltage
+    struct Sample {
+        double time;    ///< Clock time of the sample (see getClock)
+        double voltage; ///< Voltage
+    };
+
     /// Default constructor
     ADC();
 
@@ -24,9 +46,36 @@ public:
     /// Returns true for success, false in case of failure.
     bool open( const std::string & device, unsigned address );
 
-    /// Read the voltage on the specified channel
+    /// Read the voltage on the specified channel (the latest sample, if the
+    /// channel is being sampled)
     double getVoltage( unsigned channel );
 
+    /// Returns the mean of the latest voltages on a channel (up to HISTORY
+    /// samples, or as many single-shot conversions if it isn't sampled)
+    double getMeanVoltage( unsigned channel, unsigned count );
+
+    /// Returns the latest sample of a channel (false if it isn't sampled)
+    bool getSample( unsigned channel, Sample & sample ) const;
+
+    /// Set how often a channel is sampled in the background, in Hz (0 to
+    /// convert it on demand), and its priority (higher is read first). May
+    /// be called while sampling: a new rate takes effect straight away.
+    void setSchedule( unsigned channel, double rate, unsigned priority );
+
+    /// Change the sampling rate of a channel, keeping its priority
+    void setRate( unsigned channel, double rate );
+
+    /// Start sampling the scheduled channels in the background. Returns
+    /// false if the ADC isn't open, no channel is scheduled or the first
+    /// samples can't be taken (no channel is then sampled).
+    bool startSampling();
+
+    /// Stop sampling (getVoltage then converts on demand again)
+    void stopSampling();
+
+    /// Is the channel being sampled in the background?
+    bool isSampled( unsigned channel ) const;
+
     /// Close the ADC
     void close();
 
@@ -51,11 +100,49 @@ private:
     /// Read register (returns true for success)
     bool readRegister( Register address, uint16_t & value );
 
+    /// Make a single-shot conversion, waiting for it to complete (the mutex
+    /// must be locked)
+    double convert( unsigned channel );
+
+    /// Read the latest continuous conversion of a channel, selecting it
+    /// first if need be (locks the mutex, other than while waiting for the
+    /// conversion). Returns false on failure.
+    bool sample( unsigned channel, double & voltage );
+
+    /// Sampling thread
+    void sampler();
+
+    /// Add a sample to the history of a channel, unless it is no longer
+    /// scheduled (the value mutex must be locked)
+    void store( unsigned channel, const Sample & sample );
+
+    /// Schedule and recent samples of a channel
+    struct Channel {
+        double   rate;      ///< Sample rate in Hz (0 if not sampled)
+        unsigned priority;  ///< Priority (higher is read first)
+        double   due;       ///< Clock time at which the next sample is due
+
+        std::array<Sample, HISTORY> samples;    ///< Samples (a ring)
+        unsigned next;                          ///< Next position in the ring
+        unsigned count;                         ///< Number of samples (to HISTORY)
+    };
+
 private:
-    int m_file;     ///< File for communication with I2C device
+    int m_file;     ///< Handle for communication with I2C device
+    int m_selected; ///< Channel selected for continuous conversion (or -1)
+
+    std::array<Channel, CHANNELS> m_channels;   ///< Schedules and samples
+    std::atomic<unsigned> m_sampled;    ///< Channels with samples (bit mask)
+    std::atomic<bool>     m_run;        ///< Should the sampler continue?
+
+    /// Thread which samples the channels
+    std::thread m_thread;
 
 	/// Mutex to control access to the ADC
 	mutable std::mutex m_mutex;
+
+    /// Mutex to control access to the schedules and samples
+    mutable std::mutex m_valueMutex;
 };
 
 //-----------------------------------------------------------------------------
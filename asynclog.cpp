@@ -0,0 +1,323 @@
+#include "asynclog.h"
+#include "timing.h"
+#include "trace.h"
+#include <string.h>
+#include <sstream>
+
+//-----------------------------------------------------------------------------
+
+/// polling period of the writer thread in milliseconds
+static const unsigned WRITER_PERIOD = 50;
+
+//-----------------------------------------------------------------------------
+
+AsyncLogWriter::AsyncLogWriter( size_t capacity ) :
+    m_format( BinaryFormat ),
+    m_part( 1 ),
+    m_queue( capacity ),
+    m_run( false ),
+    m_flushInterval( 1.0 ),
+    m_syncInterval( 1.0 ),
+    m_sinkInterval( 60.0 ),
+    m_written( 0 ),
+    m_dropped( 0 ),
+    m_flushes( 0 ),
+    m_syncs( 0 ),
+    m_maxQueued( 0 ),
+    m_maxSize( 0 ),
+    m_startTime( 0.0 ),
+    m_loop( "logwriter" )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+AsyncLogWriter::~AsyncLogWriter()
+{
+    close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool AsyncLogWriter::open( const std::string & fileName, LogFormat format )
+{
+    close();
+
+    if ( !m_writer.open( fileName, format, true ) ) return false;
+
+    m_fileName = fileName;
+    m_format = format;
+    m_part = 1;
+    m_lastNote.clear();
+    m_lastAnchor.clear();
+
+    m_run = true;
+    m_thread = startThread( &AsyncLogWriter::worker, this );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void AsyncLogWriter::close()
+{
+    // the thread writes any queued records before it exits
+    m_run = false;
+    joinThread( m_thread );
+    m_writer.close();
+
+    std::lock_guard<std::mutex> lock( m_sinkMutex );
+    m_sinks.clear();
+}
+
+//-----------------------------------------------------------------------------
+
+void AsyncLogWriter::setFlushInterval( double seconds )
+{
+    m_flushInterval = seconds;
+}
+
+//-----------------------------------------------------------------------------
+
+void AsyncLogWriter::setSyncInterval( double seconds )
+{
+    m_syncInterval = seconds;
+}
+
+//-----------------------------------------------------------------------------
+
+void AsyncLogWriter::setSinkInterval( double seconds )
+{
+    m_sinkInterval = seconds;
+}
+
+//-----------------------------------------------------------------------------
+
+void AsyncLogWriter::setRotation( uint64_t maxSize, RotateFunc func )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_maxSize = maxSize;
+    m_rotateFunc = func;
+}
+
+//-----------------------------------------------------------------------------
+
+void AsyncLogWriter::setStartTime( double start )
+{
+    std::lock_guard<std::mutex> lock( m_sinkMutex );
+    m_startTime = start;
+}
+
+//-----------------------------------------------------------------------------
+
+void AsyncLogWriter::addSink( LogSink *sink )
+{
+    std::lock_guard<std::mutex> lock( m_sinkMutex );
+    m_sinks.push_back( sink );
+}
+
+//-----------------------------------------------------------------------------
+
+void AsyncLogWriter::writeNote( const std::string & text )
+{
+    Entry entry;
+    entry.isNote = true;
+    strncpy( entry.note, text.c_str(), NOTE_SIZE );
+    entry.note[NOTE_SIZE] = '\0';
+    push( entry );
+}
+
+//-----------------------------------------------------------------------------
+
+void AsyncLogWriter::writeSample( const Sample & sample )
+{
+    Entry entry;
+    entry.isNote = false;
+    entry.sample = sample;
+    entry.note[0] = '\0';
+    push( entry );
+}
+
+//-----------------------------------------------------------------------------
+
+AsyncLogWriter::Stats AsyncLogWriter::getStats() const
+{
+    Stats stats;
+    stats.written   = m_written;
+    stats.dropped   = m_dropped;
+    stats.flushes   = m_flushes;
+    stats.syncs     = m_syncs;
+    stats.maxQueued = m_maxQueued;
+    stats.good      = m_writer.good();
+    return stats;
+}
+
+//-----------------------------------------------------------------------------
+
+void AsyncLogWriter::push( const Entry & entry )
+{
+    if ( !m_queue.push( entry ) ) {
+        ++m_dropped;
+        return;
+    }
+
+    size_t queued = m_queue.size();
+    if ( queued > m_maxQueued ) m_maxQueued = queued;
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned AsyncLogWriter::drain()
+{
+    unsigned count = 0;
+    double traceStart = Trace::now();
+
+    std::lock_guard<std::mutex> lock( m_sinkMutex );
+
+    Entry entry;
+    while ( m_queue.pop( entry ) ) {
+        if ( entry.isNote ) {
+            m_writer.writeNote( entry.note );
+            ClockAnchor anchor;
+            if ( parseAnchor( entry.note, strlen( entry.note ), anchor ) ) {
+                // the sinks follow the wall clock from the latest anchor,
+                // so a change of the system time reaches them too
+                m_lastAnchor = entry.note;
+                m_startTime = anchor.wall - anchor.elapsed;
+            } else
+                m_lastNote = entry.note;
+        } else {
+            m_writer.writeSample( entry.sample );
+            if ( !m_sinks.empty() ) {
+                Sample point( entry.sample );
+                point.elapsed += m_startTime;
+                for (size_t i=0; i<m_sinks.size(); ++i)
+                    m_sinks[i]->add( point );
+            }
+        }
+        ++count;
+
+        // start a new file when this one is full
+        uint64_t maxSize = m_maxSize;
+        if ( (maxSize > 0) && (m_writer.getSize() >= maxSize) ) rotate();
+    }
+
+    if ( count > 0 ) {
+        m_written += count;
+        Trace::complete( "log.write", traceStart );
+    }
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+
+std::string AsyncLogWriter::getPartName( unsigned part ) const
+{
+    if ( part <= 1 ) return m_fileName;
+
+    std::ostringstream name;
+    name << m_fileName.substr( 0, m_fileName.rfind('.') ) << '-' << part
+         << getLogExtension( m_format );
+    return name.str();
+}
+
+//-----------------------------------------------------------------------------
+
+void AsyncLogWriter::rotate()
+{
+    Trace::Span span( "log.rotate" );
+
+    // finish the current file
+    std::string closed( getPartName( m_part ) );
+    m_writer.sync();
+    m_writer.close();
+
+    // the closed file can now be compressed or archived
+    ++m_part;
+    std::string next( getPartName( m_part ) );
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( m_rotateFunc ) m_rotateFunc( closed, next );
+    }
+
+    // start the next part, beginning with the parameter line and the time
+    if ( !m_writer.open( next, m_format, true ) ) return;
+    if ( !m_lastNote.empty() ) m_writer.writeNote( m_lastNote );
+    if ( !m_lastAnchor.empty() ) m_writer.writeNote( m_lastAnchor );
+}
+
+//-----------------------------------------------------------------------------
+
+void AsyncLogWriter::worker()
+{
+    Trace::setThreadName( "logwriter" );
+
+    double lastFlush = getClock();
+    double lastSync  = lastFlush;
+    double lastSink  = lastFlush;
+    bool   unflushed = false;   // records written since the last flush?
+    bool   unsynced  = false;   // records written since the last sync?
+    bool   sinkDirty = false;   // samples passed to the sinks since their sync?
+
+    while ( m_run ) {
+        m_loop.begin();
+
+        // write everything queued so far as one batch
+        if ( drain() > 0 ) {
+            unflushed = true;
+            unsynced  = true;
+            sinkDirty = true;
+        }
+
+        double now = getClock();
+
+        // pass the batched records to the operating system
+        if ( unflushed && (now - lastFlush >= m_flushInterval) ) {
+            Trace::Span span( "log.flush" );
+            m_writer.flush();
+            ++m_flushes;
+            lastFlush = now;
+            unflushed = false;
+        }
+
+        // wait for the records to reach the disk
+        double syncInterval = m_syncInterval;
+        if (
+            unsynced && (syncInterval > 0.0) &&
+            (now - lastSync >= syncInterval)
+        ) {
+            Trace::Span span( "log.sync" );
+            m_writer.sync();
+            ++m_syncs;
+            lastSync = now;
+            unsynced = false;
+        }
+
+        // write and sync the sinks, far less often
+        double sinkInterval = m_sinkInterval;
+        if ( sinkDirty && (now - lastSink >= sinkInterval) ) {
+            Trace::Span span( "log.sinks" );
+            flushSinks( true );
+            lastSink = now;
+            sinkDirty = false;
+        }
+
+        m_loop.end( getClock() + 1.0E-3 * WRITER_PERIOD );
+        delayms( WRITER_PERIOD );
+    }
+
+    // write anything left in the queue before exit
+    drain();
+    m_writer.sync();
+    flushSinks( true );
+}
+
+//-----------------------------------------------------------------------------
+
+void AsyncLogWriter::flushSinks( bool sync )
+{
+    std::lock_guard<std::mutex> lock( m_sinkMutex );
+    for (size_t i=0; i<m_sinks.size(); ++i)
+        m_sinks[i]->flush( sync );
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,167 @@
+#ifndef __asynclog_h
+#define __asynclog_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <inttypes.h>
+#include "telemetry.h"
+#include "spscqueue.h"
+#include "loopmonitor.h"
+#include <vector>
+
+//-----------------------------------------------------------------------------
+
+/// Session log written by a background thread. The controller loop queues
+/// samples and notes without blocking, and the writer thread writes them in
+/// batches, flushing and syncing the file at configurable intervals. If the
+/// file system stalls for long enough to fill the queue, further records are
+/// dropped (and counted) rather than delaying the controller. All methods
+/// other than the statistics must be called from the same thread.
+class AsyncLogWriter {
+public:
+    /// Writer statistics
+    struct Stats {
+        uint64_t written;   ///< Records written
+        uint64_t dropped;   ///< Records dropped because the queue was full
+        uint64_t flushes;   ///< Number of flushes
+        uint64_t syncs;     ///< Number of syncs to disk
+        size_t   maxQueued; ///< Largest number of queued records
+        bool     good;      ///< Have all writes succeeded?
+    };
+
+    /// Function called when a log file is closed by rotation, with the name
+    /// of the closed file and the next one
+    typedef std::function<
+        void(const std::string & closed, const std::string & next)
+    > RotateFunc;
+
+    /// Constructor, given the queue capacity in records
+    AsyncLogWriter( size_t capacity = 1024 );
+
+    /// Destructor: writes any queued records and closes the file
+    ~AsyncLogWriter();
+
+    /// Create the log file and start the writer thread. Returns true for
+    /// success.
+    bool open( const std::string & fileName, LogFormat format );
+
+    /// Write any queued records, close the file and stop the writer thread
+    void close();
+
+    /// Set the interval between flushes in seconds (zero flushes after
+    /// every batch)
+    void setFlushInterval( double seconds );
+
+    /// Set the interval between syncs to disk in seconds (zero disables)
+    void setSyncInterval( double seconds );
+
+    /// Set the interval between flushes and syncs of the sinks in seconds.
+    /// This is much longer than the log's, as the sinks rewrite the same
+    /// blocks (zero syncs them with the log).
+    void setSinkInterval( double seconds );
+
+    /// Start a new file when the current one reaches the given size in
+    /// bytes (zero disables rotation). The files are named after the first,
+    /// with a part number (150412-0930.glog, 150412-0930-2.glog, ...) and
+    /// each starts with the most recent note (the parameter line) and wall
+    /// clock anchor (see ClockAnchor). The function is called from the
+    /// writer thread at each rotation, before the next file is created.
+    void setRotation( uint64_t maxSize, RotateFunc func );
+
+    /// Set the time (in seconds since the epoch) at which the elapsed time
+    /// of the samples is zero, for the sinks. Each clock anchor written
+    /// (see ClockAnchor) replaces it with the anchor's offset.
+    void setStartTime( double start );
+
+    /// Also pass the samples written to a sink, such as the history store.
+    /// The sink is flushed and synced at the sink interval and when the log
+    /// is closed, and must remain valid until then (closing removes the
+    /// sinks).
+    void addSink( LogSink *sink );
+
+    /// Queue a line of text. Long notes are truncated.
+    void writeNote( const std::string & text );
+
+    /// Queue a sample
+    void writeSample( const Sample & sample );
+
+    /// Returns the writer statistics
+    Stats getStats() const;
+
+private:
+    /// Maximum length of a note
+    static const size_t NOTE_SIZE = 255;
+
+    /// Queued record
+    struct Entry {
+        bool   isNote;              ///< Note (or sample)?
+        Sample sample;              ///< Sample
+        char   note[NOTE_SIZE+1];   ///< Note text
+    };
+
+    /// Copy constructor (unsupported)
+    AsyncLogWriter( const AsyncLogWriter & );
+
+    /// Assignment operator (unsupported)
+    AsyncLogWriter & operator = ( const AsyncLogWriter & );
+
+    /// Queue an entry, counting it as dropped if the queue is full
+    void push( const Entry & entry );
+
+    /// Writer thread
+    void worker();
+
+    /// Write all queued records. Returns the number written.
+    unsigned drain();
+
+    /// Returns the file name for a part number
+    std::string getPartName( unsigned part ) const;
+
+    /// Close the current file and start the next part
+    void rotate();
+
+    /// Flush the sinks, and optionally sync them
+    void flushSinks( bool sync );
+
+private:
+    LogWriter          m_writer;    ///< File writer (used by the thread)
+    std::string        m_fileName;  ///< Name of the first file
+    LogFormat          m_format;    ///< Log format
+    unsigned           m_part;      ///< Current part number (from 1)
+    std::string        m_lastNote;  ///< Most recent note written
+    std::string        m_lastAnchor; ///< Most recent anchor written
+    SPSCQueue<Entry>   m_queue;     ///< Records waiting to be written
+    std::atomic<bool>  m_run;       ///< Should the thread continue to run?
+
+    std::atomic<double> m_flushInterval;    ///< Seconds between flushes
+    std::atomic<double> m_syncInterval;     ///< Seconds between syncs
+    std::atomic<double> m_sinkInterval;     ///< Seconds between sink syncs
+
+    std::atomic<uint64_t> m_written;    ///< Records written
+    std::atomic<uint64_t> m_dropped;    ///< Records dropped
+    std::atomic<uint64_t> m_flushes;    ///< Number of flushes
+    std::atomic<uint64_t> m_syncs;      ///< Number of syncs
+    std::atomic<size_t>   m_maxQueued;  ///< Largest queue length seen
+
+    std::atomic<uint64_t> m_maxSize;    ///< File size for rotation (or 0)
+    RotateFunc            m_rotateFunc; ///< Called when a file is closed
+    std::mutex            m_mutex;      ///< Controls access to m_rotateFunc
+
+    std::vector<LogSink*> m_sinks;      ///< Receive the samples written
+    double                m_startTime;  ///< Time of zero elapsed time
+    std::mutex            m_sinkMutex;  ///< Controls access to the sinks
+
+    LoopMonitor m_loop;     ///< Timing of the writer loop
+
+    /// Writer thread
+    std::thread m_thread;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__asynclog_h
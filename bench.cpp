@@ -0,0 +1,430 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tsic.h"
+#include "flow.h"
+#include "inputs.h"
+#include "pid.h"
+#include "pressure.h"
+#include "display.h"
+#include "telemetry.h"
+#include "history.h"
+#include "samplering.h"
+#include "recorder.h"
+#include "pigpiomgr.h"
+#include "settings.h"
+#include "timing.h"
+using namespace std;
+
+//-----------------------------------------------------------------------------
+
+// Microbenchmarks for the code which runs on every GPIO edge, ADC reading,
+// control loop tick and display frame. Each benchmark reports the time and
+// the number of heap allocations per operation, so that regressions can be
+// spotted on the Pi before they reach the controller.
+//
+// The benchmarks are linked with the simulated HAL (halsim.cpp), so they run
+// on the Pi or a desktop machine without touching the hardware.
+
+//-----------------------------------------------------------------------------
+
+/// number of heap allocations made by the calling thread
+static thread_local unsigned long t_allocations = 0;
+
+void * operator new( size_t size )
+{
+    ++t_allocations;
+    void *p = malloc( (size > 0) ? size : 1 );
+    if ( p == 0 ) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete( void *p ) noexcept
+{
+    free( p );
+}
+
+/// results are written here so that the compiler cannot discard them
+static volatile double g_sink = 0.0;
+
+//-----------------------------------------------------------------------------
+
+/// Microbenchmark runner. This is a friend of the classes under test, so
+/// that private event handlers can be called directly.
+class Bench {
+public:
+    /// Constructor, given the minimum time for each benchmark in seconds
+    /// and a filter (benchmarks are run if the name contains the filter)
+    Bench( double minTime, const string & filter );
+
+    /// Run all benchmarks
+    void runAll();
+
+private:
+    /// Run one benchmark: the function performs one operation per call
+    template<class Function>
+    void run( const char *name, Function function );
+
+    void tsic();
+    void flow();
+    void inputs();
+    void pid();
+    void pressure();
+    void display();
+    void telemetry();
+
+private:
+    double m_minTime;   ///< Minimum time for each benchmark in seconds
+    string m_filter;    ///< Benchmark name filter
+};
+
+//-----------------------------------------------------------------------------
+
+Bench::Bench( double minTime, const string & filter ) :
+    m_minTime( minTime ),
+    m_filter( filter )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+template<class Function>
+void Bench::run( const char *name, Function function )
+{
+    if ( !m_filter.empty() && (strstr( name, m_filter.c_str() ) == 0) )
+        return;
+
+    // warm up the caches
+    function();
+
+    // increase the iteration count until the run takes long enough
+    unsigned long iterations = 1;
+    for (;;) {
+        unsigned long allocations = t_allocations;
+        double start = getClock();
+        for (unsigned long i=0; i<iterations; ++i)
+            function();
+        double elapsed = getClock() - start;
+        allocations = t_allocations - allocations;
+
+        if ( (elapsed >= m_minTime) || (iterations >= (1UL << 30)) ) {
+            printf(
+                "%-28s %12lu %12.1f %12.2f\n",
+                name, iterations,
+                1.0E9 * elapsed / static_cast<double>(iterations),
+                static_cast<double>(allocations) /
+                    static_cast<double>(iterations)
+            );
+            return;
+        }
+
+        // aim for a little over the minimum time on the next run
+        double factor = (elapsed > 0.0) ? 1.2 * m_minTime / elapsed : 10.0;
+        if ( factor < 2.0 ) factor = 2.0;
+        if ( factor > 10.0 ) factor = 10.0;
+        iterations = static_cast<unsigned long>(
+            static_cast<double>(iterations) * factor
+        );
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void Bench::runAll()
+{
+    printf(
+        "%-28s %12s %12s %12s\n",
+        "benchmark", "iterations", "ns/op", "allocs/op"
+    );
+
+    tsic();
+    flow();
+    inputs();
+    pid();
+    pressure();
+    display();
+    telemetry();
+}
+
+//-----------------------------------------------------------------------------
+
+void Bench::tsic()
+{
+    // build the edges of a packet for 93.1C, as sent by the sensor: two
+    // packets, each with a start bit, eight data bits and even parity
+    const unsigned frame = 125;
+    const int raw = static_cast<int>( (93.1 + 50.0) * 2047.0 / 200.0 + 0.5 );
+    int packet[2] = { raw >> 8, raw & 0xFF };
+    uint32_t word = 0;
+    for (int p=0; p<2; ++p) {
+        packet[p] = (packet[p] << 1) | __builtin_parity( packet[p] );
+        word = (word << 10) | (1 << 9) | packet[p];
+    }
+
+    struct Edge {
+        int      level;
+        uint32_t tick;
+    };
+    vector<Edge> edges;
+    uint32_t tick = 0;
+    for (int bit=19; bit>=0; --bit) {
+        uint32_t low = ((word >> bit) & 1) ? frame / 4 : frame * 3 / 4;
+        Edge fall = { 0, tick };
+        Edge rise = { 1, tick + low };
+        edges.push_back( fall );
+        edges.push_back( rise );
+        tick += frame;
+    }
+
+    TSIC sensor;
+
+    // one operation is one edge; a packet is decoded on every 40th edge,
+    // and packets are sent at 10Hz
+    size_t index = 0;
+    uint32_t base = 0;
+    run( "tsic.alertFunction", [&]() {
+        const Edge & edge = edges[index];
+        sensor.alertFunction( TSIC_PIN, edge.level, base + edge.tick );
+        if ( ++index == edges.size() ) {
+            index = 0;
+            base += 100000;
+        }
+    } );
+
+    double degrees = 0.0;
+    sensor.getDegrees( degrees );
+    g_sink = degrees;
+
+    run( "tsic.tsicDecode", [&]() {
+        g_sink = TSIC::tsicDecode( packet[0], packet[1] );
+    } );
+}
+
+//-----------------------------------------------------------------------------
+
+void Bench::flow()
+{
+    Flow meter;
+
+    uint32_t tick = 0;
+    run( "flow.counter", [&]() {
+        meter.counter( FLOWPIN, (tick & 1) != 0, tick );
+        ++tick;
+    } );
+
+    g_sink = meter.getCount();
+}
+
+//-----------------------------------------------------------------------------
+
+void Bench::inputs()
+{
+    ADC adc;
+    Inputs buttons( adc, 1 );
+
+    // sweep across the button ladder voltages
+    double voltage = 0.0;
+    run( "inputs.getNearestButtonState", [&]() {
+        g_sink = buttons.getNearestButtonState( voltage );
+        voltage += 0.01;
+        if ( voltage > 3.3 ) voltage = 0.0;
+    } );
+}
+
+//-----------------------------------------------------------------------------
+
+void Bench::pid()
+{
+    PIDControl control;
+    control.setPIDGains( 0.07, 0.05, 0.90 );
+    control.setIntegratorLimits( 0.0, 1.0 );
+
+    // small oscillation around the target temperature
+    double position = 93.0;
+    double step = 0.1;
+    run( "pid.update", [&]() {
+        g_sink = control.update( 93.0 - position, position );
+        position += step;
+        if ( (position > 94.0) || (position < 92.0) ) step = -step;
+    } );
+}
+
+//-----------------------------------------------------------------------------
+
+void Bench::pressure()
+{
+    ADC adc;
+    Pressure sensor( adc, 0 );
+    sensor.setCorrection( 1.0, 0.0 );
+
+    // sweep across the sensor output range
+    double voltage = 0.5;
+    run( "pressure.getBar", [&]() {
+        g_sink = sensor.getBar( voltage );
+        voltage += 0.001;
+        if ( voltage > 4.5 ) voltage = 0.5;
+    } );
+
+    // a reading converted on demand, then one sampled in the background
+    if ( !adc.open( I2C_DEVICE_PATH, ADS1015_ADC_I2C_ADDRESS ) ) return;
+    run( "adc.getVoltage.single", [&]() {
+        g_sink = adc.getVoltage( 0 );
+    } );
+    adc.setSchedule( 0, ADC_BUTTON_RATE, ADC_BUTTON_PRIORITY );
+    adc.startSampling();
+    run( "adc.getVoltage.sampled", [&]() {
+        g_sink = adc.getVoltage( 0 );
+    } );
+    adc.stopSampling();
+}
+
+//-----------------------------------------------------------------------------
+
+void Bench::display()
+{
+    static const HAL::Colour
+        black  = {   0,   0,   0 },
+        yellow = { 255, 255,   0 };
+
+    Display screen;
+    screen
+        .updateTemperature( 92.9 )
+        .updatePressure( 8.7 )
+        .updateLevel( 0.6 )
+        .updateTime( 23.4 )
+        .setPowerOn( true )
+        .setPumpOn( true )
+        .setMessage( "shot 36.0ml" );
+
+    run( "display.render", [&]() {
+        screen.render();
+    } );
+
+    const string text( "92.9" );
+    run( "display.drawText", [&]() {
+        screen.drawText( screen.m_font, 10, 10, text, yellow, black );
+    } );
+}
+
+//-----------------------------------------------------------------------------
+
+void Bench::telemetry()
+{
+    Sample sample = { 0.0, 0.35, 92.94, 36.0, 8.73, 1, 1 };
+    char buffer[256];
+
+    run( "telemetry.formatCSV", [&]() {
+        g_sink = formatCSV( sample, buffer, sizeof(buffer) );
+        sample.elapsed += 0.25;
+    } );
+
+    char row[] = "1234.250,0.35,92.94,36.0,8.73,1,1";
+    run( "telemetry.parseCSV", [&]() {
+        parseCSV( row, sample );
+        g_sink = sample.temperature;
+    } );
+
+    // complete rows written through the log writer (without flushing)
+    LogWriter csv;
+    csv.open( "/dev/null", CSVFormat );
+    run( "telemetry.writeSample.csv", [&]() {
+        csv.writeSample( sample );
+        sample.elapsed += 0.25;
+    } );
+
+    LogWriter binary;
+    binary.open( "/dev/null", BinaryFormat );
+    run( "telemetry.writeSample.bin", [&]() {
+        binary.writeSample( sample );
+        sample.elapsed += 0.25;
+    } );
+
+    // compressed history: a slowly warming boiler with timing jitter
+    HistoryBlock block;
+    Sample point = { 1.4E9, 0.35, 92.94, 36.0, 0.0, 0, 0 };
+    unsigned tick = 0;
+    run( "history.add", [&]() {
+        point.elapsed += 0.25 + 0.001 * (tick % 3);
+        point.temperature += ((++tick % 7) == 0) ? 0.01 : 0.0;
+        if ( !block.add( point ) ) {
+            block.reset( block.getSequence() + 1 );
+            block.add( point );
+        }
+    } );
+
+    block.reset( 1 );
+    while ( block.add( point ) ) {
+        point.elapsed += 0.25 + 0.001 * (tick % 3);
+        point.temperature += ((++tick % 7) == 0) ? 0.01 : 0.0;
+    }
+    if ( m_filter.empty() || (strstr( "history.block", m_filter.c_str() ) != 0) )
+        printf(
+            "%-28s %u samples per block (%.2f bytes per sample)\n",
+            "history.block", block.getCount(),
+            static_cast<double>( HistoryBlock::SIZE ) / block.getCount()
+        );
+
+    run( "history.decode.block", [&]() {
+        HistoryBlock::decode( block.getData(), [&]( const Sample & sample ) {
+            g_sink = sample.temperature;
+        } );
+    } );
+
+    // recent samples: a full ring, read as by the display graph
+    SampleRing ring( RECENT_SAMPLES );
+    run( "samplering.add", [&]() {
+        ring.add( point );
+        point.elapsed += 0.25;
+    } );
+
+    SampleRing::Snapshot snapshot;
+    ring.reserve( snapshot );
+    run( "samplering.snapshot.graph", [&]() {
+        g_sink = ring.snapshot( DISPLAY_GRAPH_PERIOD, snapshot, SampleRing::Temperature );
+    } );
+    run( "samplering.snapshot.all", [&]() {
+        g_sink = ring.snapshot( DISPLAY_GRAPH_PERIOD, snapshot );
+    } );
+
+    // flight recorder: the cost added to every sensor reading and GPIO edge
+    uint32_t edge = 0;
+    run( "recorder.record", [&]() {
+        Recorder::record( Recorder::Input, FLOWPIN, (edge & 1) ? 1.0 : 0.0, edge );
+        ++edge;
+    } );
+}
+
+//-----------------------------------------------------------------------------
+
+int main( int argc, const char *argv[] )
+{
+    double minTime = 1.0;
+    string filter;
+
+    for (int i=1; i<argc; ++i) {
+        const string option( argv[i] );
+        if ( (option == "-t") && (i+1 < argc) ) {
+            minTime = atof( argv[++i] );
+        } else if ( option[0] != '-' ) {
+            filter = option;
+        } else {
+            cerr << "usage: gaggia-bench [-t seconds] [filter]\n";
+            return 1;
+        }
+    }
+
+    // check that PIGPIO is initialised
+    if ( !PIGPIOManager::get().ready() ) {
+        cerr << "gaggia-bench: failed to initialise PIGPIO\n";
+        return 1;
+    }
+
+    Bench( minTime, filter ).runAll();
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
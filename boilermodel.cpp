@@ -0,0 +1,170 @@
+#include "boilermodel.h"
+#include <math.h>
+
+//-----------------------------------------------------------------------------
+
+/// specific heat capacity of water in J/(ml.K)
+static const double WATER_HEAT_CAPACITY = 4.186;
+
+/// maximum integration step in seconds
+static const double MAX_STEP = 0.01;
+
+//-----------------------------------------------------------------------------
+
+BoilerModel::Parameters::Parameters() :
+    heaterPower( 1425.0 ),
+    elementCapacity( 150.0 ),
+    elementConductance( 40.0 ),
+    boilerCapacity( 1300.0 ),
+    lossConductance( 1.0 ),
+    sensorLag( 6.0 ),
+    ambientTemp( 20.0 ),
+    inletTemp( 20.0 ),
+    pumpMaxFlow( 8.0 ),
+    pumpMaxPressure( 15.0 ),
+    puckResistance( 4.5 ),
+    compliance( 0.5 ),
+    reservoirArea( 25.0 ),
+    reservoirRange( 30.0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+BoilerModel::BoilerModel()
+{
+    reset();
+}
+
+//-----------------------------------------------------------------------------
+
+BoilerModel::BoilerModel( const Parameters & parameters ) :
+    m_parameters( parameters )
+{
+    reset();
+}
+
+//-----------------------------------------------------------------------------
+
+BoilerModel::~BoilerModel()
+{
+}
+
+//-----------------------------------------------------------------------------
+
+void BoilerModel::configure( const std::map<std::string, double> & config )
+{
+    struct Entry {
+        const char *key;
+        double Parameters::*value;
+    };
+
+    static const Entry entries[] = {
+        { "simHeaterPower",         &Parameters::heaterPower        },
+        { "simElementCapacity",     &Parameters::elementCapacity    },
+        { "simElementConductance",  &Parameters::elementConductance },
+        { "simBoilerCapacity",      &Parameters::boilerCapacity     },
+        { "simLossConductance",     &Parameters::lossConductance    },
+        { "simSensorLag",           &Parameters::sensorLag          },
+        { "simAmbientTemp",         &Parameters::ambientTemp        },
+        { "simInletTemp",           &Parameters::inletTemp          },
+        { "simPumpMaxFlow",         &Parameters::pumpMaxFlow        },
+        { "simPumpMaxPressure",     &Parameters::pumpMaxPressure    },
+        { "simPuckResistance",      &Parameters::puckResistance     },
+        { "simCompliance",          &Parameters::compliance         },
+        { "simReservoirArea",       &Parameters::reservoirArea      },
+        { "simReservoirRange",      &Parameters::reservoirRange     }
+    };
+
+    for (size_t i=0; i<sizeof(entries)/sizeof(entries[0]); ++i) {
+        std::map<std::string, double>::const_iterator it =
+            config.find( entries[i].key );
+        if ( it != config.end() )
+            m_parameters.*(entries[i].value) = it->second;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+const BoilerModel::Parameters & BoilerModel::getParameters() const
+{
+    return m_parameters;
+}
+
+//-----------------------------------------------------------------------------
+
+void BoilerModel::reset()
+{
+    m_element  = m_parameters.ambientTemp;
+    m_boiler   = m_parameters.ambientTemp;
+    m_sensor   = m_parameters.ambientTemp;
+    m_pressure = 0.0;
+    m_litres   = 0.0;
+}
+
+//-----------------------------------------------------------------------------
+
+void BoilerModel::step(
+    double dt,
+    const Actuators & actuators,
+    Sensors & sensors
+) {
+    const Parameters & p = m_parameters;
+
+    // pump drive (the pump is a vibratory pump, modulated by PWM)
+    const double duty = actuators.pump ? actuators.pumpDuty : 0.0;
+
+    // flow from the pump, which falls linearly with pressure
+    double pumpFlow = 0.0;
+
+    // integrate using sub-steps no larger than MAX_STEP
+    int steps = static_cast<int>( ceil( dt / MAX_STEP ) );
+    double h = (steps > 0) ? dt / static_cast<double>(steps) : 0.0;
+
+    for (int i=0; i<steps; ++i) {
+        // hydraulics: the pump fills the compliance of the water path, and
+        // water leaves through the puck
+        pumpFlow = duty * p.pumpMaxFlow * (1.0 - m_pressure / p.pumpMaxPressure);
+        if ( pumpFlow < 0.0 ) pumpFlow = 0.0;
+        double puckFlow = m_pressure / p.puckResistance;
+        m_pressure += h * (pumpFlow - puckFlow) / p.compliance;
+        if ( m_pressure < 0.0 ) m_pressure = 0.0;
+
+        // heat flows in watts
+        double heating = actuators.heater * p.heaterPower;
+        double transfer = p.elementConductance * (m_element - m_boiler);
+        double loss = p.lossConductance * (m_boiler - p.ambientTemp);
+        double cooling =
+            pumpFlow * WATER_HEAT_CAPACITY * (m_boiler - p.inletTemp);
+
+        // update temperatures
+        m_element += h * (heating - transfer) / p.elementCapacity;
+        m_boiler  += h * (transfer - loss - cooling) / p.boilerCapacity;
+        m_sensor  += h * (m_boiler - m_sensor) / p.sensorLag;
+
+        // the flow meter is on the pump inlet
+        m_litres += h * pumpFlow / 1000.0;
+    }
+
+    sensors.temperature = m_sensor;
+    sensors.pressure    = m_pressure;
+    sensors.litres      = m_litres;
+    sensors.range       = p.reservoirRange + 1000.0 * m_litres / p.reservoirArea;
+    sensors.brewSwitch  = actuators.pump;
+}
+
+//-----------------------------------------------------------------------------
+
+double BoilerModel::getBoilerTemperature() const
+{
+    return m_boiler;
+}
+
+//-----------------------------------------------------------------------------
+
+double BoilerModel::getElementTemperature() const
+{
+    return m_element;
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,81 @@
+#ifndef __boilermodel_h
+#define __boilermodel_h
+
+//-----------------------------------------------------------------------------
+
+#include <map>
+#include <string>
+#include "simulation.h"
+
+//-----------------------------------------------------------------------------
+
+/// Physical model of the boiler, pump and water path, used as the plant
+/// behind the simulated hardware. The thermal model has three nodes: the
+/// heating element, the boiler (body and water) and the TSIC sensor mounted
+/// on the outside of the boiler. The element heats the boiler, the boiler
+/// loses heat to ambient and to cold water drawn in by the pump, and the
+/// sensor follows the boiler temperature with a first order lag.
+class BoilerModel : public Plant {
+public:
+    /// Model parameters
+    struct Parameters {
+        double heaterPower;         ///< Heater element power in W
+        double elementCapacity;     ///< Element heat capacity in J/K
+        double elementConductance;  ///< Element to boiler conductance in W/K
+        double boilerCapacity;      ///< Boiler and water heat capacity in J/K
+        double lossConductance;     ///< Boiler to ambient conductance in W/K
+        double sensorLag;           ///< Sensor time constant in seconds
+        double ambientTemp;         ///< Ambient temperature in degrees C
+        double inletTemp;           ///< Reservoir water temperature in C
+        double pumpMaxFlow;         ///< Pump flow at zero pressure in ml/s
+        double pumpMaxPressure;     ///< Pump pressure at zero flow in bar
+        double puckResistance;      ///< Puck resistance in bar/(ml/s)
+        double compliance;          ///< Hydraulic compliance in ml/bar
+        double reservoirArea;       ///< Reservoir volume per mm of depth in ml
+        double reservoirRange;      ///< Initial distance to water in mm
+
+        /// Default constructor: typical values for a Gaggia Classic
+        Parameters();
+    };
+
+    /// Default constructor
+    BoilerModel();
+
+    /// Constructor, given model parameters
+    BoilerModel( const Parameters & parameters );
+
+    /// Destructor
+    virtual ~BoilerModel();
+
+    /// Override parameters from a configuration (keys prefixed with "sim",
+    /// such as simHeaterPower). Missing keys are left unchanged.
+    void configure( const std::map<std::string, double> & config );
+
+    /// Returns the model parameters
+    const Parameters & getParameters() const;
+
+    /// Reset to ambient temperature with the boiler empty of pressure
+    void reset();
+
+    /// Advance the model by dt seconds
+    void step( double dt, const Actuators & actuators, Sensors & sensors );
+
+    /// Returns the boiler temperature in degrees C
+    double getBoilerTemperature() const;
+
+    /// Returns the heater element temperature in degrees C
+    double getElementTemperature() const;
+
+private:
+    Parameters m_parameters;    ///< Model parameters
+
+    double m_element;   ///< Element temperature in degrees C
+    double m_boiler;    ///< Boiler temperature in degrees C
+    double m_sensor;    ///< Sensor temperature in degrees C
+    double m_pressure;  ///< Pressure in bar
+    double m_litres;    ///< Total volume pumped in litres
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__boilermodel_h
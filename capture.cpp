@@ -0,0 +1,202 @@
+#include "capture.h"
+#include "pressure.h"
+#include "flow.h"
+#include "regulator.h"
+#include "timing.h"
+#include "trace.h"
+#include <stdio.h>
+#include <sstream>
+
+//-----------------------------------------------------------------------------
+
+/// polling period of the idle thread in milliseconds (the delay before the
+/// first sample of a pour)
+static const unsigned IDLE_PERIOD = 10;
+
+//-----------------------------------------------------------------------------
+
+ShotCapture::ShotCapture(
+    const Pressure & pressure,
+    const Flow & flow,
+    const Regulator & regulator
+) :
+    m_pressure( pressure ),
+    m_flow( flow ),
+    m_regulator( regulator ),
+    m_start( 0.0 ),
+    m_period( 0.0 ),
+    m_run( true ),
+    m_active( false ),
+    m_shots( 0 ),
+    m_loop( "capture" ),
+    m_thread( startThread( &ShotCapture::worker, this ) )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+ShotCapture::~ShotCapture()
+{
+    // gracefully terminate the thread (writing a capture in progress)
+    m_active = false;
+    m_run = false;
+
+    // wait for the thread to terminate
+    joinThread( m_thread );
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotCapture::setSession( const std::string & logFileName, double start )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_fileName = logFileName;
+    m_start = start;
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotCapture::setRate( double rate, double maxDuration )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    if ( (rate <= 0.0) || (maxDuration <= 0.0) ) {
+        m_period = 0.0;
+        m_samples.clear();
+        return;
+    }
+
+    m_period = 1.0 / rate;
+    m_samples.resize( static_cast<size_t>( rate * maxDuration ) + 1 );
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotCapture::start()
+{
+    m_active = true;
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotCapture::stop()
+{
+    m_active = false;
+}
+
+//-----------------------------------------------------------------------------
+
+bool ShotCapture::isCapturing() const
+{
+    return m_active;
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned ShotCapture::getShotCount() const
+{
+    return m_shots;
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotCapture::worker()
+{
+    Trace::setThreadName( "capture" );
+
+    while ( m_run ) {
+        // wait for a pour
+        if ( !m_active ) {
+            delayms( IDLE_PERIOD );
+            continue;
+        }
+
+        // the settings don't change during a capture
+        std::unique_lock<std::mutex> lock( m_mutex );
+        if ( m_fileName.empty() || m_samples.empty() ) {
+            // disabled: wait for the end of the pour
+            lock.unlock();
+            while ( m_run && m_active ) delayms( IDLE_PERIOD );
+            continue;
+        }
+
+        double start = getClock();
+        unsigned shot = m_shots + 1;
+        size_t count = capture( start, shot );
+        write( count, start, shot );
+        m_shots = shot;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+size_t ShotCapture::capture( double start, unsigned shot )
+{
+    Trace::Span span( "capture.shot" );
+
+    // volume is measured from the start of the capture
+    unsigned startCount = m_flow.getCount();
+    double litresPerCount = 1.0 / static_cast<double>(
+        m_flow.getCountsPerLitre()
+    );
+
+    size_t count = 0;
+    double next = start;
+    m_loop.begin();
+    while ( m_run && m_active ) {
+        // keep the samples from the start of the pour if the buffer fills
+        if ( count < m_samples.size() ) {
+            double now = getClock();
+            Sample & sample = m_samples[count++];
+            sample.elapsed     = now - start;
+            sample.power       = m_regulator.getPowerLevel();
+            sample.temperature = m_regulator.getTemperature();
+            sample.ml          = 1000.0 * litresPerCount *
+                static_cast<double>( m_flow.getCount() - startCount );
+            sample.bar         = m_pressure.getBarFast();
+            sample.pump        = 1;
+            sample.pour        = static_cast<int>( shot );
+        }
+
+        // sleep until the next sample is due (without catching up on any
+        // that were missed)
+        next += m_period;
+        double now = getClock();
+        if ( next < now ) next = now;
+        m_loop.end( next );
+        delayms( static_cast<unsigned>( 1.0E3 * (next - now) + 0.5 ) );
+        m_loop.begin();
+    }
+
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotCapture::write( size_t count, double start, unsigned shot )
+{
+    Trace::Span span( "capture.write" );
+
+    std::ostringstream suffix;
+    suffix << "-shot" << shot << getLogExtension( BinaryFormat );
+    std::string fileName(
+        m_fileName.substr( 0, m_fileName.rfind('.') ) + suffix.str()
+    );
+
+    LogWriter out;
+    if ( !out.open( fileName, BinaryFormat ) ) return;
+
+    // the start of the shot in session time, and the sample rate
+    char buffer[128];
+    snprintf(
+        buffer, sizeof(buffer),
+        "shot=%u,start=%.3lf,rate=%.1lf,samples=%u",
+        shot, start - m_start, 1.0 / m_period, static_cast<unsigned>(count)
+    );
+    out.writeNote( buffer );
+
+    for (size_t i=0; i<count; ++i)
+        out.writeSample( m_samples[i] );
+    out.close();
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,104 @@
+#ifndef __capture_h
+#define __capture_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "telemetry.h"
+#include "loopmonitor.h"
+
+class Pressure;
+class Flow;
+class Regulator;
+
+//-----------------------------------------------------------------------------
+
+/// High rate capture of the pressure and flow during a pour. The main loop
+/// only samples at 4Hz, which is too slow to show the pressure ramp at the
+/// start of a shot. Once triggered (by the brew switch, the pump or the flow
+/// sensor), a thread of its own samples the pressure sensor (one conversion
+/// per sample) and flow meter at a higher rate into a buffer allocated in
+/// advance. When the pour ends, the buffer is written as a separate log for
+/// the shot, alongside the session log (150412-0930-shot1.glog, ...).
+class ShotCapture {
+public:
+    /// Constructor
+    ShotCapture(
+        const Pressure & pressure,
+        const Flow & flow,
+        const Regulator & regulator
+    );
+
+    /// Destructor
+    ~ShotCapture();
+
+    /// Set the session log file name, which the shot logs are named after,
+    /// and the clock time at which the session started. An empty name
+    /// disables capture.
+    void setSession( const std::string & logFileName, double start );
+
+    /// Set the sample rate in Hz and the longest capture in seconds (the
+    /// buffer is allocated here). A rate of zero disables capture.
+    void setRate( double rate, double maxDuration );
+
+    /// Start capturing (a pour has started). Does nothing if a capture is
+    /// already in progress.
+    void start();
+
+    /// Stop capturing and write the shot log (the pour has ended)
+    void stop();
+
+    /// Is a capture in progress?
+    bool isCapturing() const;
+
+    /// Returns the number of shots captured
+    unsigned getShotCount() const;
+
+private:
+    /// Copy constructor (unsupported)
+    ShotCapture( const ShotCapture & );
+
+    /// Assignment operator (unsupported)
+    ShotCapture & operator = ( const ShotCapture & );
+
+    /// Capture thread
+    void worker();
+
+    /// Sample until the pour ends. Returns the number of samples.
+    size_t capture( double start, unsigned shot );
+
+    /// Write the samples of a shot to its log file
+    void write( size_t count, double start, unsigned shot );
+
+private:
+    const Pressure  & m_pressure;   ///< Pressure sensor
+    const Flow      & m_flow;       ///< Flow sensor
+    const Regulator & m_regulator;  ///< Temperature regulator
+
+    std::string m_fileName;     ///< Session log file name
+    double      m_start;        ///< Start time of the session
+    double      m_period;       ///< Sample period in seconds
+
+    std::vector<Sample> m_samples;  ///< Samples of the current shot
+
+    std::atomic<bool>     m_run;        ///< Should the thread continue to run?
+    std::atomic<bool>     m_active;     ///< Is a pour in progress?
+    std::atomic<unsigned> m_shots;      ///< Number of shots captured
+
+    /// Timing of the capture loop
+    LoopMonitor m_loop;
+
+    /// Thread used to capture the samples
+    std::thread m_thread;
+
+    /// Mutex to control access to the settings
+    mutable std::mutex m_mutex;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__capture_h
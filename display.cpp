@@ -1,8 +1,10 @@
 #include <sstream>
 #include <iomanip>
 #include <math.h>
+#include <algorithm>
 #include "display.h"
 #include "timing.h"
+#include "trace.h"
 #include "settings.h"
 
 using namespace std;
@@ -10,7 +12,7 @@ using namespace std;
 //-----------------------------------------------------------------------------
 
 Display::Display() :
-	m_display( 0 ),
+	m_open( false ),
 	m_font( 0 ),
     m_smallFont( 0 ),
 	m_run( true ),
@@ -23,10 +25,12 @@ Display::Display() :
     m_pumpOn( false ),
     m_pumpIcon( 0 ),
 	m_width( 320 ),
-	m_height( 240 )
+	m_height( 240 ),
+    m_recent( 0 ),
+	m_loop( "display" )
 {
 	open();
-	m_thread = std::thread( &Display::worker, this );
+	m_thread = startThread( &Display::worker, this );
 }
 
 //-----------------------------------------------------------------------------
@@ -34,7 +38,7 @@ Display::Display() :
 Display::~Display()
 {
 	m_run = false;
-	m_thread.join();
+	joinThread( m_thread );
 	close();
 }
 
@@ -132,78 +136,46 @@ Display & Display::setMessage( const std::string& message )
 
 //-----------------------------------------------------------------------------
 
-bool Display::open()
+Display & Display::setRecent( const SampleRing *recent )
 {
-	// todo: clean this up
-	static const char *table[] = {
-		"TSLIB_TSDEVICE=/dev/input/event0",
-        "TSLIB_TSEVENTTYPE=INPUT",
-        "TSLIB_CONFFILE=/etc/ts.conf",
-        "TSLIB_CALIBFILE=/etc/pointercal",
-        "SDL_FBDEV=/dev/fb1",
-        "SDL_MOUSEDRV=TSLIB",
-        "SDL_MOUSEDEV=/dev/input/event0",
-        "SDL_NOMOUSE=1",
-        "SDL_VIDEODRIVER=FBCON",
-        0
-    };
-
-    for ( int i=0; table[i] != 0; ++i )
-    	putenv( (char*)table[i] );
-
-	// initialise SDL
-	if ( SDL_Init(SDL_INIT_VIDEO) < 0 ) return false;
-
-	// get video information (resolution and bits per pixel)
-	const SDL_VideoInfo *videoInfo = SDL_GetVideoInfo();
-
-	// display resolution
-	m_width  = videoInfo->current_w;
-	m_height = videoInfo->current_h;
-
-	// create display surface
-	m_display = SDL_SetVideoMode(
-		videoInfo->current_w,
-		videoInfo->current_h,
-		videoInfo->vfmt->BitsPerPixel,
-		0
-	);
-	if ( m_display == 0 ) return false;
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_recent = recent;
 
-	// initialise TTF
-	if ( TTF_Init() < 0 ) return false;
+    // taking snapshots then never allocates memory
+    if ( m_recent != 0 ) m_recent->reserve( m_graph, SampleRing::Temperature );
+    return *this;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Display::open()
+{
+	// open the display
+	m_open = HAL::displayOpen( m_width, m_height );
+	if ( !m_open ) return false;
 
 	// load the font
-	m_font = TTF_OpenFont(
+	m_font = HAL::fontOpen(
 		"/usr/share/fonts/truetype/freefont/FreeSansBold.ttf",
 		64
 	);
 	if ( m_font == 0 ) return false;
 
     // load the small font
-    m_smallFont = TTF_OpenFont(
+    m_smallFont = HAL::fontOpen(
         "/usr/share/fonts/truetype/freefont/FreeSansBold.ttf",
         16
     );
     if ( m_smallFont == 0 ) return false;
 
     // load the power icon
-    SDL_Surface *temp = IMG_Load( ICON_BOILER_POWER );
-    if ( temp == 0 ) return false;
-    m_powerIcon = SDL_DisplayFormat( temp );
-    SDL_FreeSurface( temp );
+    m_powerIcon = HAL::imageLoad( ICON_BOILER_POWER );
     if ( m_powerIcon == 0 ) return false;
 
     // load the pump icon
-    temp = IMG_Load( ICON_PUMP_ACTIVE );
-    if ( temp == 0 ) return false;
-    m_pumpIcon = SDL_DisplayFormat( temp );
-    SDL_FreeSurface( temp );
+    m_pumpIcon = HAL::imageLoad( ICON_PUMP_ACTIVE );
     if ( m_pumpIcon == 0 ) return false;
 
-	// hide mouse pointer
-	SDL_ShowCursor( 0 );
-
 	// success
 	return true;
 }
@@ -214,45 +186,51 @@ void Display::close()
 {
     // free power icon
     if ( m_powerIcon != 0 ) {
-        SDL_FreeSurface( m_powerIcon );
+        HAL::imageFree( m_powerIcon );
         m_powerIcon = 0;
     }
 
     // free pump icon
     if ( m_pumpIcon != 0 ) {
-        SDL_FreeSurface( m_pumpIcon );
+        HAL::imageFree( m_pumpIcon );
         m_pumpIcon = 0;
     }
 
 	// close font
 	if ( m_font != 0 ) {
-        TTF_CloseFont( m_font );
+        HAL::fontClose( m_font );
         m_font = 0;
     }
 
     // close font
     if ( m_smallFont != 0 ) {
-        TTF_CloseFont( m_smallFont );
+        HAL::fontClose( m_smallFont );
         m_smallFont = 0;
     }
 
-	// close TTF
-	TTF_Quit();
-
-	// close SDL
-	SDL_Quit();
+	// close the display
+	if ( m_open ) {
+		HAL::displayClose();
+		m_open = false;
+	}
 }
 
 //-----------------------------------------------------------------------------
 
 void Display::worker()
 {
+	Trace::setThreadName( "display" );
+
 	while (m_run) {
+		m_loop.begin();
 		if (m_dirty) {
 			m_dirty = false;
 			render();
-		} else
+			m_loop.end();
+		} else {
+			m_loop.end( getClock() + 0.01 );
 			delayms(10);
+		}
 	}
 }
 
@@ -260,13 +238,23 @@ void Display::worker()
 
 void Display::render()
 {
+	Trace::Span span( "display.render" );
+
+	static const HAL::Colour
+		black  = {   0,   0,   0 },
+        green  = {   0, 255,   0 },
+		yellow = { 255, 255,   0 },
+        cyan   = {   0, 255, 255 },
+        blue   = {   0,   0, 255 };
+
     // clear the screen first
-    SDL_FillRect( m_display, 0, 0 );
+    HAL::displayFill( 0, black );
 
 	double degrees  = 0.0;
     double pressure = 0.0;
 	double level    = 0.0;
     double time     = 0.0;
+    const SampleRing *recent = 0;
 
 	// size of screen border
 	const int border = 10;
@@ -277,14 +265,9 @@ void Display::render()
         pressure = m_pressure;
 		level    = m_level;
         time     = m_time;
+        recent   = m_recent;
 	}
 
-	static const SDL_Color
-		black  = {   0,   0,   0, 255 },
-        green  = {   0, 255,   0, 255 },
-		yellow = { 255, 255,   0, 255 },
-        cyan   = {   0, 255, 255, 255 };
-
 	// format temperature value: 92.9
 	stringstream text;
 	text << std::fixed << std::setprecision(1) << degrees;
@@ -313,72 +296,104 @@ void Display::render()
         drawText( m_smallFont, 10, 200, m_message, green, black );
     }
 
-	// RGB colours
-	Uint32 rgbCyan = SDL_MapRGB( m_display->format, 0, 255, 255 );
-	Uint32 rgbBlue = SDL_MapRGB( m_display->format, 0,   0, 255 );
-
 	// draw water level bar
 	short maxWidth = 300;
-	Uint16 width = static_cast<Uint16>(
+	unsigned short width = static_cast<unsigned short>(
 		level * static_cast<double>(maxWidth) + 0.5
 	);
-	Uint16 height = 10;
+	unsigned short height = 10;
 	short left	 = 10;
 	short top	 = 240 - height - 10;
-	SDL_Rect rect = { left, top, width, height };
+	HAL::Rect rect = { left, top, width, height };
 
-	SDL_FillRect( m_display, &rect, rgbCyan );
+	HAL::displayFill( &rect, cyan );
 
 	rect.x = left + width;
 	rect.w = maxWidth - width;
-	SDL_FillRect( m_display, &rect, rgbBlue );
+	HAL::displayFill( &rect, blue );
 
     // draw power icon
     if ( m_powerOn && (m_powerIcon != 0) ) {
-        SDL_Rect destRect = {
-            static_cast<short>(m_width - 32 - border), border,
-            0, 0
-        };
-        SDL_BlitSurface( m_powerIcon, 0, m_display, &destRect );
+        HAL::displayBlit(
+            m_powerIcon, static_cast<short>(m_width - 32 - border), border
+        );
     }
 
     // draw pump icon
     if ( m_pumpOn && (m_pumpIcon != 0) ) {
-        SDL_Rect destRect = {
-            static_cast<short>(m_width - 32 - border), border + 32,
-            0, 0
-        };
-        SDL_BlitSurface( m_pumpIcon, 0, m_display, &destRect );
+        HAL::displayBlit(
+            m_pumpIcon, static_cast<short>(m_width - 32 - border), border + 32
+        );
     }
 
+    // draw the temperature graph
+    if ( recent != 0 ) drawGraph( *recent );
+
     // flip the display buffers
-	SDL_Flip( m_display );
+	HAL::displayFlip();
+}
+
+//-----------------------------------------------------------------------------
+
+void Display::drawGraph( const SampleRing & recent )
+{
+	static const HAL::Colour
+        grey   = {  64,  64,  64 },
+		yellow = { 255, 255,   0 };
+
+    // between the temperature and the icons
+    const short left = 160;
+    const short top = 12;
+    const unsigned short width = 108;
+    const unsigned short height = 60;
+
+    size_t count = recent.snapshot(
+        DISPLAY_GRAPH_PERIOD, m_graph, SampleRing::Temperature
+    );
+    if ( count < 2 ) return;
+
+    // scale to the range of the temperatures (at least two degrees)
+    double low = *std::min_element( m_graph.temperature.begin(), m_graph.temperature.end() );
+    double high = *std::max_element( m_graph.temperature.begin(), m_graph.temperature.end() );
+    if ( high - low < 2.0 ) {
+        double middle = 0.5 * (low + high);
+        low = middle - 1.0;
+        high = middle + 1.0;
+    }
+
+    HAL::Rect axis = { left, static_cast<short>( top + height ), width, 1 };
+    HAL::displayFill( &axis, grey );
+
+    // one point per column, from the latest sample at that time
+    const double start = m_graph.elapsed.back() - DISPLAY_GRAPH_PERIOD;
+    size_t i = 0;
+    for (unsigned short x=0; x<width; ++x) {
+        double t = start + DISPLAY_GRAPH_PERIOD * (x + 1) / width;
+        while ( (i + 1 < count) && (m_graph.elapsed[i+1] <= t) ) ++i;
+        if ( m_graph.elapsed[i] > t ) continue;
+
+        double scaled = (m_graph.temperature[i] - low) / (high - low);
+        HAL::Rect point = {
+            static_cast<short>( left + x ),
+            static_cast<short>( top + height - 2 - floor( scaled * (height - 2) + 0.5 ) ),
+            1, 2
+        };
+        HAL::displayFill( &point, yellow );
+    }
 }
 
 //-----------------------------------------------------------------------------
 
 void Display::drawText(
-	TTF_Font *font,
+	HAL::Font *font,
 	short x, short y,
 	const std::string & text,
-	SDL_Color foregroundColour,
-	SDL_Color backgroundColour
+	HAL::Colour foregroundColour,
+	HAL::Colour backgroundColour
 ) {
-	if ( m_display == 0 ) return;
-
-	SDL_Surface *textSurface = TTF_RenderText_Shaded(
-		font,
-		text.c_str(),
-		foregroundColour,
-		backgroundColour
-	);
-	if ( textSurface == 0 ) return;
-
-	SDL_Rect destRect = { x, y };
-
-	SDL_BlitSurface( textSurface, 0, m_display, &destRect );
+	if ( !m_open || (font == 0) ) return;
 
-	SDL_FreeSurface( textSurface );
+	HAL::displayText( font, x, y, text, foregroundColour, backgroundColour );
 }
 
 //-----------------------------------------------------------------------------
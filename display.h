@@ -6,9 +6,9 @@
 #include <string>
 #include <thread>
 #include <mutex>
-#include <SDL/SDL.h>
-#include <SDL/SDL_image.h>
-#include <SDL/SDL_ttf.h>
+#include "hal.h"
+#include "loopmonitor.h"
+#include "samplering.h"
 
 //-----------------------------------------------------------------------------
 
@@ -32,7 +32,14 @@ public:
 
     Display & setMessage( const std::string& message );
 
+    /// Draw a graph of the recent temperatures from a ring of samples (or
+    /// none if null). The ring must outlive the display.
+    Display & setRecent( const SampleRing *recent );
+
 private:
+	/// Microbenchmarks (bench.cpp) call the renderer directly
+	friend class Bench;
+
 	bool open();
 
 	void close();
@@ -43,20 +50,23 @@ private:
 	/// Render one frame
 	void render();
 
+	/// Draw the graph of the recent temperatures
+	void drawGraph( const SampleRing & recent );
+
 	void drawText(
-		TTF_Font *font,
+		HAL::Font *font,
 		short x, short y,
 		const std::string & text,
-		SDL_Color foregroundColour,
-		SDL_Color backgroundColour
+		HAL::Colour foregroundColour,
+		HAL::Colour backgroundColour
 	);
 
 private:
-	SDL_Surface *m_display;	    ///< Display surface
-	TTF_Font	*m_font;
-    TTF_Font    *m_smallFont;   ///< Small font
-    SDL_Surface *m_powerIcon;   ///< Power icon image
-    SDL_Surface *m_pumpIcon;    ///< Pump icon image
+	bool		m_open;		    ///< Is the display open?
+	HAL::Font	*m_font;
+    HAL::Font   *m_smallFont;   ///< Small font
+    HAL::Image  *m_powerIcon;   ///< Power icon image
+    HAL::Image  *m_pumpIcon;    ///< Pump icon image
 
 	int			m_width;	///< Width of display in pixels
 	int			m_height;	///< Height of display in pixels
@@ -72,6 +82,12 @@ private:
     bool        m_pumpOn;   ///< Pump on display
     std::string m_message;  ///< Message text
 
+    const SampleRing     *m_recent; ///< Recent samples (or null)
+    SampleRing::Snapshot  m_graph;  ///< Samples drawn by the graph
+
+    /// Timing of the rendering loop
+    LoopMonitor m_loop;
+
     /// Rendering thread
     std::thread m_thread;
 
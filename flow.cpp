@@ -4,6 +4,7 @@
 #include "flow.h"
 #include "settings.h"
 #include "timing.h"
+#include "trace.h"
 
 // Using the Digmesa FHKSC 932-9521-B flow sensor with 1.2mm diameter bore
 // With flow sensor in situ, pumping fresh water, measured:
@@ -22,7 +23,8 @@ Flow::Flow() :
 	m_countsPerLitre( 4095 ),
 	m_notifyFunc( nullptr ),
 	m_notifyCount( 0 ),
-	m_thread( &Flow::worker, this )
+	m_loop( "flow" ),
+	m_thread( startThread( &Flow::worker, this ) )
 {
 }
 
@@ -34,13 +36,15 @@ Flow::~Flow()
 	m_run = false;
 
 	// wait for the thread to terminate
-	m_thread.join();
+	joinThread( m_thread );
 }
 
 //-----------------------------------------------------------------------------
 
 void Flow::worker()
 {
+	Trace::setThreadName( "flow" );
+
 	// initialise GPIO pin as an input and enable interrupts on both
 	// rising and falling edges
     using namespace std::placeholders;
@@ -60,11 +64,14 @@ void Flow::worker()
 	unsigned idleTime = 0;
 
 	// poll for interrupts and count pulses
+	m_loop.begin();
 	while (m_run) {
 		bool wasFlowing = flowing;
 
         unsigned oldCount = m_count;
+        m_loop.end( getClock() + 1.0E-3 * timeout );
         delayms( timeout );
+        m_loop.begin();
         if ( m_count != oldCount ) {
 			// received one (or more) interrupts
 
@@ -138,6 +145,7 @@ void Flow::worker()
 void Flow::counter( unsigned pin, bool level, unsigned tick ) {
     // increment counter
     ++m_count;
+    Trace::instant( "flow.edge" );
 }//counter
 
 //-----------------------------------------------------------------------------
@@ -7,6 +7,7 @@
 #include <mutex>
 #include <atomic>
 #include "gpiopin.h"
+#include "loopmonitor.h"
 
 //-----------------------------------------------------------------------------
 
@@ -60,6 +61,9 @@ public:
 	bool ready() const;
 
 private:
+	/// Microbenchmarks (bench.cpp) drive the pulse counter directly
+	friend class Bench;
+
 	/// Worker thread
 	void worker();
 
@@ -78,6 +82,9 @@ private:
 	/// The number of counts per litre
 	unsigned m_countsPerLitre;
 
+	/// Timing of the polling loop
+	LoopMonitor m_loop;
+
 	/// Thread used to monitor the flow sensor
 	std::thread m_thread;
 
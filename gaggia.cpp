@@ -1,4 +1,7 @@
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
 #include <sched.h>
 #include <ctype.h>
 #include <signal.h>
@@ -9,6 +12,9 @@
 #include <sstream>
 #include <map>
 #include <memory>
+#include <vector>
+#include <thread>
+#include <atomic>
 
 #include "timing.h"
 #include "regulator.h"
@@ -24,35 +30,83 @@
 #include "settings.h"
 #include "pigpiomgr.h"
 #include "network.h"
+#include "telemetry.h"
+#include "asynclog.h"
+#include "loopmonitor.h"
+#include "trace.h"
+#include "retention.h"
+#include "upload.h"
+#include "capture.h"
+#include "shotdb.h"
+#include "shotindex.h"
+#include "logstats.h"
+#include "history.h"
+#include "rollup.h"
+#include "samplering.h"
+#include "recorder.h"
+#include "watchdog.h"
+#include "journal.h"
+#ifdef GAGGIA_SIM
+#include "simulation.h"
+#include "virtualclock.h"
+#include "replay.h"
+#endif
 
 using namespace std;
 
 //-----------------------------------------------------------------------------
 
-static const string filePath( "/var/log/gaggia/" );
-static const string configFile( "/etc/gaggia.conf" );
+static string filePath( "/var/log/gaggia/" );
+static string configFile( "/etc/gaggia.conf" );
+
+/// shot database file name (in the log directory)
+static const char *SHOT_DATABASE = "shots.db";
+
+/// index of the shot curves (in the log directory)
+static const char *SHOT_INDEX = "shots.sim";
+
+/// long term history of the samples (in the log directory)
+static const char *HISTORY_FILE = "history.gts";
 
 //-----------------------------------------------------------------------------
 
 std::map<std::string, double> config;
 
+/// configuration values which aren't numbers (such as host names)
+std::map<std::string, std::string> textConfig;
+
 bool g_enableBoiler = true;	///< Enable boiler if true
 bool g_quit = false;		///< Should we quit?
 bool g_halt = false;        ///< Should we halt? (shutdown the system)
+bool g_loopReport = false;  ///< Should we write the loop timing report?
+bool g_traceDump = false;   ///< Should we write the event trace?
 
 double g_shotSize = 60.0;   ///< Shot size in ml
 
 /// Automatic power off time in seconds. Zero disables the time out.
 double g_autoPowerOff = 0.0;
 
+/// Run time limit for the controller in seconds. Zero means no limit.
+double g_runTime = 0.0;
+
+/// Format of the session log
+LogFormat g_logFormat = BinaryFormat;
+
+/// Use the long-term stores (history, rollups and shot database) and the
+/// uploader? Not for replays and runs on a simulated clock, whose times
+/// would be out of order with those of the real sessions.
+bool g_persistent = true;
+
 class Hardware {
 private:
+    EventJournal m_journal;     ///< Discrete events (outlives the handlers)
     Timer       m_lastUsed;     ///< When was the last user interaction?
     ADC         m_adc;          ///< ADC used for buttons and pressure sensor
     Pump        m_pump;         ///< Pump controller
     Flow        m_flow;         ///< Flow sensor to measure volume dispensed
     Temperature m_temperature;  ///< Boiler temperature sensor
     Ranger      m_ranger;       ///< Range finder to measure water level
+    SampleRing  m_recent;       ///< Recent samples (outlives the display)
     Display     m_display;      ///< LCD display screen
     System      m_system;       ///< System information
     bool        m_pumpSense;    ///< Is the pump active?
@@ -66,7 +120,11 @@ private:
 
     std::shared_ptr<Pressure> m_pressure;
 
+    std::shared_ptr<ShotCapture> m_capture;
+
 public:
+    EventJournal & journal() { return m_journal; }
+
     Timer & lastUsed() { return m_lastUsed; }
 
     ADC & adc() { return m_adc; }
@@ -79,6 +137,8 @@ public:
 
     Ranger & ranger() { return m_ranger; }
 
+    SampleRing & recent() { return m_recent; }
+
     Display & display() { return m_display; }
 
     System & system() { return m_system; }
@@ -89,6 +149,8 @@ public:
 
     Pressure & pressure() { return *m_pressure; }
 
+    ShotCapture & capture() { return *m_capture; }
+
     /// Returns true if the pump is active (whether enabled in software, or by
     /// using the manual front panel switch)
     bool pumpSense() const { return m_pumpSense; }
@@ -100,7 +162,9 @@ public:
     double pourTime() const;
 
     /// Constructor
-    Hardware() {
+    Hardware() :
+        m_recent( RECENT_SAMPLES )
+    {
         // reset and stop the timer
         m_pourTime.reset().stop();
 
@@ -113,10 +177,28 @@ public:
         // initialise ADC
         if ( !m_adc.open( I2C_DEVICE_PATH, ADS1015_ADC_I2C_ADDRESS ) )
             cerr << "gaggia: failed to open ADC\n";
+        else {
+            m_adc.setSchedule(
+                ADC_BUTTON_CHANNEL, ADC_BUTTON_RATE, ADC_BUTTON_PRIORITY
+            );
+            m_adc.setSchedule(
+                ADC_PRESSURE_CHANNEL, ADC_PRESSURE_IDLE_RATE,
+                ADC_PRESSURE_PRIORITY
+            );
+            if ( ((ADC_BUTTON_RATE > 0.0) || (ADC_PRESSURE_IDLE_RATE > 0.0))
+                && !m_adc.startSampling() )
+                cerr << "gaggia: failed to start ADC sampling\n";
+        }
 
         m_regulator = std::make_shared<Regulator>( m_temperature );
         m_inputs = std::make_shared<Inputs>( m_adc, ADC_BUTTON_CHANNEL );
         m_pressure = std::make_shared<Pressure>( m_adc, ADC_PRESSURE_CHANNEL );
+        m_capture = std::make_shared<ShotCapture>(
+            *m_pressure, m_flow, *m_regulator
+        );
+
+        // the display draws a graph of the recent temperatures
+        m_display.setRecent( &m_recent );
 
         using namespace std::placeholders;
 
@@ -133,6 +215,7 @@ public:
 
     /// Destructor
     virtual ~Hardware() {
+        m_capture.reset();
         m_inputs.reset();
         m_regulator.reset();
         m_pressure.reset();
@@ -148,6 +231,10 @@ public:
     /// Called when notifications are received from the flow sensor
     void flowHandler( Flow::NotifyType type );
 
+    /// Called when a pour starts or ends: captures the shot, and samples
+    /// the pressure faster during the pour
+    void setPouring( bool pouring );
+
     /// Run the control loop
     int runController(
 	    bool interactive,
@@ -172,6 +259,14 @@ void signalHandler( int signal )
 		printf( "\ngaggia: received SIGTERM\n" );
 		g_quit = true;
 		break;
+
+	case SIGUSR1:
+		g_loopReport = true;
+		break;
+
+	case SIGUSR2:
+		g_traceDump = true;
+		break;
 	}
 }
 
@@ -184,6 +279,20 @@ double Hardware::pourTime() const
 
 //-----------------------------------------------------------------------------
 
+void Hardware::setPouring( bool pouring )
+{
+    m_adc.setRate(
+        ADC_PRESSURE_CHANNEL,
+        pouring ? ADC_PRESSURE_POUR_RATE : ADC_PRESSURE_IDLE_RATE
+    );
+    if ( pouring )
+        capture().start();
+    else
+        capture().stop();
+}
+
+//-----------------------------------------------------------------------------
+
 /// Called when buttons are pressed or released
 void Hardware::buttonHandler(
     int button,     // button number (1,2)
@@ -216,10 +325,22 @@ void Hardware::buttonHandler(
 
         // if the power has been enabled, increment the pour counter
         if ( state ) ++m_pourCount;
+        journal().add(
+            EventJournal::BrewSwitch,
+            state ? EventJournal::On : EventJournal::Off, m_pourCount
+        );
+
+        // capture the pressure and flow at a high rate during the pour
+        setPouring( state );
 
         break;
 
     case BUTTON1:
+        journal().add(
+            EventJournal::Buttons,
+            state ? EventJournal::Pressed : EventJournal::Released,
+            button, state ? 0.0 : time
+        );
         if ( state ) {
             // button 1 pushed
 
@@ -230,11 +351,17 @@ void Hardware::buttonHandler(
                 flow().notifyAfter( g_shotSize / 1000.0 );
                 // turn on the pump
                 pump().setState( true );
+                setPouring( true );
             } else {
                 // pump is already running: turn it off
                 pump().setState( false );
             }
 
+            journal().add(
+                EventJournal::Pump,
+                pump().getState() ? EventJournal::On : EventJournal::Off
+            );
+
             // display pump status for diagnostic purposes
             cout << "gaggia: pump "
                  << (pump().getState() ? "enabled" : "disabled")
@@ -245,6 +372,11 @@ void Hardware::buttonHandler(
         break;
 
     case BUTTON2:
+        journal().add(
+            EventJournal::Buttons,
+            state ? EventJournal::Pressed : EventJournal::Released,
+            button, state ? 0.0 : time
+        );
         if ( state ) {
             // button 2 pushed
         } else {
@@ -252,11 +384,16 @@ void Hardware::buttonHandler(
             if ( time >= 1.0 ) {
                 // button was held for 1 second, shut down the system
                 cout << "gaggia: shutting down\n";
+                journal().add( EventJournal::Controller, EventJournal::Halt );
                 g_halt = true;
                 g_quit = true;
             } else {
                 // button was pushed briefly, toggle boiler power
                 regulator().setPower( !regulator().getPower() );
+                journal().add(
+                    EventJournal::Boiler,
+                    regulator().getPower() ? EventJournal::On : EventJournal::Off
+                );
                 cout << "gaggia: boiler "
                      << (regulator().getPower() ? "enabled" : "disabled")
                      << endl;
@@ -273,19 +410,29 @@ void Hardware::flowHandler( Flow::NotifyType type ) {
     // reset the timer when the pump is used (e.g. via front panel switch)
     lastUsed().reset();
 
+    // volume dispensed in ml
+    const double ml = 1000.0 * flow().getLitres();
+
 	switch ( type ) {
 	case Flow::Start :
 		cout << "flow: started\n";
+		journal().add( EventJournal::FlowMeter, EventJournal::Start, 0, ml );
+		setPouring( true );
 		break;
 
 	case Flow::Stop  :
 		cout << "flow: stopped\n";
+		journal().add( EventJournal::FlowMeter, EventJournal::Stop, 0, ml );
+		// the pour continues while the pump runs (e.g. pre-infusion)
+		if ( !pumpSense() ) setPouring( false );
 		break;
 
 	case Flow::Target:
 		cout << "flow: target reached\n";
+		journal().add( EventJournal::FlowMeter, EventJournal::Target, 0, ml );
         // stop the pump
         pump().setState( false );
+        journal().add( EventJournal::Pump, EventJournal::Off );
 		break;
 	}
 }
@@ -306,12 +453,17 @@ bool loadConfig( std::string fileName )
 		if ( !f ) break;
 
 		// read value
-		double value;
-		f >> ws >> value;
+		string text;
+		f >> ws >> text;
 		if ( !f ) break;
 
-		// store key/value
-		config[key] = value;
+		// store key/value (as a number, unless it isn't one)
+		char *end;
+		double value = strtod( text.c_str(), &end );
+		if ( (end != text.c_str()) && (*end == '\0') )
+			config[key] = value;
+		else
+			textConfig[key] = text;
 		//cout << key << " = " << value << endl;
 	} while (true);
 
@@ -322,6 +474,492 @@ bool loadConfig( std::string fileName )
 
 //-----------------------------------------------------------------------------
 
+/// Returns the name of a file written alongside the log file, given a suffix
+/// (for example 150412-0930.csv with suffix -loops.txt is 150412-0930-loops.txt)
+std::string makeSideFileName(
+	const std::string & logFileName,
+	const char *suffix
+) {
+	return logFileName.substr( 0, logFileName.rfind('.') ) + suffix;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Write the loop timing report for all worker loops
+void writeLoopReport( const std::string & logFileName )
+{
+	std::string fileName( makeSideFileName( logFileName, "-loops.txt" ) );
+
+	ofstream out( fileName.c_str() );
+	if ( !out ) {
+		cerr << "gaggia: unable to write loop report " << fileName << endl;
+		return;
+	}
+
+	LoopMonitor::report( out );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Write the recent events of all threads as Chrome trace JSON
+void writeTrace( const std::string & logFileName )
+{
+	std::string fileName( makeSideFileName( logFileName, "-trace.json" ) );
+
+	if ( !Trace::write( fileName ) )
+		cerr << "gaggia: unable to write trace " << fileName << endl;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Write the flight recorder as a file alongside the log (also written on a
+/// crash or a watchdog trip)
+void writeRecorder()
+{
+	if ( !Recorder::dump( Recorder::Demand ) )
+		cerr << "gaggia: unable to write the flight recorder\n";
+}
+
+//-----------------------------------------------------------------------------
+
+/// Writes the event trace and flight recorder on request (SIGUSR2) on a
+/// thread of its own, as the recorder is large and synced to the disk, so
+/// that the controller loop only has to ask
+class DumpWriter {
+public:
+	DumpWriter() : m_run( false ), m_request( false ) {}
+	~DumpWriter() { stop(); }
+
+	/// Start the thread, for the side files of the given log
+	void start( const std::string & logFileName ) {
+		stop();
+		m_logFileName = logFileName;
+		m_run = true;
+		m_thread = startThread( &DumpWriter::worker, this );
+	}
+
+	/// Stop the thread (a request being written is finished first)
+	void stop() {
+		m_run = false;
+		joinThread( m_thread );
+	}
+
+	/// Ask for the files to be written
+	void request() { m_request = true; }
+
+private:
+	/// Background thread
+	void worker() {
+		Trace::setThreadName( "dump" );
+		while ( m_run ) {
+			if ( m_request.exchange( false ) ) {
+				writeTrace( m_logFileName );
+				writeRecorder();
+			}
+			delayms( 200 );
+		}
+	}
+
+	std::string       m_logFileName;    ///< Session log
+	std::atomic<bool> m_run;            ///< Should the thread continue to run?
+	std::atomic<bool> m_request;        ///< Have the files been asked for?
+	std::thread       m_thread;         ///< Thread used to write the files
+};
+
+//-----------------------------------------------------------------------------
+
+/// Write the events in a journal as CSV, with the time since the start of
+/// the session (as in the log) and in seconds since the epoch
+int printJournal( const std::string & fileName )
+{
+	double start = 0.0, wallStart = 0.0;
+	std::vector<JournalEvent> events;
+	if ( !EventJournal::read( fileName, start, wallStart, events ) ) {
+		cerr << "gaggia: unable to read event journal " << fileName << endl;
+		return 1;
+	}
+
+	printf( "elapsed,time,source,event,arg,value\n" );
+	for (size_t i=0; i<events.size(); ++i) {
+		const JournalEvent & event = events[i];
+		printf(
+			"%.6lf,%.6lf,%s,%s,%u,%.3lf\n",
+			event.time - start, wallStart + (event.time - start),
+			EventJournal::getSourceName( event.source ),
+			EventJournal::getTypeName( event.type ), event.arg, event.value
+		);
+	}
+
+	cerr << "gaggia: " << events.size() << " events\n";
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Write the events in a flight recorder file as CSV, with the time in
+/// seconds since the epoch
+int printRecorder( const std::string & fileName )
+{
+	Recorder::Dump dump;
+	if ( !Recorder::read( fileName, dump ) ) {
+		cerr << "gaggia: unable to read flight recorder " << fileName << endl;
+		return 1;
+	}
+
+	printf( "time,event,channel,value,aux\n" );
+	for (size_t i=0; i<dump.events.size(); ++i) {
+		const Recorder::Event & event = dump.events[i];
+		printf(
+			"%.6lf,%s,%u,%.4lf,%u\n",
+			dump.wallOffset + event.time, Recorder::getKindName( event.kind ),
+			event.channel, event.value, event.aux
+		);
+	}
+
+	cerr << "gaggia: " << dump.events.size() << " events (" << dump.written
+	     << " recorded), written on " << Recorder::getReasonName( dump.reason );
+	if ( dump.reason == Recorder::Crash ) cerr << " (signal " << dump.detail << ")";
+	cerr << endl;
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Time range of a log given by the --from, --to and --pour options
+struct LogRange {
+	double   from;  ///< Start time in seconds (zero for the start)
+	double   to;    ///< End time in seconds (zero for the end)
+	unsigned pour;  ///< Pour number (zero for all samples)
+
+	LogRange() : from( 0.0 ), to( 0.0 ), pour( 0 ) {}
+};
+
+//-----------------------------------------------------------------------------
+
+/// Set the time range of a pour from the index of the log. Returns false if
+/// the log has no index or the pour isn't in it.
+bool findPour( const std::string & logFileName, LogRange & range )
+{
+	LogIndex index;
+	double start, end;
+	if ( !index.load( logFileName ) || !index.findPour( range.pour, start, end ) )
+		return false;
+
+	range.from = start;
+	range.to = end;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Convert a session log (in either format) to CSV. If no output file name
+/// is given, the output is named after the log with a .csv extension. Only
+/// the samples in the range are exported, along with the notes at the start
+/// of the log and any in the range. Optionally, the wall clock time of each
+/// sample (in seconds since the epoch, from the anchors in the log) is added
+/// as the last column.
+int exportCSV(
+	const std::string & logFileName,
+	std::string csvFileName,
+	LogRange range,
+	bool wallTime
+) {
+	LogReader in;
+	if ( !in.open( logFileName ) ) {
+		cerr << "gaggia: unable to read log file (" << logFileName << ")\n";
+		return 1;
+	}
+
+	// the anchors are spread through the log, so are read first
+	WallClockMap wallClock;
+	if ( wallTime ) {
+		LogReader anchors;
+		Sample sample;
+		string note;
+		LogReader::Record record;
+		anchors.open( logFileName );
+		while ( (record = anchors.next( sample, note )) != LogReader::End ) {
+			ClockAnchor anchor;
+			if ( (record == LogReader::Note) && parseAnchor( note.data(), note.size(), anchor ) )
+				wallClock.add( anchor );
+		}
+		if ( wallClock.getCount() == 0 )
+			cerr << "gaggia: no wall clock anchors in the log\n";
+		else if ( !wallClock.isSynchronised() )
+			cerr << "gaggia: the system time was not synchronised during the session\n";
+	}
+
+	if ( csvFileName.empty() ) {
+		// name after the original log, rather than the compressed file
+		std::string baseName( logFileName );
+		if (
+			(baseName.size() > 3) &&
+			(baseName.compare( baseName.size() - 3, 3, ".gz" ) == 0)
+		)
+			baseName.erase( baseName.size() - 3 );
+		csvFileName = makeSideFileName( baseName, ".csv" );
+	}
+	if ( csvFileName == logFileName ) {
+		cerr << "gaggia: log file is already in CSV format\n";
+		return 1;
+	}
+
+	ofstream out( csvFileName.c_str() );
+	if ( !out ) {
+		cerr << "gaggia: unable to write " << csvFileName << endl;
+		return 1;
+	}
+
+	// a pour is found from the index, or else by reading the whole log
+	if ( (range.pour > 0) && !findPour( logFileName, range ) )
+		range.from = range.to = 0.0;
+
+	// copy notes as they are, and format samples as in the original layout
+	Sample sample;
+	string note;
+	char buffer[256];
+	unsigned count = 0;
+	LogReader::Record record;
+
+	// keep the notes at the start (the settings), then use the index to skip
+	// to the first sample in the range
+	while ( (record = in.next( sample, note )) == LogReader::Note )
+		out << note << '\n';
+	if ( (record == LogReader::SampleRow) && (range.from > 0.0) && in.seek( range.from ) )
+		record = in.next( sample, note );
+
+	for ( ; record != LogReader::End; record = in.next( sample, note ) ) {
+		if ( record == LogReader::SampleRow ) {
+			if ( sample.elapsed < range.from ) continue;
+			if ( (range.to > 0.0) && (sample.elapsed > range.to) ) break;
+			if ( (range.pour > 0) && (sample.pour != static_cast<int>( range.pour )) )
+				continue;
+
+			int length = formatCSV( sample, buffer, sizeof(buffer) );
+			if ( wallTime )
+				snprintf(
+					buffer + length, sizeof(buffer) - length, ",%.3lf",
+					wallClock.toWall( sample.elapsed )
+				);
+			out << buffer << '\n';
+			++count;
+		} else
+			out << note << '\n';
+	}
+
+	cout << "gaggia: exported " << count << " samples to " << csvFileName << endl;
+	return out.good() ? 0 : 1;
+}
+
+//-----------------------------------------------------------------------------
+
+/// List the shots in the database which match an SQL condition (or all of
+/// them if the condition is empty)
+int listShots( const std::string & condition )
+{
+	ShotDatabase shots;
+	if ( !shots.open( filePath + SHOT_DATABASE ) ) {
+		cerr << "gaggia: unable to open shot database: " << shots.getError() << endl;
+		return 1;
+	}
+
+	printf(
+		"%-19s %-16s %4s %8s %8s %6s %6s %6s %6s\n",
+		"start", "session", "pour", "time(s)", "vol(ml)",
+		"peak", "mean", "temp", "target"
+	);
+
+	unsigned count = 0;
+	string error;
+	bool success = shots.query(
+		condition,
+		[&count]( const ShotRecord & shot ) {
+			time_t start = static_cast<time_t>( shot.start );
+			char date[32];
+			strftime( date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime( &start ) );
+			printf(
+				"%-19s %-16s %4u %8.1lf %8.1lf %6.2lf %6.2lf %6.2lf %6.2lf\n",
+				date, shot.session.c_str(), shot.pour, shot.duration,
+				shot.volume, shot.peakPressure, shot.meanPressure,
+				shot.brewTemp, shot.targetTemp
+			);
+			++count;
+		},
+		error
+	);
+	if ( !success ) {
+		cerr << "gaggia: shot query failed: " << error << endl;
+		return 1;
+	}
+
+	cout << "gaggia: " << count << " shots\n";
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+/// List the k shots with the pressure and flow curves most like those of a
+/// shot log (updating the index of the shot logs in the log directory)
+int listSimilarShots( const std::string & shotFileName, size_t k )
+{
+	double started = getClock();
+
+	ShotIndex index;
+	const string indexFile( filePath + SHOT_INDEX );
+	if ( !index.load( indexFile ) )
+		cerr << "gaggia: rebuilding shot index " << indexFile << endl;
+	size_t before = index.size();
+	size_t read = index.update( filePath );
+	if ( ((read > 0) || (index.size() != before)) && !index.save( indexFile ) )
+		cerr << "gaggia: unable to write shot index " << indexFile << endl;
+
+	// the shot may be one of those indexed (by name), or any other shot log
+	ShotCurve query;
+	size_t shot = static_cast<size_t>( -1 );
+	if ( index.find( shotFileName, shot ) )
+		index.getCurve( shot, query );
+	else {
+		double duration, volume, peak;
+		if ( !query.read( shotFileName, duration, volume, peak ) ) {
+			cerr << "gaggia: unable to read shot log " << shotFileName << endl;
+			return 1;
+		}
+	}
+
+	std::vector<ShotIndex::Match> matches;
+	ShotIndex::SearchStats stats;
+	index.search( query, k, shot, matches, &stats );
+
+	printf(
+		"%4s %8s %-28s %8s %8s %6s\n",
+		"rank", "distance", "shot", "time(s)", "vol(ml)", "peak"
+	);
+	for (size_t i=0; i<matches.size(); ++i) {
+		const ShotIndex::Entry & entry = index.getEntry( matches[i].shot );
+		printf(
+			"%4u %8.3lf %-28s %8.1lf %8.1lf %6.2lf\n",
+			static_cast<unsigned>( i + 1 ), matches[i].distance,
+			entry.name.c_str(), entry.duration, entry.volume, entry.peak
+		);
+	}
+
+	cerr << "gaggia: " << stats.candidates << " shots, " << stats.distances
+	     << " compared, " << read << " logs indexed, in "
+	     << static_cast<int>( 1.0E3 * (getClock() - started) ) << "ms\n";
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Parse a local time given as YYMMDD-HHMM (as in the log file names).
+/// Returns the time in seconds since the epoch, or zero if it is invalid.
+double parseLogTime( const std::string & text )
+{
+	struct tm info;
+	memset( &info, 0, sizeof(info) );
+	const char *end = strptime( text.c_str(), "%y%m%d-%H%M", &info );
+	if ( (end == 0) || (*end != '\0') ) return 0.0;
+
+	info.tm_isdst = -1;
+	time_t time = mktime( &info );
+	return (time < 0) ? 0.0 : static_cast<double>( time );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Write the samples in the history between two local times (YYMMDD-HHMM,
+/// or empty for no limit) as CSV, with the time in seconds since the epoch
+int printHistory( const std::string & from, const std::string & to )
+{
+	HistoryReader history;
+	if ( !history.open( filePath + HISTORY_FILE ) ) {
+		cerr << "gaggia: unable to read history " << filePath << HISTORY_FILE << endl;
+		return 1;
+	}
+
+	double fromTime = from.empty() ? 0.0 : parseLogTime( from );
+	double toTime = to.empty() ? 0.0 : parseLogTime( to );
+	if ( (!from.empty() && (fromTime == 0.0)) || (!to.empty() && (toTime == 0.0)) ) {
+		cerr << "gaggia: expected times as YYMMDD-HHMM\n";
+		return 1;
+	}
+
+	char buffer[256];
+	uint64_t count = 0;
+	bool success = history.read(
+		fromTime, toTime,
+		[&]( const Sample & sample ) {
+			formatCSV( sample, buffer, sizeof(buffer) );
+			puts( buffer );
+			++count;
+		}
+	);
+
+	HistoryReader::Stats stats = history.getStats();
+	cerr << "gaggia: " << count << " samples (history has " << stats.samples
+	     << " samples in " << stats.blocks << " blocks, "
+	     << ((stats.samples > 0) ? double(stats.bytes) / stats.samples : 0.0)
+	     << " bytes per sample)\n";
+	return success ? 0 : 1;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Write the rollups of a level (1s, 1m or 1h) between two local times
+/// (YYMMDD-HHMM, or empty for no limit) as CSV
+int printRollups(
+	const std::string & name,
+	const std::string & from,
+	const std::string & to
+) {
+	size_t level = RollupStore::getLevel( name );
+	if ( level >= RollupStore::LEVELS ) {
+		cerr << "gaggia: expected a rollup interval (1s, 1m or 1h)\n";
+		return 1;
+	}
+
+	RollupReader rollups;
+	const string fileName( RollupStore::getFileName( filePath, level ) );
+	if ( !rollups.open( fileName ) ) {
+		cerr << "gaggia: unable to read rollups " << fileName << endl;
+		return 1;
+	}
+
+	double fromTime = from.empty() ? 0.0 : parseLogTime( from );
+	double toTime = to.empty() ? 0.0 : parseLogTime( to );
+	if ( (!from.empty() && (fromTime == 0.0)) || (!to.empty() && (toTime == 0.0)) ) {
+		cerr << "gaggia: expected times as YYMMDD-HHMM\n";
+		return 1;
+	}
+
+	printf(
+		"time,samples,tempMin,tempMax,tempMean,tempLast,powerMin,powerMax,"
+		"powerMean,powerLast,barMin,barMax,barMean,barLast,ml,kJ\n"
+	);
+	unsigned count = 0;
+	bool success = rollups.read(
+		fromTime, toTime,
+		[&count]( const RollupPoint & point ) {
+			const RollupPoint::Stat & t = point.temperature;
+			const RollupPoint::Stat & p = point.power;
+			const RollupPoint::Stat & b = point.pressure;
+			printf(
+				"%.0lf,%u,%.2f,%.2f,%.2f,%.2f,%.3f,%.3f,%.3f,%.3f,"
+				"%.2f,%.2f,%.2f,%.2f,%.1f,%.1f\n",
+				point.time, point.count,
+				t.min, t.max, t.mean, t.last, p.min, p.max, p.mean, p.last,
+				b.min, b.max, b.mean, b.last, point.volume, point.energy
+			);
+			++count;
+		}
+	);
+
+	cerr << "gaggia: " << count << " intervals\n";
+	return success ? 0 : 1;
+}
+
+//-----------------------------------------------------------------------------
+
 std::string makeLogFileName()
 {
 	// get the time
@@ -333,12 +971,13 @@ std::string makeLogFileName()
 	char buffer[256];
 	sprintf(
 		buffer,
-		"%02d%02d%02d-%02d%02d.csv",
+		"%02d%02d%02d-%02d%02d%s",
 		info->tm_year % 100,
 		info->tm_mon+1,
 		info->tm_mday,
 		info->tm_hour,
-		info->tm_min
+		info->tm_min,
+		getLogExtension( g_logFormat )
 	);
 
 	// return the string
@@ -357,26 +996,35 @@ int Hardware::runController(
         return 1;
     }
 
-	// open log file
-	ofstream out( fileName.c_str() );
-	if ( !out ) {
+	// long term history and rollups, fed by the log writer (declared first,
+	// so that they outlive the writer)
+	HistoryStore history;
+	RollupStore rollups;
+
+	// open log file (written by a background thread)
+	AsyncLogWriter out;
+	if ( !out.open( fileName, g_logFormat ) ) {
 		cerr << "error: unable to open log file " << fileName << endl;
 		return 1;
 	}
 
 	// check that flow meter is available
 	if ( !flow().ready() ) {
-		out << "error: flow meter not ready\n";
+		out.writeNote( "error: flow meter not ready" );
 		return 1;
 	}
 
 	// read configuration file
 	if ( !loadConfig( configFile ) ) {
-		out << "error: failed to load configuration from "
-			<< configFile << endl;
+		out.writeNote( "error: failed to load configuration from " + configFile );
 		return 1;
 	}
 
+#ifdef GAGGIA_SIM
+    // configure the simulated boiler (optional keys with the "sim" prefix)
+    Simulation::configure( config );
+#endif
+
     // shot size in millilitres
     g_shotSize = config["shotSize"];
 
@@ -423,7 +1071,84 @@ int Hardware::runController(
 		kP, kI, kD, kMin, kMax,
 		targetTemp, timeStep
 	);
-	out << buffer << endl;
+	out.writeNote( buffer );
+
+	// how often the log is flushed, and synced to the disk (in seconds)
+	if ( config.count( "logFlushInterval" ) )
+		out.setFlushInterval( config["logFlushInterval"] );
+	if ( config.count( "logSyncInterval" ) )
+		out.setSyncInterval( config["logSyncInterval"] );
+	if ( config.count( "logSinkInterval" ) )
+		out.setSinkInterval( config["logSinkInterval"] );
+
+	// log retention: compression of closed logs, maximum age (in days) and
+	// disk budget for the log directory (in megabytes)
+	LogRetention retention;
+	{
+		LogRetention::Policy policy;
+		if ( config.count( "logCompress" ) )
+			policy.compress = (config["logCompress"] != 0.0);
+		if ( config.count( "logMaxAge" ) )
+			policy.maxAge = config["logMaxAge"] * 24.0 * 3600.0;
+		policy.diskBudget = static_cast<uint64_t>(
+			(config.count( "logDiskBudget" ) ? config["logDiskBudget"] : 256.0)
+			* 1024.0 * 1024.0
+		);
+
+		// the long-term stores take part of the budget, but are never
+		// deleted
+		retention.addStore( filePath + SHOT_DATABASE );
+		retention.addStore( filePath + SHOT_INDEX );
+		retention.addStore( filePath + HISTORY_FILE );
+		for (size_t level=0; level<RollupStore::LEVELS; ++level)
+			retention.addStore( RollupStore::getFileName( filePath, level ) );
+
+		retention.protect( fileName );
+		retention.start( filePath, policy );
+	}
+
+	// copy the logs to a collector ("host:port"), at a limited rate (in
+	// kB/s), in batches (of kB) after each interval (in seconds), and
+	// optionally while the logs are still being written
+	LogUploader uploader;
+	if ( g_persistent && textConfig.count( "uploadCollector" ) ) {
+		const string & collector = textConfig["uploadCollector"];
+		size_t colon = collector.rfind( ':' );
+
+		LogUploader::Policy policy;
+		if ( colon != string::npos ) {
+			policy.host = collector.substr( 0, colon );
+			policy.port = static_cast<unsigned>( atoi( collector.c_str() + colon + 1 ) );
+		}
+		if ( config.count( "uploadRate" ) )
+			policy.rate = config["uploadRate"] * 1000.0;
+		if ( config.count( "uploadBatch" ) )
+			policy.batchSize = static_cast<size_t>( config["uploadBatch"] * 1024.0 );
+		if ( config.count( "uploadInterval" ) )
+			policy.interval = config["uploadInterval"];
+		if ( config.count( "uploadActive" ) )
+			policy.active = (config["uploadActive"] != 0.0);
+
+		uploader.protect( fileName );
+		if ( !uploader.start( filePath, policy ) )
+			cerr << "gaggia: invalid upload collector " << collector << endl;
+	}
+
+	// start a new log file when this one reaches the maximum size (in
+	// megabytes), so that closed parts can be compressed or deleted
+	{
+		double maxSize =
+			config.count( "logMaxSize" ) ? config["logMaxSize"] : 16.0;
+		out.setRotation(
+			static_cast<uint64_t>(maxSize * 1024.0 * 1024.0),
+			[&retention, &uploader]( const string & closed, const string & next ) {
+				retention.protect( next );
+				retention.release( closed );
+				uploader.protect( next );
+				uploader.release( closed );
+			}
+		);
+	}
 
 	if ( interactive )
 		nonblock(1);
@@ -435,10 +1160,97 @@ int Hardware::runController(
 	double start = getClock();
 	double next  = start;
 
+	// high rate capture of each pour: sample rate in Hz (zero disables) and
+	// the longest capture in seconds
+	capture().setRate(
+		config.count( "captureRate" ) ? config["captureRate"] : 100.0,
+		config.count( "captureMaxDuration" ) ? config["captureMaxDuration"] : 120.0
+	);
+	capture().setSession( fileName, start );
+
+	// journal of the discrete events, timed on the same clock as the samples
+	if ( journal().open( makeSideFileName( fileName, "-events.jnl" ), start ) )
+		journal().add( EventJournal::Controller, EventJournal::Start );
+	else
+		cerr << "gaggia: unable to open event journal\n";
+
+	// summary of each pour, with the regulator settings, for the shot
+	// database (in the log directory)
+	ShotDatabase shots;
+	if ( g_persistent && !shots.open( filePath + SHOT_DATABASE ) )
+		cerr << "gaggia: unable to open shot database: " << shots.getError() << endl;
+
+	const double wallStart = getWallClock() - (getClock() - start);
+	out.setStartTime( wallStart );
+
+	// compressed history of every sample, in a file of fixed size in MB
+	// (zero disables)
+	const double historyMaxSize =
+		config.count( "historyMaxSize" ) ? config["historyMaxSize"] : 32.0;
+	if ( g_persistent && (historyMaxSize > 0.0) ) {
+		if ( history.open( filePath + HISTORY_FILE, historyMaxSize * 1.0E6 ) )
+			out.addSink( &history );
+		else
+			cerr << "gaggia: unable to open history " << filePath << HISTORY_FILE << endl;
+	}
+
+	// 1 second, 1 minute and 1 hour summaries, with the boiler energy from
+	// the rated heater power in W
+	const double heaterPower =
+		config.count( "heaterPower" ) ? config["heaterPower"] : 1425.0;
+	if ( g_persistent ) {
+		if ( rollups.open( filePath, heaterPower ) )
+			out.addSink( &rollups );
+		else
+			cerr << "gaggia: unable to open rollups in " << filePath << endl;
+	}
+
+	// wall clock time of the samples (see ClockAnchor)
+	ClockAnchor anchor = { 0.0, 0.0, false };
+	bool anchored = false;
+
+	ShotSummary shot;
+	ShotRecord shotRecord;
+	shotRecord.session = fileName.substr( fileName.find_last_of('/') + 1 );
+	shotRecord.targetTemp = targetTemp;
+	shotRecord.kP = kP;
+	shotRecord.kI = kI;
+	shotRecord.kD = kD;
+	shotRecord.iMin = kMin;
+	shotRecord.iMax = kMax;
+
+	// timing of this loop
+	LoopMonitor loop( "controller" );
+	Trace::setThreadName( "controller" );
+
+	// the flight recorder is written alongside the log on a crash, when the
+	// regulator or this loop stops for longer than the watchdog timeout in
+	// seconds (zero disables), or on request
+	if ( !Recorder::setDumpFile( makeSideFileName( fileName, "-flight.rec" ) ) )
+		cerr << "gaggia: log file name too long for the flight recorder\n";
+	if ( !Recorder::installCrashHandler() )
+		cerr << "gaggia: failed to hook the fatal signals\n";
+
+	DumpWriter dumper;
+	dumper.start( fileName );
+
+	Watchdog watchdog;
+	watchdog.watch( "regulator" ).watch( "controller" );
+	watchdog.start(
+		config.count( "watchdogTimeout" ) ? config["watchdogTimeout"] : 5.0,
+		[]( const string & name ) {
+			cerr << "gaggia: watchdog: " << name << " loop stopped\n";
+			if ( !Recorder::dump( Recorder::Watchdog ) )
+				cerr << "gaggia: unable to write the flight recorder\n";
+		}
+	);
+
 	// turn on the power and start the regulator (boiler will begin to heat)
 	regulator().setPower( g_enableBoiler ).start();
 
 	do {
+		loop.begin();
+
 		// next time step
 		next += timeStepGUI;
 
@@ -451,6 +1263,29 @@ int Hardware::runController(
 		// calculate elapsed time
 		double elapsed = getClock() - start;
 
+		// stop when the run time limit is reached
+		if ( (g_runTime > 0.0) && (elapsed >= g_runTime) ) break;
+
+		// anchor the wall clock time periodically, when the system time is
+		// synchronised, and straight away if it jumps
+		{
+			ClockAnchor now = { elapsed, getWallClock(), isWallClockSynchronised() };
+			double jump = (now.wall - now.elapsed) - (anchor.wall - anchor.elapsed);
+			if ( anchored && (fabs( jump ) > CLOCK_JUMP) )
+				cerr << "gaggia: wall clock jumped by " << jump << "s\n";
+			if (
+				!anchored || (fabs( jump ) > CLOCK_JUMP) ||
+				(now.synchronised != anchor.synchronised) ||
+				(elapsed - anchor.elapsed >= CLOCK_ANCHOR_PERIOD)
+			) {
+				char note[128];
+				formatAnchor( now, note, sizeof(note) );
+				out.writeNote( note );
+				anchor = now;
+				anchored = true;
+			}
+		}
+
 		// get the latest temperature reading
 		double latestTemp = regulator().getTemperature();
 
@@ -470,12 +1305,21 @@ int Hardware::runController(
         int pour = (pump > 0) ? pourCount() : 0;
 
 		// dump values to log file
-		sprintf(
-			buffer,
-			"%.3lf,%.2lf,%.2lf,%.1lf,%.2lf,%d,%d",
+		Sample sample = {
 			elapsed, powerLevel, latestTemp, ml, bar, pump, pour
-		);
-		out << buffer << endl;
+		};
+		out.writeSample( sample );
+		recent().add( sample );
+
+		// summarise each pour for the shot database
+		if ( pour > 0 ) {
+			if ( !shot.isActive() )
+				shot.begin( sample, anchor.wall + (elapsed - anchor.elapsed) );
+			shot.add( sample );
+		} else if ( shot.isActive() ) {
+			shot.end( pourTime(), shotRecord );
+			if ( g_persistent ) shots.add( shotRecord );
+		}
 
 		if (interactive) {
 			printf( "%.2lf %.2lf %.1lf %.2lf %d\n", elapsed, latestTemp, ml, bar, pour );
@@ -534,23 +1378,80 @@ int Hardware::runController(
 
             // stop the timer to prevent repeat triggering
             lastUsed().stop();
+            journal().add( EventJournal::Boiler, EventJournal::AutoOff );
 
             // explanatory message
             cout << "gaggia: switched off power due to inactivity\n";
         }
 
+        // write the loop timing report on request (SIGUSR1)
+        if ( g_loopReport ) {
+            g_loopReport = false;
+            writeLoopReport( fileName );
+        }
+
+        // write the event trace and flight recorder on request (SIGUSR2)
+        if ( g_traceDump ) {
+            g_traceDump = false;
+            dumper.request();
+        }
+
 		// sleep for remainder of time step
+		loop.end( next );
 		double remain = next - getClock();;
 		if ( remain > 0.0 )
 			delayms( static_cast<int>(1.0E3 * remain) );
 	} while (true);
 
+	watchdog.stop();
+	dumper.stop();
+
 	if ( interactive )
 		nonblock(0);
 
 	// turn the boiler off before we exit
 	regulator().setPower( false );
 
+	// finish writing any shot in progress
+	capture().stop();
+	capture().setSession( "", 0.0 );
+	if ( shot.isActive() ) {
+		shot.end( pourTime(), shotRecord );
+		if ( g_persistent ) shots.add( shotRecord );
+	}
+	shots.close();
+
+	// write the rest of the log (the last part is left for the next session
+	// to compress, along with the side files)
+	journal().add( EventJournal::Controller, EventJournal::Stop );
+	journal().close();
+	if ( !journal().good() || (journal().getDropped() > 0) )
+		cerr << "gaggia: event journal incomplete (" << journal().getDropped()
+		     << " dropped)\n";
+	out.close();
+	history.close();
+	rollups.close();
+	retention.stop();
+	uploader.stop();
+	AsyncLogWriter::Stats stats = out.getStats();
+	cout << "gaggia: log records=" << stats.written
+	     << " dropped=" << stats.dropped
+	     << " flushes=" << stats.flushes
+	     << " syncs=" << stats.syncs
+	     << " max queued=" << stats.maxQueued
+	     << (stats.good ? "" : " (write errors)") << endl;
+	if ( g_persistent && textConfig.count( "uploadCollector" ) ) {
+		LogUploader::Stats upload = uploader.getStats();
+		cout << "gaggia: uploaded bytes=" << upload.bytes
+		     << " batches=" << upload.batches
+		     << " files=" << upload.files
+		     << " failures=" << upload.failures << endl;
+	}
+
+	// record the loop timing and recent events for the session
+	writeLoopReport( fileName );
+	writeTrace( fileName );
+
     // if the halt button was pushed, halt the system
     if ( g_halt ) {
         // rather than shutting down immediately, we want to schedule this to
@@ -692,11 +1593,6 @@ int Hardware::runTests()
 
 int main( int argc, char **argv )
 {
-    // check that PIGPIO is initialised
-    if ( !PIGPIOManager::get().ready() ) {
-        cerr << "gaggia: failed to initialise PIGPIO\n";
-        return 1;
-    }
 
 	// hook SIGINT so we can exit gracefully
 	if ( signal(SIGINT, signalHandler) == SIG_ERR ) {
@@ -710,6 +1606,18 @@ int main( int argc, char **argv )
 		return 1;
 	}
 
+	// hook SIGUSR1 to write the loop timing report on demand
+	if ( signal(SIGUSR1, signalHandler) == SIG_ERR ) {
+		cerr << "gaggia: failed to hook SIGUSR1\n";
+		return 1;
+	}
+
+	// hook SIGUSR2 to write the event trace on demand
+	if ( signal(SIGUSR2, signalHandler) == SIG_ERR ) {
+		cerr << "gaggia: failed to hook SIGUSR2\n";
+		return 1;
+	}
+
     // ignore SIGHUP to prevent an exit when running as a systemd service
     // (this appears to be an issue with SDL_Init as others have reported
     // the same issue with SDL1 and PyGame)
@@ -727,6 +1635,15 @@ int main( int argc, char **argv )
 
 	bool interactive = false;
 
+	// file names given to commands (such as replay and export-csv)
+	std::vector<string> arguments;
+
+	// part of the log used by replay and export-csv
+	LogRange range;
+
+	// add the wall clock time to the samples exported
+	bool wallTime = false;
+
 	for (int i=2; i<argc; ++i) {
 		string option( argv[i] );
 		if ( option == "-i" )
@@ -734,10 +1651,151 @@ int main( int argc, char **argv )
 		else if ( option == "-d" ) {
             // disable the boiler
 			g_enableBoiler = false;
+		} else if ( (option == "-c") && (i+1 < argc) ) {
+            // alternative configuration file
+            configFile = argv[++i];
+        } else if ( (option == "-l") && (i+1 < argc) ) {
+            // alternative log file directory
+            filePath = argv[++i];
+            if ( filePath[filePath.size()-1] != '/' ) filePath += '/';
+        } else if ( (option == "-t") && (i+1 < argc) ) {
+            // run time limit in seconds
+            g_runTime = atof( argv[++i] );
+        } else if ( (option == "--from") && (i+1 < argc) ) {
+            // start of the range of a log, as elapsed seconds
+            range.from = atof( argv[++i] );
+        } else if ( (option == "--to") && (i+1 < argc) ) {
+            // end of the range of a log, as elapsed seconds
+            range.to = atof( argv[++i] );
+        } else if ( (option == "--pour") && (i+1 < argc) ) {
+            // range of a log covering one pour
+            range.pour = static_cast<unsigned>( atoi( argv[++i] ) );
+        } else if ( option == "--wall" ) {
+            // export the wall clock time of the samples
+            wallTime = true;
+        } else if ( option == "--csv" ) {
+            // write the session log as CSV rather than binary
+            g_logFormat = CSVFormat;
+#ifdef GAGGIA_SIM
+        } else if ( option == "--virtual" ) {
+            // lock-step virtual time: runs as fast as possible, repeatably
+            static VirtualClock virtualClock;
+            setClockSource( &virtualClock );
+            g_persistent = false;
+        } else if ( (option == "--speed") && (i+1 < argc) ) {
+            // time runs faster than real time by the given factor
+            static ScaledClock scaledClock( atof( argv[++i] ) );
+            setClockSource( &scaledClock );
+            g_persistent = false;
+#endif
+		} else if ( option[0] != '-' ) {
+			arguments.push_back( option );
 		} else
 			cerr << "gaggia: unexpected option\n";
 	}
 
+	// converting logs doesn't need the hardware
+	if ( command == "export-csv" ) {
+		if ( arguments.empty() ) {
+			cerr << "gaggia: expected a log file name\n";
+			return 1;
+		}
+		return exportCSV(
+			arguments[0], (arguments.size() > 1) ? arguments[1] : string(),
+			range, wallTime
+		);
+	}
+
+	// statistics over the logs (all of those in the log directory, unless
+	// files are given)
+	if ( command == "stats" ) {
+		LogStats stats;
+		if ( arguments.empty() ) {
+			if ( !stats.addDirectory( filePath ) ) {
+				cerr << "gaggia: unable to read log directory " << filePath << endl;
+				return 1;
+			}
+		} else {
+			for (size_t i=0; i<arguments.size(); ++i)
+				stats.addFile( arguments[i] );
+		}
+		stats.run();
+		stats.write( cout );
+		return 0;
+	}
+
+	// searching the shot database doesn't need the hardware
+	if ( command == "shots" )
+		return listShots( arguments.empty() ? string() : arguments[0] );
+	if ( command == "similar" ) {
+		if ( arguments.empty() ) {
+			cerr << "gaggia: expected a shot log file name\n";
+			return 1;
+		}
+		return listSimilarShots(
+			arguments[0],
+			(arguments.size() > 1) ? static_cast<size_t>( atoi( arguments[1].c_str() ) ) : 5
+		);
+	}
+
+	// nor does reading the history
+	if ( command == "history" )
+		return printHistory(
+			(arguments.size() > 0) ? arguments[0] : string(),
+			(arguments.size() > 1) ? arguments[1] : string()
+		);
+	if ( command == "rollup" )
+		return printRollups(
+			(arguments.size() > 0) ? arguments[0] : string(),
+			(arguments.size() > 1) ? arguments[1] : string(),
+			(arguments.size() > 2) ? arguments[2] : string()
+		);
+
+	// or the event journal and the flight recorder
+	if ( command == "events" ) {
+		if ( arguments.empty() ) {
+			cerr << "gaggia: expected an event journal file name\n";
+			return 1;
+		}
+		return printJournal( arguments[0] );
+	}
+	if ( command == "recorder" ) {
+		if ( arguments.empty() ) {
+			cerr << "gaggia: expected a flight recorder file name\n";
+			return 1;
+		}
+		return printRecorder( arguments[0] );
+	}
+
+	// receiving logs from other machines (until interrupted)
+	if ( command == "collect" ) {
+		if ( arguments.empty() ) {
+			cerr << "gaggia: expected a port number\n";
+			return 1;
+		}
+		string directory( (arguments.size() > 1) ? arguments[1] : filePath );
+		if ( directory[directory.size()-1] != '/' ) directory += '/';
+
+		LogCollector collector;
+		if ( !collector.run(
+			static_cast<unsigned>( atoi( arguments[0].c_str() ) ), directory,
+			[]() { return g_quit; }
+		) ) {
+			cerr << "gaggia: unable to listen on port " << arguments[0] << endl;
+			return 1;
+		}
+		return 0;
+	}
+
+    // register the main thread with the clock source
+    getClockSource().attach();
+
+    // check that PIGPIO is initialised
+    if ( !PIGPIOManager::get().ready() ) {
+        cerr << "gaggia: failed to initialise PIGPIO\n";
+        return 1;
+    }
+
 	if ( command == "stop" ) {
 		Boiler boiler;
 		boiler.powerOff();
@@ -750,6 +1808,53 @@ int main( int argc, char **argv )
 	} else if ( command == "test" ) {
 		cout << "gaggia: test mode\n";
 		return Hardware().runTests();
+#ifdef GAGGIA_SIM
+	} else if ( command == "replay" ) {
+		// feed a recorded log through the simulated sensors
+		const string replayFile( arguments.empty() ? string() : arguments[0] );
+		if ( (range.pour > 0) && !findPour( replayFile, range ) ) {
+			cerr << "gaggia: pour " << range.pour << " is not in the index of "
+			     << replayFile << endl;
+			return 1;
+		}
+
+		ReplayPlant replay;
+		if ( !replay.load( replayFile, range.from, range.to ) ) {
+			cerr << "gaggia: unable to read log file (" << replayFile << ")\n";
+			return 1;
+		}
+
+		// the pressure correction is needed to recover the sensor readings
+		if ( loadConfig( configFile ) )
+			replay.setCorrection(
+				config["pressureScale"], config["pressureOffset"]
+			);
+
+		// run until the end of the log, unless a time limit was given
+		if ( g_runTime <= 0.0 ) g_runTime = replay.getDuration();
+
+		// a replay is not a real session
+		g_persistent = false;
+
+		string fileName(
+			"replay-" + makeSideFileName(
+				replayFile.substr( replayFile.find_last_of('/') + 1 ),
+				getLogExtension( g_logFormat )
+			)
+		);
+		cout << "gaggia: replaying " << replay.size() << " samples (log="
+		     << fileName << ")\n";
+
+		Simulation::setPlant( &replay );
+		int result = 0;
+		{
+			Hardware hardware;
+			replay.start();
+			result = hardware.runController( interactive, filePath + fileName );
+		}
+		Simulation::setPlant( 0 );
+		return result;
+#endif
 	} else {
 		cerr << "gaggia: unrecognised command (" << command << ")\n";
 		return 1;
@@ -1,6 +1,8 @@
 #include "gpiopin.h"
 #include "timing.h"
 #include "pigpiomgr.h"
+#include "hal.h"
+#include "recorder.h"
 
 using namespace std;
 
@@ -31,7 +33,7 @@ GPIOPin & GPIOPin::setOutput( bool output )
 {
     if ( m_open ) {
         // set pin to input/output as appropriate
-        set_mode( m_pin, output ? PI_OUTPUT : PI_INPUT );
+        HAL::gpioSetMode( m_pin, output ? HAL::Output : HAL::Input );
 
         // read pin state: when the pin is set as an output, this may be
         // unreliable, but decided it's better not to enforce the pin
@@ -53,7 +55,7 @@ GPIOPin & GPIOPin::setPull( Pull pull )
 {
     if ( m_open && !m_output ) {
         // set pin pull/up down state
-        set_pull_up_down( m_pin, pull );
+        HAL::gpioSetPull( m_pin, static_cast<HAL::Pull>(pull) );
     }
     return *this;
 }
@@ -63,8 +65,9 @@ GPIOPin & GPIOPin::setPull( Pull pull )
 GPIOPin & GPIOPin::setState( bool state )
 {
     if ( m_open ) {
-        gpio_write( m_pin, state ? 1 : 0 );
+        HAL::gpioWrite( m_pin, state );
         m_state = state;
+        Recorder::record( Recorder::Output, m_pin, state ? 1.0 : 0.0 );
     }
 	return *this;
 }
@@ -74,7 +77,9 @@ GPIOPin & GPIOPin::setState( bool state )
 GPIOPin & GPIOPin::setPWMDuty( double duty )
 {
     if ( m_open )
-        set_PWM_dutycycle( m_pin, static_cast<unsigned>(duty * 255.0 + 0.5) );
+        HAL::gpioSetPWMDuty(
+            m_pin, static_cast<unsigned>(duty * 255.0 + 0.5)
+        );
     return *this;
 }
 
@@ -83,7 +88,7 @@ GPIOPin & GPIOPin::setPWMDuty( double duty )
 GPIOPin & GPIOPin::setPWMFrequency( unsigned frequency )
 {
     if ( m_open )
-        set_PWM_frequency( m_pin, frequency );
+        HAL::gpioSetPWMFrequency( m_pin, frequency );
     return *this;
 }
 
@@ -97,7 +102,7 @@ bool GPIOPin::getState() const
             return m_state;
         } else {
             // pin is set as an input: read the actual pin state
-            return (gpio_read( m_pin ) != 0);
+            return HAL::gpioRead( m_pin );
         }
     } else
         return false;
@@ -163,8 +168,8 @@ GPIOPin & GPIOPin::edgeFuncRegister( EdgeFunc edgeFunc )
     m_edgeFunc = edgeFunc;
 
     // register a callback
-    unsigned edge = static_cast<unsigned>(m_edge);
-    m_callback = callback_ex( m_pin, edge, local::callback, this );
+    HAL::Edge edge = static_cast<HAL::Edge>(m_edge);
+    m_callback = HAL::gpioCallback( m_pin, edge, local::callback, this );
 
     return *this;
 }//edgeFuncRegister
@@ -173,9 +178,9 @@ GPIOPin & GPIOPin::edgeFuncRegister( EdgeFunc edgeFunc )
 
 GPIOPin & GPIOPin::edgeFuncCancel()
 {
-    // cancel the pigpiod callback
+    // cancel the HAL callback
     if ( m_callback >= 0 ) {
-        callback_cancel( m_callback );
+        HAL::gpioCallbackCancel( m_callback );
         m_callback = -1;
     }
 
@@ -196,8 +201,8 @@ bool GPIOPin::poll( unsigned timeout )
     double seconds = static_cast<double>(timeout) / 1000.0;
 
     // wait for specified edge
-    unsigned edge = static_cast<unsigned>(m_edge);
-    return (wait_for_edge( m_pin, edge, seconds ) == 1);
+    HAL::Edge edge = static_cast<HAL::Edge>(m_edge);
+    return HAL::gpioWaitForEdge( m_pin, edge, seconds );
 }//poll
 
 //-----------------------------------------------------------------------------
@@ -226,6 +231,7 @@ void GPIOPin::close()
 
 void GPIOPin::callback( unsigned pin, bool level, unsigned tick)
 {
+    Recorder::record( Recorder::Input, pin, level ? 1.0 : 0.0, tick );
     if ( m_edgeFunc ) m_edgeFunc( pin, level, tick );
 }
 
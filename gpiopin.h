@@ -4,7 +4,7 @@
 //-----------------------------------------------------------------------------
 
 #include <functional>
-#include "pigpiomgr.h"
+#include "hal.h"
 
 //-----------------------------------------------------------------------------
 
@@ -16,16 +16,16 @@ public:
 
 	/// Supported edge trigger modes
 	enum Edge {
-		Falling = FALLING_EDGE,
-		Rising  = RISING_EDGE,
-		Both    = EITHER_EDGE
+		Falling = HAL::FallingEdge,
+		Rising  = HAL::RisingEdge,
+		Both    = HAL::EitherEdge
 	};
 
     /// Supported pull up/down modes
     enum Pull {
-        Float   = PI_PUD_OFF,
-        Down    = PI_PUD_DOWN,
-        Up      = PI_PUD_UP
+        Float   = HAL::PullOff,
+        Down    = HAL::PullDown,
+        Up      = HAL::PullUp
     };
 
 	/// Set the pin to be an output (true) or input (false)
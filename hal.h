@@ -0,0 +1,174 @@
+#ifndef __hal_h
+#define __hal_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <stddef.h>
+#include <inttypes.h>
+
+//-----------------------------------------------------------------------------
+
+/// Hardware Abstraction Layer. The device classes (TSIC, GPIOPin, HCSR04,
+/// ADC, PWM and Display) use these functions rather than talking directly to
+/// pigpiod, /dev/mem, /dev/i2c-1 or SDL. The backend is selected at link time:
+/// halpi.cpp drives the Raspberry Pi hardware, and halsim.cpp provides an
+/// in-process simulation which runs on any Linux machine.
+namespace HAL {
+
+//-- Initialisation
+
+/// Initialise the backend. Returns a version number (zero or greater) for
+/// success, or a negative value in case of failure
+int open();
+
+/// Shut down the backend
+void close();
+
+//-- GPIO
+
+/// GPIO pin modes
+enum Mode {
+    Input,
+    Output
+};
+
+/// GPIO pull up/down modes
+enum Pull {
+    PullOff,
+    PullDown,
+    PullUp
+};
+
+/// GPIO edge trigger modes
+enum Edge {
+    RisingEdge,
+    FallingEdge,
+    EitherEdge
+};
+
+/// Function called when a GPIO pin changes state. The tick is a time stamp
+/// in microseconds which wraps around approximately every 72 minutes.
+typedef void (*EdgeFunc)(
+    unsigned gpio, unsigned level, uint32_t tick, void *userData
+);
+
+/// Set the GPIO pin mode (returns true for success)
+bool gpioSetMode( unsigned gpio, Mode mode );
+
+/// Set the GPIO pin pull up/down state (returns true for success)
+bool gpioSetPull( unsigned gpio, Pull pull );
+
+/// Set the GPIO output level (returns true for success)
+bool gpioWrite( unsigned gpio, bool level );
+
+/// Read the GPIO input level
+bool gpioRead( unsigned gpio );
+
+/// Set the software PWM duty cycle on a pin (0..255)
+bool gpioSetPWMDuty( unsigned gpio, unsigned duty );
+
+/// Set the software PWM frequency on a pin (nearest match is used)
+bool gpioSetPWMFrequency( unsigned gpio, unsigned frequency );
+
+/// Register a function to be called when the pin changes state. Returns a
+/// callback identifier (zero or greater), or a negative value on failure
+int gpioCallback( unsigned gpio, Edge edge, EdgeFunc func, void *userData );
+
+/// Cancel a callback. On return, the function will not be called again.
+void gpioCallbackCancel( int id );
+
+/// Wait for an edge with timeout in seconds. Returns true if detected.
+bool gpioWaitForEdge( unsigned gpio, Edge edge, double timeout );
+
+//-- I2C
+
+/// Open an I2C device given the device path name and slave address. Returns
+/// a handle (zero or greater) or a negative value in case of failure
+int i2cOpen( const std::string & device, unsigned address );
+
+/// Close an I2C device
+void i2cClose( int handle );
+
+/// Write bytes to an I2C device (returns true for success)
+bool i2cWrite( int handle, const uint8_t *data, size_t length );
+
+/// Read bytes from an I2C device (returns true for success)
+bool i2cRead( int handle, uint8_t *data, size_t length );
+
+//-- Broadcom peripheral registers
+
+/// Map the GPIO, clock and PWM register blocks into memory
+bool bcmMap(
+    volatile unsigned *& gpio,
+    volatile unsigned *& clk,
+    volatile unsigned *& pwm
+);
+
+/// Unmap the register blocks
+void bcmUnmap(
+    volatile unsigned *gpio,
+    volatile unsigned *clk,
+    volatile unsigned *pwm
+);
+
+//-- Display
+
+/// Opaque font handle
+struct Font;
+
+/// Opaque image handle
+struct Image;
+
+/// RGB colour
+struct Colour {
+    uint8_t r, g, b;
+};
+
+/// Rectangle in pixels
+struct Rect {
+    short x, y;
+    unsigned short w, h;
+};
+
+/// Open the display, returning the resolution in pixels
+bool displayOpen( int & width, int & height );
+
+/// Close the display
+void displayClose();
+
+/// Open a TrueType font with the given point size
+Font * fontOpen( const std::string & path, int size );
+
+/// Close a font
+void fontClose( Font *font );
+
+/// Load an image file and convert it to the display format
+Image * imageLoad( const std::string & path );
+
+/// Free an image
+void imageFree( Image *image );
+
+/// Fill a rectangle (or the whole display if rect is null)
+void displayFill( const Rect *rect, Colour colour );
+
+/// Draw text with the top left corner at x,y
+void displayText(
+    Font *font,
+    short x, short y,
+    const std::string & text,
+    Colour foreground,
+    Colour background
+);
+
+/// Draw an image with the top left corner at x,y
+void displayBlit( Image *image, short x, short y );
+
+/// Flip the display buffers
+void displayFlip();
+
+} // namespace HAL
+
+//-----------------------------------------------------------------------------
+
+#endif//__hal_h
@@ -0,0 +1,388 @@
+#include "hal.h"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+#include <SDL/SDL.h>
+#include <SDL/SDL_image.h>
+#include <SDL/SDL_ttf.h>
+extern "C" {
+#include <pigpiod_if.h>
+}
+
+//-----------------------------------------------------------------------------
+//
+// Raspberry Pi backend for the Hardware Abstraction Layer. GPIO is provided
+// by PIGPIOD via the pigpiod_if functions, I2C by the i2c-dev driver, the
+// hardware PWM by mapping the Broadcom peripherals from /dev/mem, and the
+// display by SDL on the framebuffer device.
+//
+//-----------------------------------------------------------------------------
+
+const off_t BCM2708_PERI_BASE = 0x20000000;
+
+const off_t BCM_BASE_CLOCK = (BCM2708_PERI_BASE + 0x101000);	///< Clocks
+const off_t BCM_BASE_GPIO  = (BCM2708_PERI_BASE + 0x200000);	///< GPIO
+const off_t BCM_BASE_PWM   = (BCM2708_PERI_BASE + 0x20C000);	///< PWM
+
+const size_t BLOCK_SIZE = 4096;
+
+/// Display surface
+static SDL_Surface *g_display = 0;
+
+//-----------------------------------------------------------------------------
+
+int HAL::open()
+{
+    // guessing this is the same return value as gpioInitialise (undocumented)
+    int version = pigpio_start( NULL, NULL );
+    return ( version == PI_INIT_FAILED ) ? -1 : version;
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::close()
+{
+    pigpio_stop();
+}
+
+//-----------------------------------------------------------------------------
+
+/// Convert edge trigger mode to PIGPIO value
+static unsigned toPigpioEdge( HAL::Edge edge )
+{
+    switch ( edge ) {
+    case HAL::RisingEdge:  return RISING_EDGE;
+    case HAL::FallingEdge: return FALLING_EDGE;
+    default:               return EITHER_EDGE;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::gpioSetMode( unsigned gpio, Mode mode )
+{
+    return ( set_mode( gpio, (mode == Output) ? PI_OUTPUT : PI_INPUT ) == 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::gpioSetPull( unsigned gpio, Pull pull )
+{
+    unsigned pud = PI_PUD_OFF;
+    if ( pull == PullDown )
+        pud = PI_PUD_DOWN;
+    else if ( pull == PullUp )
+        pud = PI_PUD_UP;
+
+    return ( set_pull_up_down( gpio, pud ) == 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::gpioWrite( unsigned gpio, bool level )
+{
+    return ( gpio_write( gpio, level ? 1 : 0 ) == 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::gpioRead( unsigned gpio )
+{
+    return ( gpio_read( gpio ) > 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::gpioSetPWMDuty( unsigned gpio, unsigned duty )
+{
+    return ( set_PWM_dutycycle( gpio, duty ) == 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::gpioSetPWMFrequency( unsigned gpio, unsigned frequency )
+{
+    return ( set_PWM_frequency( gpio, frequency ) >= 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+int HAL::gpioCallback( unsigned gpio, Edge edge, EdgeFunc func, void *userData )
+{
+    return callback_ex( gpio, toPigpioEdge( edge ), func, userData );
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::gpioCallbackCancel( int id )
+{
+    if ( id >= 0 ) callback_cancel( id );
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::gpioWaitForEdge( unsigned gpio, Edge edge, double timeout )
+{
+    return ( wait_for_edge( gpio, toPigpioEdge( edge ), timeout ) == 1 );
+}
+
+//-----------------------------------------------------------------------------
+
+int HAL::i2cOpen( const std::string & device, unsigned address )
+{
+    // attempt to open
+    int file = ::open( device.c_str(), O_RDWR );
+    if ( file < 0 ) return -1;
+
+    // select the I2C slave address
+    if ( ioctl( file, I2C_SLAVE, address ) < 0 ) {
+        ::close( file );
+        return -1;
+    }
+
+    return file;
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::i2cClose( int handle )
+{
+    if ( handle >= 0 ) ::close( handle );
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::i2cWrite( int handle, const uint8_t *data, size_t length )
+{
+    return ( write( handle, data, length ) == static_cast<ssize_t>(length) );
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::i2cRead( int handle, uint8_t *data, size_t length )
+{
+    return ( read( handle, data, length ) == static_cast<ssize_t>(length) );
+}
+
+//-----------------------------------------------------------------------------
+
+static volatile unsigned *mapRegion(
+	int	   fd,		// file descriptor to /dev/mem
+	size_t length,	// size of block
+	off_t  offset	// offset of block
+) {
+	return reinterpret_cast<volatile unsigned *>( mmap(
+		NULL,			// let the kernel choose the address for us
+		length,			// size of the block to map
+		PROT_READ  |	// read and write access
+		PROT_WRITE,
+		MAP_SHARED,		// share with other processes
+		fd,				// file descriptor to /dev/mem
+		offset			// base offset to map
+	) );
+}//mapRegion
+
+//-----------------------------------------------------------------------------
+
+bool HAL::bcmMap(
+    volatile unsigned *& gpio,
+    volatile unsigned *& clk,
+    volatile unsigned *& pwm
+) {
+	// open /dev/mem
+	int fd = ::open( "/dev/mem", O_RDWR | O_SYNC );
+	if ( fd < 0 ) return false;
+
+	// map GPIO
+	gpio = mapRegion( fd, BLOCK_SIZE, BCM_BASE_GPIO );
+	if ( gpio == MAP_FAILED ) return false;
+
+	// map Clocks
+	clk = mapRegion( fd, BLOCK_SIZE, BCM_BASE_CLOCK );
+	if ( clk == MAP_FAILED ) return false;
+
+	// map PWM
+	pwm = mapRegion( fd, BLOCK_SIZE, BCM_BASE_PWM );
+	if ( pwm == MAP_FAILED ) return false;
+
+	// close /dev/mem
+  	::close( fd );
+
+	// success
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::bcmUnmap(
+    volatile unsigned *gpio,
+    volatile unsigned *clk,
+    volatile unsigned *pwm
+) {
+	munmap( (void*)pwm,  BLOCK_SIZE );
+	munmap( (void*)clk,  BLOCK_SIZE );
+	munmap( (void*)gpio, BLOCK_SIZE );
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::displayOpen( int & width, int & height )
+{
+	// todo: clean this up
+	static const char *table[] = {
+		"TSLIB_TSDEVICE=/dev/input/event0",
+        "TSLIB_TSEVENTTYPE=INPUT",
+        "TSLIB_CONFFILE=/etc/ts.conf",
+        "TSLIB_CALIBFILE=/etc/pointercal",
+        "SDL_FBDEV=/dev/fb1",
+        "SDL_MOUSEDRV=TSLIB",
+        "SDL_MOUSEDEV=/dev/input/event0",
+        "SDL_NOMOUSE=1",
+        "SDL_VIDEODRIVER=FBCON",
+        0
+    };
+
+    for ( int i=0; table[i] != 0; ++i )
+    	putenv( (char*)table[i] );
+
+	// initialise SDL
+	if ( SDL_Init(SDL_INIT_VIDEO) < 0 ) return false;
+
+	// get video information (resolution and bits per pixel)
+	const SDL_VideoInfo *videoInfo = SDL_GetVideoInfo();
+
+	// display resolution
+	width  = videoInfo->current_w;
+	height = videoInfo->current_h;
+
+	// create display surface
+	g_display = SDL_SetVideoMode(
+		videoInfo->current_w,
+		videoInfo->current_h,
+		videoInfo->vfmt->BitsPerPixel,
+		0
+	);
+	if ( g_display == 0 ) return false;
+
+	// initialise TTF
+	if ( TTF_Init() < 0 ) return false;
+
+	// hide mouse pointer
+	SDL_ShowCursor( 0 );
+
+	// success
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::displayClose()
+{
+	// close TTF
+	TTF_Quit();
+
+	// close SDL
+	SDL_Quit();
+
+	g_display = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+HAL::Font * HAL::fontOpen( const std::string & path, int size )
+{
+    return reinterpret_cast<Font*>( TTF_OpenFont( path.c_str(), size ) );
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::fontClose( Font *font )
+{
+    if ( font != 0 ) TTF_CloseFont( reinterpret_cast<TTF_Font*>(font) );
+}
+
+//-----------------------------------------------------------------------------
+
+HAL::Image * HAL::imageLoad( const std::string & path )
+{
+    SDL_Surface *temp = IMG_Load( path.c_str() );
+    if ( temp == 0 ) return 0;
+    SDL_Surface *image = SDL_DisplayFormat( temp );
+    SDL_FreeSurface( temp );
+    return reinterpret_cast<Image*>( image );
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::imageFree( Image *image )
+{
+    if ( image != 0 ) SDL_FreeSurface( reinterpret_cast<SDL_Surface*>(image) );
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::displayFill( const Rect *rect, Colour colour )
+{
+    if ( g_display == 0 ) return;
+
+    Uint32 rgb = SDL_MapRGB( g_display->format, colour.r, colour.g, colour.b );
+
+    if ( rect != 0 ) {
+        SDL_Rect sdlRect = { rect->x, rect->y, rect->w, rect->h };
+        SDL_FillRect( g_display, &sdlRect, rgb );
+    } else
+        SDL_FillRect( g_display, 0, rgb );
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::displayText(
+    Font *font,
+    short x, short y,
+    const std::string & text,
+    Colour foreground,
+    Colour background
+) {
+	if ( (g_display == 0) || (font == 0) ) return;
+
+    SDL_Color fg = { foreground.r, foreground.g, foreground.b, 255 };
+    SDL_Color bg = { background.r, background.g, background.b, 255 };
+
+	SDL_Surface *textSurface = TTF_RenderText_Shaded(
+		reinterpret_cast<TTF_Font*>(font),
+		text.c_str(),
+		fg,
+		bg
+	);
+	if ( textSurface == 0 ) return;
+
+	SDL_Rect destRect = { x, y };
+
+	SDL_BlitSurface( textSurface, 0, g_display, &destRect );
+
+	SDL_FreeSurface( textSurface );
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::displayBlit( Image *image, short x, short y )
+{
+    if ( (g_display == 0) || (image == 0) ) return;
+
+    SDL_Rect destRect = { x, y, 0, 0 };
+    SDL_BlitSurface(
+        reinterpret_cast<SDL_Surface*>(image), 0, g_display, &destRect
+    );
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::displayFlip()
+{
+    if ( g_display != 0 ) SDL_Flip( g_display );
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,825 @@
+#include "hal.h"
+#include "simulation.h"
+#include "boilermodel.h"
+#include "settings.h"
+#include "timing.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+//-----------------------------------------------------------------------------
+//
+// Simulated backend for the Hardware Abstraction Layer. This runs entirely
+// in-process: GPIO pins, the ADS1015 ADC, the Broadcom PWM registers and the
+// display are emulated in memory, and a worker thread steps a Plant model to
+// generate the sensor signals (TSIC packets, flow meter pulses, ultrasonic
+// echoes and ADC voltages) that the real devices would produce.
+//
+//-----------------------------------------------------------------------------
+
+/// number of GPIO pins
+static const unsigned GPIO_PINS = 54;
+
+/// size of each Broadcom register block in words
+static const size_t BCM_BLOCK_WORDS = 4096 / sizeof(unsigned);
+
+/// simulation time step in seconds
+static const double SIM_STEP = 0.01;
+
+/// TSIC sample period in seconds (the sensor runs at 10Hz)
+static const double TSIC_PERIOD = 0.1;
+
+/// TSIC bit frame length in microseconds
+static const uint32_t TSIC_FRAME_US = 125;
+
+/// pulse counts per litre of the simulated flow meter
+static const double FLOW_COUNTS_PER_LITRE = 4095.0;
+
+/// the speed of sound in mm/s
+static const double SPEED_SOUND_MMS = 340270.0;
+
+/// ADC input voltages for each button state (indexed by the button bit mask)
+/// produced by the resistor ladder on the front panel
+static const std::array<double,8> BUTTON_VOLTAGES{
+    3.30754, 2.65300, 2.19561, 1.87800, 1.66669, 1.47100, 1.33261, 1.19700
+};
+
+/// maximum reading of the pressure transducer in bar (0..300psi)
+static const double PRESSURE_MAX_BAR = 20.6842719;
+
+/// display resolution
+static const int DISPLAY_WIDTH  = 320;
+static const int DISPLAY_HEIGHT = 240;
+
+//-----------------------------------------------------------------------------
+
+/// Font handle used by the simulated display
+struct HAL::Font {
+    int size;   ///< point size
+};
+
+/// Image handle used by the simulated display
+struct HAL::Image {
+    int width;                      ///< width in pixels
+    int height;                     ///< height in pixels
+    std::vector<uint32_t> pixels;   ///< pixel data
+};
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+/// Registered GPIO edge callback
+struct Callback {
+    int           id;
+    unsigned      gpio;
+    HAL::Edge     edge;
+    HAL::EdgeFunc func;
+    void         *userData;
+};
+
+/// Simulated GPIO pin state
+struct Pin {
+    HAL::Mode mode;
+    bool      level;
+    unsigned  duty;
+    unsigned  frequency;
+};
+
+/// Emulation of the ADS1015 registers
+struct ADS1015 {
+    uint8_t  pointer;
+    uint16_t config;
+    uint16_t conversion;
+};
+
+//-----------------------------------------------------------------------------
+
+class Simulator {
+public:
+    Simulator();
+
+    ~Simulator();
+
+    /// Start the worker thread
+    void start();
+
+    /// Stop the worker thread
+    void stop();
+
+    /// Call the functions registered for a pin
+    void dispatch( unsigned gpio, bool level, uint32_t tick );
+
+    /// Returns the voltage on an ADC input
+    double getVoltage( unsigned channel ) const;
+
+    /// Returns current microsecond tick
+    static uint32_t getTick();
+
+public:
+    /// Mutex for all shared state except callbacks in flight
+    mutable std::mutex m_mutex;
+
+    /// Held while callbacks are running, so that cancellation can wait
+    std::recursive_mutex m_dispatch;
+
+    std::array<Pin, GPIO_PINS> m_pins;  ///< GPIO pin state
+    std::vector<Callback> m_callbacks;  ///< edge callbacks
+    int m_nextCallback;                 ///< next callback identifier
+
+    ADS1015 m_adc;                      ///< ADC registers
+    bool    m_adcOpen;                  ///< is the ADC open?
+
+    /// Broadcom register blocks
+    volatile unsigned m_gpioRegs[BCM_BLOCK_WORDS];
+    volatile unsigned m_clkRegs[BCM_BLOCK_WORDS];
+    volatile unsigned m_pwmRegs[BCM_BLOCK_WORDS];
+
+    BoilerModel m_defaultPlant;         ///< default plant
+    Plant    *m_plant;                  ///< connected plant
+    Actuators m_actuators;              ///< latest actuator settings
+    Sensors   m_sensors;                ///< latest sensor values
+    unsigned  m_buttons;                ///< buttons held down
+
+    std::vector<uint32_t> m_backBuffer;     ///< display back buffer
+    std::vector<uint32_t> m_frontBuffer;    ///< display front buffer
+    std::atomic<unsigned long> m_frames;    ///< number of frames flipped
+
+private:
+    /// Worker thread
+    void worker();
+
+    /// Send a TSIC packet for the given temperature
+    void sendTemperature( double degrees );
+
+private:
+    std::atomic<bool> m_run;    ///< should the worker continue to run?
+    std::thread m_thread;       ///< worker thread
+};
+
+/// The simulator instance
+static Simulator g_sim;
+
+//-----------------------------------------------------------------------------
+
+Simulator::Simulator() :
+    m_nextCallback( 0 ),
+    m_adcOpen( false ),
+    m_plant( &m_defaultPlant ),
+    m_buttons( 0 ),
+    m_backBuffer( DISPLAY_WIDTH * DISPLAY_HEIGHT, 0 ),
+    m_frontBuffer( DISPLAY_WIDTH * DISPLAY_HEIGHT, 0 ),
+    m_frames( 0 ),
+    m_run( false )
+{
+    for (size_t i=0; i<m_pins.size(); ++i) {
+        m_pins[i].mode      = HAL::Input;
+        m_pins[i].level     = true;
+        m_pins[i].duty      = 0;
+        m_pins[i].frequency = 0;
+    }
+
+    m_adc.pointer    = 0;
+    m_adc.config     = 0x8583;
+    m_adc.conversion = 0;
+
+    for (size_t i=0; i<BCM_BLOCK_WORDS; ++i) {
+        m_gpioRegs[i] = 0;
+        m_clkRegs[i]  = 0;
+        m_pwmRegs[i]  = 0;
+    }
+
+    memset( &m_actuators, 0, sizeof(m_actuators) );
+    memset( &m_sensors, 0, sizeof(m_sensors) );
+}
+
+//-----------------------------------------------------------------------------
+
+Simulator::~Simulator()
+{
+    stop();
+}
+
+//-----------------------------------------------------------------------------
+
+void Simulator::start()
+{
+    stop();
+
+    // initialise the sensors from the plant before the devices open
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_plant->step( 0.0, m_actuators, m_sensors );
+    }
+
+    m_run = true;
+    m_thread = startThread( &Simulator::worker, this );
+}
+
+//-----------------------------------------------------------------------------
+
+void Simulator::stop()
+{
+    m_run = false;
+    joinThread( m_thread );
+}
+
+//-----------------------------------------------------------------------------
+
+void Simulator::dispatch( unsigned gpio, bool level, uint32_t tick )
+{
+    std::lock_guard<std::recursive_mutex> dispatchLock( m_dispatch );
+
+    // take a copy of the matching callbacks, so they can be called without
+    // holding the mutex
+    Callback matches[4];
+    size_t count = 0;
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( gpio < m_pins.size() )
+            m_pins[gpio].level = level;
+
+        for (size_t i=0; i<m_callbacks.size(); ++i) {
+            const Callback & callback = m_callbacks[i];
+            if ( callback.gpio != gpio ) continue;
+            if ( (callback.edge == HAL::RisingEdge) && !level ) continue;
+            if ( (callback.edge == HAL::FallingEdge) && level ) continue;
+            if ( count < 4 ) matches[count++] = callback;
+        }
+    }
+
+    for (size_t i=0; i<count; ++i)
+        matches[i].func( gpio, level ? 1 : 0, tick, matches[i].userData );
+}
+
+//-----------------------------------------------------------------------------
+
+double Simulator::getVoltage( unsigned channel ) const
+{
+    switch ( channel ) {
+    case ADC_BUTTON_CHANNEL:
+        {
+            unsigned buttons = m_buttons & 7;
+            if ( m_sensors.brewSwitch ) buttons |= 1 << (BREW_SWITCH-1);
+            return BUTTON_VOLTAGES[buttons];
+        }
+
+    case ADC_PRESSURE_CHANNEL:
+        // 0.5V to 4.5V output over the full range of the transducer
+        return 0.5 + 4.0 * m_sensors.pressure / PRESSURE_MAX_BAR;
+
+    default:
+        return 0.0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+uint32_t Simulator::getTick()
+{
+    return static_cast<uint32_t>(
+        static_cast<uint64_t>( getClock() * 1.0E6 )
+    );
+}
+
+//-----------------------------------------------------------------------------
+
+void Simulator::sendTemperature( double degrees )
+{
+    // convert to the 11 bit value sent by the sensor (-50C to 150C range)
+    double scaled = (degrees + 50.0) * 2047.0 / 200.0 + 0.5;
+    if ( scaled < 0.0 ) scaled = 0.0;
+    if ( scaled > 2047.0 ) scaled = 2047.0;
+    int raw = static_cast<int>( scaled );
+
+    // two packets, each with a start bit, eight data bits and even parity
+    uint32_t word = 0;
+    for (int p=0; p<2; ++p) {
+        int data = (p == 0) ? (raw >> 8) : (raw & 0xFF);
+        int parity = __builtin_parity( data );
+        word = (word << 10) | (1 << 9) | (data << 1) | parity;
+    }
+
+    // send the bits MSB first, using a 125us frame with a 25% duty cycle for
+    // a high bit and 75% duty cycle for a low bit
+    uint32_t tick = getTick();
+    for (int bit=19; bit>=0; --bit) {
+        uint32_t low = ((word >> bit) & 1) ?
+            TSIC_FRAME_US / 4 : TSIC_FRAME_US * 3 / 4;
+        dispatch( TSIC_PIN, false, tick );
+        dispatch( TSIC_PIN, true, tick + low );
+        tick += TSIC_FRAME_US;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void Simulator::worker()
+{
+    // start time and next time step
+    double next = getClock();
+    double nextTemperature = next;
+
+    // number of flow meter edges sent so far
+    unsigned long flowEdges = 0;
+    bool flowLevel = false;
+
+    while ( m_run ) {
+        next += SIM_STEP;
+
+        Sensors sensors;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+
+            // read back the actuators: the boiler uses the hardware PWM
+            // (range and data registers), and the pump uses GPIO
+            unsigned range = m_pwmRegs[4];
+            unsigned data  = m_pwmRegs[5];
+            m_actuators.heater = (range > 0) ?
+                static_cast<double>(data) / static_cast<double>(range) : 0.0;
+            m_actuators.pump = m_pins[PUMP_PIN].level &&
+                (m_pins[PUMP_PIN].mode == HAL::Output);
+            m_actuators.pumpDuty =
+                static_cast<double>( m_pins[PUMP_PWM_PIN].duty ) / 255.0;
+
+            // advance the plant
+            m_plant->step( SIM_STEP, m_actuators, m_sensors );
+            sensors = m_sensors;
+        }
+
+        // send flow meter pulses (one count per edge)
+        unsigned long edges = static_cast<unsigned long>(
+            sensors.litres * FLOW_COUNTS_PER_LITRE
+        );
+        uint32_t tick = getTick();
+        while ( flowEdges < edges ) {
+            flowLevel = !flowLevel;
+            dispatch( FLOWPIN, flowLevel, tick++ );
+            ++flowEdges;
+        }
+
+        // send a temperature packet
+        if ( getClock() >= nextTemperature ) {
+            nextTemperature += TSIC_PERIOD;
+            sendTemperature( sensors.temperature );
+        }
+
+        // sleep for the remainder of the time step
+        double remain = next - getClock();
+        if ( remain > 0.0 )
+            delayms( static_cast<int>(1.0E3 * remain) );
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+/// Returns a simple pixel value
+static uint32_t toPixel( HAL::Colour colour )
+{
+    return (colour.r << 16) | (colour.g << 8) | colour.b;
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+
+int HAL::open()
+{
+    g_sim.start();
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::close()
+{
+    g_sim.stop();
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::gpioSetMode( unsigned gpio, Mode mode )
+{
+    if ( gpio >= GPIO_PINS ) return false;
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    g_sim.m_pins[gpio].mode = mode;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::gpioSetPull( unsigned gpio, Pull pull )
+{
+    if ( gpio >= GPIO_PINS ) return false;
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    if ( g_sim.m_pins[gpio].mode == Input ) {
+        if ( pull == PullUp )
+            g_sim.m_pins[gpio].level = true;
+        else if ( pull == PullDown )
+            g_sim.m_pins[gpio].level = false;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::gpioWrite( unsigned gpio, bool level )
+{
+    if ( gpio >= GPIO_PINS ) return false;
+
+    bool wasHigh = false;
+    double range = 0.0;
+    {
+        std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+        wasHigh = g_sim.m_pins[gpio].level;
+        g_sim.m_pins[gpio].mode  = Output;
+        g_sim.m_pins[gpio].level = level;
+        range = g_sim.m_sensors.range;
+    }
+
+    // the falling edge of the ranger trigger pulse produces an echo pulse
+    // with a width proportional to the distance
+    if ( (gpio == RANGER_TRIGGER_OUT) && wasHigh && !level && (range > 0.0) ) {
+        uint32_t width = static_cast<uint32_t>(
+            range * 2.0E6 / SPEED_SOUND_MMS
+        );
+        uint32_t tick = Simulator::getTick() + 100;
+        g_sim.dispatch( RANGER_ECHO_IN, true, tick );
+        g_sim.dispatch( RANGER_ECHO_IN, false, tick + width );
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::gpioRead( unsigned gpio )
+{
+    if ( gpio >= GPIO_PINS ) return false;
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    return g_sim.m_pins[gpio].level;
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::gpioSetPWMDuty( unsigned gpio, unsigned duty )
+{
+    if ( gpio >= GPIO_PINS ) return false;
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    g_sim.m_pins[gpio].duty = (duty > 255) ? 255 : duty;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::gpioSetPWMFrequency( unsigned gpio, unsigned frequency )
+{
+    if ( gpio >= GPIO_PINS ) return false;
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    g_sim.m_pins[gpio].frequency = frequency;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+int HAL::gpioCallback( unsigned gpio, Edge edge, EdgeFunc func, void *userData )
+{
+    if ( (gpio >= GPIO_PINS) || (func == 0) ) return -1;
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    Callback callback = { g_sim.m_nextCallback++, gpio, edge, func, userData };
+    g_sim.m_callbacks.push_back( callback );
+    return callback.id;
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::gpioCallbackCancel( int id )
+{
+    // wait for any callbacks in flight to complete
+    std::lock_guard<std::recursive_mutex> dispatchLock( g_sim.m_dispatch );
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+
+    std::vector<Callback> & callbacks = g_sim.m_callbacks;
+    for (size_t i=0; i<callbacks.size(); ++i) {
+        if ( callbacks[i].id == id ) {
+            callbacks.erase( callbacks.begin() + i );
+            break;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::gpioWaitForEdge( unsigned /*gpio*/, Edge /*edge*/, double timeout )
+{
+    // edges are not queued by the simulator: wait for the timeout
+    delayms( static_cast<unsigned>(timeout * 1.0E3) );
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+
+int HAL::i2cOpen( const std::string & /*device*/, unsigned address )
+{
+    // only the ADS1015 ADC is present on the simulated bus
+    if ( address != ADS1015_ADC_I2C_ADDRESS ) return -1;
+
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    if ( g_sim.m_adcOpen ) return -1;
+    g_sim.m_adcOpen = true;
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::i2cClose( int handle )
+{
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    if ( handle == 0 ) g_sim.m_adcOpen = false;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Convert the input selected by a configuration register value into the
+/// conversion register (the simulator mutex must be locked)
+static void convertADC( uint16_t config )
+{
+    // full scale voltage for each PGA setting
+    static const double fullScale[8] = {
+        6.144, 4.096, 2.048, 1.024, 0.512, 0.256, 0.256, 0.256
+    };
+
+    unsigned mux = (config >> 12) & 7;
+    double voltage = (mux >= 4) ? g_sim.getVoltage( mux - 4 ) : 0.0;
+    double scale = fullScale[ (config >> 9) & 7 ];
+    long raw = lround( voltage / scale * 2047.0 );
+    if ( raw > 2047 ) raw = 2047;
+    if ( raw < -2048 ) raw = -2048;
+    g_sim.m_adc.conversion = static_cast<uint16_t>( raw << 4 );
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::i2cWrite( int handle, const uint8_t *data, size_t length )
+{
+    if ( (handle != 0) || (length == 0) ) return false;
+
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    ADS1015 & adc = g_sim.m_adc;
+
+    // the first byte is the pointer register
+    adc.pointer = data[0] & 3;
+    if ( length < 3 ) return true;
+
+    // remaining bytes are written to the register
+    uint16_t value = (static_cast<uint16_t>(data[1]) << 8) | data[2];
+    if ( adc.pointer != 1 ) return true;
+
+    // a write to the configuration register with the OS bit set, or in
+    // continuous mode (MODE bit clear), starts a conversion: this completes
+    // immediately
+    if ( ((value & 0x8000) != 0) || ((value & 0x0100) == 0) )
+        convertADC( value );
+    adc.config = value | 0x8000;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::i2cRead( int handle, uint8_t *data, size_t length )
+{
+    if ( (handle != 0) || (length < 2) ) return false;
+
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    const ADS1015 & adc = g_sim.m_adc;
+
+    // in continuous mode the conversion follows the input
+    if ( (adc.pointer == 0) && ((adc.config & 0x0100) == 0) )
+        convertADC( adc.config );
+
+    uint16_t value = 0;
+    if ( adc.pointer == 0 )
+        value = adc.conversion;
+    else if ( adc.pointer == 1 )
+        value = adc.config;
+
+    data[0] = static_cast<uint8_t>(value >> 8);
+    data[1] = static_cast<uint8_t>(value & 0xFF);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::bcmMap(
+    volatile unsigned *& gpio,
+    volatile unsigned *& clk,
+    volatile unsigned *& pwm
+) {
+    gpio = g_sim.m_gpioRegs;
+    clk  = g_sim.m_clkRegs;
+    pwm  = g_sim.m_pwmRegs;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::bcmUnmap(
+    volatile unsigned * /*gpio*/,
+    volatile unsigned * /*clk*/,
+    volatile unsigned * /*pwm*/
+) {
+}
+
+//-----------------------------------------------------------------------------
+
+bool HAL::displayOpen( int & width, int & height )
+{
+    width  = DISPLAY_WIDTH;
+    height = DISPLAY_HEIGHT;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::displayClose()
+{
+}
+
+//-----------------------------------------------------------------------------
+
+HAL::Font * HAL::fontOpen( const std::string & /*path*/, int size )
+{
+    Font *font = new Font;
+    font->size = size;
+    return font;
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::fontClose( Font *font )
+{
+    delete font;
+}
+
+//-----------------------------------------------------------------------------
+
+HAL::Image * HAL::imageLoad( const std::string & path )
+{
+    // images are replaced by a 32x32 block with a colour based on the name
+    uint32_t hash = 2166136261u;
+    for (size_t i=0; i<path.size(); ++i)
+        hash = (hash ^ static_cast<uint8_t>(path[i])) * 16777619u;
+
+    Image *image = new Image;
+    image->width  = 32;
+    image->height = 32;
+    image->pixels.assign( 32 * 32, hash & 0xFFFFFF );
+    return image;
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::imageFree( Image *image )
+{
+    delete image;
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::displayFill( const Rect *rect, Colour colour )
+{
+    Rect all = { 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT };
+    if ( rect == 0 ) rect = &all;
+
+    int x0 = std::max( 0, static_cast<int>(rect->x) );
+    int y0 = std::max( 0, static_cast<int>(rect->y) );
+    int x1 = std::min( DISPLAY_WIDTH,  rect->x + rect->w );
+    int y1 = std::min( DISPLAY_HEIGHT, rect->y + rect->h );
+
+    uint32_t pixel = toPixel( colour );
+    for (int y=y0; y<y1; ++y) {
+        uint32_t *row = &g_sim.m_backBuffer[y * DISPLAY_WIDTH];
+        for (int x=x0; x<x1; ++x) row[x] = pixel;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::displayText(
+    Font *font,
+    short x, short y,
+    const std::string & text,
+    Colour foreground,
+    Colour background
+) {
+    if ( font == 0 ) return;
+
+    // each character is drawn as a cell filled with the background colour,
+    // containing a 5x7 grid of foreground blocks derived from the character
+    const int cellWidth  = font->size * 3 / 5;
+    const int cellHeight = font->size * 6 / 5;
+    const int block = std::max( 1, font->size / 10 );
+
+    uint32_t fg = toPixel( foreground );
+    uint32_t bg = toPixel( background );
+
+    for (size_t c=0; c<text.size(); ++c) {
+        int left = x + static_cast<int>(c) * cellWidth;
+        uint32_t pattern = static_cast<uint8_t>(text[c]) * 2654435761u;
+        for (int row=0; row<cellHeight; ++row) {
+            int py = y + row;
+            if ( (py < 0) || (py >= DISPLAY_HEIGHT) ) continue;
+            uint32_t *line = &g_sim.m_backBuffer[py * DISPLAY_WIDTH];
+            for (int col=0; col<cellWidth; ++col) {
+                int px = left + col;
+                if ( (px < 0) || (px >= DISPLAY_WIDTH) ) continue;
+                int bit = ((row / block) % 7) * 5 + (col / block) % 5;
+                line[px] = ((pattern >> bit) & 1) ? fg : bg;
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::displayBlit( Image *image, short x, short y )
+{
+    if ( image == 0 ) return;
+
+    for (int row=0; row<image->height; ++row) {
+        int py = y + row;
+        if ( (py < 0) || (py >= DISPLAY_HEIGHT) ) continue;
+        for (int col=0; col<image->width; ++col) {
+            int px = x + col;
+            if ( (px < 0) || (px >= DISPLAY_WIDTH) ) continue;
+            g_sim.m_backBuffer[py * DISPLAY_WIDTH + px] =
+                image->pixels[row * image->width + col];
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void HAL::displayFlip()
+{
+    g_sim.m_frontBuffer = g_sim.m_backBuffer;
+    ++g_sim.m_frames;
+}
+
+//-----------------------------------------------------------------------------
+
+void Simulation::setPlant( Plant *plant )
+{
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    g_sim.m_plant = (plant != 0) ? plant : &g_sim.m_defaultPlant;
+    g_sim.m_plant->step( 0.0, g_sim.m_actuators, g_sim.m_sensors );
+}
+
+//-----------------------------------------------------------------------------
+
+void Simulation::configure( const std::map<std::string, double> & config )
+{
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    g_sim.m_defaultPlant.configure( config );
+    g_sim.m_defaultPlant.reset();
+    g_sim.m_plant->step( 0.0, g_sim.m_actuators, g_sim.m_sensors );
+}
+
+//-----------------------------------------------------------------------------
+
+void Simulation::setButtons( unsigned buttons )
+{
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    g_sim.m_buttons = buttons;
+}
+
+//-----------------------------------------------------------------------------
+
+Actuators Simulation::getActuators()
+{
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    return g_sim.m_actuators;
+}
+
+//-----------------------------------------------------------------------------
+
+Sensors Simulation::getSensors()
+{
+    std::lock_guard<std::mutex> lock( g_sim.m_mutex );
+    return g_sim.m_sensors;
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned long Simulation::getFrameCount()
+{
+    return g_sim.m_frames;
+}
+
+//-----------------------------------------------------------------------------
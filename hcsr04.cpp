@@ -1,6 +1,8 @@
 #include <unistd.h>
 #include "hcsr04.h"
 #include "pigpiomgr.h"
+#include "timing.h"
+#include "hal.h"
 
 //-----------------------------------------------------------------------------
 //
@@ -50,11 +52,11 @@ bool HCSR04::open( unsigned gpioTrigOut, unsigned gpioEchoIn )
         return false;
 
     // set up the input pin
-    if ( set_mode( gpioEchoIn, PI_INPUT ) != 0 )
+    if ( !HAL::gpioSetMode( gpioEchoIn, HAL::Input ) )
         return false;
 
     // set up the output pin
-    if ( set_mode( gpioTrigOut, PI_OUTPUT ) != 0 ) {
+    if ( !HAL::gpioSetMode( gpioTrigOut, HAL::Output ) ) {
         // note: echo is left as an input
         return false;
     }
@@ -71,12 +73,12 @@ bool HCSR04::open( unsigned gpioTrigOut, unsigned gpioEchoIn )
     };
 
     // set a function to receive events when the input changes state
-    m_callback = callback_ex(
-        gpioEchoIn, EITHER_EDGE, local::alertFunction, this
+    m_callback = HAL::gpioCallback(
+        gpioEchoIn, HAL::EitherEdge, local::alertFunction, this
     );
     if ( m_callback < 0 ) {
         // note: in case of failure, set output back to an input
-        set_mode( gpioTrigOut, PI_INPUT );
+        HAL::gpioSetMode( gpioTrigOut, HAL::Input );
         return false;
     }
 
@@ -98,11 +100,11 @@ void HCSR04::close()
     if ( !m_open ) return;
 
     // remove the alert function
-    callback_cancel( m_callback );
+    HAL::gpioCallbackCancel( m_callback );
     m_callback = -1;
 
     // change the output to an input
-    set_mode( m_gpioTrig, PI_INPUT );
+    HAL::gpioSetMode( m_gpioTrig, HAL::Input );
 
     m_gpioTrig = 0;
     m_gpioEcho = 0;
@@ -129,17 +131,17 @@ bool HCSR04::getRange( long & us, long & mm )
     //-- send 10us pulse
 
     // ensure GPIO is low initially
-    gpio_write( m_gpioTrig, 0 );
+    HAL::gpioWrite( m_gpioTrig, false );
 
     // take GPIO high
-    if ( gpio_write( m_gpioTrig, 1 ) != 0 )
+    if ( !HAL::gpioWrite( m_gpioTrig, true ) )
         return false;
 
     // delay for 10us
-    usleep(10);
+    delayus(10);
 
     // take GPIO low
-    if ( gpio_write( m_gpioTrig, 0 ) != 0 )
+    if ( !HAL::gpioWrite( m_gpioTrig, false ) )
         return false;
 
     // polling interval (ms)
@@ -150,7 +152,7 @@ bool HCSR04::getRange( long & us, long & mm )
     unsigned slept = 0;
     do {
         // polling interval
-        usleep( pollInterval * 1000 );
+        delayms( pollInterval );
         slept += pollInterval;
 
         std::lock_guard<std::mutex> lock( m_mutex );
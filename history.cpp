@@ -0,0 +1,722 @@
+#include "history.h"
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+
+// History file format (version 1). All integers are little endian.
+//
+// The file is a sequence of 4kB blocks. The first holds the file header:
+//
+//   "GHST", u16 version, u16 reserved, u32 block size, u32 block slots
+//
+// and each of the others a block of samples, starting with a header:
+//
+//   "GHBK", u32 sequence, u16 samples, u16 reserved, u32 bits used,
+//   i64 time of the first sample in ms, i64 time of the last sample in ms
+//
+// followed by the samples as a bit stream (most significant bit first). The
+// first sample has the six values as 64 bit doubles. Each later sample has
+// the change in the interval since the previous sample (D):
+//
+//   '0'                    D = 0
+//   '10'   + 7 bits        D in [-63, 64]
+//   '110'  + 9 bits        D in [-255, 256]
+//   '1110' + 12 bits       D in [-2047, 2048]
+//   '1111' + 32 bits       any other D which fits in 32 bits
+//
+// followed by each value as the XOR (X) with the previous value:
+//
+//   '0'                    X = 0
+//   '10'  + bits           the meaningful bits of X, which fit within the
+//                          leading and trailing zeros of the previous X
+//   '11'  + 5 bits leading zeros, 6 bits length - 1, and the meaningful bits
+//
+// A sample which doesn't fit in the space left (or whose interval doesn't
+// fit in 32 bits) starts a new block.
+
+/// file signature
+static const char FILE_MAGIC[4] = { 'G', 'H', 'S', 'T' };
+
+/// block signature
+static const char BLOCK_MAGIC[4] = { 'G', 'H', 'B', 'K' };
+
+/// format version
+static const uint16_t HISTORY_VERSION = 1;
+
+/// size of the file header in bytes
+static const size_t FILE_HEADER_SIZE = 16;
+
+/// bits available for the samples in a block
+static const size_t CAPACITY =
+    8 * (HistoryBlock::SIZE - HistoryBlock::HEADER_SIZE);
+
+/// marks the leading and trailing zeros before the first XOR
+static const uint8_t NO_WINDOW = 0xFF;
+
+/// resolution of the values, as in the binary log (Sample field order,
+/// without the elapsed time)
+static const double SCALES[] = { 10000.0, 100.0, 10.0, 100.0, 1.0, 1.0 };
+
+//-----------------------------------------------------------------------------
+
+/// Store a little endian integer
+static void putInteger( uint8_t *p, uint64_t value, size_t size )
+{
+    for (size_t i=0; i<size; ++i)
+        p[i] = static_cast<uint8_t>( value >> (8*i) );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Load a little endian integer
+static uint64_t getInteger( const uint8_t *p, size_t size )
+{
+    uint64_t value = 0;
+    for (size_t i=0; i<size; ++i)
+        value |= static_cast<uint64_t>( p[i] ) << (8*i);
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Writes bits into a zeroed buffer, up to a limit
+class BitWriter {
+public:
+    BitWriter( uint8_t *data, size_t position ) :
+        m_data( data ),
+        m_position( position ),
+        m_overflow( false )
+    {
+    }
+
+    /// Write the low n bits of a value (n from 1 to 64)
+    void write( uint64_t value, unsigned n ) {
+        if ( m_position + n > CAPACITY ) {
+            m_overflow = true;
+            return;
+        }
+        while ( n > 0 ) {
+            unsigned space = 8 - (m_position & 7);
+            unsigned take = std::min( space, n );
+            n -= take;
+            uint8_t bits = static_cast<uint8_t>(
+                (value >> n) & ((1u << take) - 1)
+            );
+            m_data[m_position >> 3] |= static_cast<uint8_t>( bits << (space - take) );
+            m_position += take;
+        }
+    }
+
+    size_t getPosition() const { return m_position; }
+    bool overflow() const { return m_overflow; }
+
+private:
+    uint8_t *m_data;
+    size_t   m_position;
+    bool     m_overflow;
+};
+
+//-----------------------------------------------------------------------------
+
+/// Reads bits from a buffer, up to a limit
+class BitReader {
+public:
+    BitReader( const uint8_t *data, size_t limit ) :
+        m_data( data ),
+        m_position( 0 ),
+        m_limit( limit ),
+        m_overflow( false )
+    {
+    }
+
+    /// Read n bits (n from 1 to 64)
+    uint64_t read( unsigned n ) {
+        if ( m_position + n > m_limit ) {
+            m_overflow = true;
+            return 0;
+        }
+        uint64_t value = 0;
+        while ( n > 0 ) {
+            unsigned offset = m_position & 7;
+            unsigned take = std::min( 8 - offset, n );
+            uint8_t bits = static_cast<uint8_t>(
+                m_data[m_position >> 3] << offset
+            ) >> (8 - take);
+            value = (value << take) | bits;
+            m_position += take;
+            n -= take;
+        }
+        return value;
+    }
+
+    size_t getPosition() const { return m_position; }
+    bool overflow() const { return m_overflow; }
+
+private:
+    const uint8_t *m_data;
+    size_t         m_position;
+    size_t         m_limit;
+    bool           m_overflow;
+};
+
+//-----------------------------------------------------------------------------
+
+/// Convert the values of a sample to whole numbers of their resolution,
+/// stored as doubles
+static void getValues( const Sample & sample, uint64_t *values )
+{
+    const double fields[] = {
+        sample.power, sample.temperature, sample.ml, sample.bar,
+        static_cast<double>( sample.pump ), static_cast<double>( sample.pour )
+    };
+    for (size_t i=0; i<sizeof(fields)/sizeof(fields[0]); ++i) {
+        double value = floor( fields[i] * SCALES[i] + 0.5 );
+        memcpy( &values[i], &value, sizeof(value) );
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+/// Set the values of a sample from the stored values
+static void setValues( const uint64_t *values, Sample & sample )
+{
+    double fields[6];
+    for (size_t i=0; i<6; ++i) {
+        memcpy( &fields[i], &values[i], sizeof(fields[i]) );
+        fields[i] /= SCALES[i];
+    }
+    sample.power       = fields[0];
+    sample.temperature = fields[1];
+    sample.ml          = fields[2];
+    sample.bar         = fields[3];
+    sample.pump        = static_cast<int>( fields[4] );
+    sample.pour        = static_cast<int>( fields[5] );
+}
+
+//-----------------------------------------------------------------------------
+
+HistoryBlock::HistoryBlock()
+{
+    reset( 0 );
+}
+
+//-----------------------------------------------------------------------------
+
+void HistoryBlock::reset( uint32_t sequence )
+{
+    memset( m_data, 0, sizeof(m_data) );
+    memcpy( m_data, BLOCK_MAGIC, sizeof(BLOCK_MAGIC) );
+    putInteger( m_data + 4, sequence, 4 );
+
+    memset( &m_state, 0, sizeof(m_state) );
+    writeHeader();
+}
+
+//-----------------------------------------------------------------------------
+
+bool HistoryBlock::add( const Sample & sample )
+{
+    const int64_t time = static_cast<int64_t>( floor( sample.elapsed * 1.0E3 + 0.5 ) );
+    uint64_t values[VALUE_COUNT];
+    getValues( sample, values );
+
+    State state( m_state );
+    BitWriter out( m_data + HEADER_SIZE, state.bits );
+
+    if ( state.count == 0 ) {
+        // the first sample is stored as it is
+        state.first = time;
+        state.delta = 0;
+        for (size_t i=0; i<VALUE_COUNT; ++i) {
+            out.write( values[i], 64 );
+            state.leading[i] = NO_WINDOW;
+        }
+    } else {
+        // timestamp: change in the interval
+        int64_t delta = time - state.time;
+        int64_t change = delta - state.delta;
+        if ( change == 0 )
+            out.write( 0, 1 );
+        else if ( (change >= -63) && (change <= 64) ) {
+            out.write( 2, 2 );
+            out.write( change + 63, 7 );
+        } else if ( (change >= -255) && (change <= 256) ) {
+            out.write( 6, 3 );
+            out.write( change + 255, 9 );
+        } else if ( (change >= -2047) && (change <= 2048) ) {
+            out.write( 14, 4 );
+            out.write( change + 2047, 12 );
+        } else if ( (change >= INT32_MIN) && (change <= INT32_MAX) ) {
+            out.write( 15, 4 );
+            out.write( static_cast<uint32_t>( static_cast<int32_t>( change ) ), 32 );
+        } else
+            return false;
+        state.delta = delta;
+
+        // values: XOR with the previous value
+        for (size_t i=0; i<VALUE_COUNT; ++i) {
+            uint64_t x = values[i] ^ state.value[i];
+            if ( x == 0 ) {
+                out.write( 0, 1 );
+                continue;
+            }
+
+            unsigned leading = std::min( __builtin_clzll( x ), 31 );
+            unsigned trailing = __builtin_ctzll( x );
+            if (
+                (state.leading[i] != NO_WINDOW) &&
+                (leading >= state.leading[i]) &&
+                (trailing >= state.trailing[i])
+            ) {
+                // within the previous window
+                out.write( 2, 2 );
+                out.write(
+                    x >> state.trailing[i],
+                    64 - state.leading[i] - state.trailing[i]
+                );
+            } else {
+                // new window
+                unsigned length = 64 - leading - trailing;
+                out.write( 3, 2 );
+                out.write( leading, 5 );
+                out.write( length - 1, 6 );
+                out.write( x >> trailing, length );
+                state.leading[i] = static_cast<uint8_t>( leading );
+                state.trailing[i] = static_cast<uint8_t>( trailing );
+            }
+        }
+    }
+
+    if ( out.overflow() ) {
+        // clear any bits written before the end of the block was reached
+        size_t position = m_state.bits;
+        uint8_t *data = m_data + HEADER_SIZE;
+        if ( (position & 7) != 0 ) {
+            data[position >> 3] &= static_cast<uint8_t>( 0xFF00 >> (position & 7) );
+            position = (position + 7) & ~static_cast<size_t>( 7 );
+        }
+        memset( data + (position >> 3), 0, (CAPACITY - position) >> 3 );
+        return false;
+    }
+
+    memcpy( state.value, values, sizeof(values) );
+    state.time = time;
+    state.bits = out.getPosition();
+    ++state.count;
+
+    m_state = state;
+    writeHeader();
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool HistoryBlock::load( const uint8_t *data )
+{
+    State state;
+    if ( !decode( data, state, SampleFunc() ) ) return false;
+
+    memcpy( m_data, data, sizeof(m_data) );
+    m_state = state;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool HistoryBlock::readHeader( const uint8_t *data, Header & header )
+{
+    if ( memcmp( data, BLOCK_MAGIC, sizeof(BLOCK_MAGIC) ) != 0 ) return false;
+
+    header.sequence = static_cast<uint32_t>( getInteger( data + 4, 4 ) );
+    header.count    = static_cast<unsigned>( getInteger( data + 8, 2 ) );
+    header.bits     = static_cast<size_t>( getInteger( data + 12, 4 ) );
+    header.first    = 1.0E-3 * static_cast<int64_t>( getInteger( data + 16, 8 ) );
+    header.last     = 1.0E-3 * static_cast<int64_t>( getInteger( data + 24, 8 ) );
+    return header.bits <= CAPACITY;
+}
+
+//-----------------------------------------------------------------------------
+
+bool HistoryBlock::decode( const uint8_t *data, SampleFunc func )
+{
+    State state;
+    return decode( data, state, func );
+}
+
+//-----------------------------------------------------------------------------
+
+bool HistoryBlock::decode( const uint8_t *data, State & state, SampleFunc func )
+{
+    Header header;
+    if ( !readHeader( data, header ) ) return false;
+
+    memset( &state, 0, sizeof(state) );
+    state.first = static_cast<int64_t>( getInteger( data + 16, 8 ) );
+    state.time = state.first;
+
+    BitReader in( data + HEADER_SIZE, header.bits );
+    Sample sample;
+    for ( ; state.count < header.count; ++state.count ) {
+        if ( state.count == 0 ) {
+            for (size_t i=0; i<VALUE_COUNT; ++i) {
+                state.value[i] = in.read( 64 );
+                state.leading[i] = NO_WINDOW;
+            }
+        } else {
+            // timestamp
+            int64_t change;
+            if ( in.read( 1 ) == 0 )
+                change = 0;
+            else if ( in.read( 1 ) == 0 )
+                change = static_cast<int64_t>( in.read( 7 ) ) - 63;
+            else if ( in.read( 1 ) == 0 )
+                change = static_cast<int64_t>( in.read( 9 ) ) - 255;
+            else if ( in.read( 1 ) == 0 )
+                change = static_cast<int64_t>( in.read( 12 ) ) - 2047;
+            else
+                change = static_cast<int32_t>( in.read( 32 ) );
+            state.delta += change;
+            state.time += state.delta;
+
+            // values
+            for (size_t i=0; i<VALUE_COUNT; ++i) {
+                if ( in.read( 1 ) == 0 ) continue;
+                if ( in.read( 1 ) == 0 ) {
+                    if ( state.leading[i] == NO_WINDOW ) return false;
+                } else {
+                    state.leading[i] = static_cast<uint8_t>( in.read( 5 ) );
+                    unsigned length = static_cast<unsigned>( in.read( 6 ) ) + 1;
+                    if ( state.leading[i] + length > 64 ) return false;
+                    state.trailing[i] =
+                        static_cast<uint8_t>( 64 - state.leading[i] - length );
+                }
+                unsigned length = 64 - state.leading[i] - state.trailing[i];
+                state.value[i] ^= in.read( length ) << state.trailing[i];
+            }
+        }
+        if ( in.overflow() ) return false;
+
+        if ( func ) {
+            sample.elapsed = 1.0E-3 * static_cast<double>( state.time );
+            setValues( state.value, sample );
+            func( sample );
+        }
+    }
+
+    state.bits = in.getPosition();
+    return state.bits == header.bits;
+}
+
+//-----------------------------------------------------------------------------
+
+const uint8_t * HistoryBlock::getData() const
+{
+    return m_data;
+}
+
+//-----------------------------------------------------------------------------
+
+uint32_t HistoryBlock::getSequence() const
+{
+    return static_cast<uint32_t>( getInteger( m_data + 4, 4 ) );
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned HistoryBlock::getCount() const
+{
+    return m_state.count;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t HistoryBlock::getBits() const
+{
+    return m_state.bits;
+}
+
+//-----------------------------------------------------------------------------
+
+void HistoryBlock::writeHeader()
+{
+    putInteger( m_data + 8,  m_state.count, 2 );
+    putInteger( m_data + 10, 0, 2 );
+    putInteger( m_data + 12, m_state.bits, 4 );
+    putInteger( m_data + 16, static_cast<uint64_t>( m_state.first ), 8 );
+    putInteger( m_data + 24, static_cast<uint64_t>( m_state.time ), 8 );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Read the file header, returning the number of block slots (or zero if
+/// it is not a history file)
+static uint32_t readFileHeader( int fd )
+{
+    uint8_t header[FILE_HEADER_SIZE];
+    if (
+        (pread( fd, header, sizeof(header), 0 ) != sizeof(header)) ||
+        (memcmp( header, FILE_MAGIC, sizeof(FILE_MAGIC) ) != 0) ||
+        (getInteger( header + 8, 4 ) != HistoryBlock::SIZE)
+    )
+        return 0;
+
+    return static_cast<uint32_t>( getInteger( header + 12, 4 ) );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Returns the file offset of a block slot (the file header is in the first
+/// block)
+static off_t getBlockOffset( uint32_t slot )
+{
+    return static_cast<off_t>( slot + 1 ) * HistoryBlock::SIZE;
+}
+
+//-----------------------------------------------------------------------------
+
+HistoryStore::HistoryStore() :
+    m_fd( -1 ),
+    m_good( false ),
+    m_capacity( 0 ),
+    m_slot( 0 ),
+    m_dirty( false ),
+    m_newest( 0.0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+HistoryStore::~HistoryStore()
+{
+    close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool HistoryStore::open( const std::string & fileName, uint64_t maxSize )
+{
+    close();
+
+    m_fd = ::open( fileName.c_str(), O_RDWR | O_CREAT, 0644 );
+    if ( m_fd < 0 ) return false;
+
+    struct stat info;
+    if ( fstat( m_fd, &info ) != 0 ) {
+        close();
+        return false;
+    }
+
+    m_capacity = readFileHeader( m_fd );
+    if ( (m_capacity == 0) && (info.st_size > 0) ) {
+        // something else: leave it alone
+        close();
+        return false;
+    }
+
+    if ( m_capacity == 0 ) {
+        // new file
+        m_capacity = static_cast<uint32_t>(
+            std::max<uint64_t>( maxSize / HistoryBlock::SIZE, 2 ) - 1
+        );
+
+        uint8_t header[HistoryBlock::SIZE];
+        memset( header, 0, sizeof(header) );
+        memcpy( header, FILE_MAGIC, sizeof(FILE_MAGIC) );
+        putInteger( header + 4,  HISTORY_VERSION, 2 );
+        putInteger( header + 8,  HistoryBlock::SIZE, 4 );
+        putInteger( header + 12, m_capacity, 4 );
+        if ( pwrite( m_fd, header, sizeof(header), 0 ) != sizeof(header) ) {
+            close();
+            return false;
+        }
+    }
+
+    // find the newest block
+    uint32_t newest = 0;
+    m_slot = 0;
+    m_newest = 0.0;
+    for (uint32_t slot=0; slot<m_capacity; ++slot) {
+        if ( getBlockOffset( slot ) >= info.st_size ) break;
+
+        uint8_t data[HistoryBlock::HEADER_SIZE];
+        HistoryBlock::Header header;
+        if (
+            (pread( m_fd, data, sizeof(data), getBlockOffset( slot ) ) == sizeof(data)) &&
+            HistoryBlock::readHeader( data, header ) &&
+            (header.sequence > newest)
+        ) {
+            newest = header.sequence;
+            m_slot = slot;
+            m_newest = header.last;
+        }
+    }
+
+    // continue filling it, or start the next one if it can't be read
+    uint8_t data[HistoryBlock::SIZE];
+    if (
+        (newest == 0) ||
+        (pread( m_fd, data, sizeof(data), getBlockOffset( m_slot ) ) != sizeof(data)) ||
+        !m_block.load( data )
+    ) {
+        if ( newest > 0 ) m_slot = (m_slot + 1) % m_capacity;
+        m_block.reset( newest + 1 );
+    }
+
+    m_good = true;
+    m_dirty = false;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void HistoryStore::close()
+{
+    if ( m_fd < 0 ) return;
+
+    flush( false );
+    ::close( m_fd );
+    m_fd = -1;
+}
+
+//-----------------------------------------------------------------------------
+
+void HistoryStore::add( const Sample & sample )
+{
+    if ( m_fd < 0 ) return;
+
+    // keep the blocks in order of time, even if the clock goes back
+    if ( sample.elapsed < m_newest ) return;
+    m_newest = sample.elapsed;
+
+    if ( !m_block.add( sample ) ) {
+        // the block is full: write it and start the next, replacing the
+        // oldest block once the file is full
+        writeBlock();
+        m_slot = (m_slot + 1) % m_capacity;
+        m_block.reset( m_block.getSequence() + 1 );
+        if ( !m_block.add( sample ) ) return;
+    }
+    m_dirty = true;
+}
+
+//-----------------------------------------------------------------------------
+
+void HistoryStore::flush( bool sync )
+{
+    if ( m_fd < 0 ) return;
+
+    if ( m_dirty ) writeBlock();
+    if ( sync && (fdatasync( m_fd ) != 0) ) m_good = false;
+}
+
+//-----------------------------------------------------------------------------
+
+bool HistoryStore::good() const
+{
+    return m_good;
+}
+
+//-----------------------------------------------------------------------------
+
+void HistoryStore::writeBlock()
+{
+    ssize_t written = pwrite(
+        m_fd, m_block.getData(), HistoryBlock::SIZE, getBlockOffset( m_slot )
+    );
+    if ( written != static_cast<ssize_t>( HistoryBlock::SIZE ) ) m_good = false;
+    m_dirty = false;
+}
+
+//-----------------------------------------------------------------------------
+
+HistoryReader::HistoryReader() :
+    m_fd( -1 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+HistoryReader::~HistoryReader()
+{
+    if ( m_fd >= 0 ) ::close( m_fd );
+}
+
+//-----------------------------------------------------------------------------
+
+bool HistoryReader::open( const std::string & fileName )
+{
+    if ( m_fd >= 0 ) ::close( m_fd );
+    m_blocks.clear();
+
+    m_fd = ::open( fileName.c_str(), O_RDONLY );
+    if ( m_fd < 0 ) return false;
+
+    uint32_t capacity = readFileHeader( m_fd );
+    if ( capacity == 0 ) return false;
+
+    // the block headers, in the order they were written
+    for (uint32_t slot=0; slot<capacity; ++slot) {
+        uint8_t data[HistoryBlock::HEADER_SIZE];
+        ssize_t size = pread( m_fd, data, sizeof(data), getBlockOffset( slot ) );
+        if ( size != sizeof(data) ) break;
+
+        Block block;
+        block.slot = slot;
+        if (
+            HistoryBlock::readHeader( data, block.header ) &&
+            (block.header.count > 0)
+        )
+            m_blocks.push_back( block );
+    }
+    std::sort( m_blocks.begin(), m_blocks.end() );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+HistoryReader::Stats HistoryReader::getStats() const
+{
+    Stats stats;
+    stats.blocks  = static_cast<unsigned>( m_blocks.size() );
+    stats.samples = 0;
+    stats.bytes   = static_cast<uint64_t>( m_blocks.size() ) * HistoryBlock::SIZE;
+    stats.first   = m_blocks.empty() ? 0.0 : m_blocks.front().header.first;
+    stats.last    = m_blocks.empty() ? 0.0 : m_blocks.back().header.last;
+
+    for (size_t i=0; i<m_blocks.size(); ++i)
+        stats.samples += m_blocks[i].header.count;
+    return stats;
+}
+
+//-----------------------------------------------------------------------------
+
+bool HistoryReader::read( double from, double to, HistoryBlock::SampleFunc func )
+{
+    if ( m_fd < 0 ) return false;
+
+    uint8_t data[HistoryBlock::SIZE];
+    for (size_t i=0; i<m_blocks.size(); ++i) {
+        const Block & block = m_blocks[i];
+        if ( block.header.last < from ) continue;
+        if ( (to > 0.0) && (block.header.first > to) ) continue;
+
+        ssize_t size = pread( m_fd, data, sizeof(data), getBlockOffset( block.slot ) );
+        if ( size != static_cast<ssize_t>( sizeof(data) ) ) return false;
+
+        // the block being written may change as it is read, so a block
+        // which can't be decoded is skipped
+        HistoryBlock::decode( data, [&]( const Sample & sample ) {
+            if ( sample.elapsed < from ) return;
+            if ( (to > 0.0) && (sample.elapsed > to) ) return;
+            func( sample );
+        } );
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
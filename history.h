@@ -0,0 +1,213 @@
+#ifndef __history_h
+#define __history_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <inttypes.h>
+#include "telemetry.h"
+
+//-----------------------------------------------------------------------------
+
+/// Block of compressed samples, in the style of the Gorilla time series
+/// database: each timestamp (in milliseconds) is stored as the change in the
+/// interval since the previous sample, which is usually zero, and each value
+/// as the XOR with the previous value, which is zero when the value hasn't
+/// changed and otherwise has few meaningful bits. The values are rounded to
+/// the resolution of the binary log and stored as whole numbers of that unit
+/// so that the XOR of nearby values is small. In the samples stored and
+/// returned, the elapsed field holds the time in seconds since the epoch.
+class HistoryBlock {
+public:
+    /// Size of a block in bytes
+    static const size_t SIZE = 4096;
+
+    /// Size of the block header in bytes
+    static const size_t HEADER_SIZE = 32;
+
+    /// Block header
+    struct Header {
+        uint32_t sequence;  ///< Sequence number (from 1)
+        unsigned count;     ///< Number of samples
+        size_t   bits;      ///< Bits used by the samples
+        double   first;     ///< Time of the first sample
+        double   last;      ///< Time of the last sample
+    };
+
+    /// Function called for each sample decoded
+    typedef std::function<void(const Sample & sample)> SampleFunc;
+
+    /// Default constructor: an empty block with sequence number zero
+    HistoryBlock();
+
+    /// Empty the block and give it a sequence number
+    void reset( uint32_t sequence );
+
+    /// Add a sample. Returns false (leaving the block unchanged) if the
+    /// block is full.
+    bool add( const Sample & sample );
+
+    /// Load a block which was written before, so that more samples can be
+    /// added to it. Returns false if the data is not a valid block.
+    bool load( const uint8_t *data );
+
+    /// Read the header of a block (HEADER_SIZE bytes). Returns false if it
+    /// is not a valid block header.
+    static bool readHeader( const uint8_t *data, Header & header );
+
+    /// Decode the samples of a block. Returns false if the data is not a
+    /// valid block.
+    static bool decode( const uint8_t *data, SampleFunc func );
+
+    /// Returns the block data (SIZE bytes)
+    const uint8_t * getData() const;
+
+    /// Returns the sequence number of the block
+    uint32_t getSequence() const;
+
+    /// Returns the number of samples in the block
+    unsigned getCount() const;
+
+    /// Returns the number of bits used by the samples
+    size_t getBits() const;
+
+private:
+    /// Values stored for each sample
+    static const size_t VALUE_COUNT = 6;
+
+    /// Encoding state, which is also the state of a decoder after the same
+    /// samples
+    struct State {
+        unsigned count;                 ///< Number of samples
+        size_t   bits;                  ///< Bits used (after the header)
+        int64_t  first;                 ///< Time of the first sample in ms
+        int64_t  time;                  ///< Time of the last sample in ms
+        int64_t  delta;                 ///< Last interval in ms
+        uint64_t value[VALUE_COUNT];    ///< Last values (as double bits)
+        uint8_t  leading[VALUE_COUNT];  ///< Leading zeros of the last XOR
+        uint8_t  trailing[VALUE_COUNT]; ///< Trailing zeros of the last XOR
+    };
+
+    /// Decode the samples of a block, leaving the state after the last one
+    static bool decode( const uint8_t *data, State & state, SampleFunc func );
+
+    /// Write the header from the state
+    void writeHeader();
+
+private:
+    uint8_t m_data[SIZE];   ///< Block data
+    State   m_state;        ///< Encoding state
+};
+
+//-----------------------------------------------------------------------------
+
+/// Long term history of the session samples, kept in a file of fixed size
+/// blocks which is used as a ring: once the file reaches its maximum size,
+/// each new block replaces the oldest one. The block being filled is
+/// written again each time it is flushed, as for the session logs.
+class HistoryStore : public LogSink {
+public:
+    /// Default constructor
+    HistoryStore();
+
+    /// Destructor
+    ~HistoryStore();
+
+    /// Open the history file, continuing from the last block written, or
+    /// create it with the given maximum size in bytes (the size of an
+    /// existing file is kept). Returns true for success.
+    bool open( const std::string & fileName, uint64_t maxSize );
+
+    /// Write the current block and close the file
+    void close();
+
+    /// Add a sample, with the elapsed field set to the time in seconds since
+    /// the epoch. A sample older than the newest in the history is ignored,
+    /// as the blocks must stay in order of time for HistoryReader.
+    void add( const Sample & sample );
+
+    /// Write the current block to the file, and optionally wait for it to
+    /// reach the disk
+    void flush( bool sync );
+
+    /// Have all writes succeeded so far?
+    bool good() const;
+
+private:
+    /// Copy constructor (unsupported)
+    HistoryStore( const HistoryStore & );
+
+    /// Assignment operator (unsupported)
+    HistoryStore & operator = ( const HistoryStore & );
+
+    /// Write the current block to its slot in the file
+    void writeBlock();
+
+private:
+    int          m_fd;          ///< History file
+    bool         m_good;        ///< Have all writes succeeded?
+    uint32_t     m_capacity;    ///< Number of block slots in the file
+    uint32_t     m_slot;        ///< Slot of the current block
+    bool         m_dirty;       ///< Samples added since the last write?
+    double       m_newest;      ///< Time of the newest sample
+    HistoryBlock m_block;       ///< Current block
+};
+
+//-----------------------------------------------------------------------------
+
+/// Reads ranges of the history written by HistoryStore
+class HistoryReader {
+public:
+    /// History statistics
+    struct Stats {
+        unsigned blocks;    ///< Blocks in use
+        uint64_t samples;   ///< Number of samples
+        uint64_t bytes;     ///< Size of the blocks in use in bytes
+        double   first;     ///< Time of the oldest sample
+        double   last;      ///< Time of the newest sample
+    };
+
+    /// Default constructor
+    HistoryReader();
+
+    /// Destructor
+    ~HistoryReader();
+
+    /// Open a history file and read the block headers. Returns true for
+    /// success.
+    bool open( const std::string & fileName );
+
+    /// Returns the statistics of the history
+    Stats getStats() const;
+
+    /// Call a function for each sample between two times in seconds since
+    /// the epoch (to of zero for no limit), oldest first. Only the blocks
+    /// which overlap the range are read. Returns false on a read error.
+    bool read( double from, double to, HistoryBlock::SampleFunc func );
+
+private:
+    /// Copy constructor (unsupported)
+    HistoryReader( const HistoryReader & );
+
+    /// Assignment operator (unsupported)
+    HistoryReader & operator = ( const HistoryReader & );
+
+    /// Block in use
+    struct Block {
+        HistoryBlock::Header header;    ///< Block header
+        uint32_t             slot;      ///< Slot in the file
+
+        bool operator < ( const Block & other ) const {
+            return header.sequence < other.header.sequence;
+        }
+    };
+
+    int                m_fd;        ///< History file
+    std::vector<Block> m_blocks;    ///< Blocks in use, oldest first
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__history_h
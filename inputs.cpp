@@ -5,16 +5,19 @@
 #include "inputs.h"
 #include "settings.h"
 #include "timing.h"
+#include "trace.h"
+#include "recorder.h"
 
 //-----------------------------------------------------------------------------
 
 Inputs::Inputs( ADC & adc, unsigned channel ) :
     m_adc( adc ),
     m_channel( channel ),
+    m_run( true ),
     m_buttonState( 0 ),
     m_notifyFunc( nullptr ),
-    m_run( true ),
-    m_thread( &Inputs::worker, this )
+    m_loop( "inputs" ),
+    m_thread( startThread( &Inputs::worker, this ) )
 {
 }
 
@@ -26,7 +29,7 @@ Inputs::~Inputs()
     m_run = false;
 
     // wait for the thread to terminate
-    m_thread.join();
+    joinThread( m_thread );
 }
 
 //-----------------------------------------------------------------------------
@@ -63,6 +66,8 @@ Inputs & Inputs::notifyCancel()
 
 void Inputs::worker()
 {
+    Trace::setThreadName( "inputs" );
+
     // minimum time period for polling (milliseconds)
     const unsigned period = 50;
 
@@ -81,6 +86,8 @@ void Inputs::worker()
 
     // poll the buttons
     while (m_run) {
+        m_loop.begin();
+
         // sample the ADC voltage
         double voltage = m_adc.getVoltage( m_channel );
 
@@ -108,6 +115,9 @@ void Inputs::worker()
                 double now = getClock();
                 double elapsed = now - button[i].timeStamp;
                 button[i].timeStamp = now;
+                Recorder::record(
+                    Recorder::Button, i+1, button[i].state ? 1.0 : 0.0
+                );
 
                 std::lock_guard<std::mutex> lock( m_mutex );
 
@@ -127,6 +137,7 @@ void Inputs::worker()
         }
 
         // sleep for a while
+        m_loop.end( getClock() + 1.0E-3 * period );
         delayms( period );
     }
 }//worker
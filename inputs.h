@@ -6,6 +6,7 @@
 #include <thread>
 #include <mutex>
 #include "adc.h"
+#include "loopmonitor.h"
 
 //-----------------------------------------------------------------------------
 
@@ -34,6 +35,9 @@ public:
     Inputs & notifyCancel();
 
 private:
+    /// Microbenchmarks (bench.cpp) call the button decoder directly
+    friend class Bench;
+
     /// Worker thread
     void worker();
 
@@ -49,6 +53,8 @@ private:
 
     NotifyFunc m_notifyFunc;    ///< Notification function
 
+    LoopMonitor m_loop;         ///< Timing of the polling loop
+
     /// Thread used to monitor the inputs
     std::thread m_thread;
 
@@ -0,0 +1,332 @@
+#include "journal.h"
+#include "timing.h"
+#include "trace.h"
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+//-----------------------------------------------------------------------------
+
+// Journal file format (version 1). All integers are little endian.
+//
+//   header:  "GEVT", u16 version, u16 record size, u32 reserved, i64 clock
+//            time at the start of the session in us, i64 wall clock time at
+//            the start of the session in us since the epoch, u32 reserved
+//   records: i64 clock time in us, u16 source, u16 type, u32 arg, f64 value
+//
+// Records are appended in the order in which the events were added.
+
+/// file signature
+static const char JOURNAL_MAGIC[4] = { 'G', 'E', 'V', 'T' };
+
+/// format version
+static const uint16_t JOURNAL_VERSION = 1;
+
+/// size of the header and of a record in bytes
+static const size_t HEADER_SIZE = 32;
+static const size_t RECORD_SIZE = 24;
+
+/// events buffered between writes
+static const size_t CAPACITY = 256;
+
+/// time between writes in milliseconds
+static const unsigned WRITER_PERIOD = 100;
+
+//-----------------------------------------------------------------------------
+
+/// Store a little endian integer
+static void putInteger( uint8_t *p, uint64_t value, size_t size )
+{
+    for (size_t i=0; i<size; ++i)
+        p[i] = static_cast<uint8_t>( value >> (8*i) );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Load a little endian integer
+static uint64_t getInteger( const uint8_t *p, size_t size )
+{
+    uint64_t value = 0;
+    for (size_t i=0; i<size; ++i)
+        value |= static_cast<uint64_t>( p[i] ) << (8*i);
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Convert a time in seconds to microseconds
+static uint64_t toMicroseconds( double seconds )
+{
+    return static_cast<uint64_t>( llround( 1.0E6 * seconds ) );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Convert a time in microseconds to seconds
+static double fromMicroseconds( uint64_t us )
+{
+    return 1.0E-6 * static_cast<double>( static_cast<int64_t>( us ) );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Write a buffer to a file
+static bool writeAll( int fd, const uint8_t *data, size_t size )
+{
+    while ( size > 0 ) {
+        ssize_t count = ::write( fd, data, size );
+        if ( count < 0 ) {
+            if ( errno == EINTR ) continue;
+            return false;
+        }
+        data += count;
+        size -= static_cast<size_t>( count );
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+EventJournal::EventJournal() :
+    m_fd( -1 ),
+    m_good( true ),
+    m_open( false ),
+    m_run( false ),
+    m_written( 0 ),
+    m_dropped( 0 )
+{
+    m_pending.reserve( CAPACITY );
+    m_batch.reserve( CAPACITY );
+    m_buffer.reserve( CAPACITY * RECORD_SIZE );
+}
+
+//-----------------------------------------------------------------------------
+
+EventJournal::~EventJournal()
+{
+    close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool EventJournal::open( const std::string & fileName, double start )
+{
+    close();
+
+    m_fd = ::open( fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if ( m_fd < 0 ) return false;
+
+    // the wall clock time at which the clock read the start time
+    double wallStart = getWallClock() - (getClock() - start);
+
+    uint8_t header[HEADER_SIZE];
+    memset( header, 0, sizeof(header) );
+    memcpy( header, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC) );
+    putInteger( header + 4, JOURNAL_VERSION, 2 );
+    putInteger( header + 6, RECORD_SIZE, 2 );
+    putInteger( header + 12, toMicroseconds( start ), 8 );
+    putInteger( header + 20, toMicroseconds( wallStart ), 8 );
+    if ( !writeAll( m_fd, header, sizeof(header) ) ) {
+        ::close( m_fd );
+        m_fd = -1;
+        return false;
+    }
+
+    m_good = true;
+    m_written = 0;
+    m_dropped = 0;
+    m_open = true;
+    m_run = true;
+    m_thread = startThread( &EventJournal::worker, this );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void EventJournal::close()
+{
+    m_open = false;
+    if ( m_run ) {
+        m_run = false;
+        joinThread( m_thread );
+    }
+
+    if ( m_fd >= 0 ) {
+        ::close( m_fd );
+        m_fd = -1;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void EventJournal::add( Source source, Type type, unsigned arg, double value )
+{
+    if ( !m_open ) return;
+
+    JournalEvent event = {
+        getClock(),
+        static_cast<uint16_t>( source ),
+        static_cast<uint16_t>( type ),
+        static_cast<uint32_t>( arg ),
+        value
+    };
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    if ( m_pending.size() < CAPACITY )
+        m_pending.push_back( event );
+    else
+        ++m_dropped;
+}
+
+//-----------------------------------------------------------------------------
+
+uint64_t EventJournal::getWritten() const
+{
+    return m_written;
+}
+
+//-----------------------------------------------------------------------------
+
+uint64_t EventJournal::getDropped() const
+{
+    return m_dropped;
+}
+
+//-----------------------------------------------------------------------------
+
+bool EventJournal::good() const
+{
+    return m_good;
+}
+
+//-----------------------------------------------------------------------------
+
+void EventJournal::worker()
+{
+    Trace::setThreadName( "journal" );
+
+    while ( m_run ) {
+        drain();
+        delayms( WRITER_PERIOD );
+    }
+
+    // write anything left before exit
+    drain();
+}
+
+//-----------------------------------------------------------------------------
+
+size_t EventJournal::drain()
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_batch.swap( m_pending );
+    }
+    if ( m_batch.empty() ) return 0;
+
+    Trace::Span span( "journal.write" );
+
+    m_buffer.resize( m_batch.size() * RECORD_SIZE );
+    uint8_t *record = &m_buffer[0];
+    for (size_t i=0; i<m_batch.size(); ++i) {
+        const JournalEvent & event = m_batch[i];
+        uint64_t bits;
+        memcpy( &bits, &event.value, sizeof(bits) );
+
+        putInteger( record, toMicroseconds( event.time ), 8 );
+        putInteger( record + 8, event.source, 2 );
+        putInteger( record + 10, event.type, 2 );
+        putInteger( record + 12, event.arg, 4 );
+        putInteger( record + 16, bits, 8 );
+        record += RECORD_SIZE;
+    }
+
+    // events are rare, so each batch is synced as it is written
+    if ( writeAll( m_fd, &m_buffer[0], m_buffer.size() ) && (fdatasync( m_fd ) == 0) )
+        m_written += m_batch.size();
+    else
+        m_good = false;
+
+    size_t count = m_batch.size();
+    m_batch.clear();
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+
+bool EventJournal::read(
+    const std::string & fileName,
+    double & start,
+    double & wallStart,
+    std::vector<JournalEvent> & events
+) {
+    events.clear();
+
+    int fd = ::open( fileName.c_str(), O_RDONLY );
+    if ( fd < 0 ) return false;
+
+    uint8_t header[HEADER_SIZE];
+    bool success =
+        (::read( fd, header, sizeof(header) ) == static_cast<ssize_t>( sizeof(header) )) &&
+        (memcmp( header, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC) ) == 0) &&
+        (getInteger( header + 4, 2 ) == JOURNAL_VERSION) &&
+        (getInteger( header + 6, 2 ) == RECORD_SIZE);
+
+    if ( success ) {
+        start = fromMicroseconds( getInteger( header + 12, 8 ) );
+        wallStart = fromMicroseconds( getInteger( header + 20, 8 ) );
+
+        // a partial record at the end (from a power cut) is ignored
+        uint8_t record[RECORD_SIZE];
+        while ( ::read( fd, record, sizeof(record) ) == static_cast<ssize_t>( sizeof(record) ) ) {
+            JournalEvent event;
+            uint64_t bits = getInteger( record + 16, 8 );
+            event.time   = fromMicroseconds( getInteger( record, 8 ) );
+            event.source = static_cast<uint16_t>( getInteger( record + 8, 2 ) );
+            event.type   = static_cast<uint16_t>( getInteger( record + 10, 2 ) );
+            event.arg    = static_cast<uint32_t>( getInteger( record + 12, 4 ) );
+            memcpy( &event.value, &bits, sizeof(event.value) );
+            events.push_back( event );
+        }
+    }
+
+    ::close( fd );
+    return success;
+}
+
+//-----------------------------------------------------------------------------
+
+const char *EventJournal::getSourceName( unsigned source )
+{
+    switch ( source ) {
+    case Controller: return "controller";
+    case Buttons:    return "button";
+    case BrewSwitch: return "brew-switch";
+    case Pump:       return "pump";
+    case FlowMeter:  return "flow";
+    case Boiler:     return "boiler";
+    default:         return "unknown";
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+const char *EventJournal::getTypeName( unsigned type )
+{
+    switch ( type ) {
+    case Pressed:  return "pressed";
+    case Released: return "released";
+    case On:       return "on";
+    case Off:      return "off";
+    case Start:    return "start";
+    case Stop:     return "stop";
+    case Target:   return "target";
+    case AutoOff:  return "auto-off";
+    case Halt:     return "halt";
+    default:       return "unknown";
+    }
+}
+
+//-----------------------------------------------------------------------------
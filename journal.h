@@ -0,0 +1,135 @@
+#ifndef __journal_h
+#define __journal_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <inttypes.h>
+
+//-----------------------------------------------------------------------------
+
+/// Discrete event recorded in the journal
+struct JournalEvent {
+    double   time;      ///< Time in seconds (from getClock)
+    uint16_t source;    ///< Where the event came from (EventJournal::Source)
+    uint16_t type;      ///< What happened (EventJournal::Type)
+    uint32_t arg;       ///< Button or pour number (depends on the event)
+    double   value;     ///< Value (depends on the event)
+};
+
+//-----------------------------------------------------------------------------
+
+/// Append-only journal of the discrete events of a session (buttons, the
+/// brew switch, pump, flow notifications and boiler power), written in
+/// binary alongside the session log with microsecond timestamps on the same
+/// clock as the samples, so that events can be lined up with the telemetry.
+/// Events may be added from any thread: they are copied into a buffer of
+/// fixed size and written by a background thread, and events are dropped
+/// (and counted) if the buffer is full.
+class EventJournal {
+public:
+    /// Sources of events
+    enum Source {
+        Controller  = 1,    ///< The controller itself
+        Buttons     = 2,    ///< Front panel buttons (arg is the button)
+        BrewSwitch  = 3,    ///< Brew switch (arg is the pour number)
+        Pump        = 4,    ///< Pump
+        FlowMeter   = 5,    ///< Flow meter (value is the volume in ml)
+        Boiler      = 6     ///< Boiler power
+    };
+
+    /// Types of event
+    enum Type {
+        Pressed     = 1,    ///< Button pressed
+        Released    = 2,    ///< Button released (value is the time held)
+        On          = 3,    ///< Switched on
+        Off         = 4,    ///< Switched off
+        Start       = 5,    ///< Flow started, or controller started
+        Stop        = 6,    ///< Flow stopped, or controller stopped
+        Target      = 7,    ///< Flow reached the shot size
+        AutoOff     = 8,    ///< Switched off after a period of inactivity
+        Halt        = 9     ///< System shutdown requested
+    };
+
+    /// Default constructor
+    EventJournal();
+
+    /// Destructor: writes any buffered events and closes the file
+    ~EventJournal();
+
+    /// Create the journal file and start the writer thread, given the clock
+    /// time (from getClock) at which the session started. Returns true for
+    /// success.
+    bool open( const std::string & fileName, double start );
+
+    /// Write any buffered events, close the file and stop the writer thread
+    void close();
+
+    /// Add an event, timed now. Does nothing if the journal isn't open.
+    void add( Source source, Type type, unsigned arg = 0, double value = 0.0 );
+
+    /// Returns the number of events written
+    uint64_t getWritten() const;
+
+    /// Returns the number of events dropped because the buffer was full
+    uint64_t getDropped() const;
+
+    /// Have all writes succeeded so far?
+    bool good() const;
+
+    /// Read a journal file, with the clock time and the wall clock time (in
+    /// seconds since the epoch) at which the session started. Returns true
+    /// for success.
+    static bool read(
+        const std::string & fileName,
+        double & start,
+        double & wallStart,
+        std::vector<JournalEvent> & events
+    );
+
+    /// Returns the name of a source
+    static const char *getSourceName( unsigned source );
+
+    /// Returns the name of a type of event
+    static const char *getTypeName( unsigned type );
+
+private:
+    /// Copy constructor (unsupported)
+    EventJournal( const EventJournal & );
+
+    /// Assignment operator (unsupported)
+    EventJournal & operator = ( const EventJournal & );
+
+    /// Writer thread
+    void worker();
+
+    /// Write the buffered events. Returns the number written.
+    size_t drain();
+
+private:
+    int      m_fd;          ///< Journal file
+    bool     m_good;        ///< Have all writes succeeded?
+
+    std::vector<JournalEvent> m_pending;    ///< Events waiting to be written
+    std::vector<JournalEvent> m_batch;      ///< Events being written
+    std::vector<uint8_t>      m_buffer;     ///< Encoded events
+
+    std::atomic<bool>     m_open;       ///< Are events being accepted?
+    std::atomic<bool>     m_run;        ///< Should the thread continue to run?
+    std::atomic<uint64_t> m_written;    ///< Events written
+    std::atomic<uint64_t> m_dropped;    ///< Events dropped
+
+    /// Thread which writes the events
+    std::thread m_thread;
+
+    /// Mutex to control access to the pending events
+    std::mutex m_mutex;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__journal_h
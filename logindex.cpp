@@ -0,0 +1,239 @@
+#include "logindex.h"
+#include "telemetry.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+
+// Index file format (version 1). All integers are little endian.
+//
+//   header:  "GIDX", u16 version, u16 entry size, u32 sample interval
+//   entries: u8 kind, u8 reserved, u16 pour, u32 elapsed time in ms,
+//            u64 offset of the sample in the log
+
+/// file signature
+static const char INDEX_MAGIC[4] = { 'G', 'I', 'D', 'X' };
+
+/// format version
+static const uint16_t INDEX_VERSION = 1;
+
+/// size of the header and of an entry in bytes
+static const size_t HEADER_SIZE = 12;
+static const size_t ENTRY_SIZE = 16;
+
+//-----------------------------------------------------------------------------
+
+/// Store a little endian integer
+static void putInteger( uint8_t *p, uint64_t value, size_t size )
+{
+    for (size_t i=0; i<size; ++i)
+        p[i] = static_cast<uint8_t>( value >> (8*i) );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Load a little endian integer
+static uint64_t getInteger( const uint8_t *p, size_t size )
+{
+    uint64_t value = 0;
+    for (size_t i=0; i<size; ++i)
+        value |= static_cast<uint64_t>( p[i] ) << (8*i);
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Orders entries by elapsed time
+static bool compareElapsed( double elapsed, const LogIndex::Entry & entry )
+{
+    return elapsed < entry.elapsed;
+}
+
+//-----------------------------------------------------------------------------
+
+std::string LogIndex::getFileName( const std::string & logFileName )
+{
+    std::string name( logFileName );
+    if (
+        (name.size() > 3) &&
+        (name.compare( name.size() - 3, 3, ".gz" ) == 0)
+    )
+        name.erase( name.size() - 3 );
+
+    // keep the extension, so that a log exported in another format (which
+    // has other offsets) doesn't share the index
+    return name + ".idx";
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogIndex::load( const std::string & logFileName )
+{
+    m_entries.clear();
+
+    FILE *in = fopen( getFileName( logFileName ).c_str(), "rb" );
+    if ( in == 0 ) return false;
+
+    uint8_t header[HEADER_SIZE];
+    if (
+        (fread( header, 1, sizeof(header), in ) != sizeof(header)) ||
+        (memcmp( header, INDEX_MAGIC, sizeof(INDEX_MAGIC) ) != 0) ||
+        (getInteger( header + 6, 2 ) < ENTRY_SIZE)
+    ) {
+        fclose( in );
+        return false;
+    }
+
+    // later versions may make the entries longer
+    std::vector<uint8_t> buffer( getInteger( header + 6, 2 ) );
+    while ( fread( &buffer[0], 1, buffer.size(), in ) == buffer.size() ) {
+        Entry entry;
+        entry.kind    = buffer[0];
+        entry.pour    = static_cast<unsigned>( getInteger( &buffer[2], 2 ) );
+        entry.elapsed = 1.0E-3 * static_cast<double>( getInteger( &buffer[4], 4 ) );
+        entry.offset  = getInteger( &buffer[8], 8 );
+        m_entries.push_back( entry );
+    }
+
+    fclose( in );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+const std::vector<LogIndex::Entry> & LogIndex::getEntries() const
+{
+    return m_entries;
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogIndex::find( double elapsed, uint64_t & offset ) const
+{
+    // the first entry after the time, and then the one before it
+    std::vector<Entry>::const_iterator i = std::upper_bound(
+        m_entries.begin(), m_entries.end(), elapsed, compareElapsed
+    );
+    if ( i == m_entries.begin() ) return false;
+
+    offset = (i - 1)->offset;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogIndex::findPour( unsigned pour, double & start, double & end ) const
+{
+    bool found = false;
+    for (size_t i=0; i<m_entries.size(); ++i) {
+        const Entry & entry = m_entries[i];
+        if ( entry.pour != pour ) continue;
+
+        if ( entry.kind == PourStart ) {
+            start = entry.elapsed;
+            end = 0.0;
+            found = true;
+        } else if ( found && (entry.kind == PourEnd) ) {
+            end = entry.elapsed;
+            return true;
+        }
+    }
+    return found;
+}
+
+//-----------------------------------------------------------------------------
+
+LogIndexWriter::LogIndexWriter() :
+    m_file( 0 ),
+    m_interval( 1 ),
+    m_count( 0 ),
+    m_pour( 0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+LogIndexWriter::~LogIndexWriter()
+{
+    close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogIndexWriter::open( const std::string & logFileName, unsigned interval )
+{
+    close();
+
+    m_file = fopen( LogIndex::getFileName( logFileName ).c_str(), "wb" );
+    if ( m_file == 0 ) return false;
+
+    m_interval = std::max( interval, 1u );
+    m_count = 0;
+    m_pour = 0;
+
+    uint8_t header[HEADER_SIZE];
+    memcpy( header, INDEX_MAGIC, sizeof(INDEX_MAGIC) );
+    putInteger( header + 4, INDEX_VERSION, 2 );
+    putInteger( header + 6, ENTRY_SIZE, 2 );
+    putInteger( header + 8, m_interval, 4 );
+    return fwrite( header, 1, sizeof(header), m_file ) == sizeof(header);
+}
+
+//-----------------------------------------------------------------------------
+
+void LogIndexWriter::close()
+{
+    if ( m_file == 0 ) return;
+
+    fclose( m_file );
+    m_file = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogIndexWriter::addSample( const Sample & sample, uint64_t offset )
+{
+    if ( m_file == 0 ) return;
+
+    // pour boundaries
+    unsigned pour = (sample.pour > 0) ? static_cast<unsigned>( sample.pour ) : 0;
+    if ( pour != m_pour ) {
+        if ( m_pour > 0 ) write( LogIndex::PourEnd, m_pour, sample.elapsed, offset );
+        if ( pour > 0 ) write( LogIndex::PourStart, pour, sample.elapsed, offset );
+        m_pour = pour;
+    }
+
+    // every Nth sample, starting with the first
+    if ( (m_count++ % m_interval) == 0 )
+        write( LogIndex::Time, 0, sample.elapsed, offset );
+}
+
+//-----------------------------------------------------------------------------
+
+void LogIndexWriter::flush()
+{
+    if ( m_file != 0 ) fflush( m_file );
+}
+
+//-----------------------------------------------------------------------------
+
+void LogIndexWriter::write(
+    uint8_t kind,
+    unsigned pour,
+    double elapsed,
+    uint64_t offset
+) {
+    double ms = floor( 1.0E3 * elapsed + 0.5 );
+    if ( ms < 0.0 ) ms = 0.0;
+
+    uint8_t entry[ENTRY_SIZE];
+    entry[0] = kind;
+    entry[1] = 0;
+    putInteger( entry + 2, std::min( pour, 65535u ), 2 );
+    putInteger( entry + 4, static_cast<uint64_t>( std::min( ms, 4294967295.0 ) ), 4 );
+    putInteger( entry + 8, offset, 8 );
+    fwrite( entry, 1, sizeof(entry), m_file );
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,101 @@
+#ifndef __logindex_h
+#define __logindex_h
+
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <string>
+#include <vector>
+
+struct Sample;
+
+//-----------------------------------------------------------------------------
+
+/// Sparse time index of a session log, kept in a side file (150412-0930.glog
+/// has the index 150412-0930.glog.idx). The index maps the elapsed time of every
+/// Nth sample, and of the samples where each pour starts and ends, to the
+/// offset of the sample in the (uncompressed) log, so that a range of the
+/// log can be read without reading it from the start.
+class LogIndex {
+public:
+    /// Entry kinds
+    enum Kind {
+        Time      = 'T',    ///< Every Nth sample
+        PourStart = 'B',    ///< First sample of a pour
+        PourEnd   = 'E'     ///< First sample after a pour
+    };
+
+    /// Index entry
+    struct Entry {
+        uint8_t  kind;      ///< Entry kind
+        unsigned pour;      ///< Pour number (for the pour entries)
+        double   elapsed;   ///< Elapsed time of the sample in seconds
+        uint64_t offset;    ///< Offset of the sample in the log
+    };
+
+    /// Returns the index file name for a log file (compressed or not)
+    static std::string getFileName( const std::string & logFileName );
+
+    /// Load the index of a log. Returns false if there isn't one.
+    bool load( const std::string & logFileName );
+
+    /// Returns the entries, in order of elapsed time
+    const std::vector<Entry> & getEntries() const;
+
+    /// Find the offset of the last indexed sample at or before the given
+    /// time. Returns false if there is no such sample.
+    bool find( double elapsed, uint64_t & offset ) const;
+
+    /// Find the start and end time of a pour (the end is zero if the log
+    /// ends during the pour). Returns false if the pour isn't in the index.
+    bool findPour( unsigned pour, double & start, double & end ) const;
+
+private:
+    std::vector<Entry> m_entries;   ///< Index entries
+};
+
+//-----------------------------------------------------------------------------
+
+/// Writes the index of a session log as the samples are written
+class LogIndexWriter {
+public:
+    /// Default constructor
+    LogIndexWriter();
+
+    /// Destructor
+    ~LogIndexWriter();
+
+    /// Create the index for a log file, with an entry every interval samples.
+    /// Returns true for success.
+    bool open( const std::string & logFileName, unsigned interval );
+
+    /// Close the index
+    void close();
+
+    /// Add a sample which is about to be written at the given log offset
+    void addSample( const Sample & sample, uint64_t offset );
+
+    /// Pass the buffered entries to the operating system
+    void flush();
+
+private:
+    /// Copy constructor (unsupported)
+    LogIndexWriter( const LogIndexWriter & );
+
+    /// Assignment operator (unsupported)
+    LogIndexWriter & operator = ( const LogIndexWriter & );
+
+    /// Write an entry
+    void write( uint8_t kind, unsigned pour, double elapsed, uint64_t offset );
+
+private:
+    FILE    *m_file;        ///< Index file
+    unsigned m_interval;    ///< Samples between time entries
+    uint64_t m_count;       ///< Samples so far
+    unsigned m_pour;        ///< Pour number of the previous sample
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__logindex_h
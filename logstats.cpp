@@ -0,0 +1,430 @@
+#include "logstats.h"
+#include "telemetry.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <thread>
+#include <atomic>
+
+//-----------------------------------------------------------------------------
+
+/// the boiler is ready once the temperature is within this many degrees of
+/// the target
+static const double READY_BAND = 1.0;
+
+/// samples this long after a pour (in seconds) are left out of the
+/// temperature stability, while the boiler recovers
+static const double POUR_RECOVERY = 60.0;
+
+//-----------------------------------------------------------------------------
+
+/// Does the name end with the suffix?
+static bool endsWith( const std::string & name, const char *suffix )
+{
+    size_t length = strlen( suffix );
+    return
+        (name.size() >= length) &&
+        (name.compare( name.size() - length, length, suffix ) == 0);
+}
+
+//-----------------------------------------------------------------------------
+
+/// Returns the name without its directory, log extension or .gz
+static std::string getStem( const std::string & fileName )
+{
+    std::string stem( fileName.substr( fileName.find_last_of('/') + 1 ) );
+    if ( endsWith( stem, ".gz" ) ) stem.erase( stem.size() - 3 );
+    return stem.substr( 0, stem.rfind('.') );
+}
+
+//-----------------------------------------------------------------------------
+
+/// If the stem ends with a number after a dash (-2, -shot3, ...), returns
+/// the stem before the dash and the number
+static bool splitNumber(
+    const std::string & stem,
+    const char *prefix,
+    std::string & base,
+    unsigned & number
+) {
+    size_t digits = stem.find_last_not_of( "0123456789" );
+    if ( (digits == std::string::npos) || (digits + 1 == stem.size()) )
+        return false;
+
+    std::string marker( std::string( "-" ) + prefix );
+    if (
+        (digits + 1 < marker.size()) ||
+        (stem.compare( digits + 1 - marker.size(), marker.size(), marker ) != 0)
+    )
+        return false;
+
+    base = stem.substr( 0, digits + 1 - marker.size() );
+    number = static_cast<unsigned>( atoi( stem.c_str() + digits + 1 ) );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Log file contents, mapped into memory (or decompressed into memory)
+class LogData {
+public:
+    /// Constructor, given the file name
+    LogData( const std::string & fileName ) :
+        m_map( 0 ),
+        m_size( 0 )
+    {
+        if ( endsWith( fileName, ".gz" ) ) {
+            gzFile in = gzopen( fileName.c_str(), "rb" );
+            if ( in == 0 ) return;
+            char buffer[65536];
+            int count;
+            while ( (count = gzread( in, buffer, sizeof(buffer) )) > 0 )
+                m_buffer.insert( m_buffer.end(), buffer, buffer + count );
+            gzclose( in );
+            m_size = m_buffer.size();
+            return;
+        }
+
+        int fd = open( fileName.c_str(), O_RDONLY );
+        if ( fd < 0 ) return;
+        struct stat info;
+        if ( (fstat( fd, &info ) == 0) && (info.st_size > 0) ) {
+            void *map = mmap( 0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if ( map != MAP_FAILED ) {
+                madvise( map, info.st_size, MADV_SEQUENTIAL );
+                m_map = map;
+                m_size = static_cast<size_t>( info.st_size );
+            }
+        }
+        close( fd );
+    }
+
+    /// Destructor
+    ~LogData()
+    {
+        if ( m_map != 0 ) munmap( m_map, m_size );
+    }
+
+    /// Returns the data
+    const void * data() const
+    {
+        return (m_map != 0) ? m_map : (m_buffer.empty() ? 0 : &m_buffer[0]);
+    }
+
+    /// Returns the size of the data in bytes
+    size_t size() const { return m_size; }
+
+private:
+    void             *m_map;    ///< Mapped file (or null)
+    std::vector<char> m_buffer; ///< Decompressed file
+    size_t            m_size;   ///< Size in bytes
+};
+
+//-----------------------------------------------------------------------------
+
+/// Accumulates the statistics of a session from its records
+class SessionVisitor : public LogVisitor {
+public:
+    /// Constructor
+    SessionVisitor( LogStats::Session & session ) :
+        m_session( session ),
+        m_ready( false ),
+        m_lastPour( -1.0E9 ),
+        m_count( 0 ),
+        m_mean( 0.0 ),
+        m_sumSquares( 0.0 ),
+        m_power( 0.0 )
+    {
+    }
+
+    void sample( const Sample & sample )
+    {
+        LogStats::Session & s = m_session;
+        ++s.samples;
+        s.duration = sample.elapsed;
+        m_power += sample.power;
+        if ( static_cast<unsigned>( sample.pour ) > s.pours )
+            s.pours = static_cast<unsigned>( sample.pour );
+
+        if ( s.targetTemp <= 0.0 ) return;
+
+        if (
+            !m_ready &&
+            (fabs( sample.temperature - s.targetTemp ) <= READY_BAND)
+        ) {
+            m_ready = true;
+            s.readyTime = sample.elapsed;
+        }
+
+        // temperature stability while idle (Welford's method)
+        if ( sample.pump > 0 ) m_lastPour = sample.elapsed;
+        if ( m_ready && (sample.elapsed - m_lastPour > POUR_RECOVERY) ) {
+            ++m_count;
+            double delta = sample.temperature - m_mean;
+            m_mean += delta / static_cast<double>( m_count );
+            m_sumSquares += delta * (sample.temperature - m_mean);
+        }
+    }
+
+    void note( const char *text, size_t length )
+    {
+        // the parameter line gives the target temperature
+        static const char key[] = "targetTemp=";
+        std::string line( text, length );
+        size_t position = line.find( key );
+        if ( position != std::string::npos )
+            m_session.targetTemp =
+                atof( line.c_str() + position + sizeof(key) - 1 );
+    }
+
+    /// Fill in the derived statistics
+    void finish()
+    {
+        LogStats::Session & s = m_session;
+        s.meanTemp = m_mean;
+        s.sdTemp = (m_count > 1) ?
+            sqrt( m_sumSquares / static_cast<double>( m_count - 1 ) ) : 0.0;
+        s.duty = (s.samples > 0) ?
+            m_power / static_cast<double>( s.samples ) : 0.0;
+    }
+
+private:
+    LogStats::Session & m_session;  ///< Statistics being accumulated
+    bool     m_ready;       ///< Has the boiler reached the target?
+    double   m_lastPour;    ///< Time of the latest pour sample
+    uint64_t m_count;       ///< Samples in the temperature statistics
+    double   m_mean;        ///< Mean temperature
+    double   m_sumSquares;  ///< Sum of squared differences from the mean
+    double   m_power;       ///< Sum of the power levels
+};
+
+//-----------------------------------------------------------------------------
+
+LogStats::LogStats() :
+    m_parseTime( 0.0 ),
+    m_threads( 0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogStats::addDirectory( const std::string & directory )
+{
+    DIR *dir = opendir( directory.c_str() );
+    if ( dir == 0 ) return false;
+
+    std::string path( directory );
+    if ( !path.empty() && (path[path.size()-1] != '/') ) path += '/';
+
+    struct dirent *entry;
+    while ( (entry = readdir( dir )) != 0 )
+        addFile( path + entry->d_name );
+
+    closedir( dir );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogStats::addFile( const std::string & fileName )
+{
+    std::string name( fileName );
+    if ( endsWith( name, ".gz" ) ) name.erase( name.size() - 3 );
+    bool binary = endsWith( name, ".glog" );
+    if ( !binary && !endsWith( name, ".csv" ) ) return;
+
+    // shot logs are not sessions
+    std::string stem( getStem( fileName ) );
+    std::string base;
+    unsigned number;
+    if ( splitNumber( stem, "shot", base, number ) ) return;
+
+    // a CSV exported from a binary log duplicates it, so the binary log is
+    // used where there are both
+    if ( (m_logs.count( stem ) > 0) && !binary ) return;
+    m_logs[stem] = fileName;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogStats::run( unsigned threads )
+{
+    // combine the parts of each session (150412-0930-2.glog is the second
+    // part of 150412-0930.glog)
+    std::map< std::string, std::map<unsigned, std::string> > parts;
+    for (
+        std::map<std::string, std::string>::const_iterator i = m_logs.begin();
+        i != m_logs.end(); ++i
+    ) {
+        std::string base;
+        unsigned number;
+        if (
+            splitNumber( i->first, "", base, number ) &&
+            (m_logs.count( base ) > 0) && (number > 1)
+        )
+            parts[base][number] = i->second;
+        else
+            parts[i->first][1] = i->second;
+    }
+
+    m_files.clear();
+    for (
+        std::map< std::string, std::map<unsigned, std::string> >::const_iterator
+            i = parts.begin();
+        i != parts.end(); ++i
+    ) {
+        std::vector<std::string> & files = m_files[i->first];
+        for (
+            std::map<unsigned, std::string>::const_iterator j = i->second.begin();
+            j != i->second.end(); ++j
+        )
+            files.push_back( j->second );
+    }
+
+    // sessions are parsed in parallel, and the parts of a session in order
+    m_sessions.assign( m_files.size(), Session() );
+    if ( threads == 0 ) threads = std::thread::hardware_concurrency();
+    if ( threads == 0 ) threads = 1;
+    if ( threads > m_sessions.size() ) threads = m_sessions.size();
+    m_threads = threads;
+
+    double start = getClock();
+    std::atomic<size_t> next( 0 );
+    std::vector<std::thread> workers;
+    for (unsigned i=0; i<threads; ++i) {
+        workers.push_back( std::thread( [this, &next]() {
+            size_t index;
+            while ( (index = next++) < m_sessions.size() )
+                parseSession( index );
+        } ) );
+    }
+    for (size_t i=0; i<workers.size(); ++i)
+        workers[i].join();
+    m_parseTime = getClock() - start;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogStats::parseSession( size_t index )
+{
+    std::map< std::string, std::vector<std::string> >::const_iterator i =
+        m_files.begin();
+    std::advance( i, index );
+    const std::vector<std::string> & files = i->second;
+
+    Session & session = m_sessions[index];
+    session.name       = files[0].substr( files[0].find_last_of('/') + 1 );
+    session.files      = files.size();
+    session.bytes      = 0;
+    session.samples    = 0;
+    session.duration   = 0.0;
+    session.targetTemp = 0.0;
+    session.readyTime  = -1.0;
+    session.meanTemp   = 0.0;
+    session.sdTemp     = 0.0;
+    session.duty       = 0.0;
+    session.pours      = 0;
+
+    // the day is in the name, or else the modification time
+    const std::string & stem = i->first;
+    if (
+        (stem.size() >= 6) &&
+        (stem.find_first_not_of( "0123456789" ) >= 6)
+    )
+        session.day = stem.substr( 0, 6 );
+    else {
+        struct stat info;
+        char day[16] = "unknown";
+        if ( stat( files[0].c_str(), &info ) == 0 )
+            strftime( day, sizeof(day), "%y%m%d", localtime( &info.st_mtime ) );
+        session.day = day;
+    }
+
+    SessionVisitor visitor( session );
+    for (size_t j=0; j<files.size(); ++j) {
+        LogData data( files[j] );
+        session.bytes += data.size();
+        if ( data.size() > 0 ) parseLog( data.data(), data.size(), visitor );
+    }
+    visitor.finish();
+}
+
+//-----------------------------------------------------------------------------
+
+const std::vector<LogStats::Session> & LogStats::getSessions() const
+{
+    return m_sessions;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogStats::write( std::ostream & out ) const
+{
+    char line[256];
+
+    snprintf(
+        line, sizeof(line), "%-28s %5s %7s %9s %8s %7s %6s %7s %5s\n",
+        "session", "files", "hours", "samples", "ready(s)",
+        "temp(C)", "sd(C)", "duty(%)", "pours"
+    );
+    out << line;
+
+    std::map< std::string, std::pair<unsigned, unsigned> > days;
+    uint64_t samples = 0, bytes = 0;
+    unsigned files = 0;
+    for (size_t i=0; i<m_sessions.size(); ++i) {
+        const Session & s = m_sessions[i];
+        char ready[16] = "-";
+        if ( s.readyTime >= 0.0 )
+            snprintf( ready, sizeof(ready), "%.1lf", s.readyTime );
+        snprintf(
+            line, sizeof(line),
+            "%-28s %5u %7.2lf %9llu %8s %7.2lf %6.3lf %7.1lf %5u\n",
+            s.name.c_str(), s.files, s.duration / 3600.0,
+            static_cast<unsigned long long>( s.samples ), ready,
+            s.meanTemp, s.sdTemp, 100.0 * s.duty, s.pours
+        );
+        out << line;
+
+        ++days[s.day].first;
+        days[s.day].second += s.pours;
+        samples += s.samples;
+        bytes += s.bytes;
+        files += s.files;
+    }
+
+    out << "\nday    sessions  shots\n";
+    for (
+        std::map< std::string, std::pair<unsigned, unsigned> >::const_iterator
+            i = days.begin();
+        i != days.end(); ++i
+    ) {
+        snprintf(
+            line, sizeof(line), "%-6s %8u %6u\n",
+            i->first.c_str(), i->second.first, i->second.second
+        );
+        out << line;
+    }
+
+    double megabytes = static_cast<double>( bytes ) / (1024.0 * 1024.0);
+    snprintf(
+        line, sizeof(line),
+        "\nsessions=%u files=%u samples=%llu size=%.1lfMB "
+        "time=%.3lfs (%.1lfMB/s, %u threads)\n",
+        static_cast<unsigned>( m_sessions.size() ), files,
+        static_cast<unsigned long long>( samples ), megabytes, m_parseTime,
+        (m_parseTime > 0.0) ? megabytes / m_parseTime : 0.0, m_threads
+    );
+    out << line;
+}
+
+//-----------------------------------------------------------------------------
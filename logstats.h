@@ -0,0 +1,79 @@
+#ifndef __logstats_h
+#define __logstats_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <inttypes.h>
+
+//-----------------------------------------------------------------------------
+
+/// Statistics over the history of session logs, for the stats command. The
+/// logs are mapped into memory (compressed logs are decompressed into
+/// memory) and the sessions are parsed in parallel. The parts of a session
+/// which was split by log rotation are combined.
+class LogStats {
+public:
+    /// Statistics for one session
+    struct Session {
+        std::string name;       ///< Session name (the first log file)
+        unsigned    files;      ///< Number of log files
+        uint64_t    bytes;      ///< Size of the log files in bytes
+        uint64_t    samples;    ///< Number of samples
+        double      duration;   ///< Length of the session in seconds
+        double      targetTemp; ///< Target temperature (or 0 if unknown)
+        double      readyTime;  ///< Time to reach the target (or -1)
+        double      meanTemp;   ///< Mean temperature once ready
+        double      sdTemp;     ///< Standard deviation of the temperature
+        double      duty;       ///< Mean boiler power level (0..1)
+        unsigned    pours;      ///< Number of pours
+        std::string day;        ///< Day of the session (YYMMDD)
+    };
+
+    /// Default constructor
+    LogStats();
+
+    /// Add the session logs in a directory. Returns false if the directory
+    /// can't be read.
+    bool addDirectory( const std::string & directory );
+
+    /// Add a session log file
+    void addFile( const std::string & fileName );
+
+    /// Parse the logs using the given number of threads (zero for one per
+    /// processor core)
+    void run( unsigned threads = 0 );
+
+    /// Returns the session statistics, in order of name
+    const std::vector<Session> & getSessions() const;
+
+    /// Write the per-session statistics, the shots per day and the totals
+    void write( std::ostream & out ) const;
+
+private:
+    /// Parse the log files of a session
+    void parseSession( size_t index );
+
+private:
+    /// Log file for each name (without the extension)
+    std::map<std::string, std::string> m_logs;
+
+    /// Log files for each session, in order of part number
+    std::map< std::string, std::vector<std::string> > m_files;
+
+    /// Session statistics (in the same order as m_files)
+    std::vector<Session> m_sessions;
+
+    /// Time taken to parse the logs in seconds
+    double m_parseTime;
+
+    /// Number of threads used
+    unsigned m_threads;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__logstats_h
@@ -0,0 +1,231 @@
+#include "loopmonitor.h"
+#include "timing.h"
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+/// Registered loop monitors
+std::mutex g_mutex;
+std::vector<const LoopMonitor*> g_monitors;
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+
+LatencyHistogram::LatencyHistogram() :
+    m_count( 0 ),
+    m_total( 0 ),
+    m_max( 0 )
+{
+    for (unsigned i=0; i<BUCKETS; ++i)
+        m_buckets[i] = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void LatencyHistogram::add( double seconds )
+{
+    uint64_t us = (seconds > 0.0) ?
+        static_cast<uint64_t>( seconds * 1.0E6 ) : 0;
+
+    // bucket index is the number of significant bits
+    unsigned bucket = (us > 0) ? 64 - __builtin_clzll( us ) : 0;
+    if ( bucket >= BUCKETS ) bucket = BUCKETS - 1;
+
+    // there is only one writer, so relaxed updates are sufficient
+    m_buckets[bucket].fetch_add( 1, std::memory_order_relaxed );
+    m_total.fetch_add( us, std::memory_order_relaxed );
+    if ( us > m_max.load( std::memory_order_relaxed ) )
+        m_max.store( us, std::memory_order_relaxed );
+    m_count.fetch_add( 1, std::memory_order_relaxed );
+}
+
+//-----------------------------------------------------------------------------
+
+uint64_t LatencyHistogram::getCount() const
+{
+    return m_count.load( std::memory_order_relaxed );
+}
+
+//-----------------------------------------------------------------------------
+
+double LatencyHistogram::getMean() const
+{
+    uint64_t count = getCount();
+    if ( count == 0 ) return 0.0;
+    return 1.0E-6 *
+        static_cast<double>( m_total.load( std::memory_order_relaxed ) ) /
+        static_cast<double>( count );
+}
+
+//-----------------------------------------------------------------------------
+
+double LatencyHistogram::getMax() const
+{
+    return 1.0E-6 * static_cast<double>(
+        m_max.load( std::memory_order_relaxed )
+    );
+}
+
+//-----------------------------------------------------------------------------
+
+uint64_t LatencyHistogram::getBucket( unsigned bucket ) const
+{
+    if ( bucket >= BUCKETS ) return 0;
+    return m_buckets[bucket].load( std::memory_order_relaxed );
+}
+
+//-----------------------------------------------------------------------------
+
+void LatencyHistogram::write( std::ostream & out ) const
+{
+    out << "n=" << getCount()
+        << " mean=" << static_cast<uint64_t>( 1.0E6 * getMean() ) << "us"
+        << " max=" << static_cast<uint64_t>( 1.0E6 * getMax() ) << "us";
+
+    // non-empty buckets, as "<upper bound in us>:<count>"
+    for (unsigned i=0; i<BUCKETS; ++i) {
+        uint64_t count = getBucket( i );
+        if ( count == 0 ) continue;
+        if ( i+1 < BUCKETS )
+            out << " <" << (1ULL << i) << ":" << count;
+        else
+            out << " >=" << (1ULL << (i-1)) << ":" << count;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+LoopMonitor::LoopMonitor( const std::string & name ) :
+    m_name( name ),
+    m_begin( 0.0 ),
+    m_wake( 0.0 ),
+    m_sleeping( false ),
+    m_iterations( 0 ),
+    m_overruns( 0 )
+{
+    std::lock_guard<std::mutex> lock( g_mutex );
+    g_monitors.push_back( this );
+}
+
+//-----------------------------------------------------------------------------
+
+LoopMonitor::~LoopMonitor()
+{
+    std::lock_guard<std::mutex> lock( g_mutex );
+    g_monitors.erase(
+        std::remove( g_monitors.begin(), g_monitors.end(), this ),
+        g_monitors.end()
+    );
+}
+
+//-----------------------------------------------------------------------------
+
+void LoopMonitor::begin()
+{
+    m_begin = getClock();
+
+    // how late did the loop wake?
+    if ( m_sleeping ) {
+        m_lateness.add( m_begin - m_wake );
+        m_sleeping = false;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void LoopMonitor::end()
+{
+    double now = getClock();
+    m_bodyTime.add( now - m_begin );
+    m_iterations.fetch_add( 1, std::memory_order_relaxed );
+}
+
+//-----------------------------------------------------------------------------
+
+void LoopMonitor::end( double wake )
+{
+    double now = getClock();
+    m_bodyTime.add( now - m_begin );
+    m_iterations.fetch_add( 1, std::memory_order_relaxed );
+
+    // the loop only sleeps if the wake time is still to come
+    m_wake = wake;
+    m_sleeping = (now <= wake);
+    if ( !m_sleeping )
+        m_overruns.fetch_add( 1, std::memory_order_relaxed );
+}
+
+//-----------------------------------------------------------------------------
+
+const std::string & LoopMonitor::getName() const
+{
+    return m_name;
+}
+
+//-----------------------------------------------------------------------------
+
+uint64_t LoopMonitor::getIterations() const
+{
+    return m_iterations.load( std::memory_order_relaxed );
+}
+
+//-----------------------------------------------------------------------------
+
+uint64_t LoopMonitor::getOverruns() const
+{
+    return m_overruns.load( std::memory_order_relaxed );
+}
+
+//-----------------------------------------------------------------------------
+
+const LatencyHistogram & LoopMonitor::getLateness() const
+{
+    return m_lateness;
+}
+
+//-----------------------------------------------------------------------------
+
+const LatencyHistogram & LoopMonitor::getBodyTime() const
+{
+    return m_bodyTime;
+}
+
+//-----------------------------------------------------------------------------
+
+void LoopMonitor::report( std::ostream & out )
+{
+    std::lock_guard<std::mutex> lock( g_mutex );
+
+    for (size_t i=0; i<g_monitors.size(); ++i) {
+        const LoopMonitor & monitor = *g_monitors[i];
+        out << monitor.getName()
+            << ": iterations=" << monitor.getIterations()
+            << " overruns=" << monitor.getOverruns() << "\n";
+        out << "  lateness: ";
+        monitor.getLateness().write( out );
+        out << "\n  body: ";
+        monitor.getBodyTime().write( out );
+        out << "\n";
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+uint64_t LoopMonitor::countIterations( const std::string & name )
+{
+    std::lock_guard<std::mutex> lock( g_mutex );
+
+    uint64_t count = 0;
+    for (size_t i=0; i<g_monitors.size(); ++i) {
+        if ( g_monitors[i]->getName() == name )
+            count += g_monitors[i]->getIterations();
+    }
+    return count;
+}
+
+//-----------------------------------------------------------------------------
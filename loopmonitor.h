@@ -0,0 +1,121 @@
+#ifndef __loopmonitor_h
+#define __loopmonitor_h
+
+//-----------------------------------------------------------------------------
+
+#include <array>
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <inttypes.h>
+
+//-----------------------------------------------------------------------------
+
+/// Latency histogram with power of two buckets in microseconds. Bucket 0
+/// counts values below 1us, and bucket n counts values from 2^(n-1) up to
+/// 2^n microseconds. The last bucket also counts anything larger. Values
+/// are added by one thread and may be read by any other.
+class LatencyHistogram {
+public:
+    /// Number of buckets (the last covers 2^22us, about 4 seconds, and up)
+    static const unsigned BUCKETS = 24;
+
+    /// Default constructor
+    LatencyHistogram();
+
+    /// Add a value in seconds
+    void add( double seconds );
+
+    /// Returns the number of values added
+    uint64_t getCount() const;
+
+    /// Returns the mean value in seconds
+    double getMean() const;
+
+    /// Returns the largest value in seconds
+    double getMax() const;
+
+    /// Returns the count for the given bucket
+    uint64_t getBucket( unsigned bucket ) const;
+
+    /// Write the non-empty buckets, as upper bound in us and count
+    void write( std::ostream & out ) const;
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> m_buckets;  ///< Bucket counts
+    std::atomic<uint64_t> m_count;  ///< Number of values
+    std::atomic<uint64_t> m_total;  ///< Sum of values in microseconds
+    std::atomic<uint64_t> m_max;    ///< Largest value in microseconds
+};
+
+//-----------------------------------------------------------------------------
+
+/// Records the timing of a periodic worker loop: how late the loop wakes
+/// from each sleep, how long the loop body takes, and how often the body
+/// overruns the time at which the loop should next wake. The loop calls
+/// begin() as it wakes and end() before it sleeps. Monitors register
+/// themselves by name so that all loops can be reported together.
+class LoopMonitor {
+public:
+    /// Constructor, given a name for the loop
+    LoopMonitor( const std::string & name );
+
+    /// Destructor
+    ~LoopMonitor();
+
+    /// Start of the loop body
+    void begin();
+
+    /// End of the loop body, where the loop does not sleep
+    void end();
+
+    /// End of the loop body, where the loop then sleeps until the given
+    /// time (from getClock). A missed deadline is counted if that time has
+    /// already passed.
+    void end( double wake );
+
+    /// Returns the loop name
+    const std::string & getName() const;
+
+    /// Returns the number of iterations
+    uint64_t getIterations() const;
+
+    /// Returns the number of missed deadlines
+    uint64_t getOverruns() const;
+
+    /// Returns the histogram of wake-up lateness
+    const LatencyHistogram & getLateness() const;
+
+    /// Returns the histogram of loop body times
+    const LatencyHistogram & getBodyTime() const;
+
+    /// Write a report for all monitored loops
+    static void report( std::ostream & out );
+
+    /// Returns the total number of iterations of the monitored loops with
+    /// the given name (zero if there are none)
+    static uint64_t countIterations( const std::string & name );
+
+private:
+    /// Copy constructor (unsupported)
+    LoopMonitor( const LoopMonitor & );
+
+    /// Assignment operator (unsupported)
+    LoopMonitor & operator = ( const LoopMonitor & );
+
+private:
+    std::string m_name;     ///< Loop name
+    double      m_begin;    ///< Start time of the current loop body
+    double      m_wake;     ///< Requested wake time
+    bool        m_sleeping; ///< Is the loop sleeping until m_wake?
+
+    std::atomic<uint64_t> m_iterations; ///< Number of iterations
+    std::atomic<uint64_t> m_overruns;   ///< Number of missed deadlines
+
+    LatencyHistogram m_lateness;    ///< Wake-up lateness
+    LatencyHistogram m_bodyTime;    ///< Loop body time
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__loopmonitor_h
@@ -1,4 +1,5 @@
 #include "pigpiomgr.h"
+#include "hal.h"
 
 //-----------------------------------------------------------------------------
 
@@ -10,7 +11,7 @@ PIGPIOManager & PIGPIOManager::get() {
 //-----------------------------------------------------------------------------
 
 bool PIGPIOManager::ready() const {
-    return (m_version != PI_INIT_FAILED);
+    return (m_version >= 0);
 }
 
 //-----------------------------------------------------------------------------
@@ -23,15 +24,14 @@ int PIGPIOManager::version() const {
 
 PIGPIOManager::PIGPIOManager()
 {
-    // guessing this is the same return value as gpioInitialise (undocumented)
-    m_version = pigpio_start( NULL, NULL );
+    m_version = HAL::open();
 }
 
 //-----------------------------------------------------------------------------
 
 PIGPIOManager::~PIGPIOManager()
 {
-    pigpio_stop();
+    HAL::close();
 }
 
 //-----------------------------------------------------------------------------
@@ -3,14 +3,8 @@
 
 //-----------------------------------------------------------------------------
 
-#include <iostream>
-extern "C" {
-#include <pigpiod_if.h>
-}
-
-//-----------------------------------------------------------------------------
-
-/// Singleton class to manage initialisation of PIGPIO
+/// Singleton class to manage initialisation of PIGPIO, or whichever hardware
+/// backend is linked in via the Hardware Abstraction Layer (see hal.h)
 class PIGPIOManager {
 public:
     /// Returns the single instance
@@ -29,7 +23,7 @@ private:
     /// Destructor
     ~PIGPIOManager();
 
-    int m_version;  ///< PIGPIO version number (or PI_INIT_FAILED)
+    int m_version;  ///< PIGPIO version number (or negative on failure)
 };
 
 //-----------------------------------------------------------------------------
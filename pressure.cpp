@@ -19,6 +19,22 @@ Pressure::~Pressure()
 //-----------------------------------------------------------------------------
 
 double Pressure::getBar() const
+{
+    // measure the ADC voltage (the mean of the latest samples, if the
+    // channel is sampled in the background)
+    return getBar( m_adc.getMeanVoltage( m_channel, 3 ) );
+}
+
+//-----------------------------------------------------------------------------
+
+double Pressure::getBarFast() const
+{
+    return getBar( m_adc.getVoltage( m_channel ) );
+}
+
+//-----------------------------------------------------------------------------
+
+double Pressure::getBar( double voltage ) const
 {
     // maximum reading of pressure sensor in Bar (0..300psi)
     static const double maxPressure = 20.6842719;
@@ -31,13 +47,6 @@ double Pressure::getBar() const
     // supply voltage
     static const double supplyVoltage = 3.3;
 
-    // measure the ADC voltage
-    double voltage = 0.0;
-    const int samples = 3;
-    for (int i=0; i<samples; ++i)
-        voltage += m_adc.getVoltage( m_channel );
-    voltage /= static_cast<double>(samples);
-
     // approximate conversion to Bar
     double bar = maxPressure * (voltage - minVoltage) / voltageRange;
 
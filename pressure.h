@@ -19,6 +19,13 @@ public:
     /// Returns pressure measurement in bar
     double getBar() const;
 
+    /// Returns a pressure measurement in bar from a single conversion
+    /// (quicker than getBar, which averages several)
+    double getBarFast() const;
+
+    /// Convert a sensor voltage to pressure in bar, applying the correction
+    double getBar( double voltage ) const;
+
     /// Set correction factors (scale and offset)
     void setCorrection( double scale, double offset );
 
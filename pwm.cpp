@@ -65,7 +65,7 @@ void PWM::setDivisor( int divisor )
 
 	// stop PWM clock
 	PWMCLK_CNTL = 0x5A000001;
-	sleep(1);
+	delayms(1000);
 
 	// set PWM divisor
 	PWMCLK_DIV  = 0x5A000000 | (divisor<<12);
@@ -15,7 +15,7 @@ Ranger::Ranger() :
 	m_timeLastRun = getClock();
 
 	// start the worker thread
-	m_thread = std::thread( &Ranger::worker, this );
+	m_thread = startThread( &Ranger::worker, this );
 }
 
 //-----------------------------------------------------------------------------
@@ -26,7 +26,7 @@ Ranger::~Ranger()
 	m_run = false;
 
 	// wait for the thread to terminate
-	m_thread.join();
+	joinThread( m_thread );
 }
 
 //-----------------------------------------------------------------------------
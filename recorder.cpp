@@ -0,0 +1,368 @@
+#include "recorder.h"
+#include "settings.h"
+#include "timing.h"
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <atomic>
+
+//-----------------------------------------------------------------------------
+
+// Recorder file format (version 1). All integers are little endian.
+//
+//   header:  "GREC", u16 version, u16 record size, u16 reason, i16 detail,
+//            u32 record slots, u64 events written, f64 offset of the event
+//            times from the wall clock
+//   records: u64 sequence (event number + 1, or zero for an empty slot or
+//            one which was being written), f64 time, f64 value, u16 kind,
+//            u16 channel, u32 aux
+//
+// The records are the slots of the ring, starting with the oldest event.
+
+namespace {
+
+/// file signature
+const char RECORDER_MAGIC[4] = { 'G', 'R', 'E', 'C' };
+
+/// format version
+const uint16_t RECORDER_VERSION = 1;
+
+/// size of the header and of a record in bytes
+const size_t HEADER_SIZE = 32;
+const size_t RECORD_SIZE = 32;
+
+/// number of events held by the ring (must be a power of two)
+const uint64_t RING_SIZE = FLIGHT_RECORDER_EVENTS;
+
+/// Slot in the ring. The sequence is zero while the event is written, so a
+/// reader can tell when it has copied a slot which was being overwritten.
+struct Slot {
+    std::atomic<uint64_t> sequence;     ///< Event number + 1 (zero if none)
+    Recorder::Event       event;        ///< Recorded event
+};
+
+/// The ring, and the number of events recorded
+Slot g_ring[RING_SIZE];
+std::atomic<uint64_t> g_head( 0 );
+
+/// Dump file and temporary file names, and the offset of the event times
+/// from the wall clock (fixed while g_dumping is set)
+char g_fileName[256] = "";
+char g_tempName[sizeof(g_fileName) + 4] = "";
+double g_wallOffset = 0.0;
+
+/// Set while the ring is being written (which also protects g_buffer)
+std::atomic_flag g_dumping = ATOMIC_FLAG_INIT;
+
+/// Buffer for writing the file
+uint8_t g_buffer[4096];
+
+//-----------------------------------------------------------------------------
+
+/// Store a little endian integer
+void putInteger( uint8_t *p, uint64_t value, size_t size )
+{
+    for (size_t i=0; i<size; ++i)
+        p[i] = static_cast<uint8_t>( value >> (8*i) );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Load a little endian integer
+uint64_t getInteger( const uint8_t *p, size_t size )
+{
+    uint64_t value = 0;
+    for (size_t i=0; i<size; ++i)
+        value |= static_cast<uint64_t>( p[i] ) << (8*i);
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Store a double
+void putDouble( uint8_t *p, double value )
+{
+    uint64_t bits;
+    memcpy( &bits, &value, sizeof(bits) );
+    putInteger( p, bits, 8 );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Load a double
+double getDouble( const uint8_t *p )
+{
+    uint64_t bits = getInteger( p, 8 );
+    double value;
+    memcpy( &value, &bits, sizeof(value) );
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Encode a slot of the ring as a record
+void encodeSlot( const Slot & slot, uint8_t *record )
+{
+    uint64_t sequence = slot.sequence.load( std::memory_order_acquire );
+    Recorder::Event event = slot.event;
+
+    // discard the event if it was overwritten while we copied it
+    std::atomic_thread_fence( std::memory_order_acquire );
+    if ( slot.sequence.load( std::memory_order_relaxed ) != sequence )
+        sequence = 0;
+
+    putInteger( record, sequence, 8 );
+    putDouble( record + 8, event.time );
+    putDouble( record + 16, event.value );
+    putInteger( record + 24, event.kind, 2 );
+    putInteger( record + 26, event.channel, 2 );
+    putInteger( record + 28, event.aux, 4 );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Write a buffer to a file (only async-signal-safe calls)
+bool writeAll( int fd, const uint8_t *data, size_t size )
+{
+    while ( size > 0 ) {
+        ssize_t count = ::write( fd, data, size );
+        if ( count < 0 ) {
+            if ( errno == EINTR ) continue;
+            return false;
+        }
+        data += count;
+        size -= static_cast<size_t>( count );
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Read a buffer from a file
+bool readAll( int fd, uint8_t *data, size_t size )
+{
+    while ( size > 0 ) {
+        ssize_t count = ::read( fd, data, size );
+        if ( count <= 0 ) {
+            if ( (count < 0) && (errno == EINTR) ) continue;
+            return false;
+        }
+        data += count;
+        size -= static_cast<size_t>( count );
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Handler for the fatal signals
+void crashHandler( int signal )
+{
+    static const char message[] = "recorder: fatal signal, writing the flight recorder\n";
+    ssize_t ignored = ::write( STDERR_FILENO, message, sizeof(message) - 1 );
+    (void)ignored;
+
+    Recorder::dump( Recorder::Crash, signal );
+
+    // the default action was restored (SA_RESETHAND), so this ends the
+    // process as the signal would have done
+    raise( signal );
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+
+void Recorder::record( Kind kind, unsigned channel, double value, uint32_t aux )
+{
+    uint64_t n = g_head.fetch_add( 1, std::memory_order_relaxed );
+    Slot & slot = g_ring[n & (RING_SIZE-1)];
+
+    slot.sequence.store( 0, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+
+    slot.event.time    = getClock();
+    slot.event.value   = value;
+    slot.event.aux     = aux;
+    slot.event.kind    = static_cast<uint16_t>( kind );
+    slot.event.channel = static_cast<uint16_t>( channel );
+
+    slot.sequence.store( n + 1, std::memory_order_release );
+}
+
+//-----------------------------------------------------------------------------
+
+bool Recorder::setDumpFile( const std::string & fileName )
+{
+    if ( fileName.size() >= sizeof(g_fileName) ) return false;
+
+    // wait for any dump in progress
+    while ( g_dumping.test_and_set( std::memory_order_acquire ) )
+        delayms( 1 );
+
+    strcpy( g_fileName, fileName.c_str() );
+    strcpy( g_tempName, fileName.c_str() );
+    if ( !fileName.empty() ) strcat( g_tempName, ".tmp" );
+
+    g_wallOffset = getWallClock() - getClock();
+
+    g_dumping.clear( std::memory_order_release );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Recorder::dump( Reason reason, int detail )
+{
+    if ( g_dumping.test_and_set( std::memory_order_acquire ) ) return false;
+    if ( g_fileName[0] == '\0' ) {
+        g_dumping.clear( std::memory_order_release );
+        return false;
+    }
+
+    bool success = false;
+    int fd = open( g_tempName, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if ( fd >= 0 ) {
+        uint64_t written = g_head.load( std::memory_order_acquire );
+
+        uint8_t *header = g_buffer;
+        memcpy( header, RECORDER_MAGIC, sizeof(RECORDER_MAGIC) );
+        putInteger( header + 4, RECORDER_VERSION, 2 );
+        putInteger( header + 6, RECORD_SIZE, 2 );
+        putInteger( header + 8, static_cast<uint16_t>( reason ), 2 );
+        putInteger( header + 10, static_cast<uint16_t>( detail ), 2 );
+        putInteger( header + 12, RING_SIZE, 4 );
+        putInteger( header + 16, written, 8 );
+        putDouble( header + 24, g_wallOffset );
+        success = writeAll( fd, g_buffer, HEADER_SIZE );
+
+        // every slot, starting with the oldest event
+        uint64_t first = (written > RING_SIZE) ? written - RING_SIZE : 0;
+        size_t used = 0;
+        for (uint64_t n=first; success && (n < first + RING_SIZE); ++n) {
+            encodeSlot( g_ring[n & (RING_SIZE-1)], g_buffer + used );
+            used += RECORD_SIZE;
+            if ( used == sizeof(g_buffer) ) {
+                success = writeAll( fd, g_buffer, used );
+                used = 0;
+            }
+        }
+        if ( success && (used > 0) ) success = writeAll( fd, g_buffer, used );
+
+        success = (fsync( fd ) == 0) && success;
+        success = (close( fd ) == 0) && success;
+        success = success && (rename( g_tempName, g_fileName ) == 0);
+    }
+
+    g_dumping.clear( std::memory_order_release );
+    return success;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Recorder::installCrashHandler()
+{
+    // run the handler on a stack of its own, so that a stack overflow is
+    // recorded (the worker threads are given theirs by startThread)
+    bool success = setSignalStack();
+
+    struct sigaction action;
+    memset( &action, 0, sizeof(action) );
+    action.sa_handler = crashHandler;
+    sigemptyset( &action.sa_mask );
+    action.sa_flags = SA_RESETHAND | SA_ONSTACK;
+
+    const int signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+    for (size_t i=0; i<sizeof(signals)/sizeof(signals[0]); ++i)
+        success = (sigaction( signals[i], &action, 0 ) == 0) && success;
+    return success;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Recorder::read( const std::string & fileName, Dump & dump )
+{
+    int fd = open( fileName.c_str(), O_RDONLY );
+    if ( fd < 0 ) return false;
+
+    uint8_t header[HEADER_SIZE];
+    bool success =
+        readAll( fd, header, sizeof(header) ) &&
+        (memcmp( header, RECORDER_MAGIC, sizeof(RECORDER_MAGIC) ) == 0) &&
+        (getInteger( header + 4, 2 ) == RECORDER_VERSION) &&
+        (getInteger( header + 6, 2 ) == RECORD_SIZE);
+
+    dump.events.clear();
+    if ( success ) {
+        dump.reason = static_cast<unsigned>( getInteger( header + 8, 2 ) );
+        dump.detail = static_cast<int16_t>( getInteger( header + 10, 2 ) );
+        dump.written = getInteger( header + 16, 8 );
+        dump.wallOffset = getDouble( header + 24 );
+
+        // keep the complete events, in the order in which they were recorded
+        std::vector< std::pair<uint64_t, Event> > events;
+        uint32_t slots = static_cast<uint32_t>( getInteger( header + 12, 4 ) );
+        uint8_t record[RECORD_SIZE];
+        for (uint32_t i=0; success && (i < slots); ++i) {
+            success = readAll( fd, record, sizeof(record) );
+            uint64_t sequence = getInteger( record, 8 );
+            if ( !success || (sequence == 0) ) continue;
+
+            Event event;
+            event.time    = getDouble( record + 8 );
+            event.value   = getDouble( record + 16 );
+            event.kind    = static_cast<uint16_t>( getInteger( record + 24, 2 ) );
+            event.channel = static_cast<uint16_t>( getInteger( record + 26, 2 ) );
+            event.aux     = static_cast<uint32_t>( getInteger( record + 28, 4 ) );
+            events.push_back( std::make_pair( sequence, event ) );
+        }
+
+        std::sort(
+            events.begin(), events.end(),
+            []( const std::pair<uint64_t, Event> & a, const std::pair<uint64_t, Event> & b ) {
+                return a.first < b.first;
+            }
+        );
+        dump.events.reserve( events.size() );
+        for (size_t i=0; i<events.size(); ++i)
+            dump.events.push_back( events[i].second );
+    }
+
+    close( fd );
+    return success;
+}
+
+//-----------------------------------------------------------------------------
+
+const char *Recorder::getKindName( unsigned kind )
+{
+    switch ( kind ) {
+    case Temperature:     return "temperature";
+    case SensorFault:     return "sensor-fault";
+    case Voltage:         return "voltage";
+    case Input:           return "input";
+    case Output:          return "output";
+    case Button:          return "button";
+    case RegulatorInput:  return "regulator-input";
+    case RegulatorOutput: return "regulator-output";
+    case RegulatorTarget: return "regulator-target";
+    default:              return "unknown";
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+const char *Recorder::getReasonName( unsigned reason )
+{
+    switch ( reason ) {
+    case Demand:   return "demand";
+    case Crash:    return "crash";
+    case Watchdog: return "watchdog";
+    default:       return "unknown";
+    }
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,92 @@
+#ifndef __recorder_h
+#define __recorder_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <vector>
+#include <inttypes.h>
+
+//-----------------------------------------------------------------------------
+
+/// Flight recorder. Every raw sensor reading, regulator input and output and
+/// GPIO event is recorded into one fixed size ring in memory, which is
+/// continuously overwritten, so the last few minutes at full resolution are
+/// always available without logging them. The ring is written to a file
+/// when the process crashes, when the watchdog trips or on demand. Any
+/// thread may record events without locking, and writing the ring is safe
+/// from a signal handler: nothing is allocated or locked, and the file is
+/// written under a temporary name and renamed so that it is never seen half
+/// written.
+namespace Recorder {
+
+/// Kinds of event
+enum Kind {
+    Temperature     = 1,    ///< Temperature sensor reading in degrees C
+    SensorFault     = 2,    ///< Invalid temperature sensor packet
+    Voltage         = 3,    ///< ADC reading in volts (channel is the input)
+    Input           = 4,    ///< GPIO input edge (channel is the pin, aux is the tick in us)
+    Output          = 5,    ///< GPIO output state (channel is the pin)
+    Button          = 6,    ///< Button pressed (1) or released (0)
+    RegulatorInput  = 7,    ///< Temperature used by the regulator
+    RegulatorOutput = 8,    ///< Boiler power level set by the regulator (0..1)
+    RegulatorTarget = 9     ///< Target temperature of the regulator
+};
+
+/// Reasons for writing the ring
+enum Reason {
+    Demand   = 0,   ///< On request
+    Crash    = 1,   ///< Fatal signal (the detail is the signal number)
+    Watchdog = 2    ///< A worker loop stopped making progress
+};
+
+/// Recorded event
+struct Event {
+    double   time;      ///< Time in seconds (from getClock)
+    double   value;     ///< Value
+    uint32_t aux;       ///< Extra information (depends on the kind)
+    uint16_t kind;      ///< Kind of event
+    uint16_t channel;   ///< Sensor, pin or button number
+};
+
+/// Contents of a recorder file
+struct Dump {
+    unsigned reason;        ///< Reason for writing the file
+    int      detail;        ///< Signal number for a crash
+    uint64_t written;       ///< Events recorded since the process started
+    double   wallOffset;    ///< Add to the event times for seconds since the epoch
+    std::vector<Event> events;  ///< Events still in the ring, oldest first
+};
+
+/// Record an event
+void record( Kind kind, unsigned channel, double value, uint32_t aux = 0 );
+
+/// Set the file written by dump(). Returns false if the name is too long.
+bool setDumpFile( const std::string & fileName );
+
+/// Write the ring to the dump file. This is safe to call from a signal
+/// handler. Returns false if no file has been set, another dump is in
+/// progress or the file could not be written.
+bool dump( Reason reason, int detail = 0 );
+
+/// Hook the fatal signals (SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT) so
+/// that the ring is written before the process ends (and dumps core, if
+/// enabled). The handler runs on a separate stack, so a stack overflow is
+/// recorded too, on the calling thread and on threads started with
+/// startThread (see setSignalStack). Returns true for success.
+bool installCrashHandler();
+
+/// Read a file written by dump(). Returns true for success.
+bool read( const std::string & fileName, Dump & dump );
+
+/// Returns the name of a kind of event
+const char *getKindName( unsigned kind );
+
+/// Returns the name of a reason for writing the ring
+const char *getReasonName( unsigned reason );
+
+} // namespace Recorder
+
+//-----------------------------------------------------------------------------
+
+#endif//__recorder_h
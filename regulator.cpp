@@ -1,5 +1,7 @@
 #include "regulator.h"
 #include "timing.h"
+#include "trace.h"
+#include "recorder.h"
 
 //-----------------------------------------------------------------------------
 
@@ -10,6 +12,7 @@ Regulator::Regulator( const Temperature & temperature ) :
 	m_targetTemp( 95.0 ),
 	m_latestTemp( 20.0 ),
 	m_latestPower( 0.0 ),
+	m_loop( "regulator" ),
     m_temperature( temperature )
 	//m_thread implicit
 {
@@ -32,7 +35,7 @@ bool Regulator::start()
 
 	// start thread
 	m_run = true;
-	m_thread = std::thread( &Regulator::worker, this );
+	m_thread = startThread( &Regulator::worker, this );
 
 	// todo: possible indication of failed initialisation
 	return true;
@@ -46,8 +49,7 @@ void Regulator::stop()
 	m_run = false;
 
 	// wait for the thread to terminate
-	if ( m_thread.joinable() )
-        m_thread.join();
+	joinThread( m_thread );
 }
 
 //-----------------------------------------------------------------------------
@@ -83,6 +85,7 @@ Regulator & Regulator::setTargetTemperature( double target )
 {
 	std::lock_guard<std::mutex> lock( m_mutex );
 	m_targetTemp = target;
+	Recorder::record( Recorder::RegulatorTarget, 0, target );
 	return *this;
 }
 
@@ -131,12 +134,17 @@ bool Regulator::getPower() const
 
 void Regulator::worker()
 {
+	Trace::setThreadName( "regulator" );
+
 	// start time and next time step
 	double start = getClock();
 	double next  = start;
 
 	// run the thread until requested to stop
 	while (m_run) {
+		m_loop.begin();
+		double traceStart = Trace::now();
+
 		// get elapsed time since start
 		double elapsed = getClock() - start;
 
@@ -172,6 +180,8 @@ void Regulator::worker()
 
 		// set the boiler power (uses pulse width modulation)
 		m_boiler.setPower( drive );
+		Recorder::record( Recorder::RegulatorInput, 0, latestTemp );
+		Recorder::record( Recorder::RegulatorOutput, 0, drive );
 
 		// store the latest temperature reading
 		{
@@ -181,6 +191,8 @@ void Regulator::worker()
 		}
 
 		// sleep for the remainder of the time step
+		Trace::complete( "regulator.update", traceStart );
+		m_loop.end( next );
 		double remain = next - getClock();
 		if ( remain > 0.0 )
 			delayms( static_cast<int>(1.0E3 * remain) );
@@ -9,6 +9,7 @@
 #include "pid.h"
 #include "temperature.h"
 #include "boiler.h"
+#include "loopmonitor.h"
 
 //-----------------------------------------------------------------------------
 
@@ -79,6 +80,9 @@ private:
 	double	m_latestPower;	///< Latest power level (0..1)
 	Boiler	m_boiler;		///< Boiler control
 
+	/// Timing of the control loop
+	LoopMonitor m_loop;
+
     /// Temperature sensor
 	const Temperature & m_temperature;
 };
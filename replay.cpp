@@ -0,0 +1,121 @@
+#include "replay.h"
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+
+ReplayPlant::ReplayPlant() :
+    m_index( 0 ),
+    m_time( 0.0 ),
+    m_running( false ),
+    m_scale( 1.0 ),
+    m_offset( 0.0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+ReplayPlant::~ReplayPlant()
+{
+}
+
+//-----------------------------------------------------------------------------
+
+bool ReplayPlant::load( const std::string & fileName, double from, double to )
+{
+    LogReader in;
+    if ( !in.open( fileName ) ) return false;
+
+    m_samples.clear();
+    if ( from > 0.0 ) in.seek( from );
+
+    // read the samples, skipping notes
+    std::string note;
+    Sample sample;
+    LogReader::Record record;
+    while ( (record = in.next( sample, note )) != LogReader::End ) {
+        if ( record != LogReader::SampleRow ) continue;
+        if ( sample.elapsed < from ) continue;
+        if ( (to > 0.0) && (sample.elapsed > to) ) break;
+
+        // elapsed time should increase monotonically
+        if ( !m_samples.empty() && (sample.elapsed < m_samples.back().elapsed) )
+            continue;
+
+        m_samples.push_back( sample );
+    }
+
+    m_index = 0;
+    m_time = 0.0;
+    m_running = false;
+
+    return !m_samples.empty();
+}
+
+//-----------------------------------------------------------------------------
+
+void ReplayPlant::setCorrection( double scale, double offset )
+{
+    m_scale  = (scale != 0.0) ? scale : 1.0;
+    m_offset = offset;
+}
+
+//-----------------------------------------------------------------------------
+
+void ReplayPlant::start()
+{
+    m_index = 0;
+    m_time = m_samples.empty() ? 0.0 : m_samples.front().elapsed;
+    m_running = true;
+}
+
+//-----------------------------------------------------------------------------
+
+double ReplayPlant::getDuration() const
+{
+    if ( m_samples.empty() ) return 0.0;
+    return m_samples.back().elapsed - m_samples.front().elapsed;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t ReplayPlant::size() const
+{
+    return m_samples.size();
+}
+
+//-----------------------------------------------------------------------------
+
+void ReplayPlant::step(
+    double dt,
+    const Actuators & /*actuators*/,
+    Sensors & sensors
+) {
+    sensors.range = 50.0;
+    if ( m_samples.empty() ) return;
+
+    if ( m_running ) m_time += dt;
+
+    // find the last sample at or before the current time
+    while ( (m_index + 1 < m_samples.size()) &&
+            (m_samples[m_index + 1].elapsed <= m_time) )
+        ++m_index;
+
+    // interpolate towards the next sample
+    const Sample & a = m_samples[m_index];
+    const Sample & b = m_samples[ std::min( m_index + 1, m_samples.size() - 1 ) ];
+    double t = 0.0;
+    if ( (b.elapsed > a.elapsed) && (m_time > a.elapsed) )
+        t = std::min( 1.0, (m_time - a.elapsed) / (b.elapsed - a.elapsed) );
+
+    double bar = a.bar + t * (b.bar - a.bar);
+
+    sensors.temperature = a.temperature + t * (b.temperature - a.temperature);
+    sensors.litres      = (a.ml + t * (b.ml - a.ml)) / 1000.0;
+    sensors.brewSwitch  = (a.pump != 0);
+
+    // undo the pressure correction applied by Pressure::getBar (readings
+    // which were clamped to zero are presented as the offset)
+    sensors.pressure = (bar - m_offset) / m_scale;
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,63 @@
+#ifndef __replay_h
+#define __replay_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <vector>
+#include "simulation.h"
+#include "telemetry.h"
+
+//-----------------------------------------------------------------------------
+
+/// Plant which replays a recorded session log. The logged temperature,
+/// pressure, volume and pump columns are presented to the simulated hardware
+/// as sensor values, so they pass through the TSIC, ADC and flow meter code,
+/// the Regulator, the Display and the logging path as if they were live.
+/// The heater and pump outputs are ignored (the replay is open loop).
+class ReplayPlant : public Plant {
+public:
+    /// Default constructor
+    ReplayPlant();
+
+    /// Destructor
+    virtual ~ReplayPlant();
+
+    /// Load a log file (in either format), or the part of it between two
+    /// elapsed times (to of zero for the end of the log). The index of the
+    /// log is used to skip to the start. Returns true for success.
+    bool load(
+        const std::string & fileName,
+        double from = 0.0,
+        double to = 0.0
+    );
+
+    /// Set the pressure sensor correction used when the log was recorded, so
+    /// that the logged values can be converted back to sensor readings
+    void setCorrection( double scale, double offset );
+
+    /// Start the replay from the first sample (until then, the first sample
+    /// is presented)
+    void start();
+
+    /// Returns the duration of the log in seconds
+    double getDuration() const;
+
+    /// Returns the number of samples loaded
+    size_t size() const;
+
+    /// Advance the replay by dt seconds
+    void step( double dt, const Actuators & actuators, Sensors & sensors );
+
+private:
+    std::vector<Sample> m_samples;  ///< Samples from the log
+    size_t  m_index;                ///< Index of the current sample
+    double  m_time;                 ///< Replay time in seconds
+    bool    m_running;              ///< Has the replay started?
+    double  m_scale;                ///< Pressure correction scale
+    double  m_offset;               ///< Pressure correction offset
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__replay_h
@@ -0,0 +1,412 @@
+#include "retention.h"
+#include "timing.h"
+#include "trace.h"
+#include "telemetry.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <zlib.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+
+/// time between routine checks of the directory in seconds
+static const unsigned SCAN_PERIOD = 600;
+
+/// files modified more recently than this (in seconds) are not compressed,
+/// in case another process is still writing them
+static const double COMPRESS_DELAY = 60.0;
+
+/// I/O priority for the thread: the idle class (see ioprio_set(2))
+static const int IOPRIO_WHO_PROCESS = 1;
+static const int IOPRIO_IDLE = 3 << 13;
+
+//-----------------------------------------------------------------------------
+
+/// Does the name end with the suffix?
+static bool endsWith( const std::string & name, const char *suffix )
+{
+    size_t length = strlen( suffix );
+    return
+        (name.size() >= length) &&
+        (name.compare( name.size() - length, length, suffix ) == 0);
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogRetention::isLogFile( std::string name )
+{
+    if ( endsWith( name, ".gz" ) ) name.erase( name.size() - 3 );
+
+    return
+        endsWith( name, ".glog" ) || endsWith( name, ".csv" ) ||
+        endsWith( name, "-loops.txt" ) || endsWith( name, "-trace.json" ) ||
+        endsWith( name, ".idx" ) || endsWith( name, "-flight.rec" ) ||
+        endsWith( name, "-events.jnl" );
+}
+
+//-----------------------------------------------------------------------------
+
+std::string LogRetention::getSession( std::string name )
+{
+    if ( endsWith( name, ".gz" ) ) name.erase( name.size() - 3 );
+    if ( endsWith( name, ".idx" ) ) name.erase( name.size() - 4 );
+
+    static const char *suffixes[] = {
+        ".glog", ".csv", "-loops.txt", "-trace.json", "-flight.rec",
+        "-events.jnl"
+    };
+    for (size_t i=0; i<sizeof(suffixes)/sizeof(suffixes[0]); ++i) {
+        if ( endsWith( name, suffixes[i] ) ) {
+            name.erase( name.size() - strlen( suffixes[i] ) );
+            break;
+        }
+    }
+
+    // drop the number of a shot log (-shot3) or of a later part (-2): the
+    // session names end with the time (-HHMM), which is never this short
+    size_t dash = name.rfind( '-' );
+    if ( dash == std::string::npos ) return name;
+    size_t digits = dash + 1;
+    if ( name.compare( digits, 4, "shot" ) == 0 ) digits += 4;
+    size_t count = name.size() - digits;
+    if (
+        (count > 0) &&
+        (name.find_first_not_of( "0123456789", digits ) == std::string::npos) &&
+        ((digits > dash + 1) || (count < 4))
+    )
+        name.erase( dash );
+    return name;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Is this an (uncompressed) session log, rather than a side file?
+static bool isSessionLog( const std::string & name )
+{
+    return endsWith( name, ".glog" ) || endsWith( name, ".csv" );
+}
+
+//-----------------------------------------------------------------------------
+
+/// File in the log directory
+struct LogFile {
+    std::string name;       ///< Full path
+    time_t      modified;   ///< Modification time
+    uint64_t    size;       ///< Size in bytes
+
+    bool operator < ( const LogFile & other ) const {
+        return modified < other.modified;
+    }
+};
+
+//-----------------------------------------------------------------------------
+
+/// A session in the log directory, with all its files
+struct LogSession {
+    std::vector<LogFile> files;     ///< Files of the session
+    time_t               modified;  ///< Newest modification time
+
+    bool operator < ( const LogSession & other ) const {
+        return modified < other.modified;
+    }
+};
+
+//-----------------------------------------------------------------------------
+
+/// List the log files in a directory
+static std::vector<LogFile> listFiles( const std::string & directory )
+{
+    std::vector<LogFile> files;
+
+    DIR *dir = opendir( directory.c_str() );
+    if ( dir == 0 ) return files;
+
+    struct dirent *entry;
+    while ( (entry = readdir( dir )) != 0 ) {
+        if ( !LogRetention::isLogFile( entry->d_name ) ) continue;
+
+        LogFile file;
+        file.name = directory + entry->d_name;
+
+        struct stat info;
+        if ( stat( file.name.c_str(), &info ) != 0 ) continue;
+        if ( !S_ISREG( info.st_mode ) ) continue;
+
+        file.modified = info.st_mtime;
+        file.size = static_cast<uint64_t>( info.st_size );
+        files.push_back( file );
+    }
+
+    closedir( dir );
+    return files;
+}
+
+//-----------------------------------------------------------------------------
+
+LogRetention::Policy::Policy() :
+    compress( true ),
+    maxAge( 0.0 ),
+    diskBudget( 0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+LogRetention::LogRetention() :
+    m_run( false ),
+    m_wake( false )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+LogRetention::~LogRetention()
+{
+    stop();
+}
+
+//-----------------------------------------------------------------------------
+
+void LogRetention::start( const std::string & directory, const Policy & policy )
+{
+    stop();
+
+    m_directory = directory;
+    if ( !m_directory.empty() && (m_directory[m_directory.size()-1] != '/') )
+        m_directory += '/';
+    m_policy = policy;
+
+    m_run = true;
+    m_wake = true;
+    m_thread = startThread( &LogRetention::worker, this );
+}
+
+//-----------------------------------------------------------------------------
+
+void LogRetention::stop()
+{
+    m_run = false;
+    joinThread( m_thread );
+}
+
+//-----------------------------------------------------------------------------
+
+void LogRetention::protect( const std::string & fileName )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_protected.insert( fileName );
+}
+
+//-----------------------------------------------------------------------------
+
+void LogRetention::release( const std::string & fileName )
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_protected.erase( fileName );
+        m_closed.insert( fileName );
+    }
+    wake();
+}
+
+//-----------------------------------------------------------------------------
+
+void LogRetention::addStore( const std::string & fileName )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_stores.insert( fileName );
+}
+
+//-----------------------------------------------------------------------------
+
+void LogRetention::wake()
+{
+    m_wake = true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogRetention::isProtected( const std::string & fileName ) const
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return m_protected.count( fileName ) > 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogRetention::worker()
+{
+    Trace::setThreadName( "retention" );
+
+    // compression must not compete with the controller, so run this thread
+    // at the lowest CPU priority and in the idle I/O class (best effort: the
+    // calls fail harmlessly where they are not permitted)
+    pid_t tid = static_cast<pid_t>( syscall( SYS_gettid ) );
+    setpriority( PRIO_PROCESS, tid, 19 );
+    syscall( SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_IDLE );
+
+    unsigned idle = 0;
+    while ( m_run ) {
+        if ( m_wake.exchange( false ) || (idle >= SCAN_PERIOD) ) {
+            scan();
+            idle = 0;
+        }
+
+        delayms( 1000 );
+        ++idle;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void LogRetention::scan()
+{
+    Trace::Span span( "retention.scan" );
+
+    time_t now = time( 0 );
+
+    std::set<std::string> closed;
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        closed.swap( m_closed );
+    }
+
+    // compress closed files (and any others which haven't changed recently)
+    if ( m_policy.compress ) {
+        std::vector<LogFile> files = listFiles( m_directory );
+        for (size_t i=0; (i<files.size()) && m_run; ++i) {
+            const LogFile & file = files[i];
+            if ( endsWith( file.name, ".gz" ) ) continue;
+
+            // an index is small, and is read directly by LogIndex, as are
+            // the flight recorder and event journal
+            if ( endsWith( file.name, ".idx" ) ) continue;
+            if ( endsWith( file.name, "-flight.rec" ) ) continue;
+            if ( endsWith( file.name, "-events.jnl" ) ) continue;
+            if ( isProtected( file.name ) ) continue;
+            if (
+                (closed.count( file.name ) == 0) &&
+                (difftime( now, file.modified ) < COMPRESS_DELAY)
+            ) continue;
+
+            // remove the unused space from a log left open by a power cut
+            if ( isSessionLog( file.name ) && !recoverLog( file.name ) )
+                continue;
+            compress( file.name );
+        }
+    }
+
+    // the sessions being written, and the space taken by the stores
+    std::set<std::string> active;
+    uint64_t total = 0;
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        std::set<std::string>::const_iterator i;
+        for (i=m_protected.begin(); i!=m_protected.end(); ++i)
+            active.insert( getSession( *i ) );
+        for (i=m_stores.begin(); i!=m_stores.end(); ++i) {
+            struct stat info;
+            if ( stat( i->c_str(), &info ) == 0 )
+                total += static_cast<uint64_t>( info.st_size );
+        }
+    }
+
+    // group the files by session
+    std::map<std::string, LogSession> sessions;
+    std::vector<LogFile> files = listFiles( m_directory );
+    for (size_t i=0; i<files.size(); ++i) {
+        LogSession & session = sessions[getSession( files[i].name )];
+        if ( session.files.empty() || (files[i].modified > session.modified) )
+            session.modified = files[i].modified;
+        session.files.push_back( files[i] );
+        total += files[i].size;
+    }
+
+    // delete the oldest sessions first, each as a whole
+    std::vector<LogSession> oldest;
+    std::map<std::string, LogSession>::const_iterator s;
+    for (s=sessions.begin(); s!=sessions.end(); ++s)
+        if ( active.count( s->first ) == 0 ) oldest.push_back( s->second );
+    std::sort( oldest.begin(), oldest.end() );
+
+    for (size_t i=0; (i<oldest.size()) && m_run; ++i) {
+        const LogSession & session = oldest[i];
+
+        bool expired =
+            (m_policy.maxAge > 0.0) &&
+            (difftime( now, session.modified ) > m_policy.maxAge);
+        bool overBudget =
+            (m_policy.diskBudget > 0) && (total > m_policy.diskBudget);
+        if ( !expired && !overBudget ) continue;
+
+        for (size_t f=0; f<session.files.size(); ++f)
+            if ( unlink( session.files[f].name.c_str() ) == 0 )
+                total -= session.files[f].size;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogRetention::compress( const std::string & fileName )
+{
+    Trace::Span span( "retention.compress" );
+
+    FILE *in = fopen( fileName.c_str(), "rb" );
+    if ( in == 0 ) return false;
+
+    // write to a temporary file, so that a partial file is never mistaken
+    // for a complete one
+    const std::string target( fileName + ".gz" );
+    const std::string temporary( target + ".tmp" );
+    gzFile out = gzopen( temporary.c_str(), "wb6" );
+    if ( out == 0 ) {
+        fclose( in );
+        return false;
+    }
+
+    std::vector<char> buffer( 65536 );
+    bool success = true;
+    size_t size;
+    while ( (size = fread( &buffer[0], 1, buffer.size(), in )) > 0 ) {
+        if ( gzwrite( out, &buffer[0], size ) != static_cast<int>(size) ) {
+            success = false;
+            break;
+        }
+    }
+    if ( ferror( in ) ) success = false;
+    fclose( in );
+    if ( gzclose( out ) != Z_OK ) success = false;
+
+    if ( !success ) {
+        unlink( temporary.c_str() );
+        return false;
+    }
+
+    // keep the original modification time, which is used for retention
+    struct stat info;
+    if ( stat( fileName.c_str(), &info ) == 0 ) {
+        struct utimbuf times;
+        times.actime  = info.st_atime;
+        times.modtime = info.st_mtime;
+        utime( temporary.c_str(), &times );
+    }
+
+    if ( rename( temporary.c_str(), target.c_str() ) != 0 ) {
+        unlink( temporary.c_str() );
+        return false;
+    }
+
+    unlink( fileName.c_str() );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,104 @@
+#ifndef __retention_h
+#define __retention_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <inttypes.h>
+
+//-----------------------------------------------------------------------------
+
+/// Keeps the log directory within limits. A background thread, running at
+/// low CPU and I/O priority, compresses closed log files with gzip and then
+/// deletes the oldest sessions when they are older than the maximum age or
+/// the directory is over its disk budget. A session (all parts of a log,
+/// with their indexes, shot logs and other side files) is deleted as a
+/// whole. Files which are still being written are not compressed, and the
+/// sessions they belong to are not deleted. The long-term stores (such as
+/// the history) count against the budget, but are never deleted.
+class LogRetention {
+public:
+    /// Retention policy
+    struct Policy {
+        bool     compress;      ///< Compress closed logs?
+        double   maxAge;        ///< Maximum age in seconds (0 for no limit)
+        uint64_t diskBudget;    ///< Maximum total size in bytes (0 for none)
+
+        /// Default constructor: compress, but keep everything
+        Policy();
+    };
+
+    /// Default constructor
+    LogRetention();
+
+    /// Destructor
+    ~LogRetention();
+
+    /// Start managing the given directory
+    void start( const std::string & directory, const Policy & policy );
+
+    /// Stop the background thread
+    void stop();
+
+    /// Protect a file which is being written (given its full path)
+    void protect( const std::string & fileName );
+
+    /// Remove the protection from a file, once it has been closed (it may
+    /// then be compressed straight away)
+    void release( const std::string & fileName );
+
+    /// Count a long-term store in the directory (given its full path)
+    /// against the disk budget
+    void addStore( const std::string & fileName );
+
+    /// Ask for the directory to be checked as soon as possible
+    void wake();
+
+    /// Is this one of the files written by the controller (including the
+    /// compressed versions)?
+    static bool isLogFile( std::string name );
+
+    /// Returns the session a log or side file belongs to: the path of the
+    /// first log of the session without its extension (150412-0930 for
+    /// 150412-0930-2.glog.gz, 150412-0930.glog.idx, 150412-0930-shot1.glog
+    /// or 150412-0930-events.jnl)
+    static std::string getSession( std::string name );
+
+private:
+    /// Background thread
+    void worker();
+
+    /// Compress and delete files according to the policy
+    void scan();
+
+    /// Is the file protected?
+    bool isProtected( const std::string & fileName ) const;
+
+    /// Compress a file to <name>.gz and delete the original. Returns true
+    /// for success.
+    bool compress( const std::string & fileName );
+
+private:
+    std::string         m_directory;    ///< Log directory (ending in '/')
+    Policy              m_policy;       ///< Retention policy
+    std::set<std::string> m_protected;  ///< Files being written
+    std::set<std::string> m_closed;     ///< Files released since the last scan
+    std::set<std::string> m_stores;     ///< Long-term stores
+
+    std::atomic<bool>   m_run;      ///< Should the thread continue to run?
+    std::atomic<bool>   m_wake;     ///< Has a check been requested?
+
+    /// Thread used to compress and delete files
+    std::thread m_thread;
+
+    /// Mutex to control access to the protected, closed and store files
+    mutable std::mutex m_mutex;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__retention_h
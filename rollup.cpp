@@ -0,0 +1,534 @@
+#include "rollup.h"
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+
+// Rollup file format (version 1). All integers are little endian.
+//
+//   header:  "GRUP", u16 version, u16 record size, u32 interval in seconds,
+//            u32 record slots, u64 records written, u64 reserved
+//   records: i64 start time in seconds, u32 samples, u32 reserved, then the
+//            min, max, mean and last temperature, power level and pressure,
+//            the volume and the energy as 32 bit floats
+//
+// Record n is in slot n % slots, so once the file is full each record
+// replaces the oldest.
+
+/// file signature
+static const char ROLLUP_MAGIC[4] = { 'G', 'R', 'U', 'P' };
+
+/// format version
+static const uint16_t ROLLUP_VERSION = 1;
+
+/// size of the header and of a record in bytes
+static const size_t HEADER_SIZE = 32;
+static const size_t RECORD_SIZE = 72;
+
+/// longest gap between samples counted for the boiler energy, in seconds
+static const double MAX_GAP = 1.0;
+
+/// rollup levels
+static const struct {
+    unsigned    interval;   ///< Interval in seconds
+    const char *name;       ///< Name used for the file and the command
+    uint32_t    capacity;   ///< Record slots in the file
+} LEVEL_INFO[RollupStore::LEVELS] = {
+    { 1,    "1s", 86400  },     // a day
+    { 60,   "1m", 525600 },     // a year
+    { 3600, "1h", 87600  }      // ten years
+};
+
+//-----------------------------------------------------------------------------
+
+/// Store a little endian integer
+static void putInteger( uint8_t *p, uint64_t value, size_t size )
+{
+    for (size_t i=0; i<size; ++i)
+        p[i] = static_cast<uint8_t>( value >> (8*i) );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Load a little endian integer
+static uint64_t getInteger( const uint8_t *p, size_t size )
+{
+    uint64_t value = 0;
+    for (size_t i=0; i<size; ++i)
+        value |= static_cast<uint64_t>( p[i] ) << (8*i);
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Store a float
+static void putFloat( uint8_t *p, float value )
+{
+    uint32_t bits;
+    memcpy( &bits, &value, sizeof(bits) );
+    putInteger( p, bits, 4 );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Load a float
+static float getFloat( const uint8_t *p )
+{
+    uint32_t bits = static_cast<uint32_t>( getInteger( p, 4 ) );
+    float value;
+    memcpy( &value, &bits, sizeof(value) );
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Encode a record
+static void encodeRecord( const RollupPoint & point, uint8_t *record )
+{
+    putInteger( record, static_cast<uint64_t>( static_cast<int64_t>( point.time ) ), 8 );
+    putInteger( record + 8, point.count, 4 );
+    putInteger( record + 12, 0, 4 );
+
+    const RollupPoint::Stat *stats[] = {
+        &point.temperature, &point.power, &point.pressure
+    };
+    uint8_t *p = record + 16;
+    for (size_t i=0; i<3; ++i) {
+        putFloat( p,      stats[i]->min );
+        putFloat( p + 4,  stats[i]->max );
+        putFloat( p + 8,  stats[i]->mean );
+        putFloat( p + 12, stats[i]->last );
+        p += 16;
+    }
+    putFloat( p,     point.volume );
+    putFloat( p + 4, point.energy );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Decode a record
+static void decodeRecord( const uint8_t *record, RollupPoint & point )
+{
+    point.time = static_cast<double>( static_cast<int64_t>( getInteger( record, 8 ) ) );
+    point.count = static_cast<uint32_t>( getInteger( record + 8, 4 ) );
+
+    RollupPoint::Stat *stats[] = {
+        &point.temperature, &point.power, &point.pressure
+    };
+    const uint8_t *p = record + 16;
+    for (size_t i=0; i<3; ++i) {
+        stats[i]->min  = getFloat( p );
+        stats[i]->max  = getFloat( p + 4 );
+        stats[i]->mean = getFloat( p + 8 );
+        stats[i]->last = getFloat( p + 12 );
+        p += 16;
+    }
+    point.volume = getFloat( p );
+    point.energy = getFloat( p + 4 );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Combine the summary of one signal over two parts of an interval
+static void mergeStat(
+    RollupPoint::Stat & stat,
+    uint32_t count,
+    const RollupPoint::Stat & other,
+    uint32_t otherCount
+) {
+    stat.min = std::min( stat.min, other.min );
+    stat.max = std::max( stat.max, other.max );
+    stat.mean = static_cast<float>(
+        (static_cast<double>( stat.mean ) * count +
+         static_cast<double>( other.mean ) * otherCount) /
+        std::max<uint32_t>( count + otherCount, 1 )
+    );
+    stat.last = other.last;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Read a file header, returning false if it is not a rollup file
+static bool readHeader(
+    int fd,
+    unsigned & interval,
+    uint32_t & capacity,
+    uint64_t & written
+) {
+    uint8_t header[HEADER_SIZE];
+    if (
+        (pread( fd, header, sizeof(header), 0 ) != sizeof(header)) ||
+        (memcmp( header, ROLLUP_MAGIC, sizeof(ROLLUP_MAGIC) ) != 0) ||
+        (getInteger( header + 6, 2 ) != RECORD_SIZE)
+    )
+        return false;
+
+    interval = static_cast<unsigned>( getInteger( header + 8, 4 ) );
+    capacity = static_cast<uint32_t>( getInteger( header + 12, 4 ) );
+    written  = getInteger( header + 16, 8 );
+    return capacity > 0;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Returns the file offset of a record
+static off_t getRecordOffset( uint64_t index, uint32_t capacity )
+{
+    return static_cast<off_t>( HEADER_SIZE + (index % capacity) * RECORD_SIZE );
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned RollupStore::getInterval( size_t level )
+{
+    return LEVEL_INFO[level].interval;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t RollupStore::getLevel( const std::string & name )
+{
+    for (size_t level=0; level<LEVELS; ++level)
+        if ( name == LEVEL_INFO[level].name ) return level;
+    return LEVELS;
+}
+
+//-----------------------------------------------------------------------------
+
+std::string RollupStore::getFileName(
+    const std::string & directory,
+    size_t level
+) {
+    return directory + "rollup-" + LEVEL_INFO[level].name + ".dat";
+}
+
+//-----------------------------------------------------------------------------
+
+RollupStore::RollupStore() :
+    m_heaterPower( 0.0 ),
+    m_good( false ),
+    m_hasLast( false ),
+    m_newest( 0.0 )
+{
+    for (size_t level=0; level<LEVELS; ++level) {
+        m_levels[level].fd = -1;
+        m_levels[level].capacity = 0;
+        m_levels[level].written = 0;
+        m_levels[level].bucket.count = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+RollupStore::~RollupStore()
+{
+    close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool RollupStore::open( const std::string & directory, double heaterPower )
+{
+    close();
+
+    m_heaterPower = heaterPower;
+    m_hasLast = false;
+    m_newest = 0.0;
+    m_good = true;
+
+    for (size_t level=0; level<LEVELS; ++level) {
+        Level & l = m_levels[level];
+        l.bucket.count = 0;
+        l.pending.clear();
+
+        l.fd = ::open( getFileName( directory, level ).c_str(), O_RDWR | O_CREAT, 0644 );
+        if ( l.fd < 0 ) {
+            close();
+            return false;
+        }
+
+        unsigned interval;
+        if ( readHeader( l.fd, interval, l.capacity, l.written ) ) {
+            // continue the existing file, after its newest interval
+            if ( interval != LEVEL_INFO[level].interval ) {
+                close();
+                return false;
+            }
+            uint8_t record[RECORD_SIZE];
+            if (
+                (l.written > 0) &&
+                (pread( l.fd, record, sizeof(record),
+                    getRecordOffset( l.written - 1, l.capacity ) ) == sizeof(record))
+            ) {
+                RollupPoint point;
+                decodeRecord( record, point );
+                m_newest = std::max( m_newest, point.time );
+            }
+            continue;
+        } else {
+            // create the file, unless it is something else
+            struct stat info;
+            if ( (fstat( l.fd, &info ) == 0) && (info.st_size == 0) ) {
+                l.capacity = LEVEL_INFO[level].capacity;
+                l.written = 0;
+
+                uint8_t header[HEADER_SIZE];
+                memset( header, 0, sizeof(header) );
+                memcpy( header, ROLLUP_MAGIC, sizeof(ROLLUP_MAGIC) );
+                putInteger( header + 4,  ROLLUP_VERSION, 2 );
+                putInteger( header + 6,  RECORD_SIZE, 2 );
+                putInteger( header + 8,  LEVEL_INFO[level].interval, 4 );
+                putInteger( header + 12, l.capacity, 4 );
+                if ( pwrite( l.fd, header, sizeof(header), 0 ) == sizeof(header) )
+                    continue;
+            }
+        }
+
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void RollupStore::close()
+{
+    if ( m_levels[0].fd < 0 ) return;
+
+    // write the intervals in progress (the lower levels first, as each is
+    // merged into the level above)
+    for (size_t level=0; level<LEVELS; ++level)
+        if ( (m_levels[level].fd >= 0) && (m_levels[level].bucket.count > 0) )
+            complete( level );
+    flush( false );
+
+    for (size_t level=0; level<LEVELS; ++level) {
+        if ( m_levels[level].fd >= 0 ) ::close( m_levels[level].fd );
+        m_levels[level].fd = -1;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void RollupStore::add( const Sample & sample )
+{
+    if ( m_levels[0].fd < 0 ) return;
+
+    // keep the intervals in order of time, even if the clock goes back
+    if ( sample.elapsed < m_newest ) return;
+    m_newest = sample.elapsed;
+
+    Bucket bucket;
+    bucket.time = sample.elapsed;
+    bucket.count = 1;
+
+    Totals *totals[] = { &bucket.temperature, &bucket.power, &bucket.pressure };
+    const double values[] = { sample.temperature, sample.power, sample.bar };
+    for (size_t i=0; i<3; ++i)
+        totals[i]->min = totals[i]->max = totals[i]->sum = totals[i]->last = values[i];
+
+    // the volume counter restarts for each pour, and the boiler power level
+    // applies until the next sample
+    bucket.volume = 0.0;
+    bucket.energy = 0.0;
+    if ( m_hasLast ) {
+        double volume = sample.ml - m_last.ml;
+        bucket.volume = (volume >= 0.0) ? volume : sample.ml;
+
+        double gap = std::min( std::max( sample.elapsed - m_last.elapsed, 0.0 ), MAX_GAP );
+        bucket.energy = 1.0E-3 * m_heaterPower * m_last.power * gap;
+    }
+    m_last = sample;
+    m_hasLast = true;
+
+    add( 0, bucket );
+}
+
+//-----------------------------------------------------------------------------
+
+void RollupStore::add( size_t level, const Bucket & bucket )
+{
+    Level & l = m_levels[level];
+    const double interval = LEVEL_INFO[level].interval;
+    const double start = floor( bucket.time / interval ) * interval;
+
+    if ( (l.bucket.count > 0) && (l.bucket.time != start) ) complete( level );
+
+    if ( l.bucket.count == 0 ) {
+        l.bucket = bucket;
+        l.bucket.time = start;
+        return;
+    }
+
+    Totals *totals[] = { &l.bucket.temperature, &l.bucket.power, &l.bucket.pressure };
+    const Totals *others[] = { &bucket.temperature, &bucket.power, &bucket.pressure };
+    for (size_t i=0; i<3; ++i) {
+        totals[i]->min = std::min( totals[i]->min, others[i]->min );
+        totals[i]->max = std::max( totals[i]->max, others[i]->max );
+        totals[i]->sum += others[i]->sum;
+        totals[i]->last = others[i]->last;
+    }
+    l.bucket.count  += bucket.count;
+    l.bucket.volume += bucket.volume;
+    l.bucket.energy += bucket.energy;
+}
+
+//-----------------------------------------------------------------------------
+
+void RollupStore::complete( size_t level )
+{
+    Level & l = m_levels[level];
+    const Bucket & bucket = l.bucket;
+
+    RollupPoint point;
+    point.time = bucket.time;
+    point.count = bucket.count;
+
+    RollupPoint::Stat *stats[] = { &point.temperature, &point.power, &point.pressure };
+    const Totals *totals[] = { &bucket.temperature, &bucket.power, &bucket.pressure };
+    for (size_t i=0; i<3; ++i) {
+        stats[i]->min  = static_cast<float>( totals[i]->min );
+        stats[i]->max  = static_cast<float>( totals[i]->max );
+        stats[i]->mean = static_cast<float>( totals[i]->sum / bucket.count );
+        stats[i]->last = static_cast<float>( totals[i]->last );
+    }
+    point.volume = static_cast<float>( bucket.volume );
+    point.energy = static_cast<float>( bucket.energy );
+    l.pending.push_back( point );
+
+    if ( level + 1 < LEVELS ) add( level + 1, bucket );
+    l.bucket.count = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void RollupStore::flush( bool sync )
+{
+    for (size_t level=0; level<LEVELS; ++level) {
+        Level & l = m_levels[level];
+        if ( l.fd < 0 ) continue;
+
+        if ( !l.pending.empty() ) {
+            uint8_t record[RECORD_SIZE];
+            for (size_t i=0; i<l.pending.size(); ++i) {
+                encodeRecord( l.pending[i], record );
+                off_t offset = getRecordOffset( l.written, l.capacity );
+                if ( pwrite( l.fd, record, sizeof(record), offset ) != sizeof(record) )
+                    m_good = false;
+                ++l.written;
+            }
+            l.pending.clear();
+
+            // the count is written after the records it covers
+            uint8_t written[8];
+            putInteger( written, l.written, sizeof(written) );
+            if ( pwrite( l.fd, written, sizeof(written), 16 ) != sizeof(written) )
+                m_good = false;
+        }
+
+        if ( sync && (fdatasync( l.fd ) != 0) ) m_good = false;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool RollupStore::good() const
+{
+    return m_good;
+}
+
+//-----------------------------------------------------------------------------
+
+RollupReader::RollupReader() :
+    m_fd( -1 ),
+    m_capacity( 0 ),
+    m_written( 0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+RollupReader::~RollupReader()
+{
+    if ( m_fd >= 0 ) ::close( m_fd );
+}
+
+//-----------------------------------------------------------------------------
+
+bool RollupReader::open( const std::string & fileName )
+{
+    if ( m_fd >= 0 ) ::close( m_fd );
+
+    m_fd = ::open( fileName.c_str(), O_RDONLY );
+    if ( m_fd < 0 ) return false;
+
+    unsigned interval;
+    return readHeader( m_fd, interval, m_capacity, m_written );
+}
+
+//-----------------------------------------------------------------------------
+
+bool RollupReader::readRecord( uint64_t index, RollupPoint & point )
+{
+    uint8_t record[RECORD_SIZE];
+    off_t offset = getRecordOffset( index, m_capacity );
+    if ( pread( m_fd, record, sizeof(record), offset ) != sizeof(record) )
+        return false;
+
+    decodeRecord( record, point );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool RollupReader::read( double from, double to, PointFunc func )
+{
+    if ( m_fd < 0 ) return false;
+
+    // the oldest record still in the file
+    uint64_t first = (m_written > m_capacity) ? m_written - m_capacity : 0;
+
+    // the records are in order of time: find the first in the range
+    uint64_t low = first, high = m_written;
+    RollupPoint point;
+    while ( low < high ) {
+        uint64_t middle = low + (high - low) / 2;
+        if ( !readRecord( middle, point ) ) return false;
+        if ( point.time < from )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    // combine the records of an interval split by a restart
+    bool pending = false;
+    RollupPoint merged;
+    for (uint64_t index=low; index<m_written; ++index) {
+        if ( !readRecord( index, point ) ) return false;
+        if ( (to > 0.0) && (point.time > to) ) break;
+
+        if ( pending && (point.time == merged.time) ) {
+            mergeStat( merged.temperature, merged.count, point.temperature, point.count );
+            mergeStat( merged.power, merged.count, point.power, point.count );
+            mergeStat( merged.pressure, merged.count, point.pressure, point.count );
+            merged.count  += point.count;
+            merged.volume += point.volume;
+            merged.energy += point.energy;
+            continue;
+        }
+
+        if ( pending ) func( merged );
+        merged = point;
+        pending = true;
+    }
+    if ( pending ) func( merged );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
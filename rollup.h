@@ -0,0 +1,180 @@
+#ifndef __rollup_h
+#define __rollup_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <inttypes.h>
+#include "telemetry.h"
+
+//-----------------------------------------------------------------------------
+
+/// Summary of the samples in an interval
+struct RollupPoint {
+    /// Summary of one signal
+    struct Stat {
+        float min;      ///< Lowest value
+        float max;      ///< Highest value
+        float mean;     ///< Mean value
+        float last;     ///< Last value
+    };
+
+    double   time;          ///< Start of the interval (seconds since the epoch)
+    uint32_t count;         ///< Number of samples
+    Stat     temperature;   ///< Boiler temperature in degrees C
+    Stat     power;         ///< Boiler power level (0..1)
+    Stat     pressure;      ///< Pressure in bar
+    float    volume;        ///< Volume drawn by the pump in ml
+    float    energy;        ///< Energy used by the boiler in kJ
+};
+
+//-----------------------------------------------------------------------------
+
+/// Downsampled series of the session samples at 1 second, 1 minute and 1
+/// hour intervals, kept up to date as the samples arrive so that reports
+/// over weeks or months read thousands of points rather than millions. Each
+/// sample updates the current 1 second interval; when an interval ends, it
+/// is written and merged into the current interval of the next level, so
+/// the cost per sample is constant. Each level is a file of fixed size
+/// records in the log directory, used as a ring: the 1 second level keeps
+/// about a day of use, the 1 minute level a year and the 1 hour level ten
+/// years. The current intervals are written when the store is closed, so an
+/// interval in which the controller was stopped and started has more than
+/// one record (RollupReader combines them).
+class RollupStore : public LogSink {
+public:
+    /// Number of levels
+    static const size_t LEVELS = 3;
+
+    /// Returns the length of the intervals of a level in seconds
+    static unsigned getInterval( size_t level );
+
+    /// Returns the level for a name (1s, 1m or 1h), or LEVELS if the name
+    /// is not known
+    static size_t getLevel( const std::string & name );
+
+    /// Returns the file name of a level in a directory (ending with '/')
+    static std::string getFileName( const std::string & directory, size_t level );
+
+    /// Default constructor
+    RollupStore();
+
+    /// Destructor
+    ~RollupStore();
+
+    /// Open (or create) the files in a directory (ending with '/'), given
+    /// the heater power in W for the energy. Returns true for success.
+    bool open( const std::string & directory, double heaterPower );
+
+    /// Write the current intervals and close the files
+    void close();
+
+    /// Add a sample, with the elapsed field set to the time in seconds since
+    /// the epoch. A sample older than the last one added (or the newest
+    /// interval in the files) is ignored, as the intervals must stay in
+    /// order of time for RollupReader::read.
+    void add( const Sample & sample );
+
+    /// Write the completed intervals, and optionally wait for them to reach
+    /// the disk
+    void flush( bool sync );
+
+    /// Have all writes succeeded so far?
+    bool good() const;
+
+private:
+    /// Copy constructor (unsupported)
+    RollupStore( const RollupStore & );
+
+    /// Assignment operator (unsupported)
+    RollupStore & operator = ( const RollupStore & );
+
+    /// Running totals of one signal
+    struct Totals {
+        double min;     ///< Lowest value
+        double max;     ///< Highest value
+        double sum;     ///< Sum of the values
+        double last;    ///< Last value
+    };
+
+    /// Interval being summarised
+    struct Bucket {
+        double   time;          ///< Start of the interval
+        uint32_t count;         ///< Number of samples
+        Totals   temperature;   ///< Boiler temperature
+        Totals   power;         ///< Boiler power level
+        Totals   pressure;      ///< Pressure
+        double   volume;        ///< Volume in ml
+        double   energy;        ///< Energy in kJ
+    };
+
+    /// One level of the rollups
+    struct Level {
+        int       fd;           ///< Level file
+        uint32_t  capacity;     ///< Record slots in the file
+        uint64_t  written;      ///< Records written so far
+        Bucket    bucket;       ///< Current interval
+        std::vector<RollupPoint> pending;   ///< Records waiting to be written
+    };
+
+    /// Add a summary (of a sample or a completed interval of the level
+    /// below) to a level
+    void add( size_t level, const Bucket & bucket );
+
+    /// Complete the current interval of a level
+    void complete( size_t level );
+
+private:
+    Level    m_levels[LEVELS];  ///< Rollup levels
+    double   m_heaterPower;     ///< Heater power in W
+    bool     m_good;            ///< Have all writes succeeded?
+    bool     m_hasLast;         ///< Has a sample been added?
+    Sample   m_last;            ///< Previous sample
+    double   m_newest;          ///< Time of the newest sample or interval
+};
+
+//-----------------------------------------------------------------------------
+
+/// Reads a level of the rollups written by RollupStore
+class RollupReader {
+public:
+    /// Function called for each record
+    typedef std::function<void(const RollupPoint & point)> PointFunc;
+
+    /// Default constructor
+    RollupReader();
+
+    /// Destructor
+    ~RollupReader();
+
+    /// Open a level file. Returns true for success.
+    bool open( const std::string & fileName );
+
+    /// Call a function for each interval starting between two times in
+    /// seconds since the epoch (to of zero for no limit), oldest first. The
+    /// start of the range is found by a binary search. Returns false on a
+    /// read error.
+    bool read( double from, double to, PointFunc func );
+
+private:
+    /// Copy constructor (unsupported)
+    RollupReader( const RollupReader & );
+
+    /// Assignment operator (unsupported)
+    RollupReader & operator = ( const RollupReader & );
+
+    /// Read a record by its index (in order of writing). Returns false on
+    /// a read error.
+    bool readRecord( uint64_t index, RollupPoint & point );
+
+private:
+    int      m_fd;          ///< Level file
+    uint32_t m_capacity;    ///< Record slots in the file
+    uint64_t m_written;     ///< Records written
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__rollup_h
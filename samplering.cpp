@@ -0,0 +1,159 @@
+#include "samplering.h"
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+
+/// Copy the items with indexes from begin to end (which may wrap around the
+/// end of the ring) into the start of an array
+template<class T>
+static void copyRange(
+    const std::vector<T> & ring,
+    size_t mask,
+    uint64_t begin,
+    uint64_t end,
+    std::vector<T> & array
+) {
+    size_t count = static_cast<size_t>( end - begin );
+    size_t first = static_cast<size_t>( begin & mask );
+    size_t split = std::min( count, ring.size() - first );
+
+    array.resize( count );
+    std::copy( ring.begin() + first, ring.begin() + first + split, array.begin() );
+    std::copy( ring.begin(), ring.begin() + (count - split), array.begin() + split );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Remove items from the start of an array (if it has any)
+template<class T>
+static void dropFront( std::vector<T> & array, size_t count )
+{
+    if ( array.empty() ) return;
+    array.erase( array.begin(), array.begin() + std::min( count, array.size() ) );
+}
+
+//-----------------------------------------------------------------------------
+
+SampleRing::SampleRing( size_t capacity ) :
+    m_count( 0 )
+{
+    size_t size = 1;
+    while ( size < capacity ) size <<= 1;
+    m_mask = size - 1;
+
+    m_elapsed.resize( size );
+    m_power.resize( size );
+    m_temperature.resize( size );
+    m_ml.resize( size );
+    m_bar.resize( size );
+    m_pump.resize( size );
+    m_pour.resize( size );
+}
+
+//-----------------------------------------------------------------------------
+
+size_t SampleRing::capacity() const
+{
+    return m_elapsed.size();
+}
+
+//-----------------------------------------------------------------------------
+
+uint64_t SampleRing::getCount() const
+{
+    return m_count.load( std::memory_order_acquire );
+}
+
+//-----------------------------------------------------------------------------
+
+void SampleRing::add( const Sample & sample )
+{
+    uint64_t count = m_count.load( std::memory_order_relaxed );
+    size_t i = static_cast<size_t>( count & m_mask );
+
+    m_elapsed[i]     = sample.elapsed;
+    m_power[i]       = static_cast<float>( sample.power );
+    m_temperature[i] = static_cast<float>( sample.temperature );
+    m_ml[i]          = static_cast<float>( sample.ml );
+    m_bar[i]         = static_cast<float>( sample.bar );
+    m_pump[i]        = static_cast<uint8_t>( sample.pump );
+    m_pour[i]        = static_cast<uint16_t>( sample.pour );
+
+    // publish the sample
+    m_count.store( count + 1, std::memory_order_release );
+}
+
+//-----------------------------------------------------------------------------
+
+void SampleRing::reserve( Snapshot & snapshot, unsigned signals ) const
+{
+    size_t size = capacity();
+    snapshot.elapsed.reserve( size );
+    if ( signals & Power ) snapshot.power.reserve( size );
+    if ( signals & Temperature ) snapshot.temperature.reserve( size );
+    if ( signals & Volume ) snapshot.ml.reserve( size );
+    if ( signals & Pressure ) snapshot.bar.reserve( size );
+    if ( signals & Pump ) snapshot.pump.reserve( size );
+    if ( signals & Pour ) snapshot.pour.reserve( size );
+}
+
+//-----------------------------------------------------------------------------
+
+size_t SampleRing::snapshot(
+    double seconds,
+    Snapshot & snapshot,
+    unsigned signals
+) const {
+    // the oldest slot may be being overwritten by the next sample
+    const uint64_t size = capacity();
+    uint64_t end = m_count.load( std::memory_order_acquire );
+    uint64_t begin = (end >= size) ? end - size + 1 : 0;
+
+    snapshot.elapsed.clear();
+    snapshot.power.clear();
+    snapshot.temperature.clear();
+    snapshot.ml.clear();
+    snapshot.bar.clear();
+    snapshot.pump.clear();
+    snapshot.pour.clear();
+    if ( begin == end ) return 0;
+
+    // the samples are in order of time: find the first in the period
+    const double from = m_elapsed[(end - 1) & m_mask] - seconds;
+    uint64_t low = begin, high = end - 1;
+    while ( low < high ) {
+        uint64_t middle = low + (high - low) / 2;
+        if ( m_elapsed[middle & m_mask] < from )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    copyRange( m_elapsed, m_mask, low, end, snapshot.elapsed );
+    if ( signals & Power ) copyRange( m_power, m_mask, low, end, snapshot.power );
+    if ( signals & Temperature )
+        copyRange( m_temperature, m_mask, low, end, snapshot.temperature );
+    if ( signals & Volume ) copyRange( m_ml, m_mask, low, end, snapshot.ml );
+    if ( signals & Pressure ) copyRange( m_bar, m_mask, low, end, snapshot.bar );
+    if ( signals & Pump ) copyRange( m_pump, m_mask, low, end, snapshot.pump );
+    if ( signals & Pour ) copyRange( m_pour, m_mask, low, end, snapshot.pour );
+
+    // drop any samples which were overwritten while they were copied
+    std::atomic_thread_fence( std::memory_order_acquire );
+    uint64_t after = m_count.load( std::memory_order_relaxed );
+    uint64_t valid = (after >= size) ? after - size + 1 : 0;
+    if ( valid > low ) {
+        size_t count = static_cast<size_t>( valid - low );
+        dropFront( snapshot.elapsed, count );
+        dropFront( snapshot.power, count );
+        dropFront( snapshot.temperature, count );
+        dropFront( snapshot.ml, count );
+        dropFront( snapshot.bar, count );
+        dropFront( snapshot.pump, count );
+        dropFront( snapshot.pour, count );
+    }
+
+    return snapshot.size();
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,95 @@
+#ifndef __samplering_h
+#define __samplering_h
+
+//-----------------------------------------------------------------------------
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+#include <inttypes.h>
+#include "telemetry.h"
+
+//-----------------------------------------------------------------------------
+
+/// Recent samples held in memory, so that the display, remote clients and
+/// shot analysis can read the last few minutes without reading the logs.
+/// The samples are kept as a structure of arrays (one array per signal), so
+/// a reader which wants one signal only touches that signal's memory. One
+/// thread adds samples and any thread can take a snapshot; neither side
+/// locks, and nothing is allocated after construction. A reader which is
+/// slow enough for the samples it is copying to be overwritten drops them
+/// from the start of its snapshot.
+class SampleRing {
+public:
+    /// Signals which can be copied by a snapshot (the elapsed time is always
+    /// copied)
+    enum Signal {
+        Power       = 0x01,
+        Temperature = 0x02,
+        Volume      = 0x04,
+        Pressure    = 0x08,
+        Pump        = 0x10,
+        Pour        = 0x20,
+        AllSignals  = 0x3F
+    };
+
+    /// Copy of recent samples (arrays of the signals not copied are empty)
+    struct Snapshot {
+        std::vector<double>   elapsed;      ///< Time in seconds
+        std::vector<float>    power;        ///< Boiler power level (0..1)
+        std::vector<float>    temperature;  ///< Boiler temperature in C
+        std::vector<float>    ml;           ///< Volume in ml
+        std::vector<float>    bar;          ///< Pressure in bar
+        std::vector<uint8_t>  pump;         ///< Pump status
+        std::vector<uint16_t> pour;         ///< Pour number
+
+        /// Returns the number of samples
+        size_t size() const { return elapsed.size(); }
+    };
+
+    /// Constructor, given the capacity in samples (rounded up to a power of
+    /// two)
+    explicit SampleRing( size_t capacity );
+
+    /// Returns the capacity in samples
+    size_t capacity() const;
+
+    /// Returns the number of samples added so far
+    uint64_t getCount() const;
+
+    /// Add a sample (from the one writing thread only)
+    void add( const Sample & sample );
+
+    /// Reserve space in a snapshot for the whole ring, so that taking
+    /// snapshots of the given signals never allocates memory
+    void reserve( Snapshot & snapshot, unsigned signals = AllSignals ) const;
+
+    /// Copy the samples from the last given number of seconds (up to the
+    /// newest sample) into a snapshot. Returns the number of samples.
+    size_t snapshot(
+        double seconds,
+        Snapshot & snapshot,
+        unsigned signals = AllSignals
+    ) const;
+
+private:
+    /// Copy constructor (unsupported)
+    SampleRing( const SampleRing & );
+
+    /// Assignment operator (unsupported)
+    SampleRing & operator = ( const SampleRing & );
+
+    size_t                m_mask;           ///< Index mask (capacity - 1)
+    std::vector<double>   m_elapsed;        ///< Time in seconds
+    std::vector<float>    m_power;          ///< Boiler power level
+    std::vector<float>    m_temperature;    ///< Boiler temperature
+    std::vector<float>    m_ml;             ///< Volume
+    std::vector<float>    m_bar;            ///< Pressure
+    std::vector<uint8_t>  m_pump;           ///< Pump status
+    std::vector<uint16_t> m_pour;           ///< Pour number
+    std::atomic<uint64_t> m_count;          ///< Samples added
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__samplering_h
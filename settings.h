@@ -33,6 +33,16 @@
 // ADC channel used by the pressure sensor
 #define ADC_PRESSURE_CHANNEL 1
 
+// Rates at which the ADC channels are sampled in the background in
+// continuous-conversion mode, in Hz (0 to convert on demand), and their
+// priorities (the higher is read first when both are due). The pressure is
+// sampled faster during a pour.
+#define ADC_BUTTON_RATE 50.0
+#define ADC_BUTTON_PRIORITY 0
+#define ADC_PRESSURE_IDLE_RATE 5.0
+#define ADC_PRESSURE_POUR_RATE 200.0
+#define ADC_PRESSURE_PRIORITY 1
+
 // Maps logical button number to physical button number
 // Where BUTTON1 is the top button on the panel, and the defined values
 // correspond to the button numbers from the ADC
@@ -40,6 +50,22 @@
 #define BUTTON2 2
 #define BREW_SWITCH 1
 
+// Recent samples kept in memory for the display and other readers (two
+// hours at the 4 Hz sample rate)
+#define RECENT_SAMPLES 28800
+
+// Period of the temperature graph on the display in seconds
+#define DISPLAY_GRAPH_PERIOD 600.0
+
+// Events held by the flight recorder (must be a power of two)
+#define FLIGHT_RECORDER_EVENTS 65536
+
+// Period of the wall clock anchors in the log in seconds, and the change in
+// the offset between the wall clock and the monotonic clock (in seconds)
+// taken to be a jump, which is anchored straight away
+#define CLOCK_ANCHOR_PERIOD 60.0
+#define CLOCK_JUMP 0.5
+
 // Icon file paths
 #define ICON_BOILER_POWER "/etc/gaggia/boiler_32x32.png"
 #define ICON_PUMP_ACTIVE  "/etc/gaggia/pump_32x32.png"
@@ -0,0 +1,308 @@
+#include "shotdb.h"
+#include "timing.h"
+#include "trace.h"
+#include <sqlite3.h>
+
+//-----------------------------------------------------------------------------
+
+/// polling period of the writer thread in milliseconds
+static const unsigned WRITER_PERIOD = 100;
+
+/// time to wait for another process to release the database in milliseconds
+static const int BUSY_TIMEOUT = 2000;
+
+/// Database schema. Write ahead logging with normal synchronisation keeps
+/// the database consistent after a power cut while syncing less often.
+static const char *SCHEMA =
+    "PRAGMA journal_mode=WAL;"
+    "PRAGMA synchronous=NORMAL;"
+    "CREATE TABLE IF NOT EXISTS shots ("
+    "  id           INTEGER PRIMARY KEY,"
+    "  start        REAL NOT NULL,"
+    "  session      TEXT,"
+    "  pour         INTEGER,"
+    "  duration     REAL,"
+    "  volume       REAL,"
+    "  peakPressure REAL,"
+    "  meanPressure REAL,"
+    "  brewTemp     REAL,"
+    "  targetTemp   REAL,"
+    "  kP           REAL,"
+    "  kI           REAL,"
+    "  kD           REAL,"
+    "  iMin         REAL,"
+    "  iMax         REAL"
+    ");"
+    "CREATE INDEX IF NOT EXISTS shotsStart    ON shots(start);"
+    "CREATE INDEX IF NOT EXISTS shotsPeak     ON shots(peakPressure);"
+    "CREATE INDEX IF NOT EXISTS shotsMean     ON shots(meanPressure);"
+    "CREATE INDEX IF NOT EXISTS shotsVolume   ON shots(volume);"
+    "CREATE INDEX IF NOT EXISTS shotsDuration ON shots(duration);"
+    "CREATE INDEX IF NOT EXISTS shotsBrewTemp ON shots(brewTemp);";
+
+/// columns in the order used by insert and query
+static const char *COLUMNS =
+    "start, session, pour, duration, volume, peakPressure, meanPressure, "
+    "brewTemp, targetTemp, kP, kI, kD, iMin, iMax";
+
+//-----------------------------------------------------------------------------
+
+ShotSummary::ShotSummary() :
+    m_active( false ),
+    m_start( 0.0 ),
+    m_pour( 0 ),
+    m_startMl( 0.0 ),
+    m_lastMl( 0.0 ),
+    m_peakBar( 0.0 ),
+    m_sumBar( 0.0 ),
+    m_sumTemp( 0.0 ),
+    m_count( 0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+bool ShotSummary::isActive() const
+{
+    return m_active;
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotSummary::begin( const Sample & sample, double start )
+{
+    m_active  = true;
+    m_start   = start;
+    m_pour    = static_cast<unsigned>( sample.pour );
+    m_startMl = sample.ml;
+    m_lastMl  = sample.ml;
+    m_peakBar = 0.0;
+    m_sumBar  = 0.0;
+    m_sumTemp = 0.0;
+    m_count   = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotSummary::add( const Sample & sample )
+{
+    if ( !m_active ) return;
+
+    m_lastMl = sample.ml;
+    if ( sample.bar > m_peakBar ) m_peakBar = sample.bar;
+    m_sumBar  += sample.bar;
+    m_sumTemp += sample.temperature;
+    ++m_count;
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotSummary::end( double duration, ShotRecord & record )
+{
+    double count = (m_count > 0) ? static_cast<double>( m_count ) : 1.0;
+
+    record.start        = m_start;
+    record.pour         = m_pour;
+    record.duration     = duration;
+    record.volume       = m_lastMl - m_startMl;
+    record.peakPressure = m_peakBar;
+    record.meanPressure = m_sumBar / count;
+    record.brewTemp     = m_sumTemp / count;
+
+    m_active = false;
+}
+
+//-----------------------------------------------------------------------------
+
+ShotDatabase::ShotDatabase() :
+    m_db( 0 ),
+    m_run( false )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+ShotDatabase::~ShotDatabase()
+{
+    close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool ShotDatabase::open( const std::string & fileName )
+{
+    close();
+
+    std::lock_guard<std::mutex> lock( m_dbMutex );
+    if ( sqlite3_open( fileName.c_str(), &m_db ) != SQLITE_OK ) return false;
+    sqlite3_busy_timeout( m_db, BUSY_TIMEOUT );
+    return execute( SCHEMA );
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotDatabase::close()
+{
+    // the thread writes any queued records before it exits
+    m_run = false;
+    joinThread( m_thread );
+
+    std::lock_guard<std::mutex> lock( m_dbMutex );
+    if ( m_db != 0 ) {
+        sqlite3_close( m_db );
+        m_db = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotDatabase::add( const ShotRecord & record )
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_pending.push_back( record );
+    }
+
+    // start the writer when the first record is added
+    if ( !m_run ) {
+        m_run = true;
+        m_thread = startThread( &ShotDatabase::worker, this );
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool ShotDatabase::query(
+    const std::string & condition,
+    RecordFunc func,
+    std::string & error
+) {
+    std::lock_guard<std::mutex> lock( m_dbMutex );
+    if ( m_db == 0 ) {
+        error = "database is not open";
+        return false;
+    }
+
+    std::string sql( std::string( "SELECT " ) + COLUMNS + " FROM shots" );
+    if ( !condition.empty() ) sql += " WHERE " + condition;
+    sql += " ORDER BY start";
+
+    sqlite3_stmt *statement = 0;
+    if ( sqlite3_prepare_v2( m_db, sql.c_str(), -1, &statement, 0 ) != SQLITE_OK ) {
+        error = sqlite3_errmsg( m_db );
+        return false;
+    }
+
+    int result;
+    while ( (result = sqlite3_step( statement )) == SQLITE_ROW ) {
+        ShotRecord record;
+        record.start = sqlite3_column_double( statement, 0 );
+        const unsigned char *session = sqlite3_column_text( statement, 1 );
+        record.session = session ? reinterpret_cast<const char*>( session ) : "";
+        record.pour         = sqlite3_column_int( statement, 2 );
+        record.duration     = sqlite3_column_double( statement, 3 );
+        record.volume       = sqlite3_column_double( statement, 4 );
+        record.peakPressure = sqlite3_column_double( statement, 5 );
+        record.meanPressure = sqlite3_column_double( statement, 6 );
+        record.brewTemp     = sqlite3_column_double( statement, 7 );
+        record.targetTemp   = sqlite3_column_double( statement, 8 );
+        record.kP           = sqlite3_column_double( statement, 9 );
+        record.kI           = sqlite3_column_double( statement, 10 );
+        record.kD           = sqlite3_column_double( statement, 11 );
+        record.iMin         = sqlite3_column_double( statement, 12 );
+        record.iMax         = sqlite3_column_double( statement, 13 );
+        func( record );
+    }
+
+    bool success = (result == SQLITE_DONE);
+    if ( !success ) error = sqlite3_errmsg( m_db );
+    sqlite3_finalize( statement );
+    return success;
+}
+
+//-----------------------------------------------------------------------------
+
+std::string ShotDatabase::getError() const
+{
+    std::lock_guard<std::mutex> lock( m_dbMutex );
+    return (m_db != 0) ? sqlite3_errmsg( m_db ) : "database is not open";
+}
+
+//-----------------------------------------------------------------------------
+
+bool ShotDatabase::execute( const char *sql )
+{
+    return sqlite3_exec( m_db, sql, 0, 0, 0 ) == SQLITE_OK;
+}
+
+//-----------------------------------------------------------------------------
+
+bool ShotDatabase::insert( const ShotRecord & record )
+{
+    std::string sql(
+        std::string( "INSERT INTO shots (" ) + COLUMNS + ") VALUES "
+        "(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"
+    );
+
+    sqlite3_stmt *statement = 0;
+    if ( sqlite3_prepare_v2( m_db, sql.c_str(), -1, &statement, 0 ) != SQLITE_OK )
+        return false;
+
+    sqlite3_bind_double( statement, 1, record.start );
+    sqlite3_bind_text( statement, 2, record.session.c_str(), -1, SQLITE_TRANSIENT );
+    sqlite3_bind_int( statement, 3, static_cast<int>( record.pour ) );
+    sqlite3_bind_double( statement, 4,  record.duration );
+    sqlite3_bind_double( statement, 5,  record.volume );
+    sqlite3_bind_double( statement, 6,  record.peakPressure );
+    sqlite3_bind_double( statement, 7,  record.meanPressure );
+    sqlite3_bind_double( statement, 8,  record.brewTemp );
+    sqlite3_bind_double( statement, 9,  record.targetTemp );
+    sqlite3_bind_double( statement, 10, record.kP );
+    sqlite3_bind_double( statement, 11, record.kI );
+    sqlite3_bind_double( statement, 12, record.kD );
+    sqlite3_bind_double( statement, 13, record.iMin );
+    sqlite3_bind_double( statement, 14, record.iMax );
+
+    bool success = (sqlite3_step( statement ) == SQLITE_DONE);
+    sqlite3_finalize( statement );
+    return success;
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotDatabase::drain()
+{
+    std::vector<ShotRecord> records;
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        records.swap( m_pending );
+    }
+    if ( records.empty() ) return;
+
+    Trace::Span span( "shotdb.insert" );
+
+    // one transaction for the batch
+    std::lock_guard<std::mutex> lock( m_dbMutex );
+    if ( m_db == 0 ) return;
+    execute( "BEGIN" );
+    for (size_t i=0; i<records.size(); ++i)
+        insert( records[i] );
+    execute( "COMMIT" );
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotDatabase::worker()
+{
+    Trace::setThreadName( "shotdb" );
+
+    while ( m_run ) {
+        drain();
+        delayms( WRITER_PERIOD );
+    }
+
+    // write anything left in the queue before exit
+    drain();
+}
+
+//-----------------------------------------------------------------------------
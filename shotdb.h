@@ -0,0 +1,146 @@
+#ifndef __shotdb_h
+#define __shotdb_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "telemetry.h"
+
+struct sqlite3;
+
+//-----------------------------------------------------------------------------
+
+/// Summary of one pour
+struct ShotRecord {
+    double      start;          ///< Start time (seconds since the epoch)
+    std::string session;        ///< Session log file name (without path)
+    unsigned    pour;           ///< Pour number in the session
+    double      duration;       ///< Pour time in seconds
+    double      volume;         ///< Volume in ml
+    double      peakPressure;   ///< Highest pressure in bar
+    double      meanPressure;   ///< Mean pressure in bar
+    double      brewTemp;       ///< Mean boiler temperature in degrees C
+    double      targetTemp;     ///< Target temperature in degrees C
+    double      kP;             ///< Proportional gain
+    double      kI;             ///< Integral gain
+    double      kD;             ///< Derivative gain
+    double      iMin;           ///< Integrator lower limit
+    double      iMax;           ///< Integrator upper limit
+};
+
+//-----------------------------------------------------------------------------
+
+/// Builds the summary of a pour from the samples of the main loop
+class ShotSummary {
+public:
+    /// Default constructor
+    ShotSummary();
+
+    /// Is a pour in progress?
+    bool isActive() const;
+
+    /// Start a pour, given its first sample and start time (seconds since
+    /// the epoch)
+    void begin( const Sample & sample, double start );
+
+    /// Add a sample during the pour
+    void add( const Sample & sample );
+
+    /// End the pour, given its duration in seconds, and fill in the record
+    /// (other than the session name and the regulator settings)
+    void end( double duration, ShotRecord & record );
+
+private:
+    bool     m_active;      ///< Is a pour in progress?
+    double   m_start;       ///< Start time
+    unsigned m_pour;        ///< Pour number
+    double   m_startMl;     ///< Volume at the start of the pour
+    double   m_lastMl;      ///< Latest volume
+    double   m_peakBar;     ///< Highest pressure
+    double   m_sumBar;      ///< Sum of the pressures
+    double   m_sumTemp;     ///< Sum of the temperatures
+    unsigned m_count;       ///< Number of samples
+};
+
+//-----------------------------------------------------------------------------
+
+/// Database of shots (an SQLite file), with indexes on the start time and
+/// the main measurements so that the history can be searched quickly. The
+/// controller adds a record at the end of each pour, and the records are
+/// written by a background thread so that the main loop never waits for
+/// the disk.
+class ShotDatabase {
+public:
+    /// Function called for each record found by a query
+    typedef std::function<void(const ShotRecord & record)> RecordFunc;
+
+    /// Default constructor
+    ShotDatabase();
+
+    /// Destructor: writes any queued records and closes the database
+    ~ShotDatabase();
+
+    /// Open (or create) the database. Returns true for success.
+    bool open( const std::string & fileName );
+
+    /// Write any queued records and close the database
+    void close();
+
+    /// Queue a record to be written by the background thread
+    void add( const ShotRecord & record );
+
+    /// Call a function for each record matching an SQL condition on the
+    /// columns (all records if the condition is empty), in order of start
+    /// time. Returns false and sets the error message on failure.
+    bool query(
+        const std::string & condition,
+        RecordFunc func,
+        std::string & error
+    );
+
+    /// Returns the last error message
+    std::string getError() const;
+
+private:
+    /// Copy constructor (unsupported)
+    ShotDatabase( const ShotDatabase & );
+
+    /// Assignment operator (unsupported)
+    ShotDatabase & operator = ( const ShotDatabase & );
+
+    /// Execute SQL statements. Returns true for success.
+    bool execute( const char *sql );
+
+    /// Insert a record. Returns true for success.
+    bool insert( const ShotRecord & record );
+
+    /// Write the queued records
+    void drain();
+
+    /// Writer thread
+    void worker();
+
+private:
+    sqlite3 *m_db;      ///< Database connection
+
+    std::vector<ShotRecord> m_pending;  ///< Records waiting to be written
+    std::atomic<bool>       m_run;      ///< Should the thread continue to run?
+
+    /// Thread used to write the records
+    std::thread m_thread;
+
+    /// Mutex to control access to the queued records
+    mutable std::mutex m_mutex;
+
+    /// Mutex to control access to the connection
+    mutable std::mutex m_dbMutex;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__shotdb_h
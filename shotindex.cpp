@@ -0,0 +1,600 @@
+#include "shotindex.h"
+#include "telemetry.h"
+#include "trace.h"
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <queue>
+#include <fstream>
+#include <thread>
+#include <atomic>
+
+//-----------------------------------------------------------------------------
+
+// Index file format (version 1). All integers are little endian.
+//
+//   header:  "GSIM", u16 version, u16 points per curve, u32 number of shots,
+//            u32 time between points in ms
+//   entries: u16 name length, the name, i64 modification time of the log,
+//            f32 duration, f32 volume, f32 peak pressure, then the pressure
+//            and flow curves as u16 in thousandths of a bar and of a ml/s
+//
+// The curves are held in memory as floats, one shot after another.
+
+/// file signature
+static const char INDEX_MAGIC[4] = { 'G', 'S', 'I', 'M' };
+
+/// format version
+static const uint16_t INDEX_VERSION = 1;
+
+/// size of the header, and of the fixed part of an entry, in bytes
+static const size_t HEADER_SIZE = 16;
+static const size_t ENTRY_SIZE = 22;
+
+/// scale factor of the stored curves
+static const float CURVE_SCALE = 1000.0f;
+
+/// half width of the DTW band in points (four seconds either way)
+static const unsigned WINDOW = 8;
+
+/// weight of the flow against the pressure: 1 ml/s counts as 2 bar, as the
+/// flow varies over about half the range
+static const float FLOW_WEIGHT = 2.0f;
+
+const unsigned ShotCurve::POINTS;
+const double ShotCurve::STEP = 0.5;
+
+//-----------------------------------------------------------------------------
+
+/// Store a little endian integer
+static void putInteger( uint8_t *p, uint64_t value, size_t size )
+{
+    for (size_t i=0; i<size; ++i)
+        p[i] = static_cast<uint8_t>( value >> (8*i) );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Load a little endian integer
+static uint64_t getInteger( const uint8_t *p, size_t size )
+{
+    uint64_t value = 0;
+    for (size_t i=0; i<size; ++i)
+        value |= static_cast<uint64_t>( p[i] ) << (8*i);
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Store a float
+static void putFloat( uint8_t *p, double value )
+{
+    float f = static_cast<float>( value );
+    uint32_t bits;
+    memcpy( &bits, &f, sizeof(bits) );
+    putInteger( p, bits, 4 );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Load a float
+static double getFloat( const uint8_t *p )
+{
+    uint32_t bits = static_cast<uint32_t>( getInteger( p, 4 ) );
+    float f;
+    memcpy( &f, &bits, sizeof(f) );
+    return f;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Is this the name of a shot log (150412-0930-shot1.glog, or .glog.gz)?
+static bool isShotLog( std::string name )
+{
+    const std::string extension( getLogExtension( BinaryFormat ) );
+    if ( (name.size() > 3) && (name.compare( name.size() - 3, 3, ".gz" ) == 0) )
+        name.erase( name.size() - 3 );
+    if (
+        (name.size() <= extension.size()) ||
+        (name.compare( name.size() - extension.size(), extension.size(), extension ) != 0)
+    ) return false;
+    name.erase( name.size() - extension.size() );
+
+    size_t shot = name.rfind( "-shot" );
+    return
+        (shot != std::string::npos) && (shot + 5 < name.size()) &&
+        (name.find_first_not_of( "0123456789", shot + 5 ) == std::string::npos);
+}
+
+//-----------------------------------------------------------------------------
+
+bool ShotCurve::read(
+    const std::string & fileName,
+    double & duration,
+    double & volume,
+    double & peak
+) {
+    LogReader in;
+    if ( !in.open( fileName ) ) return false;
+
+    // the samples of a shot log are timed from the start of the pour
+    std::vector<Sample> samples;
+    Sample sample;
+    std::string note;
+    LogReader::Record record;
+    while ( (record = in.next( sample, note )) != LogReader::End )
+        if ( record == LogReader::SampleRow ) samples.push_back( sample );
+    if ( samples.empty() ) return false;
+
+    duration = samples.back().elapsed;
+    volume = samples.back().ml - samples.front().ml;
+    peak = 0.0;
+    for (size_t i=0; i<samples.size(); ++i)
+        peak = std::max( peak, samples[i].bar );
+
+    // the volume at a time, interpolated between the samples (the cursor
+    // only moves forward, as the times asked for increase)
+    size_t cursor = 0;
+    auto volumeAt = [&samples, &cursor]( double t ) {
+        while ( (cursor + 1 < samples.size()) && (samples[cursor + 1].elapsed <= t) )
+            ++cursor;
+        if ( cursor + 1 >= samples.size() ) return samples.back().ml;
+        const Sample & a = samples[cursor];
+        const Sample & b = samples[cursor + 1];
+        if ( (t <= a.elapsed) || (b.elapsed <= a.elapsed) ) return a.ml;
+        return a.ml + (b.ml - a.ml) * (t - a.elapsed) / (b.elapsed - a.elapsed);
+    };
+
+    // each point is the mean pressure and the mean flow over its step (or
+    // the nearest sample, if the capture rate is below two samples a step)
+    size_t next = 0;
+    double startMl = volumeAt( 0.0 );
+    for (unsigned i=0; i<POINTS; ++i) {
+        double t0 = i * STEP;
+        double t1 = t0 + STEP;
+        if ( t0 > duration ) {
+            pressure[i] = 0.0f;
+            flow[i] = 0.0f;
+            continue;
+        }
+
+        double sum = 0.0;
+        unsigned count = 0;
+        while ( (next < samples.size()) && (samples[next].elapsed < t1) ) {
+            if ( samples[next].elapsed >= t0 ) {
+                sum += samples[next].bar;
+                ++count;
+            }
+            ++next;
+        }
+        if ( count > 0 )
+            pressure[i] = static_cast<float>( sum / count );
+        else
+            pressure[i] = static_cast<float>( samples[std::min( next, samples.size() - 1 )].bar );
+
+        double endMl = volumeAt( std::min( t1, duration ) );
+        flow[i] = static_cast<float>( std::max( 0.0, (endMl - startMl) / STEP ) );
+        startMl = endMl;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Squared distance between two points of the curves
+static inline float pointCost( float p0, float f0, float p1, float f1 )
+{
+    float dp = p0 - p1;
+    float df = FLOW_WEIGHT * (f0 - f1);
+    return dp*dp + df*df;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Squared distance by which a value is outside an envelope
+static inline float outside( float value, float lower, float upper )
+{
+    float d = (value > upper) ? value - upper : ((value < lower) ? lower - value : 0.0f);
+    return d*d;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Lower bound of the DTW distance between the query (given by its envelope
+/// within the band) and a shot: each point of the shot is matched to some
+/// point of the query within the band, so costs at least its distance from
+/// the envelope.
+static float lowerBound(
+    const float *pressure, const float *flow,
+    const float *pressureLower, const float *pressureUpper,
+    const float *flowLower, const float *flowUpper
+) {
+    const float weight = FLOW_WEIGHT * FLOW_WEIGHT;
+    float sum = 0.0f;
+    for (unsigned i=0; i<ShotCurve::POINTS; ++i) {
+        sum +=
+            outside( pressure[i], pressureLower[i], pressureUpper[i] ) +
+            weight * outside( flow[i], flowLower[i], flowUpper[i] );
+    }
+    return sum;
+}
+
+//-----------------------------------------------------------------------------
+
+/// DTW distance (the sum of the squared distances along the best warping
+/// path within the band) between two curves. Returns a value over the
+/// limit as soon as every path is known to exceed it.
+static float warpDistance(
+    const float *p0, const float *f0,
+    const float *p1, const float *f1,
+    float limit
+) {
+    const unsigned n = ShotCurve::POINTS;
+    const float infinity = HUGE_VALF;
+
+    // two rows of the cost matrix, each with a cell of infinity in front
+    float rows[2][ShotCurve::POINTS + 1];
+    float *previous = rows[0];
+    float *current = rows[1];
+    for (unsigned j=0; j<=n; ++j) previous[j] = infinity;
+    previous[0] = 0.0f;
+
+    for (unsigned i=0; i<n; ++i) {
+        unsigned from = (i > WINDOW) ? i - WINDOW : 0;
+        unsigned to = std::min( n - 1, i + WINDOW );
+
+        for (unsigned j=0; j<=n; ++j) current[j] = infinity;
+        float best = infinity;
+        for (unsigned j=from; j<=to; ++j) {
+            float cost = pointCost( p0[i], f0[i], p1[j], f1[j] );
+            float d = cost + std::min( std::min( previous[j], previous[j + 1] ), current[j] );
+            current[j + 1] = d;
+            best = std::min( best, d );
+        }
+        if ( best > limit ) return best;
+
+        std::swap( previous, current );
+    }
+    return previous[n];
+}
+
+//-----------------------------------------------------------------------------
+
+ShotIndex::ShotIndex()
+{
+}
+
+//-----------------------------------------------------------------------------
+
+bool ShotIndex::load( const std::string & fileName )
+{
+    m_entries.clear();
+    m_pressure.clear();
+    m_flow.clear();
+    m_names.clear();
+
+    std::ifstream in( fileName.c_str(), std::ios::binary );
+    if ( !in ) return true;
+
+    uint8_t header[HEADER_SIZE];
+    if (
+        !in.read( reinterpret_cast<char*>( header ), sizeof(header) ) ||
+        (memcmp( header, INDEX_MAGIC, sizeof(INDEX_MAGIC) ) != 0) ||
+        (getInteger( header + 4, 2 ) != INDEX_VERSION) ||
+        (getInteger( header + 6, 2 ) != ShotCurve::POINTS) ||
+        (getInteger( header + 12, 4 ) != static_cast<uint64_t>( 1.0E3 * ShotCurve::STEP + 0.5 ))
+    ) return false;
+    size_t count = static_cast<size_t>( getInteger( header + 8, 4 ) );
+
+    m_entries.reserve( count );
+    m_pressure.reserve( count * ShotCurve::POINTS );
+    m_flow.reserve( count * ShotCurve::POINTS );
+
+    std::vector<uint8_t> curves( 4 * ShotCurve::POINTS );
+    for (size_t i=0; i<count; ++i) {
+        uint8_t length[2];
+        uint8_t fixed[ENTRY_SIZE - 2];
+        Entry entry;
+        if ( !in.read( reinterpret_cast<char*>( length ), sizeof(length) ) ) return false;
+        entry.name.resize( static_cast<size_t>( getInteger( length, 2 ) ) );
+        if (
+            !in.read( &entry.name[0], entry.name.size() ) ||
+            !in.read( reinterpret_cast<char*>( fixed ), sizeof(fixed) ) ||
+            !in.read( reinterpret_cast<char*>( &curves[0] ), curves.size() )
+        ) return false;
+
+        entry.modified = static_cast<int64_t>( getInteger( fixed, 8 ) );
+        entry.duration = getFloat( fixed + 8 );
+        entry.volume = getFloat( fixed + 12 );
+        entry.peak = getFloat( fixed + 16 );
+        m_names[entry.name] = m_entries.size();
+        m_entries.push_back( entry );
+
+        const uint8_t *p = &curves[0];
+        for (unsigned j=0; j<ShotCurve::POINTS; ++j, p += 2)
+            m_pressure.push_back( getInteger( p, 2 ) / CURVE_SCALE );
+        for (unsigned j=0; j<ShotCurve::POINTS; ++j, p += 2)
+            m_flow.push_back( getInteger( p, 2 ) / CURVE_SCALE );
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool ShotIndex::save( const std::string & fileName ) const
+{
+    // replace the file, so that it is never seen half written
+    const std::string temporary( fileName + ".tmp" );
+    {
+        std::ofstream out( temporary.c_str(), std::ios::binary | std::ios::trunc );
+        if ( !out ) return false;
+
+        uint8_t header[HEADER_SIZE];
+        memset( header, 0, sizeof(header) );
+        memcpy( header, INDEX_MAGIC, sizeof(INDEX_MAGIC) );
+        putInteger( header + 4, INDEX_VERSION, 2 );
+        putInteger( header + 6, ShotCurve::POINTS, 2 );
+        putInteger( header + 8, m_entries.size(), 4 );
+        putInteger( header + 12, static_cast<uint64_t>( 1.0E3 * ShotCurve::STEP + 0.5 ), 4 );
+        out.write( reinterpret_cast<const char*>( header ), sizeof(header) );
+
+        std::vector<uint8_t> buffer;
+        for (size_t i=0; i<m_entries.size(); ++i) {
+            const Entry & entry = m_entries[i];
+            buffer.resize( ENTRY_SIZE + entry.name.size() + 4 * ShotCurve::POINTS );
+
+            uint8_t *p = &buffer[0];
+            putInteger( p, entry.name.size(), 2 );
+            memcpy( p + 2, entry.name.data(), entry.name.size() );
+            p += 2 + entry.name.size();
+            putInteger( p, static_cast<uint64_t>( entry.modified ), 8 );
+            putFloat( p + 8, entry.duration );
+            putFloat( p + 12, entry.volume );
+            putFloat( p + 16, entry.peak );
+            p += ENTRY_SIZE - 2;
+
+            const float *curves[2] = {
+                &m_pressure[i * ShotCurve::POINTS], &m_flow[i * ShotCurve::POINTS]
+            };
+            for (unsigned c=0; c<2; ++c)
+                for (unsigned j=0; j<ShotCurve::POINTS; ++j, p += 2) {
+                    float value = std::min( 65535.0f, std::max( 0.0f, curves[c][j] * CURVE_SCALE + 0.5f ) );
+                    putInteger( p, static_cast<uint64_t>( value ), 2 );
+                }
+            out.write( reinterpret_cast<const char*>( &buffer[0] ), buffer.size() );
+        }
+        if ( !out.flush() ) return false;
+    }
+    return rename( temporary.c_str(), fileName.c_str() ) == 0;
+}
+
+//-----------------------------------------------------------------------------
+
+size_t ShotIndex::update( const std::string & directory )
+{
+    Trace::Span span( "shotindex.update" );
+
+    // the shot logs, by the name they are indexed by
+    struct LogFile {
+        std::string path;       ///< Full path of the log
+        int64_t     modified;   ///< Modification time
+    };
+    std::map<std::string, LogFile> logs;
+
+    DIR *dir = opendir( directory.c_str() );
+    if ( dir == 0 ) return 0;
+    struct dirent *item;
+    while ( (item = readdir( dir )) != 0 ) {
+        if ( !isShotLog( item->d_name ) ) continue;
+
+        LogFile log;
+        log.path = directory + item->d_name;
+        struct stat info;
+        if ( (stat( log.path.c_str(), &info ) != 0) || !S_ISREG( info.st_mode ) )
+            continue;
+        log.modified = static_cast<int64_t>( info.st_mtime );
+
+        // compression keeps the modification time, so either will do
+        logs[getIndexName( item->d_name )] = log;
+    }
+    closedir( dir );
+
+    // keep the shots which are unchanged, and read the rest
+    ShotIndex updated;
+    std::vector<std::string> pending;
+    for (std::map<std::string, LogFile>::const_iterator it = logs.begin(); it != logs.end(); ++it) {
+        std::map<std::string, size_t>::const_iterator found = m_names.find( it->first );
+        if ( (found == m_names.end()) || (m_entries[found->second].modified != it->second.modified) ) {
+            pending.push_back( it->first );
+            continue;
+        }
+
+        size_t shot = found->second;
+        updated.m_names[it->first] = updated.m_entries.size();
+        updated.m_entries.push_back( m_entries[shot] );
+        updated.m_pressure.insert(
+            updated.m_pressure.end(),
+            m_pressure.begin() + shot * ShotCurve::POINTS,
+            m_pressure.begin() + (shot + 1) * ShotCurve::POINTS
+        );
+        updated.m_flow.insert(
+            updated.m_flow.end(),
+            m_flow.begin() + shot * ShotCurve::POINTS,
+            m_flow.begin() + (shot + 1) * ShotCurve::POINTS
+        );
+    }
+
+    // read the logs in parallel, one thread per processor core
+    std::vector<Entry> entries( pending.size() );
+    std::vector<ShotCurve> curves( pending.size() );
+    std::vector<char> valid( pending.size(), 0 );
+    unsigned threads = std::thread::hardware_concurrency();
+    if ( threads == 0 ) threads = 1;
+    if ( threads > pending.size() ) threads = static_cast<unsigned>( pending.size() );
+
+    std::atomic<size_t> next( 0 );
+    std::vector<std::thread> workers;
+    for (unsigned i=0; i<threads; ++i) {
+        workers.push_back( std::thread( [&]() {
+            size_t index;
+            while ( (index = next++) < pending.size() ) {
+                const LogFile & log = logs.find( pending[index] )->second;
+                Entry & entry = entries[index];
+                entry.name = pending[index];
+                entry.modified = log.modified;
+                valid[index] = curves[index].read(
+                    log.path, entry.duration, entry.volume, entry.peak
+                );
+            }
+        } ) );
+    }
+    for (size_t i=0; i<workers.size(); ++i)
+        workers[i].join();
+
+    for (size_t i=0; i<pending.size(); ++i) {
+        if ( !valid[i] ) continue;
+        updated.m_names[entries[i].name] = updated.m_entries.size();
+        updated.m_entries.push_back( entries[i] );
+        updated.m_pressure.insert( updated.m_pressure.end(), curves[i].pressure, curves[i].pressure + ShotCurve::POINTS );
+        updated.m_flow.insert( updated.m_flow.end(), curves[i].flow, curves[i].flow + ShotCurve::POINTS );
+    }
+
+    std::swap( *this, updated );
+    return pending.size();
+}
+
+//-----------------------------------------------------------------------------
+
+size_t ShotIndex::size() const
+{
+    return m_entries.size();
+}
+
+//-----------------------------------------------------------------------------
+
+const ShotIndex::Entry & ShotIndex::getEntry( size_t shot ) const
+{
+    return m_entries[shot];
+}
+
+//-----------------------------------------------------------------------------
+
+bool ShotIndex::find( const std::string & fileName, size_t & shot ) const
+{
+    std::map<std::string, size_t>::const_iterator it = m_names.find( getIndexName( fileName ) );
+    if ( it == m_names.end() ) return false;
+    shot = it->second;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotIndex::getCurve( size_t shot, ShotCurve & curve ) const
+{
+    std::copy(
+        m_pressure.begin() + shot * ShotCurve::POINTS,
+        m_pressure.begin() + (shot + 1) * ShotCurve::POINTS,
+        curve.pressure
+    );
+    std::copy(
+        m_flow.begin() + shot * ShotCurve::POINTS,
+        m_flow.begin() + (shot + 1) * ShotCurve::POINTS,
+        curve.flow
+    );
+}
+
+//-----------------------------------------------------------------------------
+
+void ShotIndex::search(
+    const ShotCurve & query,
+    size_t k,
+    size_t exclude,
+    std::vector<Match> & matches,
+    SearchStats * stats
+) const {
+    Trace::Span span( "shotindex.search" );
+
+    const unsigned n = ShotCurve::POINTS;
+    matches.clear();
+    if ( stats != 0 ) {
+        stats->candidates = 0;
+        stats->distances = 0;
+    }
+    if ( k == 0 ) return;
+
+    // the envelope of the query within the band
+    float pressureLower[ShotCurve::POINTS], pressureUpper[ShotCurve::POINTS];
+    float flowLower[ShotCurve::POINTS], flowUpper[ShotCurve::POINTS];
+    for (unsigned i=0; i<n; ++i) {
+        unsigned from = (i > WINDOW) ? i - WINDOW : 0;
+        unsigned to = std::min( n - 1, i + WINDOW );
+        pressureLower[i] = pressureUpper[i] = query.pressure[from];
+        flowLower[i] = flowUpper[i] = query.flow[from];
+        for (unsigned j=from+1; j<=to; ++j) {
+            pressureLower[i] = std::min( pressureLower[i], query.pressure[j] );
+            pressureUpper[i] = std::max( pressureUpper[i], query.pressure[j] );
+            flowLower[i] = std::min( flowLower[i], query.flow[j] );
+            flowUpper[i] = std::max( flowUpper[i], query.flow[j] );
+        }
+    }
+
+    // the lower bound of every shot, smallest first
+    std::vector< std::pair<float, size_t> > bounds;
+    bounds.reserve( m_entries.size() );
+    for (size_t shot=0; shot<m_entries.size(); ++shot) {
+        if ( shot == exclude ) continue;
+        bounds.push_back( std::make_pair(
+            lowerBound(
+                &m_pressure[shot * n], &m_flow[shot * n],
+                pressureLower, pressureUpper, flowLower, flowUpper
+            ),
+            shot
+        ) );
+    }
+    std::sort( bounds.begin(), bounds.end() );
+
+    // the distances of the shots, until no other shot can be nearer than
+    // the kth nearest so far
+    std::priority_queue< std::pair<float, size_t> > nearest;
+    size_t distances = 0;
+    for (size_t i=0; i<bounds.size(); ++i) {
+        float limit = (nearest.size() < k) ? HUGE_VALF : nearest.top().first;
+        if ( bounds[i].first >= limit ) break;
+
+        size_t shot = bounds[i].second;
+        float distance = warpDistance(
+            query.pressure, query.flow, &m_pressure[shot * n], &m_flow[shot * n], limit
+        );
+        ++distances;
+        if ( distance < limit ) {
+            nearest.push( std::make_pair( distance, shot ) );
+            if ( nearest.size() > k ) nearest.pop();
+        }
+    }
+
+    // nearest first, as an RMS distance per point
+    matches.resize( nearest.size() );
+    for (size_t i=matches.size(); i-- > 0; nearest.pop()) {
+        matches[i].shot = nearest.top().second;
+        matches[i].distance = sqrt( nearest.top().first / n );
+    }
+
+    if ( stats != 0 ) {
+        stats->candidates = bounds.size();
+        stats->distances = distances;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+std::string ShotIndex::getIndexName( const std::string & fileName )
+{
+    std::string name( fileName.substr( fileName.rfind( '/' ) + 1 ) );
+    if ( (name.size() > 3) && (name.compare( name.size() - 3, 3, ".gz" ) == 0) )
+        name.erase( name.size() - 3 );
+    return name;
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,120 @@
+#ifndef __shotindex_h
+#define __shotindex_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <vector>
+#include <map>
+#include <inttypes.h>
+
+//-----------------------------------------------------------------------------
+
+/// Pressure and flow curves of a shot, resampled to a fixed time base
+struct ShotCurve {
+    /// Number of points, and the time between them in seconds (the curves
+    /// cover the first 64 seconds of a pour)
+    static const unsigned POINTS = 128;
+    static const double   STEP;
+
+    float pressure[POINTS]; ///< Pressure in bar (zero after the pour)
+    float flow[POINTS];     ///< Flow in ml/s (zero after the pour)
+
+    /// Read a shot log (see ShotCapture), filling in the curves and the
+    /// duration, volume and peak pressure. Returns false if the log can't
+    /// be read or has no samples.
+    bool read(
+        const std::string & fileName,
+        double & duration,
+        double & volume,
+        double & peak
+    );
+};
+
+//-----------------------------------------------------------------------------
+
+/// Compact index of the curves of the shot logs in the log directory, used
+/// to find the shots most like a given one. The curves are kept in a single
+/// file (shots.sim), updated from the shot logs which are new or changed,
+/// so that a search reads one small file rather than every log. Shots are
+/// compared by dynamic time warping (DTW) within a band of a few seconds,
+/// which tolerates small differences in timing such as a slower ramp up.
+/// Most shots are ruled out by a cheap lower bound on the DTW distance
+/// (LB_Keogh) without computing the distance itself.
+class ShotIndex {
+public:
+    /// An indexed shot
+    struct Entry {
+        std::string name;       ///< Shot log file name (without path or .gz)
+        int64_t     modified;   ///< Modification time of the log
+        double      duration;   ///< Pour time in seconds
+        double      volume;     ///< Volume in ml
+        double      peak;       ///< Highest pressure in bar
+    };
+
+    /// A shot found by a search
+    struct Match {
+        size_t shot;        ///< Index of the shot
+        double distance;    ///< Distance from the query (RMS, in bar)
+    };
+
+    /// Search statistics
+    struct SearchStats {
+        size_t candidates;  ///< Shots considered
+        size_t distances;   ///< DTW distances computed (the rest were pruned)
+    };
+
+    /// Default constructor
+    ShotIndex();
+
+    /// Read an index file. A missing file gives an empty index. Returns
+    /// false if the file can't be understood.
+    bool load( const std::string & fileName );
+
+    /// Write the index file (replacing it whole). Returns true for success.
+    bool save( const std::string & fileName ) const;
+
+    /// Bring the index up to date with the shot logs in a directory (ending
+    /// with '/'), reading the new and changed logs in parallel and dropping
+    /// the shots whose logs have been deleted. Returns the number of logs
+    /// read.
+    size_t update( const std::string & directory );
+
+    /// Returns the number of shots
+    size_t size() const;
+
+    /// Returns a shot
+    const Entry & getEntry( size_t shot ) const;
+
+    /// Find a shot by its log file name (with or without a path or .gz).
+    /// Returns false if it isn't indexed.
+    bool find( const std::string & fileName, size_t & shot ) const;
+
+    /// Returns the curves of a shot
+    void getCurve( size_t shot, ShotCurve & curve ) const;
+
+    /// Find the k shots nearest to the curves, nearest first, leaving out
+    /// one shot (such as the query itself, or -1 for none)
+    void search(
+        const ShotCurve & query,
+        size_t k,
+        size_t exclude,
+        std::vector<Match> & matches,
+        SearchStats * stats = 0
+    ) const;
+
+    /// Returns the name by which a shot log is indexed (no path or .gz)
+    static std::string getIndexName( const std::string & fileName );
+
+private:
+    std::vector<Entry>  m_entries;  ///< Indexed shots
+    std::vector<float>  m_pressure; ///< Pressure curves, one after the other
+    std::vector<float>  m_flow;     ///< Flow curves, one after the other
+
+    /// Shots by name
+    std::map<std::string, size_t> m_names;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__shotindex_h
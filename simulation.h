@@ -0,0 +1,78 @@
+#ifndef __simulation_h
+#define __simulation_h
+
+//-----------------------------------------------------------------------------
+
+#include <map>
+#include <string>
+
+//-----------------------------------------------------------------------------
+
+/// Actuator outputs read back from the simulated hardware
+struct Actuators {
+    double heater;      ///< Boiler heater power level from hardware PWM (0..1)
+    bool   pump;        ///< Is the pump switched on?
+    double pumpDuty;    ///< Pump PWM duty cycle (0..1)
+};
+
+//-----------------------------------------------------------------------------
+
+/// Sensor values presented by the simulated hardware
+struct Sensors {
+    double temperature; ///< Temperature at the TSIC sensor in degrees C
+    double pressure;    ///< Pressure at the transducer in bar
+    double litres;      ///< Total volume through the flow meter in litres
+    double range;       ///< Distance from the ranger to the water in mm
+    bool   brewSwitch;  ///< Is the pump supply sensed?
+};
+
+//-----------------------------------------------------------------------------
+
+/// Physical process connected to the simulated hardware (the boiler, pump
+/// and water path). The simulator steps the plant at a fixed rate and
+/// converts its sensor values into GPIO edges and ADC conversions.
+class Plant {
+public:
+    /// Destructor
+    virtual ~Plant() {}
+
+    /// Advance the plant by dt seconds given the actuator settings, and
+    /// update the sensor values
+    virtual void step(
+        double dt,
+        const Actuators & actuators,
+        Sensors & sensors
+    ) = 0;
+};
+
+//-----------------------------------------------------------------------------
+
+/// Control of the simulated hardware backend (halsim.cpp)
+namespace Simulation {
+
+/// Connect a plant to the simulator. The caller retains ownership. Passing
+/// a null pointer restores the default plant.
+void setPlant( Plant *plant );
+
+/// Configure the default plant (a BoilerModel) from configuration keys with
+/// the "sim" prefix, and reset it to ambient temperature
+void configure( const std::map<std::string, double> & config );
+
+/// Set the front panel buttons which are held down (bit mask, where bit 0 is
+/// button 1). The brew switch is also sensed when the pump is running.
+void setButtons( unsigned buttons );
+
+/// Returns the latest actuator settings
+Actuators getActuators();
+
+/// Returns the latest sensor values
+Sensors getSensors();
+
+/// Returns the number of display frames flipped so far
+unsigned long getFrameCount();
+
+} // namespace Simulation
+
+//-----------------------------------------------------------------------------
+
+#endif//__simulation_h
@@ -0,0 +1,78 @@
+#ifndef __spscqueue_h
+#define __spscqueue_h
+
+//-----------------------------------------------------------------------------
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+
+//-----------------------------------------------------------------------------
+
+/// Bounded lock-free queue for one producer thread and one consumer thread.
+/// Neither side ever blocks: push fails when the queue is full, and pop
+/// fails when it is empty.
+template<class T>
+class SPSCQueue {
+public:
+    /// Constructor, given the capacity (rounded up to a power of two)
+    SPSCQueue( size_t capacity ) :
+        m_head( 0 ),
+        m_tail( 0 )
+    {
+        size_t size = 1;
+        while ( size < capacity ) size <<= 1;
+        m_items.resize( size );
+        m_mask = size - 1;
+    }
+
+    /// Returns the capacity
+    size_t capacity() const { return m_items.size(); }
+
+    /// Returns the number of queued items (approximate if called by a
+    /// thread other than the producer or consumer)
+    size_t size() const {
+        return static_cast<size_t>(
+            m_tail.load( std::memory_order_acquire ) -
+            m_head.load( std::memory_order_acquire )
+        );
+    }
+
+    /// Add an item (producer only). Returns false if the queue is full.
+    bool push( const T & item ) {
+        size_t tail = m_tail.load( std::memory_order_relaxed );
+        if ( tail - m_head.load( std::memory_order_acquire ) >= m_items.size() )
+            return false;
+        m_items[tail & m_mask] = item;
+        m_tail.store( tail + 1, std::memory_order_release );
+        return true;
+    }
+
+    /// Remove the oldest item (consumer only). Returns false if the queue
+    /// is empty.
+    bool pop( T & item ) {
+        size_t head = m_head.load( std::memory_order_relaxed );
+        if ( head == m_tail.load( std::memory_order_acquire ) )
+            return false;
+        item = m_items[head & m_mask];
+        m_head.store( head + 1, std::memory_order_release );
+        return true;
+    }
+
+private:
+    /// Copy constructor (unsupported)
+    SPSCQueue( const SPSCQueue & );
+
+    /// Assignment operator (unsupported)
+    SPSCQueue & operator = ( const SPSCQueue & );
+
+private:
+    std::vector<T>      m_items;    ///< Storage for the items
+    size_t              m_mask;     ///< Index mask (capacity - 1)
+    std::atomic<size_t> m_head;     ///< Count of items removed
+    std::atomic<size_t> m_tail;     ///< Count of items added
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__spscqueue_h
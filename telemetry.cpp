@@ -0,0 +1,924 @@
+#include "telemetry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <math.h>
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+
+int formatCSV( const Sample & sample, char *buffer, size_t size )
+{
+	return snprintf(
+		buffer, size,
+		"%.3lf,%.2lf,%.2lf,%.1lf,%.2lf,%d,%d",
+		sample.elapsed, sample.power, sample.temperature,
+		sample.ml, sample.bar, sample.pump, sample.pour
+	);
+}
+
+//-----------------------------------------------------------------------------
+
+// Binary log format (version 1). All integers are little endian.
+//
+//   header:  "GLOG", u16 version, u16 column count, u16 sample record size,
+//            u16 reserved
+//   columns: for each column, char name[16] (zero padded), u8 type,
+//            u8 reserved[3], u32 scale
+//   records: u8 kind, then
+//            'S': a sample, with the columns in order, each stored as an
+//                 integer equal to the value multiplied by the column scale
+//            'N': u16 length and the text of a note (no terminator)
+//
+// Readers locate the sample fields by column name and skip columns which
+// they do not recognise, so columns can be added in later versions.
+//
+// Logs in either format are written a block at a time into space allocated
+// beyond the end of the file, so a log which was not closed (after a power
+// cut) ends with the records flushed, perhaps with part of a record, which
+// readers ignore. recoverLog releases the allocated space. Logs written by
+// earlier versions may end with zero bytes instead, and readers stop at a
+// zero byte where a record should start.
+
+/// file signature
+static const char LOG_MAGIC[4] = { 'G', 'L', 'O', 'G' };
+
+/// format version
+static const uint16_t LOG_VERSION = 1;
+
+/// record kinds
+static const uint8_t RECORD_SAMPLE = 'S';
+static const uint8_t RECORD_NOTE   = 'N';
+
+/// column types
+enum ColumnType {
+	TYPE_U8  = 1,
+	TYPE_U16 = 2,
+	TYPE_I16 = 3,
+	TYPE_U32 = 4,
+	TYPE_I32 = 5
+};
+
+/// column name length in the header
+static const size_t COLUMN_NAME_SIZE = 16;
+
+/// column definition
+struct ColumnDef {
+	const char *name;	///< Column name
+	uint8_t     type;	///< Column type
+	uint32_t    scale;	///< Scale factor
+};
+
+/// columns written by this version, in the order of the Sample fields
+static const ColumnDef COLUMNS[] = {
+	{ "elapsed",     TYPE_U32, 1000  },	// milliseconds
+	{ "power",       TYPE_U16, 10000 },
+	{ "temperature", TYPE_I16, 100   },	// hundredths of a degree
+	{ "ml",          TYPE_U32, 10    },
+	{ "bar",         TYPE_I16, 100   },
+	{ "pump",        TYPE_U8,  1     },
+	{ "pour",        TYPE_U16, 1     }
+};
+
+/// number of columns
+static const size_t COLUMN_COUNT = sizeof(COLUMNS) / sizeof(COLUMNS[0]);
+
+/// size of the blocks written to the file
+static const size_t BLOCK_SIZE = LOG_BLOCK_SIZE;
+
+/// space allocated for the file at a time in bytes
+static const uint64_t ALLOCATE_SIZE = 1024 * 1024;
+
+/// samples between time index entries (one minute at the 4 Hz log rate)
+static const unsigned INDEX_INTERVAL = 240;
+
+//-----------------------------------------------------------------------------
+
+/// Returns the size of a column type in bytes (or zero if unknown)
+static size_t getTypeSize( uint8_t type )
+{
+	switch ( type ) {
+	case TYPE_U8:  return 1;
+	case TYPE_U16: return 2;
+	case TYPE_I16: return 2;
+	case TYPE_U32: return 4;
+	case TYPE_I32: return 4;
+	default:       return 0;
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+/// Store a little endian integer
+static void putInteger( uint8_t *p, uint32_t value, size_t size )
+{
+	for (size_t i=0; i<size; ++i)
+		p[i] = static_cast<uint8_t>( value >> (8*i) );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Load a little endian integer
+static uint32_t getInteger( const uint8_t *p, size_t size )
+{
+	uint32_t value = 0;
+	for (size_t i=0; i<size; ++i)
+		value |= static_cast<uint32_t>( p[i] ) << (8*i);
+	return value;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Encode a value as a column of the given type, rounding and clamping it
+/// to the range of the type
+static void encodeColumn( uint8_t *p, uint8_t type, uint32_t scale, double value )
+{
+	double scaled = floor( value * static_cast<double>(scale) + 0.5 );
+
+	double lo = 0.0, hi = 0.0;
+	switch ( type ) {
+	case TYPE_U8:  lo = 0.0;         hi = 255.0;        break;
+	case TYPE_U16: lo = 0.0;         hi = 65535.0;      break;
+	case TYPE_I16: lo = -32768.0;    hi = 32767.0;      break;
+	case TYPE_U32: lo = 0.0;         hi = 4294967295.0; break;
+	case TYPE_I32: lo = -2147483648.0; hi = 2147483647.0; break;
+	}
+	scaled = std::max( lo, std::min( scaled, hi ) );
+
+	uint32_t bits = (scaled < 0.0) ?
+		static_cast<uint32_t>( static_cast<int32_t>( scaled ) ) :
+		static_cast<uint32_t>( scaled );
+	putInteger( p, bits, getTypeSize( type ) );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Decode a column of the given type
+static double decodeColumn( const uint8_t *p, uint8_t type, uint32_t scale )
+{
+	uint32_t bits = getInteger( p, getTypeSize( type ) );
+
+	double value = 0.0;
+	switch ( type ) {
+	case TYPE_I16: value = static_cast<int16_t>( bits ); break;
+	case TYPE_I32: value = static_cast<int32_t>( bits ); break;
+	default:       value = bits;                         break;
+	}
+
+	return (scale > 0) ? value / static_cast<double>( scale ) : value;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Returns the sample fields as an array of values, in column order
+static void getFields( const Sample & sample, double values[COLUMN_COUNT] )
+{
+	values[0] = sample.elapsed;
+	values[1] = sample.power;
+	values[2] = sample.temperature;
+	values[3] = sample.ml;
+	values[4] = sample.bar;
+	values[5] = sample.pump;
+	values[6] = sample.pour;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Set a sample field, given its column index
+static void setField( Sample & sample, int field, double value )
+{
+	switch ( field ) {
+	case 0: sample.elapsed     = value; break;
+	case 1: sample.power       = value; break;
+	case 2: sample.temperature = value; break;
+	case 3: sample.ml          = value; break;
+	case 4: sample.bar         = value; break;
+	case 5: sample.pump        = static_cast<int>( value ); break;
+	case 6: sample.pour        = static_cast<int>( value ); break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+/// Read a column description from the header of a binary log, finding the
+/// index of the sample field by name (or -1 if it isn't recognised)
+static void getColumnInfo(
+	const uint8_t *column,
+	uint8_t & type,
+	uint32_t & scale,
+	int & field
+) {
+	std::string name(
+		reinterpret_cast<const char*>( column ),
+		strnlen( reinterpret_cast<const char*>( column ), COLUMN_NAME_SIZE )
+	);
+
+	type  = column[COLUMN_NAME_SIZE];
+	scale = getInteger( column + COLUMN_NAME_SIZE + 4, 4 );
+	field = -1;
+	for (size_t j=0; j<COLUMN_COUNT; ++j)
+		if ( name == COLUMNS[j].name ) field = static_cast<int>( j );
+}
+
+//-----------------------------------------------------------------------------
+
+const char * getLogExtension( LogFormat format )
+{
+	return (format == BinaryFormat) ? ".glog" : ".csv";
+}
+
+//-----------------------------------------------------------------------------
+
+/// powers of ten, for the number parser
+static const double POWERS_OF_TEN[] = {
+	1.0E0, 1.0E1, 1.0E2,  1.0E3,  1.0E4,  1.0E5,  1.0E6,  1.0E7,
+	1.0E8, 1.0E9, 1.0E10, 1.0E11, 1.0E12, 1.0E13, 1.0E14, 1.0E15
+};
+
+/// most significant digits parsed without strtod
+static const int MAX_DIGITS = 15;
+
+//-----------------------------------------------------------------------------
+
+/// Parse a number at the start of a field, advancing the pointer past it.
+/// Plain decimals (as written by formatCSV) are converted directly: the
+/// digits are exact as an integer, so a single division by a power of ten
+/// gives the correctly rounded value. Anything else is passed to strtod.
+/// Returns false if there is no number.
+static bool parseNumber( const char *& p, const char *end, double & value )
+{
+	while ( (p < end) && ((*p == ' ') || (*p == '\t')) ) ++p;
+
+	const char *start = p;
+	bool negative = false;
+	if ( (p < end) && ((*p == '-') || (*p == '+')) ) {
+		negative = (*p == '-');
+		++p;
+	}
+
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int decimals = 0;
+	while ( (p < end) && (static_cast<unsigned>( *p - '0' ) < 10) ) {
+		mantissa = mantissa * 10 + static_cast<unsigned>( *p++ - '0' );
+		++digits;
+	}
+	if ( (p < end) && (*p == '.') ) {
+		++p;
+		while ( (p < end) && (static_cast<unsigned>( *p - '0' ) < 10) ) {
+			mantissa = mantissa * 10 + static_cast<unsigned>( *p++ - '0' );
+			++digits;
+			++decimals;
+		}
+	}
+
+	bool exponent = (p < end) && ((*p == 'e') || (*p == 'E'));
+	if ( (digits > 0) && (digits <= MAX_DIGITS) && !exponent ) {
+		value = static_cast<double>( mantissa ) / POWERS_OF_TEN[decimals];
+		if ( negative ) value = -value;
+		return true;
+	}
+
+	// long numbers, exponents, infinity and so on
+	char buffer[64];
+	size_t length = 0;
+	for (p=start; (p < end) && (*p != ',') && (length+1 < sizeof(buffer)); ++p)
+		buffer[length++] = *p;
+	buffer[length] = '\0';
+
+	char *stop = 0;
+	value = strtod( buffer, &stop );
+	p = start + (stop - buffer);
+	return stop != buffer;
+}
+
+//-----------------------------------------------------------------------------
+
+bool parseCSV( const char *begin, const char *end, Sample & sample )
+{
+	double values[COLUMN_COUNT];
+	const char *p = begin;
+	for (size_t i=0; i<COLUMN_COUNT; ++i) {
+		if ( (i > 0) && ((p == end) || (*p++ != ',')) ) return false;
+		if ( !parseNumber( p, end, values[i] ) ) return false;
+	}
+
+	sample.elapsed     = values[0];
+	sample.power       = values[1];
+	sample.temperature = values[2];
+	sample.ml          = values[3];
+	sample.bar         = values[4];
+	sample.pump        = static_cast<int>( values[5] );
+	sample.pour        = static_cast<int>( values[6] );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool parseCSV( const char *line, Sample & sample )
+{
+	return parseCSV( line, line + strlen( line ), sample );
+}
+
+//-----------------------------------------------------------------------------
+
+int formatAnchor( const ClockAnchor & anchor, char *buffer, size_t size )
+{
+	return snprintf(
+		buffer, size, "anchor=%.3lf,wall=%.6lf,sync=%d",
+		anchor.elapsed, anchor.wall, anchor.synchronised ? 1 : 0
+	);
+}
+
+//-----------------------------------------------------------------------------
+
+bool parseAnchor( const char *text, size_t length, ClockAnchor & anchor )
+{
+	static const char key[] = "anchor=";
+	if ( (length < sizeof(key) - 1) || (memcmp( text, key, sizeof(key) - 1 ) != 0) )
+		return false;
+
+	// notes aren't terminated
+	const std::string line( text, length );
+	int sync = 0;
+	if ( sscanf(
+		line.c_str(), "anchor=%lf,wall=%lf,sync=%d",
+		&anchor.elapsed, &anchor.wall, &sync
+	) != 3 ) return false;
+	anchor.synchronised = (sync != 0);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void WallClockMap::add( const ClockAnchor & anchor )
+{
+	m_all.push_back( anchor );
+	if ( anchor.synchronised ) m_synced.push_back( anchor );
+}
+
+//-----------------------------------------------------------------------------
+
+size_t WallClockMap::getCount() const
+{
+	return m_all.size();
+}
+
+//-----------------------------------------------------------------------------
+
+bool WallClockMap::isSynchronised() const
+{
+	return !m_synced.empty();
+}
+
+//-----------------------------------------------------------------------------
+
+double WallClockMap::toWall( double elapsed ) const
+{
+	const std::vector<ClockAnchor> & anchors = m_synced.empty() ? m_all : m_synced;
+	if ( anchors.empty() ) return elapsed;
+
+	// the first anchor after the time
+	std::vector<ClockAnchor>::const_iterator after = std::upper_bound(
+		anchors.begin(), anchors.end(), elapsed,
+		[]( double t, const ClockAnchor & anchor ) { return t < anchor.elapsed; }
+	);
+	if ( after == anchors.begin() )
+		return elapsed + (after->wall - after->elapsed);
+	std::vector<ClockAnchor>::const_iterator before = after - 1;
+	if ( (after == anchors.end()) || (after->elapsed <= before->elapsed) )
+		return elapsed + (before->wall - before->elapsed);
+
+	// interpolate the offset, which drifts as the clocks run at different
+	// rates
+	double offset0 = before->wall - before->elapsed;
+	double offset1 = after->wall - after->elapsed;
+	double f = (elapsed - before->elapsed) / (after->elapsed - before->elapsed);
+	return elapsed + offset0 + f * (offset1 - offset0);
+}
+
+//-----------------------------------------------------------------------------
+
+bool parseLog( const void *data, size_t size, LogVisitor & visitor )
+{
+	const uint8_t *p = static_cast<const uint8_t*>( data );
+	const uint8_t *end = p + size;
+
+	if ( (size < 12) || (memcmp( p, LOG_MAGIC, sizeof(LOG_MAGIC) ) != 0) ) {
+		// text: one record per line
+		const char *line = reinterpret_cast<const char*>( p );
+		const char *last = reinterpret_cast<const char*>( end );
+		Sample sample;
+		while ( line < last ) {
+			// unused space at the end of a log which wasn't closed
+			if ( *line == '\0' ) break;
+
+			const char *next = static_cast<const char*>(
+				memchr( line, '\n', last - line )
+			);
+			if ( next == 0 ) next = last;
+
+			const char *stop = next;
+			if ( (stop > line) && (stop[-1] == '\r') ) --stop;
+			if ( parseCSV( line, stop, sample ) )
+				visitor.sample( sample );
+			else
+				visitor.note( line, stop - line );
+
+			line = next + 1;
+		}
+		return true;
+	}
+
+	// binary: read the column layout from the header
+	size_t count = getInteger( p + 6, 2 );
+	size_t recordSize = getInteger( p + 8, 2 );
+	p += 12;
+
+	struct Column {
+		uint8_t  type;
+		uint32_t scale;
+		int      field;
+	};
+	std::vector<Column> columns( count );
+	size_t total = 0;
+	for (size_t i=0; i<count; ++i) {
+		if ( end - p < static_cast<ptrdiff_t>( COLUMN_NAME_SIZE + 8 ) )
+			return false;
+		Column & column = columns[i];
+		getColumnInfo( p, column.type, column.scale, column.field );
+		if ( getTypeSize( column.type ) == 0 ) return false;
+		total += getTypeSize( column.type );
+		p += COLUMN_NAME_SIZE + 8;
+	}
+	if ( total != recordSize ) return false;
+
+	// the records (stopping at the end of the file, an incomplete record or
+	// an unknown record kind)
+	const Sample zero = { 0.0, 0.0, 0.0, 0.0, 0.0, 0, 0 };
+	Sample sample;
+	while ( p < end ) {
+		uint8_t kind = *p++;
+		if ( kind == RECORD_SAMPLE ) {
+			if ( static_cast<size_t>( end - p ) < recordSize ) break;
+			sample = zero;
+			for (size_t i=0; i<count; ++i) {
+				const Column & column = columns[i];
+				if ( column.field >= 0 )
+					setField(
+						sample, column.field,
+						decodeColumn( p, column.type, column.scale )
+					);
+				p += getTypeSize( column.type );
+			}
+			visitor.sample( sample );
+		} else if ( kind == RECORD_NOTE ) {
+			if ( end - p < 2 ) break;
+			size_t length = getInteger( p, 2 );
+			p += 2;
+			if ( static_cast<size_t>( end - p ) < length ) break;
+			visitor.note( reinterpret_cast<const char*>( p ), length );
+			p += length;
+		} else
+			break;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+LogWriter::LogWriter() :
+	m_fd( -1 ),
+	m_format( BinaryFormat ),
+	m_good( false ),
+	m_size( 0 ),
+	m_block( BLOCK_SIZE ),
+	m_fill( 0 ),
+	m_blockOffset( 0 ),
+	m_written( 0 ),
+	m_allocated( 0 ),
+	m_allocate( true )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+LogWriter::~LogWriter()
+{
+	close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogWriter::open(
+	const std::string & fileName,
+	LogFormat format,
+	bool index
+) {
+	close();
+
+	m_format = format;
+	m_fd = ::open( fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if ( m_fd < 0 ) return false;
+	m_good = true;
+	m_size = 0;
+	m_fill = 0;
+	m_blockOffset = 0;
+	m_written = 0;
+	m_allocated = 0;
+	m_allocate = true;
+
+	// the index is only an aid to reading, so the log is written without it
+	// if it can't be created
+	if ( index ) m_index.open( fileName, INDEX_INTERVAL );
+
+	if ( m_format == BinaryFormat ) {
+		// header
+		size_t recordSize = 0;
+		for (size_t i=0; i<COLUMN_COUNT; ++i)
+			recordSize += getTypeSize( COLUMNS[i].type );
+
+		uint8_t header[12];
+		memcpy( header, LOG_MAGIC, sizeof(LOG_MAGIC) );
+		putInteger( header + 4,  LOG_VERSION, 2 );
+		putInteger( header + 6,  COLUMN_COUNT, 2 );
+		putInteger( header + 8,  recordSize, 2 );
+		putInteger( header + 10, 0, 2 );
+		write( header, sizeof(header) );
+
+		// column descriptions
+		for (size_t i=0; i<COLUMN_COUNT; ++i) {
+			uint8_t column[COLUMN_NAME_SIZE + 8];
+			memset( column, 0, sizeof(column) );
+			strncpy(
+				reinterpret_cast<char*>( column ),
+				COLUMNS[i].name, COLUMN_NAME_SIZE
+			);
+			column[COLUMN_NAME_SIZE] = COLUMNS[i].type;
+			putInteger( column + COLUMN_NAME_SIZE + 4, COLUMNS[i].scale, 4 );
+			write( column, sizeof(column) );
+		}
+	}
+
+	return m_good;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogWriter::close()
+{
+	if ( m_fd < 0 ) return;
+
+	// write the last block, and remove the space allocated beyond it
+	flush();
+	if ( (m_allocated > m_size) && (ftruncate( m_fd, m_size ) != 0) )
+		m_good = false;
+	if ( ::close( m_fd ) != 0 ) m_good = false;
+	m_fd = -1;
+	m_index.close();
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogWriter::isOpen() const
+{
+	return m_fd >= 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogWriter::writeNote( const std::string & text )
+{
+	if ( m_format == BinaryFormat ) {
+		size_t length = std::min<size_t>( text.size(), 65535 );
+		uint8_t prefix[3];
+		prefix[0] = RECORD_NOTE;
+		putInteger( prefix + 1, length, 2 );
+		write( prefix, sizeof(prefix) );
+		write( text.data(), length );
+	} else {
+		write( text.data(), text.size() );
+		write( "\n", 1 );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void LogWriter::writeSample( const Sample & sample )
+{
+	m_index.addSample( sample, m_size );
+
+	if ( m_format == BinaryFormat ) {
+		double values[COLUMN_COUNT];
+		getFields( sample, values );
+
+		uint8_t record[64];
+		size_t size = 0;
+		record[size++] = RECORD_SAMPLE;
+		for (size_t i=0; i<COLUMN_COUNT; ++i) {
+			encodeColumn(
+				record + size, COLUMNS[i].type, COLUMNS[i].scale, values[i]
+			);
+			size += getTypeSize( COLUMNS[i].type );
+		}
+		write( record, size );
+	} else {
+		char buffer[256];
+		int length = formatCSV( sample, buffer, sizeof(buffer) - 1 );
+		if ( length < 0 ) return;
+		length = std::min<int>( length, sizeof(buffer) - 2 );
+		buffer[length++] = '\n';
+		write( buffer, length );
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void LogWriter::flush()
+{
+	// the partly filled block is written again each time until it is full
+	if ( (m_fd >= 0) && (m_written < m_fill) ) writeBlock();
+
+	// index entries are written after the records they refer to
+	m_index.flush();
+}
+
+//-----------------------------------------------------------------------------
+
+void LogWriter::sync()
+{
+	if ( m_fd < 0 ) return;
+
+	// the space is already allocated, so this only updates the size of the
+	// file along with the extents written
+	flush();
+	if ( fdatasync( m_fd ) != 0 ) m_good = false;
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogWriter::good() const
+{
+	return m_good;
+}
+
+//-----------------------------------------------------------------------------
+
+uint64_t LogWriter::getSize() const
+{
+	return m_size;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogWriter::write( const void *data, size_t size )
+{
+	if ( m_fd < 0 ) return;
+
+	const uint8_t *p = static_cast<const uint8_t*>( data );
+	while ( size > 0 ) {
+		size_t count = std::min( size, BLOCK_SIZE - m_fill );
+		memcpy( &m_block[m_fill], p, count );
+		m_fill += count;
+		m_size += count;
+		p += count;
+		size -= count;
+
+		// write each block once it is full, and start the next
+		if ( m_fill == BLOCK_SIZE ) {
+			writeBlock();
+			m_blockOffset += BLOCK_SIZE;
+			m_fill = 0;
+			m_written = 0;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+
+void LogWriter::writeBlock()
+{
+	// allocate space ahead of the data, so that the file is written to
+	// contiguous extents (where the file system doesn't support this, the
+	// file grows as it is written). The space is kept beyond the end of the
+	// file, so that readers of a file being written (such as LogUploader)
+	// never see the unwritten space as data.
+	if ( m_allocate && (m_blockOffset + BLOCK_SIZE > m_allocated) ) {
+		if ( fallocate( m_fd, FALLOC_FL_KEEP_SIZE, m_allocated, ALLOCATE_SIZE ) == 0 )
+			m_allocated += ALLOCATE_SIZE;
+		else
+			m_allocate = false;
+	}
+
+	ssize_t result = pwrite( m_fd, &m_block[0], m_fill, m_blockOffset );
+	if ( result != static_cast<ssize_t>( m_fill ) ) m_good = false;
+	m_written = m_fill;
+}
+
+//-----------------------------------------------------------------------------
+
+bool recoverLog( const std::string & fileName )
+{
+	int fd = ::open( fileName.c_str(), O_RDWR );
+	if ( fd < 0 ) return false;
+
+	// a log which was closed holds no space beyond the end of the file
+	struct stat info;
+	bool success = (fstat( fd, &info ) == 0);
+	uint64_t size = static_cast<uint64_t>( info.st_size );
+	uint64_t used = (size + info.st_blksize - 1) / info.st_blksize * info.st_blksize;
+	if ( success && (static_cast<uint64_t>( info.st_blocks ) * 512 > used) ) {
+		// release it, keeping the modification time (used for retention)
+		success = (ftruncate( fd, info.st_size ) == 0);
+		struct timespec times[2] = { info.st_atim, info.st_mtim };
+		futimens( fd, times );
+	}
+
+	if ( ::close( fd ) != 0 ) success = false;
+	return success;
+}
+
+//-----------------------------------------------------------------------------
+
+LogReader::LogReader() :
+	m_in( 0 ),
+	m_format( CSVFormat ),
+	m_size( 0 )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+LogReader::~LogReader()
+{
+	close();
+}
+
+//-----------------------------------------------------------------------------
+
+void LogReader::close()
+{
+	if ( m_in == 0 ) return;
+
+	gzclose( m_in );
+	m_in = 0;
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogReader::read( void *data, size_t size )
+{
+	return gzread( m_in, data, size ) == static_cast<int>( size );
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogReader::open( const std::string & fileName )
+{
+	close();
+	m_columns.clear();
+	m_size = 0;
+	m_fileName = fileName;
+
+	// uncompressed files are read as they are
+	m_in = gzopen( fileName.c_str(), "rb" );
+	if ( m_in == 0 ) return false;
+
+	// read the header, if there is one
+	uint8_t header[12];
+	if (
+		!read( header, sizeof(header) ) ||
+		(memcmp( header, LOG_MAGIC, sizeof(LOG_MAGIC) ) != 0)
+	) {
+		// not a binary log: read as text from the start
+		m_format = CSVFormat;
+		return gzrewind( m_in ) == 0;
+	}
+
+	m_format = BinaryFormat;
+
+	// later versions may add columns, but must keep the same layout
+	size_t count = getInteger( header + 6, 2 );
+	size_t recordSize = getInteger( header + 8, 2 );
+
+	for (size_t i=0; i<count; ++i) {
+		uint8_t column[COLUMN_NAME_SIZE + 8];
+		if ( !read( column, sizeof(column) ) ) return false;
+
+		Column entry;
+		getColumnInfo( column, entry.type, entry.scale, entry.field );
+
+		// the record layout can't be known if a column type is unknown
+		if ( getTypeSize( entry.type ) == 0 ) return false;
+
+		m_size += getTypeSize( entry.type );
+		m_columns.push_back( entry );
+	}
+
+	return m_size == recordSize;
+}
+
+//-----------------------------------------------------------------------------
+
+LogFormat LogReader::getFormat() const
+{
+	return m_format;
+}
+
+//-----------------------------------------------------------------------------
+
+uint64_t LogReader::getOffset() const
+{
+	if ( m_in == 0 ) return 0;
+
+	z_off_t offset = gztell( m_in );
+	return (offset < 0) ? 0 : static_cast<uint64_t>( offset );
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogReader::seek( double elapsed )
+{
+	if ( m_in == 0 ) return false;
+
+	LogIndex index;
+	uint64_t offset;
+	if ( !index.load( m_fileName ) || !index.find( elapsed, offset ) )
+		return false;
+
+	// a compressed log is decompressed up to the offset, which is still
+	// quicker than parsing the records
+	return gzseek( m_in, static_cast<z_off_t>( offset ), SEEK_SET ) >= 0;
+}
+
+//-----------------------------------------------------------------------------
+
+LogReader::Record LogReader::next( Sample & sample, std::string & note )
+{
+	if ( m_in == 0 ) return End;
+
+	if ( m_format == CSVFormat ) {
+		// read a line, which may be longer than the buffer
+		char buffer[512];
+		note.clear();
+		do {
+			if ( gzgets( m_in, buffer, sizeof(buffer) ) == 0 ) {
+				if ( note.empty() ) return End;
+				break;
+			}
+
+			// unused space at the end of a log which wasn't closed
+			if ( buffer[0] == '\0' ) {
+				if ( note.empty() ) return End;
+				break;
+			}
+			note += buffer;
+		} while ( note[note.size()-1] != '\n' );
+
+		// remove the line terminator
+		size_t end = note.find_last_not_of( "\r\n" );
+		note.erase( (end == std::string::npos) ? 0 : end + 1 );
+
+		return parseCSV( note.c_str(), sample ) ? SampleRow : Note;
+	}
+
+	uint8_t kind = 0;
+	if ( !read( &kind, 1 ) ) return End;
+
+	if ( kind == RECORD_SAMPLE ) {
+		uint8_t record[256];
+		if ( m_size > sizeof(record) ) return End;
+		if ( !read( record, m_size ) ) return End;
+
+		Sample zero = { 0.0, 0.0, 0.0, 0.0, 0.0, 0, 0 };
+		sample = zero;
+		const uint8_t *p = record;
+		for (size_t i=0; i<m_columns.size(); ++i) {
+			const Column & column = m_columns[i];
+			if ( column.field >= 0 )
+				setField(
+					sample, column.field,
+					decodeColumn( p, column.type, column.scale )
+				);
+			p += getTypeSize( column.type );
+		}
+		return SampleRow;
+	} else if ( kind == RECORD_NOTE ) {
+		uint8_t prefix[2];
+		if ( !read( prefix, 2 ) ) return End;
+		size_t length = getInteger( prefix, 2 );
+		note.resize( length );
+		if ( (length > 0) && !read( &note[0], length ) ) return End;
+		return Note;
+	}
+
+	// unknown record kind (or a truncated file, or the unused space at the
+	// end of a log which wasn't closed)
+	return End;
+}
+
+//-----------------------------------------------------------------------------
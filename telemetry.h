@@ -0,0 +1,288 @@
+#ifndef __telemetry_h
+#define __telemetry_h
+
+//-----------------------------------------------------------------------------
+
+#include <stddef.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string>
+#include <zlib.h>
+#include <vector>
+#include "logindex.h"
+
+//-----------------------------------------------------------------------------
+
+/// One row of telemetry, sampled by the main loop and written to the log
+struct Sample {
+    double elapsed;     ///< Time since the controller started in seconds
+    double power;       ///< Boiler power level (0..1)
+    double temperature; ///< Boiler temperature in degrees C
+    double ml;          ///< Volume drawn by the pump in ml
+    double bar;         ///< Pressure in bar
+    int    pump;        ///< Pump status (1 if the pump is running)
+    int    pour;        ///< Pour number (zero if the pump isn't running)
+};
+
+//-----------------------------------------------------------------------------
+
+/// Receives the samples written to a session log, on the thread which
+/// writes the log (see AsyncLogWriter::addSink)
+class LogSink {
+public:
+    /// Destructor
+    virtual ~LogSink() {}
+
+    /// Add a sample, with the elapsed field set to the time in seconds since
+    /// the epoch
+    virtual void add( const Sample & sample ) = 0;
+
+    /// Write any buffered data, and optionally wait for it to reach the disk
+    virtual void flush( bool sync ) = 0;
+};
+
+//-----------------------------------------------------------------------------
+
+/// Format a sample as a CSV row without a line terminator, in the layout
+/// elapsed,power,temp,ml,bar,pump,pour. Returns the length of the text.
+int formatCSV( const Sample & sample, char *buffer, size_t size );
+
+/// Parse a CSV row written by formatCSV. Returns false if the line is not a
+/// sample (for example the parameter line at the start of the log).
+bool parseCSV( const char *line, Sample & sample );
+
+/// Parse a CSV row held between two pointers (without a line terminator)
+bool parseCSV( const char *begin, const char *end, Sample & sample );
+
+//-----------------------------------------------------------------------------
+
+/// Wall clock anchor: the wall clock time at an elapsed time of a session.
+/// The elapsed time of the samples comes from the monotonic clock, so it
+/// never jumps, but the system time may be set during a session (such as
+/// when the Pi boots without a network and NTP catches up later). The
+/// controller writes anchors to the log as notes, at the start, once a
+/// minute and whenever the wall clock jumps, so that the calendar time of
+/// the samples can be worked out afterwards (see WallClockMap).
+struct ClockAnchor {
+    double elapsed;         ///< Elapsed time in seconds
+    double wall;            ///< Wall clock time in seconds since the epoch
+    bool   synchronised;    ///< Was the system time synchronised?
+};
+
+/// Format an anchor as a note ("anchor=<elapsed>,wall=<time>,sync=<0|1>"),
+/// returning the length of the text
+int formatAnchor( const ClockAnchor & anchor, char *buffer, size_t size );
+
+/// Parse a note written by formatAnchor. Returns false for other notes.
+bool parseAnchor( const char *text, size_t length, ClockAnchor & anchor );
+
+/// Maps the elapsed time of a session to wall clock time, from the anchors
+/// in its log. Anchors taken while the system time was synchronised are
+/// trusted over the rest (which are only used if there are no others). The
+/// offset between the clocks is interpolated between the anchors around a
+/// time, and taken from the nearest anchor outside them.
+class WallClockMap {
+public:
+    /// Add an anchor (in order of elapsed time)
+    void add( const ClockAnchor & anchor );
+
+    /// Returns the number of anchors
+    size_t getCount() const;
+
+    /// Is any anchor synchronised?
+    bool isSynchronised() const;
+
+    /// Returns the wall clock time for an elapsed time (or the elapsed time
+    /// if there are no anchors)
+    double toWall( double elapsed ) const;
+
+private:
+    std::vector<ClockAnchor> m_all;     ///< All anchors
+    std::vector<ClockAnchor> m_synced;  ///< Synchronised anchors
+};
+
+//-----------------------------------------------------------------------------
+
+/// Log file formats
+enum LogFormat {
+    CSVFormat,      ///< Text, one line per sample (the original format)
+    BinaryFormat    ///< Fixed width binary records (see telemetry.cpp)
+};
+
+/// Returns the file name extension for a log format (including the dot)
+const char * getLogExtension( LogFormat format );
+
+//-----------------------------------------------------------------------------
+
+/// Receives the records of a log parsed from memory
+class LogVisitor {
+public:
+    /// Destructor
+    virtual ~LogVisitor() {}
+
+    /// Called for each sample
+    virtual void sample( const Sample & sample ) = 0;
+
+    /// Called for each note (the text is not terminated)
+    virtual void note( const char *text, size_t length ) = 0;
+};
+
+/// Parse a whole log held in memory (for example a mapped file) in either
+/// format, passing each record to the visitor. This is quicker than
+/// LogReader for bulk analysis. Returns false if the header of a binary log
+/// is not understood.
+bool parseLog( const void *data, size_t size, LogVisitor & visitor );
+
+//-----------------------------------------------------------------------------
+
+/// Size of the blocks written by LogWriter in bytes (a multiple of the flash
+/// page size)
+static const size_t LOG_BLOCK_SIZE = 4096;
+
+/// Writes a session log of samples and notes (the parameter line and any
+/// error messages) in either format. To reduce wear on flash storage, the
+/// records are collected in a block aligned with the file, written once it
+/// is full, into space allocated beyond the end of the file. A flush writes
+/// the partly filled block again from its start, so a power cut loses no
+/// more than the records since the last flush (see recoverLog).
+class LogWriter {
+public:
+    /// Default constructor
+    LogWriter();
+
+    /// Destructor
+    ~LogWriter();
+
+    /// Create the log file, and optionally its time index (see LogIndex).
+    /// Returns true for success.
+    bool open(
+        const std::string & fileName,
+        LogFormat format,
+        bool index = false
+    );
+
+    /// Close the log file
+    void close();
+
+    /// Is the log file open?
+    bool isOpen() const;
+
+    /// Write a line of text
+    void writeNote( const std::string & text );
+
+    /// Write a sample
+    void writeSample( const Sample & sample );
+
+    /// Write buffered records to the file
+    void flush();
+
+    /// Write buffered records and wait for them to reach the disk
+    void sync();
+
+    /// Have all writes succeeded so far?
+    bool good() const;
+
+    /// Returns the number of bytes written to the file
+    uint64_t getSize() const;
+
+private:
+    /// Copy constructor (unsupported)
+    LogWriter( const LogWriter & );
+
+    /// Assignment operator (unsupported)
+    LogWriter & operator = ( const LogWriter & );
+
+    /// Add data to the buffered block, writing each block when it is full
+    void write( const void *data, size_t size );
+
+    /// Write the current block to the file (allocating space as needed)
+    void writeBlock();
+
+private:
+    int       m_fd;             ///< Output file
+    LogFormat m_format;         ///< Log format
+    bool      m_good;           ///< Have all writes succeeded?
+    uint64_t  m_size;           ///< Bytes written
+
+    std::vector<uint8_t> m_block;   ///< Current block
+    size_t    m_fill;           ///< Bytes in the current block
+    uint64_t  m_blockOffset;    ///< File offset of the current block
+    size_t    m_written;        ///< Bytes of the current block in the file
+    uint64_t  m_allocated;      ///< Bytes allocated for the file
+    bool      m_allocate;       ///< Does the file system support allocation?
+
+    LogIndexWriter m_index;     ///< Time index
+};
+
+/// Release the space allocated beyond the end of a log which was not closed
+/// (for example after a power cut). The log keeps the records written up to
+/// the last flush. Returns false if the log can't be opened or truncated.
+bool recoverLog( const std::string & fileName );
+
+//-----------------------------------------------------------------------------
+
+/// Reads a session log written by LogWriter, in either format (the format
+/// is detected from the start of the file). Logs compressed with gzip are
+/// decompressed as they are read.
+class LogReader {
+public:
+    /// Record types
+    enum Record {
+        End,        ///< End of the log (or an unreadable record)
+        SampleRow,  ///< A sample
+        Note        ///< A line of text
+    };
+
+    /// Default constructor
+    LogReader();
+
+    /// Destructor
+    ~LogReader();
+
+    /// Open a log file. Returns true for success.
+    bool open( const std::string & fileName );
+
+    /// Returns the format of the open log
+    LogFormat getFormat() const;
+
+    /// Returns the offset in the (uncompressed) file of the next record
+    uint64_t getOffset() const;
+
+    /// Skip to the last indexed sample at or before the given time, using
+    /// the index of the log. Returns false (leaving the position unchanged)
+    /// if there is no index, or the time is before the first entry.
+    bool seek( double elapsed );
+
+    /// Read the next record, which is either a sample or a note
+    Record next( Sample & sample, std::string & note );
+
+private:
+    /// Copy constructor (unsupported)
+    LogReader( const LogReader & );
+
+    /// Assignment operator (unsupported)
+    LogReader & operator = ( const LogReader & );
+
+    /// Close the file
+    void close();
+
+    /// Read a block of data. Returns true for success.
+    bool read( void *data, size_t size );
+
+    /// Column layout of a binary log
+    struct Column {
+        uint8_t  type;      ///< Column type
+        uint32_t scale;     ///< Scale factor (stored value = value * scale)
+        int      field;     ///< Index of the sample field (or -1)
+    };
+
+    gzFile              m_in;       ///< Input file
+    std::string         m_fileName; ///< Input file name
+    LogFormat           m_format;   ///< Log format
+    size_t              m_size;     ///< Sample record size in bytes
+    std::vector<Column> m_columns;  ///< Columns in a binary log
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__telemetry_h
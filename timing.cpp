@@ -1,6 +1,9 @@
 #include "timing.h"
 #include <sys/time.h>
+#include <sys/timex.h>
 #include <time.h>
+#include <signal.h>
+#include <vector>
 
 //-----------------------------------------------------------------------------
 
@@ -12,44 +15,169 @@ static const clockid_t g_timingClockId = CLOCK_MONOTONIC_RAW;
 
 //-----------------------------------------------------------------------------
 
+namespace {
+
+/// Default clock source, using the hardware clock
+class RealClock : public ClockSource {
+public:
+    double now()
+    {
+        struct timespec now;
+        clock_gettime( g_timingClockId, &now );
+
+        return (double)now.tv_sec + (double)now.tv_nsec * 1.0E-9;
+    }
+
+    void sleep( double seconds )
+    {
+        struct timespec req, rem;
+
+        req.tv_sec  = (time_t)seconds;
+        req.tv_nsec = (long)((seconds - (double)req.tv_sec) * 1.0E9);
+
+        nanosleep( &req, &rem );
+    }
+
+    void delay( double seconds )
+    {
+        struct timeval now;
+        gettimeofday( &now, 0 );
+
+        unsigned us = (unsigned)(seconds * 1.0E6);
+        struct timeval delay, end;
+        delay.tv_sec  = us / 1000000 ;
+        delay.tv_usec = us % 1000000 ;
+        timeradd( &now, &delay, &end );
+
+        while ( timercmp( &now, &end, <) )
+            gettimeofday( &now, 0 );
+    }
+};
+
+/// The default clock source
+RealClock g_realClock;
+
+/// The current clock source
+ClockSource *g_clockSource = &g_realClock;
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+
 void delayms( unsigned ms )
 {
-	struct timespec req, rem;
+	g_clockSource->sleep( static_cast<double>(ms) * 1.0E-3 );
+}
+
+//-----------------------------------------------------------------------------
+
+void delayus ( unsigned us )
+{
+	g_clockSource->delay( static_cast<double>(us) * 1.0E-6 );
+}
 
-	req.tv_sec  = (time_t)(ms / 1000) ;
-  	req.tv_nsec = (long)(ms % 1000) * 1000000L;
+//-----------------------------------------------------------------------------
 
-  	nanosleep( &req, &rem );
+double getClock()
+{
+	return g_clockSource->now();
 }
 
 //-----------------------------------------------------------------------------
 
-void delayus ( unsigned us )
+double getWallClock()
 {
-  	struct timeval now;
-  	gettimeofday( &now, 0 );
+	return g_clockSource->wall();
+}
 
-	struct timeval delay, end;
-  	delay.tv_sec  = us / 1000000 ;
-  	delay.tv_usec = us % 1000000 ;
-  	timeradd( &now, &delay, &end );
+//-----------------------------------------------------------------------------
 
-  	while ( timercmp( &now, &end, <) )
-		gettimeofday( &now, 0 );
+bool isWallClockSynchronised()
+{
+	// the kernel clears STA_UNSYNC once a time server disciplines the clock
+	struct timex status;
+	status.modes = 0;
+	int state = adjtimex( &status );
+	return (state != -1) && (state != TIME_ERROR) && !(status.status & STA_UNSYNC);
 }
 
 //-----------------------------------------------------------------------------
 
-double getClock()
+double ClockSource::wall()
 {
 	struct timespec now;
-	clock_gettime( g_timingClockId, &now );
+	clock_gettime( CLOCK_REALTIME, &now );
 
 	return (double)now.tv_sec + (double)now.tv_nsec * 1.0E-9;
 }
 
 //-----------------------------------------------------------------------------
 
+void setClockSource( ClockSource *source )
+{
+    g_clockSource = (source != 0) ? source : &g_realClock;
+}
+
+//-----------------------------------------------------------------------------
+
+ClockSource & getClockSource()
+{
+    return *g_clockSource;
+}
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+/// size of the signal stack of each thread
+const size_t SIGNAL_STACK_SIZE = 64 * 1024;
+
+/// Signal stack of a thread, removed when the thread exits
+struct SignalStack {
+    std::vector<char> memory;   ///< The stack (empty if none)
+
+    ~SignalStack() {
+        if ( memory.empty() ) return;
+        stack_t none;
+        none.ss_sp = 0;
+        none.ss_size = 0;
+        none.ss_flags = SS_DISABLE;
+        sigaltstack( &none, 0 );
+    }
+};
+
+thread_local SignalStack t_signalStack;
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+
+bool setSignalStack()
+{
+    if ( !t_signalStack.memory.empty() ) return true;
+
+    t_signalStack.memory.resize( SIGNAL_STACK_SIZE );
+    stack_t alternate;
+    alternate.ss_sp = &t_signalStack.memory[0];
+    alternate.ss_size = t_signalStack.memory.size();
+    alternate.ss_flags = 0;
+    if ( sigaltstack( &alternate, 0 ) == 0 ) return true;
+
+    t_signalStack.memory.clear();
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+
+void joinThread( std::thread & thread )
+{
+    if ( !thread.joinable() ) return;
+    g_clockSource->detach();
+    thread.join();
+}
+
+//-----------------------------------------------------------------------------
+
 Timer::Timer()
 {
     reset();
@@ -3,12 +3,94 @@
 
 //-----------------------------------------------------------------------------
 
+#include <thread>
+#include <functional>
+#include <utility>
+
+//-----------------------------------------------------------------------------
+
 void delayms( unsigned ms );
 
 void delayus ( unsigned us );
 
 double getClock();
 
+/// Returns the wall clock time in seconds since the epoch, which (unlike
+/// getClock) may jump when the system time is set, for example by NTP
+double getWallClock();
+
+/// Is the system time synchronised to a time server?
+bool isWallClockSynchronised();
+
+//-----------------------------------------------------------------------------
+
+/// Source of time for getClock(), delayms(), delayus() and Timer. The default
+/// source uses the CLOCK_MONOTONIC_RAW hardware clock, and simulations can
+/// substitute an accelerated or virtual clock (see virtualclock.h).
+class ClockSource {
+public:
+    /// Destructor
+    virtual ~ClockSource() {}
+
+    /// Returns the current time in seconds
+    virtual double now() = 0;
+
+    /// Sleep for the given number of seconds
+    virtual void sleep( double seconds ) = 0;
+
+    /// Short delay for the given number of seconds (may busy-wait)
+    virtual void delay( double seconds ) { sleep( seconds ); }
+
+    /// Called by a thread which is about to start a worker thread
+    virtual void spawn() {}
+
+    /// Called by a worker thread as it starts running
+    virtual void attach() {}
+
+    /// Called by a worker thread before it exits, or before it blocks on
+    /// something other than the clock (such as joining another thread)
+    virtual void detach() {}
+
+    /// Returns the wall clock time in seconds since the epoch (by default,
+    /// the system time)
+    virtual double wall();
+};
+
+/// Select the clock source. This should be done before any worker threads
+/// are started. Passing a null pointer restores the default clock.
+void setClockSource( ClockSource *source );
+
+/// Returns the current clock source
+ClockSource & getClockSource();
+
+/// Give the calling thread a stack of its own for signal handlers, so that
+/// the crash handler (see Recorder::installCrashHandler) can run after a
+/// stack overflow. Threads started with startThread have one. The stack is
+/// freed when the thread exits. Returns true for success.
+bool setSignalStack();
+
+/// Start a worker thread which is registered with the clock source
+template<class Function, class... Args>
+std::thread startThread( Function && function, Args &&... args )
+{
+    ClockSource & source = getClockSource();
+    std::function<void()> call = std::bind(
+        std::forward<Function>(function), std::forward<Args>(args)...
+    );
+
+    source.spawn();
+    return std::thread( [&source, call]() {
+        setSignalStack();
+        source.attach();
+        call();
+        source.detach();
+    } );
+}
+
+/// Wait for a worker thread to finish. The calling thread is detached from
+/// the clock source first, as it will block until the worker exits.
+void joinThread( std::thread & thread );
+
 //-----------------------------------------------------------------------------
 
 /// Simple timer class
@@ -0,0 +1,215 @@
+#include "trace.h"
+#include "timing.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+/// number of events held by each thread (must be a power of two)
+const unsigned RING_SIZE = 4096;
+
+/// Trace event
+struct Event {
+    const char *name;       ///< Event name
+    double      time;       ///< Start time in seconds
+    double      duration;   ///< Duration in seconds (spans only)
+    unsigned    thread;     ///< Thread number
+    char        phase;      ///< 'X' for a span, or 'i' for an instant
+};
+
+/// An event in a ring buffer, with the number of the event it holds so that
+/// a reader can tell whether it was overwritten while being copied
+struct Slot {
+    std::atomic<uint64_t> sequence;     ///< Event number + 1 (zero if none)
+    Event                 event;        ///< Recorded event
+};
+
+/// Ring buffer of events, written by one thread at a time. Buffers are
+/// never freed: when a thread exits its buffer is reused by the next new
+/// thread, which keeps the events of short lived notification threads.
+struct Ring {
+    Slot                  slots[RING_SIZE];     ///< Recorded events
+    std::atomic<uint64_t> head;                 ///< Number of events written
+    bool                  inUse;                ///< Owned by a thread?
+};
+
+/// Thread names, by thread number
+struct ThreadName {
+    unsigned    thread;     ///< Thread number
+    const char *name;       ///< Thread name
+};
+
+/// All ring buffers, and thread names (protected by g_mutex)
+std::mutex g_mutex;
+std::vector<Ring*> g_rings;
+std::vector<ThreadName> g_names;
+
+/// Next thread number
+unsigned g_nextThread = 1;
+
+/// Per-thread state: the ring buffer is claimed on the first event
+struct ThreadState {
+    Ring    *ring;      ///< Ring buffer for this thread
+    unsigned thread;    ///< Thread number
+
+    ThreadState() : ring( 0 ), thread( 0 ) {}
+
+    ~ThreadState() {
+        if ( ring == 0 ) return;
+        std::lock_guard<std::mutex> lock( g_mutex );
+        ring->inUse = false;
+    }
+
+    /// Claim a ring buffer for the calling thread
+    void claim() {
+        std::lock_guard<std::mutex> lock( g_mutex );
+        thread = g_nextThread++;
+        for (size_t i=0; i<g_rings.size(); ++i) {
+            if ( !g_rings[i]->inUse ) {
+                ring = g_rings[i];
+                break;
+            }
+        }
+        if ( ring == 0 ) {
+            ring = new Ring;
+            for (unsigned i=0; i<RING_SIZE; ++i) ring->slots[i].sequence = 0;
+            ring->head = 0;
+            g_rings.push_back( ring );
+        }
+        ring->inUse = true;
+    }
+
+    /// Add an event to the ring buffer
+    void add( const char *name, double time, double duration, char phase ) {
+        if ( ring == 0 ) claim();
+
+        uint64_t head = ring->head.load( std::memory_order_relaxed );
+        Slot & slot = ring->slots[head & (RING_SIZE-1)];
+
+        slot.sequence.store( 0, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_release );
+
+        slot.event.name     = name;
+        slot.event.time     = time;
+        slot.event.duration = duration;
+        slot.event.thread   = thread;
+        slot.event.phase    = phase;
+
+        slot.sequence.store( head + 1, std::memory_order_release );
+        ring->head.store( head + 1, std::memory_order_release );
+    }
+};
+
+thread_local ThreadState t_state;
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+
+double Trace::now()
+{
+    return getClock();
+}
+
+//-----------------------------------------------------------------------------
+
+void Trace::instant( const char *name )
+{
+    t_state.add( name, getClock(), 0.0, 'i' );
+}
+
+//-----------------------------------------------------------------------------
+
+void Trace::complete( const char *name, double start )
+{
+    t_state.add( name, start, getClock() - start, 'X' );
+}
+
+//-----------------------------------------------------------------------------
+
+void Trace::setThreadName( const char *name )
+{
+    if ( t_state.ring == 0 ) t_state.claim();
+
+    std::lock_guard<std::mutex> lock( g_mutex );
+    ThreadName entry = { t_state.thread, name };
+    g_names.push_back( entry );
+}
+
+//-----------------------------------------------------------------------------
+
+bool Trace::write( const std::string & fileName )
+{
+    // copy the events, as the rings may be written while we read them
+    std::vector<Event> events;
+    std::vector<ThreadName> names;
+    {
+        std::lock_guard<std::mutex> lock( g_mutex );
+        names = g_names;
+        for (size_t r=0; r<g_rings.size(); ++r) {
+            const Ring & ring = *g_rings[r];
+            uint64_t head = ring.head.load( std::memory_order_acquire );
+            uint64_t first = (head > RING_SIZE) ? head - RING_SIZE : 0;
+            for (uint64_t i=first; i<head; ++i) {
+                const Slot & slot = ring.slots[i & (RING_SIZE-1)];
+                uint64_t sequence = slot.sequence.load( std::memory_order_acquire );
+                Event event = slot.event;
+
+                // discard the event if it was overwritten while we copied it
+                std::atomic_thread_fence( std::memory_order_acquire );
+                if ( (sequence != i + 1) ||
+                    (slot.sequence.load( std::memory_order_relaxed ) != sequence) )
+                    continue;
+                events.push_back( event );
+            }
+        }
+    }
+
+    FILE *file = fopen( fileName.c_str(), "w" );
+    if ( file == 0 ) return false;
+
+    fprintf( file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+
+    bool first = true;
+    for (size_t i=0; i<names.size(); ++i) {
+        fprintf(
+            file,
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+            "\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", names[i].thread, names[i].name
+        );
+        first = false;
+    }
+
+    for (size_t i=0; i<events.size(); ++i) {
+        const Event & event = events[i];
+        if ( event.phase == 'X' ) {
+            fprintf(
+                file,
+                "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                "\"ts\":%.1f,\"dur\":%.1f}",
+                first ? "" : ",\n", event.name, event.thread,
+                1.0E6 * event.time, 1.0E6 * event.duration
+            );
+        } else {
+            fprintf(
+                file,
+                "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,"
+                "\"tid\":%u,\"ts\":%.1f}",
+                first ? "" : ",\n", event.name, event.thread,
+                1.0E6 * event.time
+            );
+        }
+        first = false;
+    }
+
+    fprintf( file, "\n]}\n" );
+    return fclose( file ) == 0;
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,52 @@
+#ifndef __trace_h
+#define __trace_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+
+//-----------------------------------------------------------------------------
+
+/// Lightweight event tracing. Each thread records spans and instant events
+/// into its own fixed size ring buffer without locking, so the most recent
+/// events are always available. The rings can be written out at any time
+/// in the Chrome trace event format (JSON), which can be viewed with
+/// chrome://tracing or Perfetto. Event and thread names must be string
+/// literals, as only the pointers are stored.
+namespace Trace {
+
+/// Returns the current time stamp in seconds (from getClock)
+double now();
+
+/// Record an instant event
+void instant( const char *name );
+
+/// Record a span which started at the given time and ends now
+void complete( const char *name, double start );
+
+/// Name the calling thread in the trace
+void setThreadName( const char *name );
+
+/// Write all buffered events to a file as Chrome trace JSON. Returns true
+/// for success.
+bool write( const std::string & fileName );
+
+/// Records a span covering the lifetime of the object
+class Span {
+public:
+    /// Constructor: the span starts now
+    Span( const char *name ) : m_name( name ), m_start( now() ) {}
+
+    /// Destructor: the span ends now
+    ~Span() { complete( m_name, m_start ); }
+
+private:
+    const char *m_name;     ///< Event name
+    double      m_start;    ///< Start time in seconds
+};
+
+} // namespace Trace
+
+//-----------------------------------------------------------------------------
+
+#endif//__trace_h
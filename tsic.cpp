@@ -2,6 +2,10 @@
 #include <stdio.h>
 #include <unistd.h>
 #include "pigpiomgr.h"
+#include "timing.h"
+#include "hal.h"
+#include "trace.h"
+#include "recorder.h"
 using namespace std;
 
 //-----------------------------------------------------------------------------
@@ -24,7 +28,7 @@ using namespace std;
 // downloaded here:
 //     http://abyz.co.uk/rpi/pigpio/
 //
-// This version uses PIGPIOD via the pigpiod_if functions
+// This version uses PIGPIOD via the Hardware Abstraction Layer (see hal.h)
 //
 // Alternatively, there's a Kernel Module also available: tsic-kernel
 // which can be downloaded here:
@@ -64,7 +68,7 @@ static int parity8( int value )
 // Decode two 9-bit packets from the sensor, and return the temperature.
 // Returns either a fixed point integer temperature multiplied by SCALE_FACTOR,
 // or INVALID_TEMP in case of error
-static int tsicDecode( int packet0, int packet1 )
+int TSIC::tsicDecode( int packet0, int packet1 )
 {
     // strip off the parity bits (LSB)
     int parity0 = packet0 & 1;
@@ -140,11 +144,11 @@ bool TSIC::open( unsigned gpio )
         return false;
 
     // set the GPIO pin to be an input
-    if ( set_mode( gpio, PI_INPUT ) != 0 )
+    if ( !HAL::gpioSetMode( gpio, HAL::Input ) )
         return false;
 
     // set the GPIO pin pull up
-    set_pull_up_down( gpio, PI_PUD_UP );
+    HAL::gpioSetPull( gpio, HAL::PullUp );
 
     // local static function used to forward GPIO alerts to an
     // associated instance of the TSIC class
@@ -158,7 +162,9 @@ bool TSIC::open( unsigned gpio )
     };
 
     // set a function to receive events when the input changes state
-    m_callback = callback_ex( gpio, EITHER_EDGE, local::alertFunction, this );
+    m_callback = HAL::gpioCallback(
+        gpio, HAL::EitherEdge, local::alertFunction, this
+    );
     if ( m_callback < 0 ) {
         // note: in case of failure leaves GPIO pin set as input
         return false;
@@ -168,7 +174,7 @@ bool TSIC::open( unsigned gpio )
     bool success = false;
     for (int c=0; !success & (c<3); ++c) {
         // sample rate is 10Hz, so we need to wait at least 1/10th second
-        usleep( 100000 );
+        delayms( 100 );
         // attempt to read the value
         double value = 0.0;
         success = getDegrees(value);
@@ -177,7 +183,7 @@ bool TSIC::open( unsigned gpio )
     // did we receive some data?
     if ( !success) {
         // no: remove alert function and return false
-        callback_cancel( m_callback );
+        HAL::gpioCallbackCancel( m_callback );
         m_callback = -1;
         return false;
     }
@@ -199,7 +205,7 @@ void TSIC::close()
     if ( !m_open ) return;
 
     // remove the alert function
-    callback_cancel( m_callback );
+    HAL::gpioCallbackCancel( m_callback );
     m_callback = -1;
 
     // note: leaves the GPIO pin set as input
@@ -255,6 +261,8 @@ void TSIC::alertFunction(
         }
 
         if ( ++m_count == TSIC_BITS ) {
+            Trace::Span span( "tsic.decode" );
+
             // decode the packet
             int result = tsicDecode(
                 (m_word >> 10) & 0x1FF, // packet 0
@@ -276,6 +284,15 @@ void TSIC::alertFunction(
                     m_valid = false;
             }
 
+            // keep every reading (or the packet) for the flight recorder
+            if ( result != INVALID_TEMP )
+                Recorder::record(
+                    Recorder::Temperature, 0,
+                    static_cast<double>( result ) / static_cast<double>( SCALE_FACTOR )
+                );
+            else
+                Recorder::record( Recorder::SensorFault, 0, 0.0, m_word );
+
             // prepare to receive a new packet
             m_count = 0;
             m_word = 0;
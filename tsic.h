@@ -45,9 +45,16 @@ public:
     bool getDegrees( double & value ) const;
 
 private:
+    /// Microbenchmarks (bench.cpp) drive the alert function directly
+    friend class Bench;
+
     /// Alert function called when the GPIO pin changes state
     void alertFunction( int gpio, int level, uint32_t tick );
 
+    /// Decode two 9-bit packets from the sensor into a fixed point
+    /// temperature, or an invalid value in case of error
+    static int tsicDecode( int packet0, int packet1 );
+
 private:
     unsigned m_gpio;        ///< the GPIO pin used for the sensor
     bool     m_open;        ///< true if the sensor is open
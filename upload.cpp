@@ -0,0 +1,746 @@
+#include "upload.h"
+#include "retention.h"
+#include "timing.h"
+#include "trace.h"
+#include "telemetry.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <zlib.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+//-----------------------------------------------------------------------------
+
+// Upload protocol (version 1). All integers are little endian.
+//
+//   request:  "GUPL", u8 operation, u8 version, u16 name length, u64 offset,
+//             u32 data length, then the name and the data
+//   response: u8 status, 7 reserved bytes, u64 size of the file at the
+//             collector
+//
+// A query (operation 1) has no data and returns the size of the file. An
+// append (operation 2) writes the data if the offset is the size of the
+// file, and otherwise fails with the size, so that the uploader can resume
+// from there. An append at offset zero replaces the file, so that a file
+// which has been rewritten can be sent again from the start. Names are the host name of the machine, '/', and the name of
+// the file in its log directory.
+
+/// request signature
+static const char UPLOAD_MAGIC[4] = { 'G', 'U', 'P', 'L' };
+
+/// protocol version
+static const uint8_t UPLOAD_VERSION = 1;
+
+/// size of the fixed part of a request, and of a response, in bytes
+static const size_t REQUEST_SIZE = 20;
+static const size_t RESPONSE_SIZE = 16;
+
+/// largest batch accepted by the collector in bytes
+static const uint32_t MAX_BATCH = 16 * 1024 * 1024;
+
+/// longest name accepted by the collector
+static const size_t MAX_NAME = 255;
+
+/// operations
+enum Operation { QueryOperation = 1, AppendOperation = 2 };
+
+/// response status
+enum Status { StatusOk = 0, StatusMismatch = 1, StatusFailed = 2 };
+
+/// uploader state file, in the log directory (one line per file: the
+/// offset acknowledged by the collector, 1 if complete or 0, the name and
+/// the modification time of the file sent)
+static const char STATE_FILE[] = "upload-state.txt";
+
+/// files which are not protected, but were modified more recently than
+/// this (in seconds), may still be being written (such as shot logs)
+static const double CLOSE_DELAY = 10.0;
+
+/// network timeout in seconds
+static const int TIMEOUT = 10;
+
+/// I/O priority for the thread: the idle class (see ioprio_set(2))
+static const int IOPRIO_WHO_PROCESS = 1;
+static const int IOPRIO_IDLE = 3 << 13;
+
+//-----------------------------------------------------------------------------
+
+/// Store a little endian integer
+static void putInteger( uint8_t *p, uint64_t value, size_t size )
+{
+    for (size_t i=0; i<size; ++i)
+        p[i] = static_cast<uint8_t>( value >> (8*i) );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Load a little endian integer
+static uint64_t getInteger( const uint8_t *p, size_t size )
+{
+    uint64_t value = 0;
+    for (size_t i=0; i<size; ++i)
+        value |= static_cast<uint64_t>( p[i] ) << (8*i);
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Does the name end with the suffix?
+static bool endsWith( const std::string & name, const char *suffix )
+{
+    size_t length = strlen( suffix );
+    return
+        (name.size() >= length) &&
+        (name.compare( name.size() - length, length, suffix ) == 0);
+}
+
+//-----------------------------------------------------------------------------
+
+/// Is this a side file which is rewritten as a whole, rather than appended
+/// to (the loop report and trace on request and at exit, and the flight
+/// recorder, which is replaced at each dump)?
+static bool isRewritten( const std::string & name )
+{
+    return
+        endsWith( name, "-loops.txt" ) || endsWith( name, "-trace.json" ) ||
+        endsWith( name, "-flight.rec" );
+}
+
+//-----------------------------------------------------------------------------
+
+/// Send a buffer on a socket. Returns false on an error or a time out.
+static bool sendAll( int socket, const void *data, size_t size )
+{
+    const char *p = static_cast<const char*>( data );
+    while ( size > 0 ) {
+        ssize_t count = ::send( socket, p, size, MSG_NOSIGNAL );
+        if ( count < 0 ) {
+            if ( errno == EINTR ) continue;
+            return false;
+        }
+        p += count;
+        size -= static_cast<size_t>( count );
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Receive a buffer from a socket. A time out is retried while the run flag
+/// is set (or is an error if there is no flag). Returns false on an error,
+/// a time out or the end of the connection.
+static bool recvAll(
+    int socket,
+    void *data,
+    size_t size,
+    const std::atomic<bool> *run = 0
+) {
+    char *p = static_cast<char*>( data );
+    while ( size > 0 ) {
+        ssize_t count = ::recv( socket, p, size, 0 );
+        if ( count < 0 ) {
+            if ( errno == EINTR ) continue;
+            if ( (run != 0) && *run && ((errno == EAGAIN) || (errno == EWOULDBLOCK)) )
+                continue;
+            return false;
+        }
+        if ( count == 0 ) return false;
+        p += count;
+        size -= static_cast<size_t>( count );
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+/// Set the send and receive time outs of a socket
+static void setTimeout( int socket, int seconds )
+{
+    struct timeval timeout;
+    timeout.tv_sec = seconds;
+    timeout.tv_usec = 0;
+    setsockopt( socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+    setsockopt( socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout) );
+}
+
+//-----------------------------------------------------------------------------
+
+LogUploader::Policy::Policy() :
+    port( 0 ),
+    batchSize( 256 * 1024 ),
+    rate( 100000.0 ),
+    interval( 60.0 ),
+    active( false )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+LogUploader::LogUploader() :
+    m_socket( -1 ),
+    m_bytes( 0 ),
+    m_batches( 0 ),
+    m_files( 0 ),
+    m_failures( 0 ),
+    m_run( false )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+LogUploader::~LogUploader()
+{
+    stop();
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogUploader::start( const std::string & directory, const Policy & policy )
+{
+    stop();
+    if ( policy.host.empty() || (policy.port == 0) ) return false;
+
+    m_directory = directory;
+    if ( !m_directory.empty() && (m_directory[m_directory.size()-1] != '/') )
+        m_directory += '/';
+    m_policy = policy;
+    m_policy.batchSize = std::max<size_t>( 1, std::min<size_t>( m_policy.batchSize, MAX_BATCH ) );
+    m_buffer.resize( m_policy.batchSize );
+
+    // files are named after the machine at the collector
+    char host[256];
+    if ( gethostname( host, sizeof(host) ) != 0 ) strcpy( host, "gaggia" );
+    host[sizeof(host)-1] = '\0';
+    m_host = host;
+
+    loadState();
+
+    m_run = true;
+    m_thread = startThread( &LogUploader::worker, this );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogUploader::stop()
+{
+    m_run = false;
+    joinThread( m_thread );
+    disconnect();
+}
+
+//-----------------------------------------------------------------------------
+
+void LogUploader::protect( const std::string & fileName )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_protected.insert( fileName );
+}
+
+//-----------------------------------------------------------------------------
+
+void LogUploader::release( const std::string & fileName )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_protected.erase( fileName );
+}
+
+//-----------------------------------------------------------------------------
+
+LogUploader::Stats LogUploader::getStats() const
+{
+    Stats stats;
+    stats.bytes    = m_bytes;
+    stats.batches  = m_batches;
+    stats.files    = m_files;
+    stats.failures = m_failures;
+    return stats;
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogUploader::isProtected( const std::string & fileName ) const
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return m_protected.count( fileName ) > 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogUploader::worker()
+{
+    Trace::setThreadName( "upload" );
+
+    // this thread waits on the network, so it runs outside any lock-step
+    // simulation clock (see ClockSource::detach)
+    getClockSource().detach();
+
+    // uploads must not compete with the controller, so run this thread at
+    // the lowest CPU priority and in the idle I/O class (best effort)
+    pid_t tid = static_cast<pid_t>( syscall( SYS_gettid ) );
+    setpriority( PRIO_PROCESS, tid, 19 );
+    syscall( SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_IDLE );
+
+    double next = getClock();
+    while ( m_run ) {
+        if ( getClock() >= next ) {
+            if ( !scan() ) {
+                ++m_failures;
+                disconnect();
+            }
+            next = getClock() + m_policy.interval;
+        }
+        delayms( 200 );
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogUploader::scan()
+{
+    Trace::Span span( "upload.scan" );
+
+    // the files by the name they are sent by (without .gz)
+    struct File {
+        std::string path;       ///< Full path of the file to read
+        time_t      modified;   ///< Modification time
+        uint64_t    size;       ///< Size in bytes
+        bool        compressed; ///< Is the file compressed?
+    };
+    std::map<std::string, File> files;
+
+    DIR *dir = opendir( m_directory.c_str() );
+    if ( dir == 0 ) return true;
+    struct dirent *entry;
+    while ( (entry = readdir( dir )) != 0 ) {
+        std::string name( entry->d_name );
+        if ( !LogRetention::isLogFile( name ) ) continue;
+
+        File file;
+        file.path = m_directory + name;
+        struct stat info;
+        if ( (stat( file.path.c_str(), &info ) != 0) || !S_ISREG( info.st_mode ) )
+            continue;
+        file.modified = info.st_mtime;
+        file.size = static_cast<uint64_t>( info.st_size );
+        file.compressed = endsWith( name, ".gz" );
+        if ( file.compressed ) name.erase( name.size() - 3 );
+
+        // both exist while a file is being compressed: use the original
+        std::map<std::string, File>::iterator it = files.find( name );
+        if ( (it == files.end()) || !file.compressed ) files[name] = file;
+    }
+    closedir( dir );
+
+    // forget the files which have been deleted
+    bool changed = false;
+    for (std::map<std::string, Progress>::iterator it = m_progress.begin(); it != m_progress.end(); ) {
+        if ( files.count( it->first ) == 0 ) {
+            m_progress.erase( it++ );
+            changed = true;
+        } else
+            ++it;
+    }
+    if ( changed ) saveState();
+
+    // oldest first
+    std::vector< std::pair<time_t, std::string> > order;
+    for (std::map<std::string, File>::const_iterator it = files.begin(); it != files.end(); ++it)
+        order.push_back( std::make_pair( it->second.modified, it->first ) );
+    std::sort( order.begin(), order.end() );
+
+    time_t now = time( 0 );
+    for (size_t i=0; (i<order.size()) && m_run; ++i) {
+        const std::string & name = order[i].second;
+        const File & file = files[name];
+
+        // a file which has been rewritten since it was sent is sent again
+        // from the start (replacing the collector's copy)
+        Progress & progress = m_progress[name];
+        bool restart =
+            isRewritten( name ) && (file.modified != progress.modified) &&
+            (progress.complete || (progress.offset > 0));
+
+        // other side files (such as the event journal) may be appended to
+        // after a quiet spell, so a complete file is sent again if it grows
+        if (
+            !restart && progress.complete &&
+            (file.compressed || (file.size <= progress.offset))
+        ) continue;
+
+        // a file being written is only sent if asked for, and is complete
+        // once it has been closed and sent to the end
+        bool written = isProtected( m_directory + name );
+        bool closed = !written && (difftime( now, file.modified ) >= CLOSE_DELAY);
+        if ( !closed && !(written && m_policy.active) ) continue;
+
+        // the last block of a file being written is still to be extended,
+        // so only the whole blocks before it are sent
+        uint64_t limit = UINT64_MAX;
+        if ( !closed ) limit = file.size - file.size % LOG_BLOCK_SIZE;
+
+        // nothing new in an uncompressed file
+        if ( !file.compressed && (limit <= progress.offset) && !closed ) continue;
+
+        if ( !send( name, file.path, file.modified, limit, closed, restart ) )
+            return false;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogUploader::send(
+    const std::string & name,
+    const std::string & path,
+    time_t modified,
+    uint64_t limit,
+    bool closed,
+    bool restart
+) {
+    Trace::Span span( "upload.send" );
+
+    if ( !connect() ) return false;
+    const std::string remote( m_host + "/" + name );
+    Progress & progress = m_progress[name];
+
+    uint8_t request[REQUEST_SIZE];
+    uint8_t response[RESPONSE_SIZE];
+    memcpy( request, UPLOAD_MAGIC, sizeof(UPLOAD_MAGIC) );
+    request[5] = UPLOAD_VERSION;
+    putInteger( request + 6, remote.size(), 2 );
+
+    // the collector has the last word on how much it has, unless its copy
+    // is to be replaced
+    uint64_t offset = 0;
+    if ( !restart ) {
+        request[4] = QueryOperation;
+        putInteger( request + 8, 0, 8 );
+        putInteger( request + 16, 0, 4 );
+        if (
+            !sendAll( m_socket, request, sizeof(request) ) ||
+            !sendAll( m_socket, remote.data(), remote.size() ) ||
+            !recvAll( m_socket, response, sizeof(response) ) ||
+            (response[0] != StatusOk)
+        ) return false;
+        offset = getInteger( response + 8, 8 );
+    }
+
+    gzFile in = gzopen( path.c_str(), "rb" );
+    if ( in == 0 ) return true;     // deleted since the scan
+    gzbuffer( in, 65536 );
+
+    bool success = true;
+    bool end = false;
+    while ( success && m_run ) {
+        if ( gzseek( in, static_cast<z_off_t>( offset ), SEEK_SET ) < 0 ) {
+            // the collector has more than the file: nothing left to send
+            end = true;
+            break;
+        }
+        if ( offset >= limit ) {
+            end = true;
+            break;
+        }
+        size_t size = static_cast<size_t>(
+            std::min<uint64_t>( m_buffer.size(), limit - offset )
+        );
+        int count = gzread( in, &m_buffer[0], static_cast<unsigned>( size ) );
+        if ( count < 0 ) break;     // unreadable: try again next time
+        if ( count == 0 ) {
+            end = true;
+            break;
+        }
+
+        double start = getClock();
+        request[4] = AppendOperation;
+        putInteger( request + 8, offset, 8 );
+        putInteger( request + 16, static_cast<uint32_t>( count ), 4 );
+        success =
+            sendAll( m_socket, request, sizeof(request) ) &&
+            sendAll( m_socket, remote.data(), remote.size() ) &&
+            sendAll( m_socket, &m_buffer[0], static_cast<size_t>( count ) ) &&
+            recvAll( m_socket, response, sizeof(response) ) &&
+            (response[0] != StatusFailed);
+        if ( !success ) break;
+
+        // on a mismatch, carry on from what the collector has (the copy
+        // being replaced is only forgotten once the start has been sent)
+        offset = getInteger( response + 8, 8 );
+        progress.offset = offset;
+        progress.modified = modified;
+        if ( restart ) progress.complete = false;
+        restart = false;
+        saveState();
+        if ( response[0] == StatusOk ) {
+            m_bytes += static_cast<uint64_t>( count );
+            ++m_batches;
+        }
+
+        // keep to the maximum rate
+        if ( m_policy.rate > 0.0 ) {
+            double remain = count / m_policy.rate - (getClock() - start);
+            if ( remain > 0.0 ) delayms( static_cast<unsigned>( 1.0E3 * remain ) );
+        }
+    }
+    gzclose( in );
+
+    if ( success && end && closed && !progress.complete ) {
+        progress.offset = offset;
+        progress.complete = true;
+        ++m_files;
+        saveState();
+    }
+    return success;
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogUploader::connect()
+{
+    if ( m_socket >= 0 ) return true;
+
+    char port[16];
+    snprintf( port, sizeof(port), "%u", m_policy.port );
+
+    struct addrinfo hints;
+    memset( &hints, 0, sizeof(hints) );
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *addresses = 0;
+    if ( getaddrinfo( m_policy.host.c_str(), port, &hints, &addresses ) != 0 )
+        return false;
+
+    for (struct addrinfo *address = addresses; address != 0; address = address->ai_next) {
+        m_socket = socket( address->ai_family, address->ai_socktype, address->ai_protocol );
+        if ( m_socket < 0 ) continue;
+
+        // the send time out also limits the time taken to connect
+        setTimeout( m_socket, TIMEOUT );
+        if ( ::connect( m_socket, address->ai_addr, address->ai_addrlen ) == 0 ) break;
+
+        ::close( m_socket );
+        m_socket = -1;
+    }
+    freeaddrinfo( addresses );
+    return m_socket >= 0;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogUploader::disconnect()
+{
+    if ( m_socket >= 0 ) {
+        ::close( m_socket );
+        m_socket = -1;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void LogUploader::loadState()
+{
+    m_progress.clear();
+
+    std::ifstream in( (m_directory + STATE_FILE).c_str() );
+    std::string line;
+    while ( std::getline( in, line ) ) {
+        std::istringstream fields( line );
+        Progress progress;
+        std::string name;
+        if ( !(fields >> progress.offset >> progress.complete >> name) ) continue;
+
+        // older state files have no modification time
+        progress.modified = 0;
+        fields >> progress.modified;
+        m_progress[name] = progress;
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+void LogUploader::saveState()
+{
+    // replace the file, so that it is never seen half written
+    const std::string fileName( m_directory + STATE_FILE );
+    const std::string temporary( fileName + ".tmp" );
+    {
+        std::ofstream out( temporary.c_str() );
+        for (std::map<std::string, Progress>::const_iterator it = m_progress.begin(); it != m_progress.end(); ++it)
+            out << it->second.offset << ' ' << (it->second.complete ? 1 : 0) << ' ' << it->first << ' ' << it->second.modified << '\n';
+        if ( !out ) return;
+    }
+    rename( temporary.c_str(), fileName.c_str() );
+}
+
+//-----------------------------------------------------------------------------
+
+LogCollector::LogCollector() :
+    m_run( false )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogCollector::run( unsigned port, const std::string & directory, StopFunc stop )
+{
+    m_directory = directory;
+
+    int listener = socket( AF_INET, SOCK_STREAM, 0 );
+    if ( listener < 0 ) return false;
+
+    int reuse = 1;
+    setsockopt( listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse) );
+
+    struct sockaddr_in address;
+    memset( &address, 0, sizeof(address) );
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl( INADDR_ANY );
+    address.sin_port = htons( static_cast<uint16_t>( port ) );
+    if (
+        (bind( listener, reinterpret_cast<struct sockaddr*>( &address ), sizeof(address) ) != 0) ||
+        (listen( listener, 16 ) != 0)
+    ) {
+        ::close( listener );
+        return false;
+    }
+
+    // serve each connection on a thread of its own until asked to stop
+    m_run = true;
+    std::atomic<unsigned> connections( 0 );
+    while ( !stop() ) {
+        struct pollfd ready = { listener, POLLIN, 0 };
+        if ( poll( &ready, 1, 500 ) <= 0 ) continue;
+
+        int client = accept( listener, 0, 0 );
+        if ( client < 0 ) continue;
+
+        // short time outs, so that the threads notice when to stop
+        setTimeout( client, 1 );
+        ++connections;
+        std::thread( [this, client, &connections]() {
+            serve( client );
+            --connections;
+        } ).detach();
+    }
+
+    m_run = false;
+    while ( connections > 0 ) usleep( 100000 );
+    ::close( listener );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void LogCollector::serve( int socket )
+{
+    uint8_t request[REQUEST_SIZE];
+    std::vector<char> data;
+
+    while ( m_run && recvAll( socket, request, sizeof(request), &m_run ) ) {
+        uint8_t operation = request[4];
+        size_t nameLength = static_cast<size_t>( getInteger( request + 6, 2 ) );
+        uint64_t offset = getInteger( request + 8, 8 );
+        uint32_t dataLength = static_cast<uint32_t>( getInteger( request + 16, 4 ) );
+        if (
+            (memcmp( request, UPLOAD_MAGIC, sizeof(UPLOAD_MAGIC) ) != 0) ||
+            (request[5] != UPLOAD_VERSION) ||
+            (nameLength == 0) || (nameLength > MAX_NAME) ||
+            (dataLength > MAX_BATCH)
+        ) break;
+
+        std::string name( nameLength, '\0' );
+        data.resize( dataLength );
+        if (
+            !recvAll( socket, &name[0], nameLength, &m_run ) ||
+            ((dataLength > 0) && !recvAll( socket, &data[0], dataLength, &m_run ))
+        ) break;
+
+        // the name is a machine and a file name, with no other path
+        size_t slash = name.find( '/' );
+        bool valid =
+            (slash != std::string::npos) && (slash > 0) && (slash + 1 < name.size()) &&
+            (name.find( '/', slash + 1 ) == std::string::npos) &&
+            (name[0] != '.') && (name[slash + 1] != '.');
+
+        uint8_t status = StatusFailed;
+        uint64_t size = 0;
+        if ( valid && (operation == QueryOperation) ) {
+            struct stat info;
+            if ( stat( (m_directory + name).c_str(), &info ) == 0 )
+                size = static_cast<uint64_t>( info.st_size );
+            status = StatusOk;
+        } else if ( valid && (operation == AppendOperation) ) {
+            mkdir( (m_directory + name.substr( 0, slash )).c_str(), 0755 );
+            if ( append( name, offset, data, size ) )
+                status = StatusOk;
+            else if ( size != offset )
+                status = StatusMismatch;
+        }
+
+        uint8_t response[RESPONSE_SIZE];
+        memset( response, 0, sizeof(response) );
+        response[0] = status;
+        putInteger( response + 8, size, 8 );
+        if ( !sendAll( socket, response, sizeof(response) ) ) break;
+    }
+
+    ::close( socket );
+}
+
+//-----------------------------------------------------------------------------
+
+bool LogCollector::append(
+    const std::string & name,
+    uint64_t offset,
+    const std::vector<char> & data,
+    uint64_t & size
+) {
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    size = 0;
+    // an append at the start replaces the file
+    int flags = O_WRONLY | O_CREAT | O_APPEND;
+    if ( offset == 0 ) flags |= O_TRUNC;
+    int fd = ::open( (m_directory + name).c_str(), flags, 0644 );
+    if ( fd < 0 ) return false;
+
+    struct stat info;
+    bool success = (fstat( fd, &info ) == 0);
+    if ( success ) size = static_cast<uint64_t>( info.st_size );
+    success = success && (size == offset);
+
+    // the data is acknowledged once it is on the disk
+    const char *p = data.empty() ? 0 : &data[0];
+    size_t remain = data.size();
+    while ( success && (remain > 0) ) {
+        ssize_t count = ::write( fd, p, remain );
+        if ( count < 0 ) {
+            if ( errno == EINTR ) continue;
+            success = false;
+            break;
+        }
+        p += count;
+        remain -= static_cast<size_t>( count );
+        size += static_cast<uint64_t>( count );
+    }
+    success = success && (fdatasync( fd ) == 0);
+
+    ::close( fd );
+    return success;
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,193 @@
+#ifndef __upload_h
+#define __upload_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <inttypes.h>
+#include <time.h>
+
+//-----------------------------------------------------------------------------
+
+/// Copies the files in the log directory to a collector (see LogCollector)
+/// over TCP. A background thread, running at low CPU and I/O priority and
+/// limited to a maximum rate, periodically sends each closed log in large
+/// batches, oldest first. The collector appends each batch at the offset it
+/// was sent for and acknowledges it, and the acknowledged offsets are kept
+/// in a state file in the log directory, so that after a network failure or
+/// a restart the upload resumes where it stopped without sending anything
+/// twice. Side files which are rewritten (such as the flight recorder) are
+/// sent again whenever they change. Files are sent by their uncompressed
+/// name and content, whether or not LogRetention has since compressed them. Files which are still being
+/// written can optionally be sent as they grow, a whole block at a time (see
+/// LogWriter), so that the collector never receives a partly written block.
+class LogUploader {
+public:
+    /// Upload settings
+    struct Policy {
+        std::string host;       ///< Collector host name or address
+        unsigned    port;       ///< Collector TCP port
+        size_t      batchSize;  ///< Largest batch in bytes
+        double      rate;       ///< Maximum rate in bytes/s (0 for no limit)
+        double      interval;   ///< Time between scans of the directory in seconds
+        bool        active;     ///< Also send files which are still being written?
+
+        /// Default constructor: 256 KiB batches at up to 100 kB/s, every
+        /// minute, closed files only (the host must be set)
+        Policy();
+    };
+
+    /// Upload statistics
+    struct Stats {
+        uint64_t bytes;     ///< Bytes acknowledged by the collector
+        uint64_t batches;   ///< Batches acknowledged
+        uint64_t files;     ///< Files completed
+        uint64_t failures;  ///< Connection and protocol failures
+    };
+
+    /// Default constructor
+    LogUploader();
+
+    /// Destructor
+    ~LogUploader();
+
+    /// Start uploading the given directory. Returns false if no collector
+    /// has been given.
+    bool start( const std::string & directory, const Policy & policy );
+
+    /// Stop the background thread
+    void stop();
+
+    /// Mark a file as being written (given its full path)
+    void protect( const std::string & fileName );
+
+    /// Mark a file as closed (it may then be completed)
+    void release( const std::string & fileName );
+
+    /// Returns the statistics
+    Stats getStats() const;
+
+private:
+    /// Copy constructor (unsupported)
+    LogUploader( const LogUploader & );
+
+    /// Assignment operator (unsupported)
+    LogUploader & operator = ( const LogUploader & );
+
+    /// Progress of a file
+    struct Progress {
+        uint64_t offset;    ///< Bytes acknowledged by the collector
+        bool     complete;  ///< Has the whole (closed) file been sent?
+        time_t   modified;  ///< Modification time of the file sent
+    };
+
+    /// Background thread
+    void worker();
+
+    /// Send the files which have something new. Returns false if the
+    /// collector could not be reached.
+    bool scan();
+
+    /// Send the rest of a file (given the name it is sent by, the file to
+    /// read, its modification time and the number of bytes which are
+    /// final), or with restart the whole file, replacing the collector's
+    /// copy. Returns false on a connection or protocol failure.
+    bool send(
+        const std::string & name,
+        const std::string & path,
+        time_t modified,
+        uint64_t limit,
+        bool closed,
+        bool restart
+    );
+
+    /// Connect to the collector, if not already connected
+    bool connect();
+
+    /// Close the connection
+    void disconnect();
+
+    /// Read and write the state file
+    void loadState();
+    void saveState();
+
+    /// Is the file protected?
+    bool isProtected( const std::string & fileName ) const;
+
+private:
+    std::string m_directory;    ///< Log directory (ending in '/')
+    std::string m_host;         ///< Host name, used to name the files
+    Policy      m_policy;       ///< Upload settings
+    int         m_socket;       ///< Connection to the collector (or -1)
+
+    std::map<std::string, Progress> m_progress;     ///< Progress by name
+    std::set<std::string>            m_protected;   ///< Files being written
+    std::vector<char>                m_buffer;      ///< Batch buffer
+
+    std::atomic<uint64_t> m_bytes;      ///< Bytes acknowledged
+    std::atomic<uint64_t> m_batches;    ///< Batches acknowledged
+    std::atomic<uint64_t> m_files;      ///< Files completed
+    std::atomic<uint64_t> m_failures;   ///< Failures
+    std::atomic<bool>     m_run;        ///< Should the thread continue to run?
+
+    /// Thread used to send the files
+    std::thread m_thread;
+
+    /// Mutex to control access to the protected files
+    mutable std::mutex m_mutex;
+};
+
+//-----------------------------------------------------------------------------
+
+/// Receives files from LogUploader, over TCP. Each connection is served by
+/// a thread of its own, and the files are written under a directory, in a
+/// subdirectory for each machine.
+class LogCollector {
+public:
+    /// Function which returns true when the collector should stop
+    typedef std::function<bool()> StopFunc;
+
+    /// Default constructor
+    LogCollector();
+
+    /// Serve on a TCP port until the stop function returns true, writing the
+    /// files under a directory (ending with '/'). Returns false if the port
+    /// could not be opened.
+    bool run( unsigned port, const std::string & directory, StopFunc stop );
+
+private:
+    /// Copy constructor (unsupported)
+    LogCollector( const LogCollector & );
+
+    /// Assignment operator (unsupported)
+    LogCollector & operator = ( const LogCollector & );
+
+    /// Serve one connection
+    void serve( int socket );
+
+    /// Append data to a file if it is at the given offset (replacing the
+    /// file at offset zero). Returns the size of the file afterwards, and
+    /// whether the data was written.
+    bool append(
+        const std::string & name,
+        uint64_t offset,
+        const std::vector<char> & data,
+        uint64_t & size
+    );
+
+private:
+    std::string       m_directory;  ///< Directory for the files
+    std::atomic<bool> m_run;        ///< Should the connections continue?
+    std::mutex        m_mutex;      ///< Serialises the writes
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__upload_h
@@ -0,0 +1,199 @@
+#include "virtualclock.h"
+#include <time.h>
+
+//-----------------------------------------------------------------------------
+
+/// Returns the hardware clock time in seconds
+static double getRealTime()
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC_RAW, &now );
+
+	return (double)now.tv_sec + (double)now.tv_nsec * 1.0E-9;
+}
+
+//-----------------------------------------------------------------------------
+
+ScaledClock::ScaledClock( double speed ) :
+    m_speed( (speed > 0.0) ? speed : 1.0 ),
+    m_start( getRealTime() ),
+    m_wallStart( ClockSource::wall() )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+double ScaledClock::now()
+{
+    return m_start + (getRealTime() - m_start) * m_speed;
+}
+
+//-----------------------------------------------------------------------------
+
+void ScaledClock::sleep( double seconds )
+{
+    double real = seconds / m_speed;
+
+    struct timespec req, rem;
+    req.tv_sec  = (time_t)real;
+    req.tv_nsec = (long)((real - (double)req.tv_sec) * 1.0E9);
+
+    nanosleep( &req, &rem );
+}
+
+//-----------------------------------------------------------------------------
+
+void ScaledClock::delay( double seconds )
+{
+    double end = getRealTime() + seconds / m_speed;
+    while ( getRealTime() < end ) {}
+}
+
+//-----------------------------------------------------------------------------
+
+double ScaledClock::wall()
+{
+    return m_wallStart + (now() - m_start);
+}
+
+//-----------------------------------------------------------------------------
+
+VirtualClock::VirtualClock( double start ) :
+    m_time( start ),
+    m_start( start ),
+    m_wallStart( ClockSource::wall() ),
+    m_sequence( 0 ),
+    m_pending( 0 ),
+    m_running( false )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+double VirtualClock::now()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return m_time;
+}
+
+//-----------------------------------------------------------------------------
+
+double VirtualClock::wall()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return m_wallStart + (m_time - m_start);
+}
+
+//-----------------------------------------------------------------------------
+
+void VirtualClock::sleep( double seconds )
+{
+    std::unique_lock<std::mutex> lock( m_mutex );
+    const std::thread::id id = std::this_thread::get_id();
+    if ( seconds < 0.0 ) seconds = 0.0;
+
+    if ( m_registered.count( id ) == 0 ) {
+        // unregistered thread: if there are no registered threads to advance
+        // the clock, advance it directly
+        double target = m_time + seconds;
+        if ( m_registered.empty() && (m_pending == 0) ) {
+            m_time = target;
+            m_changed.notify_all();
+            return;
+        }
+
+        // otherwise wait for virtual time to pass
+        while ( m_time < target )
+            m_changed.wait( lock );
+        return;
+    }
+
+    // go to sleep, and let the next thread run
+    Participant participant = { m_time + seconds, m_sequence++ };
+    m_waiting[id] = participant;
+    if ( m_running && (m_owner == id) ) m_running = false;
+    schedule();
+
+    // wait until it is our turn again
+    waitTurn( lock );
+}
+
+//-----------------------------------------------------------------------------
+
+void VirtualClock::spawn()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    ++m_pending;
+}
+
+//-----------------------------------------------------------------------------
+
+void VirtualClock::attach()
+{
+    std::unique_lock<std::mutex> lock( m_mutex );
+    const std::thread::id id = std::this_thread::get_id();
+    if ( m_registered.count( id ) != 0 ) return;
+
+    // register the thread, ready to run at the current time
+    if ( m_pending > 0 ) --m_pending;
+    m_registered.insert( id );
+    Participant participant = { m_time, m_sequence++ };
+    m_waiting[id] = participant;
+    schedule();
+
+    // wait until it is our turn
+    waitTurn( lock );
+}
+
+//-----------------------------------------------------------------------------
+
+void VirtualClock::detach()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    const std::thread::id id = std::this_thread::get_id();
+    if ( m_registered.erase( id ) == 0 ) return;
+
+    m_waiting.erase( id );
+    if ( m_running && (m_owner == id) ) m_running = false;
+    schedule();
+
+    // unregistered sleepers may now be able to advance the clock
+    m_changed.notify_all();
+}
+
+//-----------------------------------------------------------------------------
+
+void VirtualClock::schedule()
+{
+    // wait while a thread is running, or a new thread is starting up
+    if ( m_running || (m_pending > 0) || m_waiting.empty() ) return;
+
+    // find the thread with the earliest wake up time
+    std::map<std::thread::id, Participant>::iterator next = m_waiting.begin();
+    std::map<std::thread::id, Participant>::iterator it = next;
+    for ( ++it; it != m_waiting.end(); ++it ) {
+        const Participant & a = it->second;
+        const Participant & b = next->second;
+        if ( (a.wake < b.wake) ||
+             ((a.wake == b.wake) && (a.sequence < b.sequence)) )
+            next = it;
+    }
+
+    // advance time and let it run
+    if ( next->second.wake > m_time ) m_time = next->second.wake;
+    m_owner = next->first;
+    m_running = true;
+    m_waiting.erase( next );
+    m_changed.notify_all();
+}
+
+//-----------------------------------------------------------------------------
+
+void VirtualClock::waitTurn( std::unique_lock<std::mutex> & lock )
+{
+    const std::thread::id id = std::this_thread::get_id();
+    while ( !(m_running && (m_owner == id)) )
+        m_changed.wait( lock );
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,99 @@
+#ifndef __virtualclock_h
+#define __virtualclock_h
+
+//-----------------------------------------------------------------------------
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "timing.h"
+
+//-----------------------------------------------------------------------------
+
+/// Clock which runs faster (or slower) than real time by a constant factor.
+/// Threads run freely, so results are not repeatable from run to run.
+class ScaledClock : public ClockSource {
+public:
+    /// Constructor, given the speed relative to real time
+    ScaledClock( double speed );
+
+    double now();
+
+    void sleep( double seconds );
+
+    void delay( double seconds );
+
+    /// Wall clock time, running at the same speed as the clock
+    double wall();
+
+private:
+    double m_speed;     ///< Speed relative to real time
+    double m_start;     ///< Real time at construction
+    double m_wallStart; ///< Wall clock time at construction
+};
+
+//-----------------------------------------------------------------------------
+
+/// Virtual clock with lock-step scheduling. Threads which are registered with
+/// the clock (the main thread, and worker threads started with startThread)
+/// run one at a time. When the running thread sleeps, virtual time advances
+/// immediately to the earliest wake-up time and that thread runs next, with
+/// ties broken by the order in which threads went to sleep. Simulations
+/// therefore run as fast as the CPU allows and are repeatable, provided that
+/// registered threads only block on the clock. Unregistered threads which
+/// sleep simply wait for virtual time to pass.
+class VirtualClock : public ClockSource {
+public:
+    /// Constructor, given the initial time in seconds
+    VirtualClock( double start = 0.0 );
+
+    double now();
+
+    void sleep( double seconds );
+
+    void spawn();
+
+    void attach();
+
+    void detach();
+
+    /// Wall clock time, running in step with the virtual time
+    double wall();
+
+private:
+    /// Registered thread
+    struct Participant {
+        double        wake;     ///< Time at which to wake
+        unsigned long sequence; ///< Order in which the thread went to sleep
+    };
+
+    /// Select the next thread to run (mutex must be locked)
+    void schedule();
+
+    /// Wait until the calling thread is selected to run
+    void waitTurn( std::unique_lock<std::mutex> & lock );
+
+private:
+    std::mutex              m_mutex;    ///< Mutex for all members
+    std::condition_variable m_changed;  ///< Signalled when the owner changes
+
+    double          m_time;         ///< Current virtual time in seconds
+    double          m_start;        ///< Initial virtual time
+    double          m_wallStart;    ///< Wall clock time at construction
+    unsigned long   m_sequence;     ///< Sequence number for next sleeper
+    unsigned        m_pending;      ///< Threads spawned but not yet attached
+    bool            m_running;      ///< Is a registered thread running?
+    std::thread::id m_owner;        ///< The registered thread that is running
+
+    /// Registered threads which are not running
+    std::map<std::thread::id, Participant> m_waiting;
+
+    /// Registered threads (running or not)
+    std::set<std::thread::id> m_registered;
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__virtualclock_h
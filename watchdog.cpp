@@ -0,0 +1,102 @@
+#include "watchdog.h"
+#include "loopmonitor.h"
+#include "timing.h"
+#include "trace.h"
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+
+Watchdog::Watchdog() :
+    m_timeout( 0.0 ),
+    m_trips( 0 ),
+    m_run( false )
+{
+}
+
+//-----------------------------------------------------------------------------
+
+Watchdog::~Watchdog()
+{
+    stop();
+}
+
+//-----------------------------------------------------------------------------
+
+Watchdog & Watchdog::watch( const std::string & loop )
+{
+    Loop entry = { loop, 0, 0.0, false };
+    m_loops.push_back( entry );
+    return *this;
+}
+
+//-----------------------------------------------------------------------------
+
+bool Watchdog::start( double timeout, TripFunc trip )
+{
+    if ( m_run || (timeout <= 0.0) ) return false;
+
+    m_timeout = timeout;
+    m_trip = trip;
+
+    // every loop has the whole timeout to make its first iteration
+    double now = getClock();
+    for (size_t i=0; i<m_loops.size(); ++i) {
+        m_loops[i].iterations = LoopMonitor::countIterations( m_loops[i].name );
+        m_loops[i].progress = now;
+        m_loops[i].tripped = false;
+    }
+
+    m_run = true;
+    m_thread = startThread( &Watchdog::worker, this );
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+void Watchdog::stop()
+{
+    if ( !m_run ) return;
+    m_run = false;
+    joinThread( m_thread );
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned Watchdog::getTrips() const
+{
+    return m_trips;
+}
+
+//-----------------------------------------------------------------------------
+
+void Watchdog::worker()
+{
+    Trace::setThreadName( "watchdog" );
+
+    // check several times per timeout, and often enough to stop promptly
+    const unsigned period = std::max( 1u, std::min( 100u,
+        static_cast<unsigned>( 250.0 * m_timeout )
+    ) );
+
+    while (m_run) {
+        double now = getClock();
+        for (size_t i=0; i<m_loops.size(); ++i) {
+            Loop & loop = m_loops[i];
+            uint64_t iterations = LoopMonitor::countIterations( loop.name );
+            if ( iterations != loop.iterations ) {
+                loop.iterations = iterations;
+                loop.progress = now;
+                loop.tripped = false;
+            } else if ( !loop.tripped && (now - loop.progress > m_timeout) ) {
+                loop.tripped = true;
+                ++m_trips;
+                Trace::instant( "watchdog.trip" );
+                if ( m_trip ) m_trip( loop.name );
+            }
+        }
+
+        delayms( period );
+    }
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,73 @@
+#ifndef __watchdog_h
+#define __watchdog_h
+
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <inttypes.h>
+
+//-----------------------------------------------------------------------------
+
+/// Watches the worker loops named by their LoopMonitor, and calls a function
+/// (on a thread of its own) when one of them has not completed an iteration
+/// within the timeout, for example because it is blocked on a device or a
+/// lock. The function is called once each time a loop stops, and the loop
+/// is watched again once it makes progress.
+class Watchdog {
+public:
+    /// Function called with the name of a loop which has stopped
+    typedef std::function<void(const std::string & loop)> TripFunc;
+
+    /// Default constructor
+    Watchdog();
+
+    /// Destructor
+    ~Watchdog();
+
+    /// Watch a loop, given the name of its LoopMonitor
+    Watchdog & watch( const std::string & loop );
+
+    /// Start watching, given the timeout in seconds. Returns true for
+    /// success.
+    bool start( double timeout, TripFunc trip );
+
+    /// Stop watching
+    void stop();
+
+    /// Returns the number of times the watchdog has tripped
+    unsigned getTrips() const;
+
+private:
+    /// Copy constructor (unsupported)
+    Watchdog( const Watchdog & );
+
+    /// Assignment operator (unsupported)
+    Watchdog & operator = ( const Watchdog & );
+
+    /// Worker thread which checks the loops
+    void worker();
+
+private:
+    /// State of a watched loop
+    struct Loop {
+        std::string name;       ///< Loop name
+        uint64_t    iterations; ///< Iterations when last checked
+        double      progress;   ///< Time at which the iterations last changed
+        bool        tripped;    ///< Has the watchdog tripped for this loop?
+    };
+
+    std::vector<Loop>     m_loops;      ///< Watched loops
+    double                m_timeout;    ///< Timeout in seconds
+    TripFunc              m_trip;       ///< Function called on a trip
+    std::atomic<unsigned> m_trips;      ///< Number of trips
+    std::atomic<bool>     m_run;        ///< Should the thread continue to run?
+    std::thread           m_thread;     ///< Thread which checks the loops
+};
+
+//-----------------------------------------------------------------------------
+
+#endif//__watchdog_h